@@ -3,36 +3,18 @@
 #include "CodalComponent.h"
 #include "I2C.h"
 #include "SPI.h"
+#include "ColorData.h"
+#include "LightSensorRegisters.h"
 
 namespace codal
 {
 
-    enum ColorFormat
-    {
-        RGB,
-        BGR,
-        RGBD,
-        BGRD,
-        W,
-        RGBW,
-        BGRW,
-        RGBWI //RGB + White + Infrared  , stored as RGBDW
-    };
-
-    struct ColorData
-    {
-        uint8_t r;
-        uint8_t g;
-        uint8_t b;
-        uint8_t d; // Optional brightness/depth
-        uint8_t w; // Optional Lux/Raw ADC/IR/UV index
-    };
     /**
      * @class CodalLightSensor
      * @brief A flexible light sensor interface supporting SPI and I2C communication.
      *        Supports multiple color formats including RGB, BGR, RGBD, and BGRD.
      */
-    class CodalLightSensor : public CodalComponent
+    class CodalLightSensor : public CodalComponent, public RegisterBus
     {
     private:
         I2C *i2c;           // Pointer to I2C bus (if used)
@@ -41,23 +23,67 @@ namespace codal
         ColorFormat format; // Current color format
         bool useSPI;        // True if using SPI, false if using I2C
         uint8_t dummybyte;  // Dummy byte used for SPI reads
+        uint8_t gain;             // Gain reported with each sample
+        uint32_t integrationTime; // Integration time (us) reported with each sample
+        LightSensorRegisterMap registers; // Shadowed configuration, once a profile is set
+
+        /**
+         * @brief Finds the step whose code is currently held in a register field.
+         */
+        static const ExposureStep *currentStep(uint8_t field, uint8_t mask, const ExposureStep *steps, uint8_t count)
+        {
+            for (uint8_t i = 0; i < count; i++)
+                if ((steps[i].code & mask) == field)
+                    return &steps[i];
+
+            return nullptr;
+        }
+
+        void refreshExposure()
+        {
+            const LightSensorProfile *p = registers.getProfile();
+            const ExposureStep *g = currentStep(registers.get(p->gainRegister) & p->gainMask, p->gainMask, p->gains, p->gainCount);
+            const ExposureStep *t = currentStep(registers.get(p->integrationRegister) & p->integrationMask, p->integrationMask,
+                                                p->integrationTimes, p->integrationCount);
+
+            setExposure(g ? g->value : 0, t ? t->value : 0);
+        }
+
+        /**
+         * @brief Assembles one channel of Bytes bytes from the raw bus buffer.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order, typename T>
+        static inline T channel(const uint8_t *buffer, int index)
+        {
+            static_assert(Bytes >= 1 && Bytes <= sizeof(T), "channel is wider than ColorData<T> can hold");
+
+            const uint8_t *p = buffer + index * Bytes;
+            uint32_t value = 0;
+            for (uint8_t i = 0; i < Bytes; i++)
+                value |= static_cast<uint32_t>(p[Order == ColorByteOrder::LSB_FIRST ? i : Bytes - 1 - i]) << (8 * i);
+
+            return static_cast<T>(value);
+        }
+
     public:
         /**
          * @brief Constructor for I2C-based light sensor.
          * @param i2cBus Reference to I2C bus
-         * @param addr I2C address of the sensor
+         * @param addr I2C address of the sensor, or 0 to use the address from setProfile()
          * @param fmt Desired color format (default: RGBD)
          */
 
         CodalLightSensor(I2C &i2cBus, uint8_t addr, ColorFormat fmt = RGBD)
-            : i2c(&i2cBus), spi(nullptr), address(addr), format(fmt), useSPI(false), dummyByte(0) {}
+            : i2c(&i2cBus), spi(nullptr), address(addr), format(fmt), useSPI(false), dummybyte(0),
+              gain(0), integrationTime(0) {}
         /**
          * @brief Constructor for SPI-based light sensor.
          * @param spiBus Reference to SPI bus
          * @param fmt Desired color format (default: RGBD)
          */
         CodalLightSensor(SPI &spiBus, ColorFormat fmt = RGBD)
-            : i2c(nullptr), spi(&spiBus), address(0), format(fmt), useSPI(true) {}
+            : i2c(nullptr), spi(&spiBus), address(0), format(fmt), useSPI(true), dummybyte(0),
+              gain(0), integrationTime(0) {}
         /**
          * @brief Sets the color format used when reading sensor data.
          * @param fmt New color format
@@ -83,56 +109,335 @@ namespace codal
                 return DEVICE_NOT_SUPPORTED; // I2C does not need this.
             }
         }
+        /**
+         * @brief Records the exposure the sensor has been configured with.
+         *        The values are copied into every subsequent sample; they do not touch the device.
+         * @param gain Analogue gain multiplier (1 = unity)
+         * @param integrationTimeUs Integration time in microseconds
+         */
+        void setExposure(uint8_t gain, uint32_t integrationTimeUs)
+        {
+            this->gain = gain;
+            this->integrationTime = integrationTimeUs;
+        }
+
+        uint8_t getGain() const
+        {
+            return gain;
+        }
+
+        uint32_t getIntegrationTime() const
+        {
+            return integrationTime;
+        }
+
+        /**
+         * @brief Reads consecutive device registers. reg is sent as-is (including any command bits).
+         * @return DEVICE_OK, or DEVICE_I2C_ERROR if the transfer failed.
+         */
+        virtual int readRegisters(uint8_t reg, uint8_t *data, int length) override
+        {
+            if (useSPI)
+            {
+                spi->write(reg);
+                spi->read(data, length);
+                return DEVICE_OK;
+            }
+
+            return i2c->readRegister(address, reg, data, length) == DEVICE_OK ? DEVICE_OK : DEVICE_I2C_ERROR;
+        }
+
+        /**
+         * @brief Writes consecutive device registers in a single transfer.
+         * @return DEVICE_OK, DEVICE_INVALID_PARAMETER if longer than LIGHTSENSOR_MAX_BURST,
+         *         or DEVICE_I2C_ERROR if the transfer failed.
+         */
+        virtual int writeRegisters(uint8_t reg, const uint8_t *data, int length) override
+        {
+            if (length > LIGHTSENSOR_MAX_BURST)
+                return DEVICE_INVALID_PARAMETER;
+
+            if (useSPI)
+            {
+                spi->write(reg);
+                for (int i = 0; i < length; i++)
+                    spi->write(data[i]);
+                return DEVICE_OK;
+            }
+
+            uint8_t buffer[LIGHTSENSOR_MAX_BURST + 1];
+            buffer[0] = reg;
+            memcpy(&buffer[1], data, length);
+
+            return i2c->write(address, buffer, length + 1) == DEVICE_OK ? DEVICE_OK : DEVICE_I2C_ERROR;
+        }
+
+        /**
+         * @brief Describes the attached sensor, enabling the register-level API below.
+         *        The color format is taken from the profile, its initWrites are written
+         *        and the sensor is powered on. An I2C sensor constructed with address 0
+         *        takes the profile's i2cAddress.
+         * @param profile e.g. LIGHTSENSOR_PROFILE_TCS34725
+         * @param sync true to read the current configuration back from the device rather
+         *        than assume it is fresh from reset.
+         * @return DEVICE_OK, or a bus error.
+         */
+        int setProfile(const LightSensorProfile &profile, bool sync = false)
+        {
+            if (!useSPI && address == 0)
+                address = profile.i2cAddress;
+
+            int result = registers.attach(*this, profile);
+
+            if (result == DEVICE_OK && sync)
+                result = registers.sync();
+
+            if (result == DEVICE_OK)
+                result = registers.stageInitWrites();
+
+            if (result != DEVICE_OK)
+                return result;
+
+            format = profile.dataFormat;
+            refreshExposure();
+
+            return setPower(true);
+        }
+
+        /**
+         * @brief The shadowed configuration registers, for settings without a dedicated method.
+         *        Staged writes go out on the next flush().
+         */
+        LightSensorRegisterMap &getRegisters()
+        {
+            return registers;
+        }
+
+        /**
+         * @brief Powers the sensor's ADC up or down.
+         * @return DEVICE_OK, DEVICE_INVALID_STATE if no profile is set, or a bus error.
+         */
+        int setPower(bool on)
+        {
+            const LightSensorProfile *p = registers.getProfile();
+            if (p == nullptr)
+                return DEVICE_INVALID_STATE;
+
+            registers.setField(p->powerRegister, p->powerMask, on ? p->powerOnValue : 0);
+            return registers.flush();
+        }
+
+        /**
+         * @brief Selects one of the profile's gain steps.
+         * @param step Index into the profile's gains, lowest first.
+         * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, DEVICE_INVALID_STATE if no profile is set, or a bus error.
+         */
+        int setGainStep(uint8_t step)
+        {
+            const LightSensorProfile *p = registers.getProfile();
+            if (p == nullptr)
+                return DEVICE_INVALID_STATE;
+            if (step >= p->gainCount)
+                return DEVICE_INVALID_PARAMETER;
+
+            registers.setField(p->gainRegister, p->gainMask, p->gains[step].code);
+            gain = p->gains[step].value;
+            return registers.flush();
+        }
+
+        /**
+         * @brief Selects one of the profile's integration time steps.
+         * @param step Index into the profile's integrationTimes, shortest first.
+         * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, DEVICE_INVALID_STATE if no profile is set, or a bus error.
+         */
+        int setIntegrationStep(uint8_t step)
+        {
+            const LightSensorProfile *p = registers.getProfile();
+            if (p == nullptr)
+                return DEVICE_INVALID_STATE;
+            if (step >= p->integrationCount)
+                return DEVICE_INVALID_PARAMETER;
+
+            registers.setField(p->integrationRegister, p->integrationMask, p->integrationTimes[step].code);
+            integrationTime = p->integrationTimes[step].value;
+            return registers.flush();
+        }
+
+        /**
+         * @brief Number of channels the sensor delivers for a given format.
+         * @return channel count, or 0 if the format is unknown.
+         */
+        static constexpr int channelCount(ColorFormat fmt)
+        {
+            return (fmt == W) ? 1 : (fmt == RGB || fmt == BGR) ? 3 : (fmt == RGBWI) ? 5 : (fmt <= DRGB) ? 4 : 0;
+        }
+
         /**
          * @brief Reads color data from the sensor and maps it to the selected format.
          *        Supports RGB, BGR, RGBD, and BGRD formats. If the format is invalid or unsupported,
          *        the method returns DEVICE_PERIPHERAL_ERROR.
          *
+         *        Only sensors with 8-bit channels fit ColorData<>; with a profile of wider
+         *        channels, use read<Bytes>() into a ColorData of matching width.
+         *
          * @param out Reference to ColorData struct to store the result.
-         * @return DEVICE_OK if successful, DEVICE_PERIPHERAL_ERROR if format is unknown.
+         * @return DEVICE_OK if successful, DEVICE_PERIPHERAL_ERROR if format is unknown,
+         *         DEVICE_INVALID_PARAMETER if the profile's channels are wider than 8 bits.
          */
-        int read(ColorData &out)
+        int read(ColorData<> &out)
         {
-            uint8_t buffer[5] = {0};
+            return read<1>(out);
+        }
 
-            if (useSPI)
+        /**
+         * @brief Reads native-width channels from the sensor in a single bus transfer.
+         *
+         * All channels of the current format are fetched in one burst of
+         * channelCount(format) * Bytes bytes and assembled in the given byte order.
+         * For example, a TCS34725 delivers 16-bit little-endian channels:
+         *
+         * @code
+         * ColorData<uint16_t> sample;
+         * sensor.read<2>(sample);
+         * @endcode
+         *
+         * @tparam Bytes width of each channel on the bus (1 to 4). Once a profile is set
+         *         this must match its channelBytes.
+         * @tparam Order byte order of each channel on the bus.
+         * @param out Reference to ColorData struct to store the result.
+         * @return DEVICE_OK if successful, DEVICE_PERIPHERAL_ERROR if format is unknown,
+         *         DEVICE_INVALID_PARAMETER if Bytes differs from the profile's channel width,
+         *         DEVICE_I2C_ERROR if the bus transfer failed.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename T>
+        int read(ColorData<T> &out)
+        {
+            if (registers.isAttached() && registers.getProfile()->channelBytes != Bytes)
+                return DEVICE_INVALID_PARAMETER;
+
+            uint8_t buffer[LIGHTSENSOR_MAX_CHANNELS * Bytes];
+            int result = readRaw(buffer, sampleSize(Bytes));
+
+            if (result < 0)
+                return result;
+
+            return decode<Bytes, Order>(buffer, out);
+        }
+
+        /**
+         * @brief Reads a run of samples, decoding each straight into the caller's storage.
+         *
+         * Any output iterator over ColorData<T> works, so a sample can land directly in a
+         * ring slot, a flash page buffer or a network payload without intermediate copies:
+         *
+         * @code
+         * struct LogRecord { uint32_t time; ColorData<uint16_t> sample; } page[32];
+         * sensor.read<2>(ColorDataSpan<uint16_t>(&page[0].sample, 32, sizeof(LogRecord)));
+         * @endcode
+         *
+         * @return the number of samples read, or an error if the first read failed.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename OutputIt>
+        int read(OutputIt first, OutputIt last)
+        {
+            int count = 0;
+
+            for (; first != last; ++first, ++count)
+            {
+                int result = read<Bytes, Order>(*first);
+                if (result != DEVICE_OK)
+                    return count ? count : result;
+            }
+
+            return count;
+        }
+
+        /**
+         * @brief Reads out.size() samples into a (possibly strided) span of caller storage.
+         * @return the number of samples read, or an error if the first read failed.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename T>
+        int read(ColorDataSpan<T> out)
+        {
+            return read<Bytes, Order>(out.begin(), out.end());
+        }
+
+        /**
+         * @brief Bytes in one raw sample of the current format.
+         * @param channelBytes Width of each channel on the bus.
+         */
+        int sampleSize(int channelBytes = 1) const
+        {
+            return channelCount(format) * channelBytes;
+        }
+
+        /**
+         * @brief Transfers one undecoded sample (sampleSize() bytes) from the sensor into
+         *        the caller's buffer, e.g. directly into an outgoing packet payload.
+         * @param data Destination.
+         * @param length Bytes to read; normally sampleSize(channelBytes).
+         * @return length if successful, DEVICE_PERIPHERAL_ERROR if the format is unknown,
+         *         or a bus error.
+         */
+        int readRaw(uint8_t *data, int length)
+        {
+            if (length <= 0)
+                return DEVICE_PERIPHERAL_ERROR;
+
+            if (registers.isAttached())
+            {
+                int result = registers.read(registers.getProfile()->dataRegister, data, length);
+                if (result != DEVICE_OK)
+                    return result;
+            }
+            else if (useSPI)
             {
                 spi->write(this->dummybyte); // Dummy command
-                spi->read(buffer, sizeof(buffer));
+                spi->read(data, length);
             }
-            else
+            else if (i2c->read(address, data, length) != DEVICE_OK)
             {
-                i2c->read(address, buffer, sizeof(buffer));
+                return DEVICE_I2C_ERROR;
             }
 
+            return length;
+        }
+
+        /**
+         * @brief Maps a raw channel buffer onto a ColorData according to the current format.
+         * @return DEVICE_OK if successful, DEVICE_PERIPHERAL_ERROR if format is unknown.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename T>
+        int decode(const uint8_t *buffer, ColorData<T> &out) const
+        {
             switch (format)
             {
             case RGB:
-                out.r = buffer[0];
-                out.g = buffer[1];
-                out.b = buffer[2];
+                out.r = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.b = channel<Bytes, Order, T>(buffer, 2);
                 out.d = 0;
                 out.w = 0;
                 break;
             case BGR:
-                out.b = buffer[0];
-                out.g = buffer[1];
-                out.r = buffer[2];
+                out.b = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.r = channel<Bytes, Order, T>(buffer, 2);
                 out.d = 0;
                 out.w = 0;
                 break;
             case RGBD:
-                out.r = buffer[0];
-                out.g = buffer[1];
-                out.b = buffer[2];
-                out.d = buffer[3];
+                out.r = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.b = channel<Bytes, Order, T>(buffer, 2);
+                out.d = channel<Bytes, Order, T>(buffer, 3);
                 out.w = 0;
                 break;
             case BGRD:
-                out.b = buffer[0];
-                out.g = buffer[1];
-                out.r = buffer[2];
-                out.d = buffer[3];
+                out.b = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.r = channel<Bytes, Order, T>(buffer, 2);
+                out.d = channel<Bytes, Order, T>(buffer, 3);
                 out.w = 0;
                 break;
             case W:
@@ -140,39 +445,47 @@ namespace codal
                 out.g = 0;
                 out.b = 0;
                 out.d = 0;
-                out.w = buffer[0];
+                out.w = channel<Bytes, Order, T>(buffer, 0);
                 break;
             case RGBW:
-                out.r = buffer[0];
-                out.g = buffer[1];
-                out.b = buffer[2];
+                out.r = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.b = channel<Bytes, Order, T>(buffer, 2);
                 out.d = 0;
-                out.w = 0;
-                out.w = buffer[3];
+                out.w = channel<Bytes, Order, T>(buffer, 3);
                 break;
             case RGBWI:
-                out.r = buffer[0];
-                out.g = buffer[1];
-                out.b = buffer[2];
-                out.d = buffer[3];
-                out.w = buffer[4];
+                out.r = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.b = channel<Bytes, Order, T>(buffer, 2);
+                out.d = channel<Bytes, Order, T>(buffer, 3);
+                out.w = channel<Bytes, Order, T>(buffer, 4);
                 break;
             case BGRW:
-                out.b = buffer[0];
-                out.g = buffer[1];
-                out.r = buffer[2];
+                out.b = channel<Bytes, Order, T>(buffer, 0);
+                out.g = channel<Bytes, Order, T>(buffer, 1);
+                out.r = channel<Bytes, Order, T>(buffer, 2);
                 out.d = 0;
+                out.w = channel<Bytes, Order, T>(buffer, 3);
+                break;
+            case DRGB:
+                out.d = channel<Bytes, Order, T>(buffer, 0);
+                out.r = channel<Bytes, Order, T>(buffer, 1);
+                out.g = channel<Bytes, Order, T>(buffer, 2);
+                out.b = channel<Bytes, Order, T>(buffer, 3);
                 out.w = 0;
-                out.w = buffer[3];
                 break;
             default:
                 return DEVICE_PERIPHERAL_ERROR;
             }
 
+            out.gain = gain;
+            out.integrationTime = integrationTime;
+
             return DEVICE_OK;
         }
     };
 
 } // namespace codal
 
-typedef CODAL_LIGHTSENSOR codal::CodalLightSensor;
+typedef codal::CodalLightSensor CODAL_LIGHTSENSOR;
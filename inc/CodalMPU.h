@@ -2,7 +2,68 @@
 #define CODAL_MPU_H
 
 #include "stdint.h"
+
+// MPU architecture: PMSAv7 (Armv7-M, Armv6-M) or PMSAv8 (Armv8-M). Detected from the
+// compiler's target; define it to 1 when building for the host emulation of PMSAv8.
+#ifndef CODAL_MPU_PMSAV8
+#if defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8M_BASE__) || defined(__ARM_ARCH_8_1M_MAIN__)
+#define CODAL_MPU_PMSAV8 1
+#else
+#define CODAL_MPU_PMSAV8 0
+#endif
+#endif
+
+#if defined(CODAL_MPU_HOST)
+#include "CodalMPUHost.h"
+#else
 #include "cmsis.h" // or your MCU's CMSIS core header
+#endif
+
+#if CODAL_MPU_PMSAV8
+/*
+ * Regions are described everywhere (MPUPlanner, MPUProfile, ...) by their Armv7-M
+ * RBAR / RASR values, and CodalMPU::writeRegion() translates them to RBAR / RLAR.
+ * The Armv8-M core headers lack these field definitions, so they are given here.
+ */
+#define MPU_RBAR_ADDR_Pos 5U
+#define MPU_RBAR_ADDR_Msk (0x7FFFFFFUL << MPU_RBAR_ADDR_Pos)
+#define MPU_RBAR_VALID_Pos 4U
+#define MPU_RBAR_VALID_Msk (1UL << MPU_RBAR_VALID_Pos)
+#define MPU_RBAR_REGION_Pos 0U
+#define MPU_RBAR_REGION_Msk (0xFUL << MPU_RBAR_REGION_Pos)
+
+#define MPU_RASR_ATTRS_Pos 16U
+#define MPU_RASR_ATTRS_Msk (0xFFFFUL << MPU_RASR_ATTRS_Pos)
+#define MPU_RASR_XN_Pos 28U
+#define MPU_RASR_XN_Msk (1UL << MPU_RASR_XN_Pos)
+#define MPU_RASR_AP_Pos 24U
+#define MPU_RASR_AP_Msk (0x7UL << MPU_RASR_AP_Pos)
+#define MPU_RASR_TEX_Pos 19U
+#define MPU_RASR_TEX_Msk (0x7UL << MPU_RASR_TEX_Pos)
+#define MPU_RASR_S_Pos 18U
+#define MPU_RASR_S_Msk (1UL << MPU_RASR_S_Pos)
+#define MPU_RASR_C_Pos 17U
+#define MPU_RASR_C_Msk (1UL << MPU_RASR_C_Pos)
+#define MPU_RASR_B_Pos 16U
+#define MPU_RASR_B_Msk (1UL << MPU_RASR_B_Pos)
+#define MPU_RASR_SRD_Pos 8U
+#define MPU_RASR_SRD_Msk (0xFFUL << MPU_RASR_SRD_Pos)
+#define MPU_RASR_SIZE_Pos 1U
+#define MPU_RASR_SIZE_Msk (0x1FUL << MPU_RASR_SIZE_Pos)
+#define MPU_RASR_ENABLE_Pos 0U
+#define MPU_RASR_ENABLE_Msk (1UL << MPU_RASR_ENABLE_Pos)
+
+/*
+ * MAIR attribute indices, one per MPUMemoryType:
+ *   0 Device-nGnRnE (strongly ordered)   3 Normal write-back, read-allocate
+ *   1 Device-nGnRE                       4 Normal non-cacheable
+ *   2 Normal write-through, read-allocate 5 Normal write-back, read/write-allocate
+ */
+#define CODAL_MPU_MAIR0 0xEEAA0400UL
+#define CODAL_MPU_MAIR1 0x0000FF44UL
+#endif
+
+#include "CodalVectorTable.h"
 
 namespace codal
 {
@@ -50,30 +111,52 @@ namespace codal
         SIZE_4GB
     };
 
+    /**
+     * Memory types for regions, as TEX[2:0]:C:B (Armv7-M ARM B3.5.7). Normal memory
+     * types are cached in the same way inside and outside the core.
+     */
+    enum class MPUMemoryType : uint8_t
+    {
+        STRONGLY_ORDERED = 0x00,          // TEX 000 C0 B0: every access in order, always shareable
+        DEVICE = 0x01,                    // TEX 000 C0 B1: peripherals, shareable
+        WRITE_THROUGH = 0x02,             // TEX 000 C1 B0: no write allocate
+        WRITE_BACK = 0x03,                // TEX 000 C1 B1: no write allocate
+        NORMAL_NON_CACHEABLE = 0x04,      // TEX 001 C0 B0: DMA buffers
+        WRITE_BACK_WRITE_ALLOCATE = 0x07  // TEX 001 C1 B1: hot data
+    };
+
     enum class MPU_STATE : uint8_t {
         // the MPU is okay.
         MPU_OK,
         // the wanted operation is not allowed by the MPU
         MPU_OPERATION_NOT_ALLOWED,
-        MPU_UNKOWN_PERMISSON_ACCESS
+        MPU_UNKOWN_PERMISSON_ACCESS,
+        // a size, address or count is out of range
+        MPU_INVALID_PARAMETER,
+        // the request needs more regions than the MPU has
+        MPU_NO_REGIONS
     };
 
     class CodalMPU
     {
     public:
-        static inline int enable(bool privilegedDefault = true)
+        static inline MPU_STATE enable(bool privilegedDefault = true)
         {
-            if (this->isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED}
+            if (isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;}
             __DMB();
-            MPU->CTRL = (privilegedDefault ? 0 : MPU_CTRL_PRIVDEFENA_Msk) | MPU_CTRL_ENABLE_Msk;
+#if CODAL_MPU_PMSAV8
+            MPU->MAIR0 = CODAL_MPU_MAIR0;
+            MPU->MAIR1 = CODAL_MPU_MAIR1;
+#endif
+            MPU->CTRL = (privilegedDefault ? MPU_CTRL_PRIVDEFENA_Msk : 0) | MPU_CTRL_ENABLE_Msk;
             __DSB();
             __ISB();
             return MPU_STATE::MPU_OK;
         }
 
-        static inline int disable()
+        static inline MPU_STATE disable()
         {
-            if (this->isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED} 
+            if (isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;}
             MPU->CTRL = 0;
             __DSB();
             __ISB();
@@ -85,39 +168,256 @@ namespace codal
             return (MPU->CTRL & MPU_CTRL_ENABLE_Msk) != 0;
         }
 
-        static inline int configureRegion(uint8_t regionNumber, uint32_t baseAddress, MPURegionSize size,
+        /**
+         * Builds the RASR value of a region. srd holds the subregion disable bits
+         * (bit n disables the n-th eighth; regions of 256 bytes and up only).
+         */
+        static inline uint32_t encodeRASR(MPURegionSize size, MPUAccessPermission access, bool executable = true,
+                                          bool shareable = false, bool cacheable = false, bool bufferable = false,
+                                          uint8_t srd = 0)
+        {
+            return (static_cast<uint32_t>(access) << MPU_RASR_AP_Pos) |
+                   (static_cast<uint32_t>(size) << MPU_RASR_SIZE_Pos) |
+                   (static_cast<uint32_t>(srd) << MPU_RASR_SRD_Pos) |
+                   (executable ? 0 : MPU_RASR_XN_Msk) |
+                   (shareable ? MPU_RASR_S_Msk : 0) |
+                   (cacheable ? MPU_RASR_C_Msk : 0) |
+                   (bufferable ? MPU_RASR_B_Msk : 0) |
+                   MPU_RASR_ENABLE_Msk;
+        }
+
+        /**
+         * The TEX, S, C and B bits of RASR for a memory type.
+         */
+        static inline uint32_t encodeAttributes(MPUMemoryType type, bool shareable = false)
+        {
+            uint32_t t = static_cast<uint32_t>(type);
+
+            return ((t >> 2) << MPU_RASR_TEX_Pos) |
+                   ((t & 0x2) ? MPU_RASR_C_Msk : 0) |
+                   ((t & 0x1) ? MPU_RASR_B_Msk : 0) |
+                   (shareable ? MPU_RASR_S_Msk : 0);
+        }
+
+        /**
+         * Builds the RASR value of a region of the given memory type.
+         */
+        static inline uint32_t encodeRASR(MPURegionSize size, MPUAccessPermission access, MPUMemoryType type,
+                                          bool executable = false, bool shareable = false, uint8_t srd = 0)
+        {
+            return encodeRASR(size, access, executable, false, false, false, srd) | encodeAttributes(type, shareable);
+        }
+
+        /**
+         * Configures one region. srd is as for encodeRASR(); on PMSAv8 the enabled
+         * subregions must be contiguous (see translate()), or MPU_INVALID_PARAMETER
+         * is returned and the region is not touched.
+         */
+        static inline MPU_STATE configureRegion(uint8_t regionNumber, uint32_t baseAddress, MPURegionSize size,
                                            MPUAccessPermission access, bool executable = true,
-                                           bool shareable = false, bool cacheable = false, bool bufferable = false)
+                                           bool shareable = false, bool cacheable = false, bool bufferable = false,
+                                           uint8_t srd = 0)
         {
             if (access == MPUAccessPermission::RESERVED) {
                 return MPU_STATE::MPU_UNKOWN_PERMISSON_ACCESS;
             }
-            if (this->isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED}
+            if (isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;}
+            uint32_t rasr = encodeRASR(size, access, executable, shareable, cacheable, bufferable, srd);
+#if CODAL_MPU_PMSAV8
+            if (isContiguous(rasr) == false) {return MPU_STATE::MPU_INVALID_PARAMETER;}
+#endif
+            writeRegion(regionNumber, baseAddress, rasr);
+            __DSB();
+            __ISB();
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Protects [address, address + length) with one region. On PMSAv8 any 32-byte
+         * aligned range will do; on PMSAv7 the range must be a naturally aligned power
+         * of two (use MPUPlanner for anything else).
+         */
+        static inline MPU_STATE configureRange(uint8_t regionNumber, uint32_t address, uint32_t length,
+                                               MPUAccessPermission access,
+                                               MPUMemoryType type = MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE,
+                                               bool executable = false, bool shareable = false)
+        {
+            if (access == MPUAccessPermission::RESERVED)
+                return MPU_STATE::MPU_UNKOWN_PERMISSON_ACCESS;
+            if (isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+            if (length < 32 || ((address | length) & 31) || (uint64_t)address + length > (1ULL << 32))
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+#if CODAL_MPU_PMSAV8
+            uint32_t rasr = encodeRASR(MPURegionSize::SIZE_32B, access, type, executable, shareable);
+
             MPU->RNR = regionNumber;
-            MPU->RBAR = baseAddress & MPU_RBAR_ADDR_Msk;
+            MPU->RBAR = encodeRBAR(address, rasr);
+            MPU->RLAR = encodeRLAR(address + (length - 1), rasr);
+#else
+            uint8_t bits = 5;
 
-            uint32_t rasr = (static_cast<uint32_t>(access) << MPU_RASR_AP_Pos) |
-                            (static_cast<uint32_t>(size) << MPU_RASR_SIZE_Pos) |
-                            (executable ? 0 : MPU_RASR_XN_Msk) |
-                            (shareable ? MPU_RASR_S_Msk : 0) |
-                            (cacheable ? MPU_RASR_C_Msk : 0) |
-                            (bufferable ? MPU_RASR_B_Msk : 0) |
-                            MPU_RASR_ENABLE_Msk;
+            while (bits < 32 && (1ULL << bits) < length)
+                bits++;
+            if ((1ULL << bits) != length || (address & (length - 1)))
+                return MPU_STATE::MPU_INVALID_PARAMETER;
 
-            MPU->RASR = rasr;
+            writeRegion(regionNumber, address,
+                        encodeRASR(static_cast<MPURegionSize>(bits - 1), access, type, executable, shareable));
+#endif
             __DSB();
             __ISB();
             return MPU_STATE::MPU_OK;
         }
 
-        static inline int setSVCHandler(void (*handler)(void))
+#if CODAL_MPU_PMSAV8
+        /**
+         * The PMSAv8 RBAR value for an address and the access of a PMSAv7 RASR value.
+         * PMSAv8 has no access level without reads, so NO_ACCESS becomes privileged
+         * read-only and never executable: unprivileged code is still kept out, but
+         * privileged code can read. PRIV_RW_UNPRIV_RO has no equivalent either and
+         * becomes privileged read-write: unprivileged code loses its reads, and
+         * privileged code keeps its writes.
+         */
+        static inline uint32_t encodeRBAR(uint32_t address, uint32_t rasr)
+        {
+            static const uint8_t ap[8] = {2, 0, 0, 1, 2, 2, 3, 3}; // Indexed by the PMSAv7 AP field
+            uint32_t access = (rasr & MPU_RASR_AP_Msk) >> MPU_RASR_AP_Pos;
+            bool xn = (rasr & MPU_RASR_XN_Msk) || access == static_cast<uint32_t>(MPUAccessPermission::NO_ACCESS);
+
+            return (address & MPU_RBAR_BASE_Msk) | ((rasr & MPU_RASR_S_Msk) ? 3UL << MPU_RBAR_SH_Pos : 0) |
+                   ((uint32_t)ap[access] << MPU_RBAR_AP_Pos) | (xn ? MPU_RBAR_XN_Msk : 0);
+        }
+
+        /**
+         * The PMSAv8 RLAR value for the last byte of a region and the memory type of a PMSAv7 RASR value.
+         */
+        static inline uint32_t encodeRLAR(uint32_t last, uint32_t rasr)
+        {
+            // TEX:C:B to the MAIR indices of CODAL_MPU_MAIR0 / 1. TEX 1xx gives the inner policy in C:B.
+            static const uint8_t index[32] = {0, 1, 2, 3, 4, 4, 0, 5, 1, 1, 1, 1, 0, 0, 0, 0,
+                                              4, 5, 2, 3, 4, 5, 2, 3, 4, 5, 2, 3, 4, 5, 2, 3};
+            uint32_t type = (rasr & (MPU_RASR_TEX_Msk | MPU_RASR_C_Msk | MPU_RASR_B_Msk)) >> MPU_RASR_B_Pos;
+
+            type = ((type >> 3) << 2) | (type & 3); // Drop S, which sits between TEX and C
+            return (last & MPU_RLAR_LIMIT_Msk) | ((uint32_t)index[type] << MPU_RLAR_AttrIndx_Pos) | MPU_RLAR_EN_Msk;
+        }
+
+        /**
+         * Whether the enabled subregions of a PMSAv7 RASR value form a single run, so
+         * that one PMSAv8 base / limit pair covers exactly them. An SRD with a hole
+         * (e.g. 0x3C) is not. Regions below 256 bytes have no subregions.
+         */
+        static inline bool isContiguous(uint32_t rasr)
+        {
+            uint32_t size = (rasr & MPU_RASR_SIZE_Msk) >> MPU_RASR_SIZE_Pos;
+            uint32_t enabled = size >= 7 ? ~(rasr >> MPU_RASR_SRD_Pos) & 0xFF : 0xFF;
+
+            if (enabled == 0)
+                return true;
+            enabled /= enabled & (0U - enabled); // Shift the lowest enabled subregion down to bit 0
+            return (enabled & (enabled + 1)) == 0;
+        }
+
+        /**
+         * Translates a PMSAv7 RBAR / RASR pair to PMSAv8 RBAR / RLAR. If last is non-zero
+         * the region runs from the RBAR address to last, and SIZE and SRD are ignored
+         * (MPUPlanner's exact regions). Otherwise it becomes the span from its first to
+         * its last enabled subregion. RLAR is 0 if nothing is enabled, and also if the
+         * enabled subregions are not contiguous, which PMSAv8 cannot express: false is
+         * then returned and the region is left disabled rather than widened.
+         */
+        static inline bool translate(uint32_t rbar, uint32_t rasr, uint32_t last, uint32_t &base, uint32_t &limit)
+        {
+            uint64_t size = 2ULL << ((rasr & MPU_RASR_SIZE_Msk) >> MPU_RASR_SIZE_Pos);
+            uint64_t start = rbar & MPU_RBAR_ADDR_Msk & ~(size - 1);
+            uint64_t end = start + size;
+            uint8_t enabled = size >= 256 ? ~(rasr >> MPU_RASR_SRD_Pos) & 0xFF : 0xFF;
+
+            base = 0;
+            limit = 0;
+            if (!(rasr & MPU_RASR_ENABLE_Msk))
+                return true;
+
+            if (last)
+            {
+                start = rbar & MPU_RBAR_ADDR_Msk;
+                end = (uint64_t)last + 1;
+            }
+            else if (enabled == 0)
+                return true;
+            else if (!isContiguous(rasr))
+                return false;
+            else if (size >= 256)
+            {
+                uint8_t firstSub = 0, lastSub = 7;
+
+                while (!(enabled & (1 << firstSub)))
+                    firstSub++;
+                while (!(enabled & (1 << lastSub)))
+                    lastSub--;
+                end = start + (lastSub + 1) * (size / 8);
+                start += firstSub * (size / 8);
+            }
+
+            base = encodeRBAR((uint32_t)start, rasr);
+            limit = encodeRLAR((uint32_t)(end - 1), rasr);
+            return true;
+        }
+#endif
+
+        /**
+         * Writes a region's raw RBAR / RASR values, without barriers: call sync()
+         * once after the last of a group of writes. On PMSAv8 they are translated
+         * to RBAR / RLAR, with last as in translate(); PMSAv7 ignores last.
+         */
+        static inline void writeRegion(uint8_t regionNumber, uint32_t rbar, uint32_t rasr, uint32_t last = 0)
+        {
+#if CODAL_MPU_PMSAV8
+            uint32_t base, limit;
+
+            translate(rbar, rasr, last, base, limit);
+            MPU->RNR = regionNumber;
+            MPU->RBAR = base;
+            MPU->RLAR = limit;
+#else
+            (void)last;
+            MPU->RNR = regionNumber;
+            MPU->RBAR = rbar & MPU_RBAR_ADDR_Msk;
+            MPU->RASR = rasr;
+#endif
+        }
+
+        /**
+         * Disables a region.
+         */
+        static inline void clearRegion(uint8_t regionNumber)
+        {
+            MPU->RNR = regionNumber;
+#if CODAL_MPU_PMSAV8
+            MPU->RLAR = 0;
+#else
+            MPU->RASR = 0;
+#endif
+        }
+
+        /**
+         * Makes preceding MPU writes take effect for the next instruction.
+         */
+        static inline void sync()
         {
-            if (this->isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED}
-            constexpr uint32_t SVC_VECTOR_INDEX = 11; // SVC is exception #11
-            uint32_t *vectorTable = reinterpret_cast<uint32_t *>(SCB->VTOR);
-            vectorTable[SVC_VECTOR_INDEX] = reinterpret_cast<uint32_t>(handler);
             __DSB();
             __ISB();
+        }
+
+        static inline MPU_STATE setSVCHandler(void (*handler)(void))
+        {
+            if (isPrivileged() == false) {return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;}
+            // Fails if CODAL_VECTOR_TABLE_ENTRIES is smaller than the device's table
+            if (VectorTable::relocate() == false) {return MPU_STATE::MPU_INVALID_PARAMETER;}
+            VectorTable::set(VectorTable::SVC_EXCEPTION, handler);
+            __ISB();
             return MPU_STATE::MPU_OK;
         }
 
@@ -0,0 +1,673 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file CodalMPUHost.h
+ * @brief Host emulation of the Armv7-M (or Armv8-M) MPU, for running MPU code off-target.
+ *
+ * Define CODAL_MPU_HOST before including CodalMPU.h and this header stands in for
+ * the target's CMSIS core header: MPU, SCB, SCnSCB, DWT, CoreDebug and the barrier /
+ * CONTROL intrinsics are backed by host objects instead of memory-mapped registers.
+ *
+ * The MPU registers are proxies, so a store has the same side effects as on
+ * silicon: writing RBAR with VALID set also selects the region (RNR), and the
+ * RBAR_An / RASR_An aliases reach the same region registers as RBAR / RASR.
+ * Register writes and barriers are counted, and MPUHost::check() resolves an
+ * access the way the MPU would (highest matching region, subregion disables,
+ * AP and XN bits, PRIVDEFENA background), so a configuration can be verified
+ * byte by byte.
+ *
+ * With CODAL_MPU_PMSAV8 set the MPU is the Armv8-M one instead (core_cm33.h): RBAR /
+ * RLAR base-limit regions, MAIR0 / MAIR1, and RBAR_An / RLAR_An aliases that reach
+ * region (RNR & ~3) + n. An address that falls in more than one enabled region
+ * faults, as PMSAv8 requires.
+ */
+
+// Register field definitions, as in CMSIS core_cm3.h / core_cm4.h / core_cm7.h.
+
+#define MPU_TYPE_DREGION_Pos 8U
+#define MPU_TYPE_DREGION_Msk (0xFFUL << MPU_TYPE_DREGION_Pos)
+
+#define MPU_CTRL_PRIVDEFENA_Pos 2U
+#define MPU_CTRL_PRIVDEFENA_Msk (1UL << MPU_CTRL_PRIVDEFENA_Pos)
+#define MPU_CTRL_HFNMIENA_Pos 1U
+#define MPU_CTRL_HFNMIENA_Msk (1UL << MPU_CTRL_HFNMIENA_Pos)
+#define MPU_CTRL_ENABLE_Pos 0U
+#define MPU_CTRL_ENABLE_Msk (1UL << MPU_CTRL_ENABLE_Pos)
+
+#define MPU_RNR_REGION_Pos 0U
+#define MPU_RNR_REGION_Msk (0xFFUL << MPU_RNR_REGION_Pos)
+
+#if CODAL_MPU_PMSAV8
+
+#define MPU_RBAR_BASE_Pos 5U
+#define MPU_RBAR_BASE_Msk (0x7FFFFFFUL << MPU_RBAR_BASE_Pos)
+#define MPU_RBAR_SH_Pos 3U
+#define MPU_RBAR_SH_Msk (0x3UL << MPU_RBAR_SH_Pos)
+#define MPU_RBAR_AP_Pos 1U
+#define MPU_RBAR_AP_Msk (0x3UL << MPU_RBAR_AP_Pos)
+#define MPU_RBAR_XN_Pos 0U
+#define MPU_RBAR_XN_Msk (1UL << MPU_RBAR_XN_Pos)
+
+#define MPU_RLAR_LIMIT_Pos 5U
+#define MPU_RLAR_LIMIT_Msk (0x7FFFFFFUL << MPU_RLAR_LIMIT_Pos)
+#define MPU_RLAR_AttrIndx_Pos 1U
+#define MPU_RLAR_AttrIndx_Msk (0x7UL << MPU_RLAR_AttrIndx_Pos)
+#define MPU_RLAR_EN_Pos 0U
+#define MPU_RLAR_EN_Msk (1UL << MPU_RLAR_EN_Pos)
+
+#else
+
+#define MPU_RBAR_ADDR_Pos 5U
+#define MPU_RBAR_ADDR_Msk (0x7FFFFFFUL << MPU_RBAR_ADDR_Pos)
+#define MPU_RBAR_VALID_Pos 4U
+#define MPU_RBAR_VALID_Msk (1UL << MPU_RBAR_VALID_Pos)
+#define MPU_RBAR_REGION_Pos 0U
+#define MPU_RBAR_REGION_Msk (0xFUL << MPU_RBAR_REGION_Pos)
+
+#define MPU_RASR_ATTRS_Pos 16U
+#define MPU_RASR_ATTRS_Msk (0xFFFFUL << MPU_RASR_ATTRS_Pos)
+#define MPU_RASR_XN_Pos 28U
+#define MPU_RASR_XN_Msk (1UL << MPU_RASR_XN_Pos)
+#define MPU_RASR_AP_Pos 24U
+#define MPU_RASR_AP_Msk (0x7UL << MPU_RASR_AP_Pos)
+#define MPU_RASR_TEX_Pos 19U
+#define MPU_RASR_TEX_Msk (0x7UL << MPU_RASR_TEX_Pos)
+#define MPU_RASR_S_Pos 18U
+#define MPU_RASR_S_Msk (1UL << MPU_RASR_S_Pos)
+#define MPU_RASR_C_Pos 17U
+#define MPU_RASR_C_Msk (1UL << MPU_RASR_C_Pos)
+#define MPU_RASR_B_Pos 16U
+#define MPU_RASR_B_Msk (1UL << MPU_RASR_B_Pos)
+#define MPU_RASR_SRD_Pos 8U
+#define MPU_RASR_SRD_Msk (0xFFUL << MPU_RASR_SRD_Pos)
+#define MPU_RASR_SIZE_Pos 1U
+#define MPU_RASR_SIZE_Msk (0x1FUL << MPU_RASR_SIZE_Pos)
+#define MPU_RASR_ENABLE_Pos 0U
+#define MPU_RASR_ENABLE_Msk (1UL << MPU_RASR_ENABLE_Pos)
+
+#endif
+
+#define CONTROL_nPRIV_Msk 1UL
+
+#define SCB_SHCSR_MEMFAULTENA_Pos 16U
+#define SCB_SHCSR_MEMFAULTENA_Msk (1UL << SCB_SHCSR_MEMFAULTENA_Pos)
+
+#define SCB_CFSR_MEMFAULTSR_Pos 0U
+#define SCB_CFSR_MEMFAULTSR_Msk (0xFFUL << SCB_CFSR_MEMFAULTSR_Pos)
+#define SCB_CFSR_MMARVALID_Msk (1UL << 7U)
+#define SCB_CFSR_MLSPERR_Msk (1UL << 5U)
+#define SCB_CFSR_MSTKERR_Msk (1UL << 4U)
+#define SCB_CFSR_MUNSTKERR_Msk (1UL << 3U)
+#define SCB_CFSR_DACCVIOL_Msk (1UL << 1U)
+#define SCB_CFSR_IACCVIOL_Msk (1UL << 0U)
+
+#define DWT_CTRL_CYCCNTENA_Pos 0U
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << DWT_CTRL_CYCCNTENA_Pos)
+#define SCB_AIRCR_VECTKEY_Pos 16U
+#define SCB_AIRCR_VECTKEY_Msk (0xFFFFUL << SCB_AIRCR_VECTKEY_Pos)
+#define SCB_AIRCR_SYSRESETREQ_Pos 2U
+#define SCB_AIRCR_SYSRESETREQ_Msk (1UL << SCB_AIRCR_SYSRESETREQ_Pos)
+
+#define SCnSCB_ICTR_INTLINESNUM_Pos 0U
+#define SCnSCB_ICTR_INTLINESNUM_Msk (0xFUL << SCnSCB_ICTR_INTLINESNUM_Pos)
+
+#define CoreDebug_DEMCR_TRCENA_Pos 24U
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << CoreDebug_DEMCR_TRCENA_Pos)
+
+namespace codal
+{
+
+#define MPU_HOST_REGIONS 8
+
+    class MPUHost;
+
+    /**
+     * Kinds of access resolved by MPUHost::check().
+     */
+    enum class MPUHostAccess : uint8_t
+    {
+        READ,
+        WRITE,
+        EXECUTE
+    };
+
+    /**
+     * One memory-mapped MPU register. Reads and writes go through MPUHost, which
+     * applies the register's side effects.
+     */
+    class MPUHostRegister
+    {
+    private:
+        MPUHost *mpu;
+        uint8_t id;
+
+    public:
+        MPUHostRegister(MPUHost *owner, uint8_t registerId) : mpu(owner), id(registerId) {}
+        MPUHostRegister(const MPUHostRegister &) = delete;
+
+        inline operator uint32_t() const;
+        inline MPUHostRegister &operator=(uint32_t value);
+
+        MPUHostRegister &operator=(const MPUHostRegister &other)
+        {
+            return *this = static_cast<uint32_t>(other);
+        }
+
+        MPUHostRegister &operator|=(uint32_t value)
+        {
+            return *this = static_cast<uint32_t>(*this) | value;
+        }
+
+        MPUHostRegister &operator&=(uint32_t value)
+        {
+            return *this = static_cast<uint32_t>(*this) & value;
+        }
+    };
+
+#if CODAL_MPU_PMSAV8
+
+    /**
+     * The emulated Armv8-M MPU (with the same register names as CMSIS MPU_Type in
+     * core_cm33.h), plus the core state the MPU code touches.
+     */
+    class MPUHost
+    {
+    public:
+        enum : uint8_t
+        {
+            REG_TYPE,
+            REG_CTRL,
+            REG_RNR,
+            REG_RBAR,
+            REG_RLAR,
+            REG_RBAR_A1,
+            REG_RLAR_A1,
+            REG_RBAR_A2,
+            REG_RLAR_A2,
+            REG_RBAR_A3,
+            REG_RLAR_A3,
+            REG_MAIR0,
+            REG_MAIR1
+        };
+
+        MPUHostRegister TYPE, CTRL, RNR, RBAR, RLAR;
+        MPUHostRegister RBAR_A1, RLAR_A1, RBAR_A2, RLAR_A2, RBAR_A3, RLAR_A3;
+        MPUHostRegister MAIR0, MAIR1;
+
+        uint32_t ctrl;
+        uint32_t rnr;
+        uint32_t rbar[MPU_HOST_REGIONS];
+        uint32_t rlar[MPU_HOST_REGIONS];
+        uint32_t mair[2];
+
+        uint32_t control;   // CONTROL register; nPRIV (bit 0) set = unprivileged thread mode
+        uint32_t writes;    // MPU register writes
+        uint32_t barriers;  // __DSB / __ISB / __DMB executed
+
+        MPUHost()
+            : TYPE(this, REG_TYPE), CTRL(this, REG_CTRL), RNR(this, REG_RNR), RBAR(this, REG_RBAR), RLAR(this, REG_RLAR),
+              RBAR_A1(this, REG_RBAR_A1), RLAR_A1(this, REG_RLAR_A1), RBAR_A2(this, REG_RBAR_A2),
+              RLAR_A2(this, REG_RLAR_A2), RBAR_A3(this, REG_RBAR_A3), RLAR_A3(this, REG_RLAR_A3),
+              MAIR0(this, REG_MAIR0), MAIR1(this, REG_MAIR1)
+        {
+            reset();
+        }
+
+        MPUHost(const MPUHost &) = delete;
+
+        /**
+         * Returns the MPU to its reset state (disabled, all regions cleared, privileged).
+         */
+        void reset()
+        {
+            ctrl = 0;
+            rnr = 0;
+            memset(rbar, 0, sizeof(rbar));
+            memset(rlar, 0, sizeof(rlar));
+            memset(mair, 0, sizeof(mair));
+            control = 0;
+            resetCounters();
+        }
+
+        void resetCounters()
+        {
+            writes = 0;
+            barriers = 0;
+        }
+
+        /**
+         * The region a register reaches: RNR for RBAR / RLAR, (RNR & ~3) + n for the aliases.
+         */
+        uint32_t regionOf(uint8_t id) const
+        {
+            uint32_t alias = id >= REG_RBAR_A1 && id <= REG_RLAR_A3 ? (id - REG_RBAR) / 2 : 0;
+            return alias ? ((rnr & ~3UL) + alias) % MPU_HOST_REGIONS : rnr;
+        }
+
+        uint32_t read(uint8_t id) const
+        {
+            switch (id)
+            {
+            case REG_TYPE:
+                return MPU_HOST_REGIONS << MPU_TYPE_DREGION_Pos;
+            case REG_CTRL:
+                return ctrl;
+            case REG_RNR:
+                return rnr;
+            case REG_RBAR:
+            case REG_RBAR_A1:
+            case REG_RBAR_A2:
+            case REG_RBAR_A3:
+                return rbar[regionOf(id)];
+            case REG_RLAR:
+            case REG_RLAR_A1:
+            case REG_RLAR_A2:
+            case REG_RLAR_A3:
+                return rlar[regionOf(id)];
+            case REG_MAIR0:
+                return mair[0];
+            case REG_MAIR1:
+                return mair[1];
+            }
+            return 0;
+        }
+
+        void write(uint8_t id, uint32_t value)
+        {
+            writes++;
+
+            switch (id)
+            {
+            case REG_CTRL:
+                ctrl = value & (MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_HFNMIENA_Msk | MPU_CTRL_ENABLE_Msk);
+                break;
+            case REG_RNR:
+                rnr = value % MPU_HOST_REGIONS;
+                break;
+            case REG_RBAR:
+            case REG_RBAR_A1:
+            case REG_RBAR_A2:
+            case REG_RBAR_A3:
+                rbar[regionOf(id)] = value & (MPU_RBAR_BASE_Msk | MPU_RBAR_SH_Msk | MPU_RBAR_AP_Msk | MPU_RBAR_XN_Msk);
+                break;
+            case REG_RLAR:
+            case REG_RLAR_A1:
+            case REG_RLAR_A2:
+            case REG_RLAR_A3:
+                rlar[regionOf(id)] = value & (MPU_RLAR_LIMIT_Msk | MPU_RLAR_AttrIndx_Msk | MPU_RLAR_EN_Msk);
+                break;
+            case REG_MAIR0:
+                mair[0] = value;
+                break;
+            case REG_MAIR1:
+                mair[1] = value;
+                break;
+            }
+        }
+
+        /**
+         * The region an access to address resolves to, -1 for none, or -2 if it
+         * falls in more than one enabled region (a fault on PMSAv8).
+         */
+        int regionAt(uint32_t address) const
+        {
+            int found = -1;
+
+            for (int r = 0; r < MPU_HOST_REGIONS; r++)
+            {
+                if (!(rlar[r] & MPU_RLAR_EN_Msk))
+                    continue;
+
+                uint32_t base = rbar[r] & MPU_RBAR_BASE_Msk;
+                uint32_t limit = (rlar[r] & MPU_RLAR_LIMIT_Msk) | 0x1F;
+
+                if (address < base || address > limit)
+                    continue;
+                if (found >= 0)
+                    return -2;
+                found = r;
+            }
+            return found;
+        }
+
+        /**
+         * The MAIR attribute byte of a region.
+         */
+        uint8_t attributes(int r) const
+        {
+            uint32_t index = (rlar[r] & MPU_RLAR_AttrIndx_Msk) >> MPU_RLAR_AttrIndx_Pos;
+            return (uint8_t)(mair[index / 4] >> (8 * (index % 4)));
+        }
+
+        /**
+         * Resolves an access as the MPU would.
+         * @return true if it is allowed, false if it would raise MemManage.
+         */
+        bool check(uint32_t address, MPUHostAccess access, bool privileged) const
+        {
+            if (!(ctrl & MPU_CTRL_ENABLE_Msk))
+                return true;
+
+            int r = regionAt(address);
+            if (r == -2)
+                return false;
+            if (r < 0)
+                return privileged && (ctrl & MPU_CTRL_PRIVDEFENA_Msk);
+
+            uint32_t ap = (rbar[r] & MPU_RBAR_AP_Msk) >> MPU_RBAR_AP_Pos;
+            bool readable = privileged || (ap & 1);
+            bool writable = readable && !(ap & 2);
+
+            if (access == MPUHostAccess::WRITE)
+                return writable;
+            if (access == MPUHostAccess::EXECUTE)
+                return readable && !(rbar[r] & MPU_RBAR_XN_Msk);
+            return readable;
+        }
+    };
+
+#else
+
+    /**
+     * The emulated MPU (with the same register names as CMSIS MPU_Type), plus the
+     * core state the MPU code touches.
+     */
+    class MPUHost
+    {
+    public:
+        enum : uint8_t
+        {
+            REG_TYPE,
+            REG_CTRL,
+            REG_RNR,
+            REG_RBAR,
+            REG_RASR,
+        };
+
+        MPUHostRegister TYPE, CTRL, RNR, RBAR, RASR;
+        MPUHostRegister RBAR_A1, RASR_A1, RBAR_A2, RASR_A2, RBAR_A3, RASR_A3;
+
+        uint32_t ctrl;
+        uint32_t rnr;
+        uint32_t rbar[MPU_HOST_REGIONS];
+        uint32_t rasr[MPU_HOST_REGIONS];
+
+        uint32_t control;   // CONTROL register; nPRIV (bit 0) set = unprivileged thread mode
+        uint32_t writes;    // MPU register writes
+        uint32_t barriers;  // __DSB / __ISB / __DMB executed
+
+        MPUHost()
+            : TYPE(this, REG_TYPE), CTRL(this, REG_CTRL), RNR(this, REG_RNR), RBAR(this, REG_RBAR), RASR(this, REG_RASR),
+              RBAR_A1(this, REG_RBAR), RASR_A1(this, REG_RASR), RBAR_A2(this, REG_RBAR), RASR_A2(this, REG_RASR),
+              RBAR_A3(this, REG_RBAR), RASR_A3(this, REG_RASR)
+        {
+            reset();
+        }
+
+        MPUHost(const MPUHost &) = delete;
+
+        /**
+         * Returns the MPU to its reset state (disabled, all regions cleared, privileged).
+         */
+        void reset()
+        {
+            ctrl = 0;
+            rnr = 0;
+            memset(rbar, 0, sizeof(rbar));
+            memset(rasr, 0, sizeof(rasr));
+            control = 0;
+            resetCounters();
+        }
+
+        void resetCounters()
+        {
+            writes = 0;
+            barriers = 0;
+        }
+
+        uint32_t read(uint8_t id) const
+        {
+            switch (id)
+            {
+            case REG_TYPE:
+                return MPU_HOST_REGIONS << MPU_TYPE_DREGION_Pos;
+            case REG_CTRL:
+                return ctrl;
+            case REG_RNR:
+                return rnr;
+            case REG_RBAR:
+                return rbar[rnr] | rnr;
+            case REG_RASR:
+                return rasr[rnr];
+            }
+            return 0;
+        }
+
+        void write(uint8_t id, uint32_t value)
+        {
+            writes++;
+
+            switch (id)
+            {
+            case REG_CTRL:
+                ctrl = value & (MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_HFNMIENA_Msk | MPU_CTRL_ENABLE_Msk);
+                break;
+            case REG_RNR:
+                rnr = value % MPU_HOST_REGIONS;
+                break;
+            case REG_RBAR:
+                if (value & MPU_RBAR_VALID_Msk)
+                    rnr = (value & MPU_RBAR_REGION_Msk) % MPU_HOST_REGIONS;
+                rbar[rnr] = value & MPU_RBAR_ADDR_Msk;
+                break;
+            case REG_RASR:
+                rasr[rnr] = value;
+                break;
+            }
+        }
+
+        /**
+         * The region an access to address resolves to: the highest-numbered enabled
+         * region that contains it with its subregion enabled, or -1 for none.
+         */
+        int regionAt(uint32_t address) const
+        {
+            for (int r = MPU_HOST_REGIONS - 1; r >= 0; r--)
+            {
+                if (!(rasr[r] & MPU_RASR_ENABLE_Msk))
+                    continue;
+
+                uint32_t sizeField = (rasr[r] & MPU_RASR_SIZE_Msk) >> MPU_RASR_SIZE_Pos;
+                uint64_t size = 1ULL << (sizeField + 1);
+                uint64_t base = rbar[r] & ~(size - 1);
+
+                if (address < base || address >= base + size)
+                    continue;
+
+                // Regions of 256 bytes and up are split into 8 subregions, each with a disable bit.
+                if (size >= 256)
+                {
+                    uint32_t sub = (uint32_t)((address - base) / (size / 8));
+                    if (rasr[r] & (1UL << (MPU_RASR_SRD_Pos + sub)))
+                        continue;
+                }
+                return r;
+            }
+            return -1;
+        }
+
+        /**
+         * Resolves an access as the MPU would.
+         * @return true if it is allowed, false if it would raise MemManage.
+         */
+        bool check(uint32_t address, MPUHostAccess access, bool privileged) const
+        {
+            if (!(ctrl & MPU_CTRL_ENABLE_Msk))
+                return true;
+
+            int r = regionAt(address);
+            if (r < 0)
+                return privileged && (ctrl & MPU_CTRL_PRIVDEFENA_Msk);
+
+            uint32_t ap = (rasr[r] & MPU_RASR_AP_Msk) >> MPU_RASR_AP_Pos;
+            bool readable, writable;
+
+            switch (ap)
+            {
+            case 1:
+                readable = writable = privileged;
+                break;
+            case 2:
+                readable = true;
+                writable = privileged;
+                break;
+            case 3:
+                readable = writable = true;
+                break;
+            case 5:
+                readable = privileged;
+                writable = false;
+                break;
+            case 6:
+            case 7:
+                readable = true;
+                writable = false;
+                break;
+            default:
+                readable = writable = false;
+                break;
+            }
+
+            if (access == MPUHostAccess::WRITE)
+                return writable;
+            if (access == MPUHostAccess::EXECUTE)
+                return readable && !(rasr[r] & MPU_RASR_XN_Msk);
+            return readable;
+        }
+    };
+
+#endif
+
+    MPUHostRegister::operator uint32_t() const
+    {
+        return mpu->read(id);
+    }
+
+    MPUHostRegister &MPUHostRegister::operator=(uint32_t value)
+    {
+        mpu->write(id, value);
+        return *this;
+    }
+
+    /**
+     * The emulated core: the instance MPU and the intrinsics below operate on.
+     */
+    inline MPUHost &mpuHost()
+    {
+        static MPUHost host;
+        return host;
+    }
+
+    /**
+     * Stand-in for the System Control Block registers the MPU code uses.
+     */
+    struct SCBHost
+    {
+        uintptr_t VTOR;
+        uint32_t SHCSR;
+        uint32_t CFSR;
+        uint32_t MMFAR;
+        uint32_t AIRCR;
+    };
+
+    inline SCBHost &scbHost()
+    {
+        static SCBHost scb;
+        return scb;
+    }
+
+    /**
+     * Stand-in for the System Control Space registers outside the SCB. ICTR reads as
+     * 1 (64 interrupt lines) unless a test sets it.
+     */
+    struct SCnSCBHost
+    {
+        uint32_t ICTR;
+    };
+
+    inline SCnSCBHost &scnScbHost()
+    {
+        static SCnSCBHost scnScb = {1};
+        return scnScb;
+    }
+
+    /**
+     * Stand-in for the DWT cycle counter. Nothing advances CYCCNT on a host; a test
+     * can set it to model elapsed time.
+     */
+    struct DWTHost
+    {
+        uint32_t CTRL;
+        uint32_t CYCCNT;
+    };
+
+    inline DWTHost &dwtHost()
+    {
+        static DWTHost dwt;
+        return dwt;
+    }
+
+    struct CoreDebugHost
+    {
+        uint32_t DEMCR;
+    };
+
+    inline CoreDebugHost &coreDebugHost()
+    {
+        static CoreDebugHost coreDebug;
+        return coreDebug;
+    }
+
+} // namespace codal
+
+#define MPU (&codal::mpuHost())
+#define SCB (&codal::scbHost())
+#define SCnSCB (&codal::scnScbHost())
+#define DWT (&codal::dwtHost())
+#define CoreDebug (&codal::coreDebugHost())
+
+static inline void __DSB()
+{
+    codal::mpuHost().barriers++;
+}
+
+static inline void __ISB()
+{
+    codal::mpuHost().barriers++;
+}
+
+static inline void __DMB()
+{
+    codal::mpuHost().barriers++;
+}
+
+/**
+ * Requests a reset. On a host it only sets SYSRESETREQ, and returns.
+ */
+static inline void NVIC_SystemReset()
+{
+    codal::scbHost().AIRCR = (0x05FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+}
+
+static inline uint32_t __get_CONTROL()
+{
+    return codal::mpuHost().control;
+}
+
+static inline void __set_CONTROL(uint32_t control)
+{
+    codal::mpuHost().control = control;
+}
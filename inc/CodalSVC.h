@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ErrorNo.h"
+#include "CodalMPU.h"
+#include "MPUProfile.h"
+
+/**
+ * @file CodalSVC.h
+ * @brief Supervisor calls: a constant dispatch table indexed by SVC number.
+ *
+ * Unprivileged code reaches privileged services (drivers, MPU reconfiguration) with
+ * svcCall<N>(a0, a1, a2, a3). The arguments stay in r0-r3, which the exception entry
+ * stacks anyway; the handler reads them from that frame, calls entry N of the table
+ * and writes the result back into the stacked r0, so nothing is copied and the
+ * caller finds the result in r0 on return.
+ *
+ * The table is an ordinary constexpr array, so it lives in flash and dispatch is one
+ * bounds check and an indexed call:
+ *
+ *     static int32_t sysNetSend(uint32_t buf, uint32_t len, uint32_t, uint32_t);
+ *     static int32_t sysLightRead(uint32_t out, uint32_t, uint32_t, uint32_t);
+ *
+ *     static constexpr codal::SVCFunction syscalls[] = { sysNetSend, sysLightRead };
+ *     CODAL_SVC_TABLE(syscalls)   // once, in one source file
+ *
+ *     codal::CodalSVC::install(); // points the SVC vector at the dispatcher
+ *     ...
+ *     int32_t r = codal::svcCall<1>((uint32_t)&sample); // from an unprivileged fiber
+ *
+ * Numbers outside the table (or with a null entry) return DEVICE_NOT_SUPPORTED.
+ *
+ * With CODAL_MPU_HOST defined, svcCall<N>() builds the exception frame in memory and
+ * calls the dispatcher directly, so the table can be exercised on a host.
+ */
+
+namespace codal
+{
+
+    /**
+     * A system call: up to four register arguments, one result in r0.
+     */
+    typedef int32_t (*SVCFunction)(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+    /**
+     * Stacked exception frame, in words from the stack pointer at entry.
+     */
+    enum SVCFrame
+    {
+        SVC_FRAME_R0 = 0,
+        SVC_FRAME_R1,
+        SVC_FRAME_R2,
+        SVC_FRAME_R3,
+        SVC_FRAME_R12,
+        SVC_FRAME_LR,
+        SVC_FRAME_PC,
+        SVC_FRAME_XPSR,
+        SVC_FRAME_WORDS
+    };
+
+} // namespace codal
+
+extern "C" void codal_svc_dispatch(uint32_t *frame, uint8_t number);
+extern "C" void codal_svc_entry(void);
+
+namespace codal
+{
+
+    class CodalSVC
+    {
+    public:
+        /**
+         * Runs entry number of table on the arguments in frame, leaving the result in
+         * the frame's r0.
+         */
+        template <size_t N>
+        static inline void dispatch(const SVCFunction (&table)[N], uint32_t *frame, uint8_t number)
+        {
+            SVCFunction f = number < N ? table[number] : NULL;
+
+            frame[SVC_FRAME_R0] = f ? static_cast<uint32_t>(f(frame[SVC_FRAME_R0], frame[SVC_FRAME_R1],
+                                                             frame[SVC_FRAME_R2], frame[SVC_FRAME_R3]))
+                                    : static_cast<uint32_t>(DEVICE_NOT_SUPPORTED);
+        }
+
+        /**
+         * The immediate of the SVC instruction just executed: the low byte of the
+         * Thumb halfword before the stacked PC (SVC #imm8 encodes as 0xDFxx).
+         */
+        static inline uint8_t number(const uint16_t *pc)
+        {
+            return static_cast<uint8_t>(pc[-1] & 0xFF);
+        }
+
+        static inline uint8_t number(const uint32_t *frame)
+        {
+            return number(reinterpret_cast<const uint16_t *>(static_cast<uintptr_t>(frame[SVC_FRAME_PC])));
+        }
+
+#if !defined(CODAL_MPU_HOST)
+        /**
+         * Points the SVC exception at the dispatcher defined by CODAL_SVC_TABLE.
+         */
+        static MPU_STATE install()
+        {
+            return CodalMPU::setSVCHandler(codal_svc_entry);
+        }
+#endif
+
+        /**
+         * Mean cycles (DWT) of a round trip through system call N, for latency budgets.
+         * Call with the cycle counter enabled (CycleCounter::enable()).
+         */
+        template <uint8_t N>
+        static uint32_t measure(uint32_t iterations);
+    };
+
+    /**
+     * Makes system call N.
+     */
+    template <uint8_t N>
+    static inline int32_t svcCall(uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0)
+    {
+#if defined(CODAL_MPU_HOST)
+        uint32_t frame[SVC_FRAME_WORDS] = {a0, a1, a2, a3, 0, 0, 0, 0x01000000};
+
+        codal_svc_dispatch(frame, N);
+        return static_cast<int32_t>(frame[SVC_FRAME_R0]);
+#else
+        register uint32_t r0 __asm("r0") = a0;
+        register uint32_t r1 __asm("r1") = a1;
+        register uint32_t r2 __asm("r2") = a2;
+        register uint32_t r3 __asm("r3") = a3;
+
+        __asm volatile("svc %[n]" : "+r"(r0) : [n] "I"(N), "r"(r1), "r"(r2), "r"(r3) : "memory");
+        return static_cast<int32_t>(r0);
+#endif
+    }
+
+    template <uint8_t N>
+    uint32_t CodalSVC::measure(uint32_t iterations)
+    {
+        uint32_t start = CycleCounter::now();
+
+        for (uint32_t i = 0; i < iterations; i++)
+            svcCall<N>(i);
+
+        return iterations ? (CycleCounter::now() - start) / iterations : 0;
+    }
+
+} // namespace codal
+
+#if defined(CODAL_MPU_HOST)
+
+#define CODAL_SVC_TABLE(table)                                                                                         \
+    extern "C" void codal_svc_dispatch(uint32_t *frame, uint8_t number)                                                \
+    {                                                                                                                  \
+        codal::CodalSVC::dispatch(table, frame, number);                                                               \
+    }
+
+#else
+
+/**
+ * Defines the SVC handler for a table. The entry picks the stack the caller was on
+ * (MSP or PSP, from EXC_RETURN bit 2) and passes its frame on; the sequence is valid
+ * on Armv6-M as well as Armv7-M. The tail call goes through a register, since a
+ * 16-bit B only reaches +/-2 KB and the linker may place the dispatcher further away.
+ */
+#define CODAL_SVC_TABLE(table)                                                                                         \
+    extern "C" void codal_svc_dispatch(uint32_t *frame, uint8_t number)                                                \
+    {                                                                                                                  \
+        codal::CodalSVC::dispatch(table, frame, number);                                                               \
+    }                                                                                                                  \
+    extern "C" void codal_svc_dispatch_frame(uint32_t *frame)                                                          \
+    {                                                                                                                  \
+        codal_svc_dispatch(frame, codal::CodalSVC::number(frame));                                                     \
+    }                                                                                                                  \
+    extern "C" __attribute__((naked)) void codal_svc_entry(void)                                                       \
+    {                                                                                                                  \
+        __asm volatile("movs r0, #4            \n"                                                                     \
+                       "mov r1, lr             \n"                                                                     \
+                       "tst r0, r1             \n"                                                                     \
+                       "beq 1f                 \n"                                                                     \
+                       "mrs r0, psp            \n"                                                                     \
+                       "b 2f                   \n"                                                                     \
+                       "1:                     \n"                                                                     \
+                       "mrs r0, msp            \n"                                                                     \
+                       "2:                     \n"                                                                     \
+                       "ldr r2, =codal_svc_dispatch_frame \n"                                                          \
+                       "bx r2                  \n"                                                                     \
+                       ".ltorg                 \n");                                                                   \
+    }
+
+#endif
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CODAL_MPU_HOST)
+#include "CodalMPUHost.h"
+#else
+#include "cmsis.h" // or your MCU's CMSIS core header
+#endif
+
+/**
+ * @file CodalVectorTable.h
+ * @brief Vector table relocated to RAM, with handlers swappable at run time.
+ *
+ * Out of reset VTOR points at the table in flash, where a store to change a handler
+ * faults or is silently dropped. relocate() copies the table into an aligned RAM
+ * table once and switches VTOR to it; the copy is complete before VTOR moves, so an
+ * interrupt taken meanwhile still finds the flash table. After that set() swaps a
+ * handler with a single aligned word store followed by a DSB, which an exception
+ * sees either before or after, never half done.
+ *
+ * The table can be placed in tightly coupled or otherwise fast RAM, where vector
+ * fetches do not contend with the bus, by naming its section:
+ *
+ *     #define CODAL_VECTOR_TABLE_SECTION ".dtcm_bss"
+ *
+ * The section needs no initialisation; relocate() fills the whole table.
+ *
+ * The table holds CODAL_VECTOR_TABLE_ENTRIES entries: the 16 system exceptions and
+ * the external interrupts. It is taken from the device header where it gives a vector
+ * count, and is checked against the NVIC at run time on cores that report their
+ * interrupt lines (ICTR): relocate() refuses a table that could cut off the device's
+ * interrupts, rather than leave the ones past its end pointing at nothing. Set it to
+ * 16 + 32 * (ICTR.INTLINESNUM + 1) on such cores, or 16 + the IRQ count elsewhere.
+ *
+ * These calls write to the SCB and must run privileged.
+ */
+
+#ifndef CODAL_VECTOR_TABLE_ENTRIES
+#if defined(NUMBER_OF_INT_VECTORS)
+#define CODAL_VECTOR_TABLE_ENTRIES NUMBER_OF_INT_VECTORS // Device header's vector count, system exceptions included
+#else
+#define CODAL_VECTOR_TABLE_ENTRIES 80 // 16 system exceptions + 64 external interrupts
+#endif
+#endif
+
+static_assert(CODAL_VECTOR_TABLE_ENTRIES > 16 && CODAL_VECTOR_TABLE_ENTRIES <= 16 + 496,
+              "CODAL_VECTOR_TABLE_ENTRIES must cover the system exceptions and at most 496 interrupts");
+
+#if defined(NUMBER_OF_INT_VECTORS)
+static_assert(CODAL_VECTOR_TABLE_ENTRIES >= NUMBER_OF_INT_VECTORS,
+              "CODAL_VECTOR_TABLE_ENTRIES is smaller than the device's vector table");
+#endif
+
+#if defined(CODAL_VECTOR_TABLE_SECTION)
+#define CODAL_VECTOR_TABLE_PLACEMENT __attribute__((section(CODAL_VECTOR_TABLE_SECTION)))
+#else
+#define CODAL_VECTOR_TABLE_PLACEMENT
+#endif
+
+namespace codal
+{
+
+    typedef void (*VectorHandler)(void);
+
+    /**
+     * VTOR alignment for a table of the given size: the next power of two, at least 128 bytes.
+     */
+    constexpr size_t vectorTableAlignment(size_t bytes, size_t align = 128)
+    {
+        return align >= bytes ? align : vectorTableAlignment(bytes, align * 2);
+    }
+
+    class VectorTable
+    {
+    public:
+        static constexpr uint32_t MEMMANAGE_EXCEPTION = 4;
+        static constexpr uint32_t SVC_EXCEPTION = 11;
+        static constexpr uint32_t PENDSV_EXCEPTION = 14;
+        static constexpr uint32_t SYSTICK_EXCEPTION = 15;
+        static constexpr uint32_t FIRST_IRQ = 16;
+
+    private:
+        struct Table
+        {
+            alignas(vectorTableAlignment(CODAL_VECTOR_TABLE_ENTRIES * sizeof(uintptr_t))) uintptr_t entries[CODAL_VECTOR_TABLE_ENTRIES];
+        };
+
+        static uintptr_t *ram()
+        {
+            static Table table CODAL_VECTOR_TABLE_PLACEMENT;
+            return table.entries;
+        }
+
+    public:
+        /**
+         * The most vectors the device can use: 16 + the interrupt lines its NVIC reports,
+         * or CODAL_VECTOR_TABLE_ENTRIES where the core has no ICTR to ask.
+         */
+        static uint32_t deviceEntries()
+        {
+#if defined(SCnSCB_ICTR_INTLINESNUM_Msk)
+            return FIRST_IRQ + 32 * (((SCnSCB->ICTR & SCnSCB_ICTR_INTLINESNUM_Msk) >> SCnSCB_ICTR_INTLINESNUM_Pos) + 1);
+#else
+            return CODAL_VECTOR_TABLE_ENTRIES;
+#endif
+        }
+
+        /**
+         * Copies the active table into RAM and points VTOR at it. Does nothing if that
+         * has been done already.
+         * @return false, leaving VTOR alone, if the device has more vectors than the table holds.
+         */
+        static bool relocate()
+        {
+            uintptr_t *table = ram();
+            const uintptr_t *current = reinterpret_cast<const uintptr_t *>(SCB->VTOR);
+
+            if (current == table)
+                return true;
+            if (deviceEntries() > CODAL_VECTOR_TABLE_ENTRIES)
+                return false;
+
+            for (uint32_t i = 0; i < CODAL_VECTOR_TABLE_ENTRIES; i++)
+                table[i] = current[i];
+
+            __DSB();
+            SCB->VTOR = reinterpret_cast<uintptr_t>(table);
+            __DSB();
+            __ISB();
+            return true;
+        }
+
+        static bool isRelocated()
+        {
+            return reinterpret_cast<const uintptr_t *>(SCB->VTOR) == ram();
+        }
+
+        /**
+         * Installs the handler of an exception (relocating the table first if needed).
+         * @param exception Exception number: 1-15 for system exceptions, FIRST_IRQ + n for IRQ n.
+         * @return The handler it replaces, or NULL if exception is out of range or the
+         *         table cannot be relocated.
+         */
+        static VectorHandler set(uint32_t exception, VectorHandler handler)
+        {
+            if (exception == 0 || exception >= CODAL_VECTOR_TABLE_ENTRIES || !relocate())
+                return NULL;
+
+            uintptr_t *table = ram();
+            VectorHandler previous = reinterpret_cast<VectorHandler>(table[exception]);
+
+            table[exception] = reinterpret_cast<uintptr_t>(handler);
+            __DSB();
+            return previous;
+        }
+
+        static VectorHandler setIRQ(uint32_t irq, VectorHandler handler)
+        {
+            return set(FIRST_IRQ + irq, handler);
+        }
+
+        /**
+         * The handler the active table holds for an exception, or NULL if out of range.
+         */
+        static VectorHandler get(uint32_t exception)
+        {
+            if (exception >= CODAL_VECTOR_TABLE_ENTRIES)
+                return NULL;
+            return reinterpret_cast<VectorHandler>(reinterpret_cast<const uintptr_t *>(SCB->VTOR)[exception]);
+        }
+    };
+
+} // namespace codal
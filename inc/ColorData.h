@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ColorData.h
+ * @brief Colour sample types shared by CodalLightSensor and its helpers.
+ */
+
+namespace codal
+{
+
+    enum ColorFormat
+    {
+        RGB,
+        BGR,
+        RGBD,
+        BGRD,
+        W,
+        RGBW,
+        BGRW,
+        RGBWI, //RGB + White + Infrared  , stored as RGBDW
+        DRGB   // Clear/brightness channel first (TCS34725, APDS-9960), stored as RGBD
+    };
+
+    /**
+     * Byte order of multi-byte channels as they arrive on the bus.
+     * Chosen at compile time by the read path, so no per-sample branching is needed.
+     */
+    enum class ColorByteOrder : uint8_t
+    {
+        LSB_FIRST, // e.g. TCS34725, APDS-9960, BH1745
+        MSB_FIRST
+    };
+
+    /**
+     * A single colour sample.
+     *
+     * @tparam T channel storage type: uint8_t for 8-bit sensors, uint16_t for 16-bit ADCs
+     *           and uint32_t for 24-bit channels.
+     *
+     * The gain and integration time in effect when the sample was taken travel with it,
+     * so samples taken under different exposures can be compared later.
+     *
+     * @note ABI change: ColorData used to be a plain 5-byte struct of uint8_t channels.
+     *       ColorData<> keeps the uint8_t channels but is 12 bytes with its exposure fields
+     *       and padding, so code that stored, transmitted or memcpy'd samples by their old
+     *       layout must use PackedColorData (and packColorData()/unpackColorData()) instead.
+     */
+    template <typename T = uint8_t>
+    struct ColorData
+    {
+        T r;
+        T g;
+        T b;
+        T d; // Optional brightness/depth
+        T w; // Optional Lux/Raw ADC/IR/UV index
+        uint8_t gain;             // Analogue gain multiplier (1 = unity, 0 = unknown)
+        uint32_t integrationTime; // Integration time in microseconds (0 = unknown)
+    };
+
+    /**
+     * The fixed 5-byte layout ColorData had before it carried its exposure, kept for
+     * samples that are stored or sent in that form.
+     */
+    struct PackedColorData
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+        uint8_t d;
+        uint8_t w;
+    };
+
+    static_assert(sizeof(PackedColorData) == 5, "PackedColorData must keep the original 5-byte layout");
+
+    /**
+     * @brief Drops the exposure fields of a sample, giving the original 5-byte layout.
+     */
+    inline PackedColorData packColorData(const ColorData<> &in)
+    {
+        PackedColorData out = {in.r, in.g, in.b, in.d, in.w};
+        return out;
+    }
+
+    /**
+     * @brief Widens a sample stored in the original layout; its exposure is unknown (0).
+     */
+    inline ColorData<> unpackColorData(const PackedColorData &in)
+    {
+        ColorData<> out = {in.r, in.g, in.b, in.d, in.w, 0, 0};
+        return out;
+    }
+
+    /**
+     * Maps a channel width in bytes onto the narrowest ColorData channel type able to hold it.
+     */
+    template <uint8_t Bytes>
+    struct ColorChannel;
+    template <>
+    struct ColorChannel<1> { typedef uint8_t type; };
+    template <>
+    struct ColorChannel<2> { typedef uint16_t type; };
+    template <>
+    struct ColorChannel<3> { typedef uint32_t type; };
+    template <>
+    struct ColorChannel<4> { typedef uint32_t type; };
+
+#define LIGHTSENSOR_MAX_CHANNELS 5
+
+    /**
+     * A view of count ColorData<T> samples in caller-owned memory, spaced stride bytes
+     * apart. A stride larger than the sample lets samples be scattered into the records
+     * of a larger structure (a log entry, a packet) without copying them there afterwards.
+     *
+     * The view does not own the memory; stride must keep every sample suitably aligned.
+     */
+    template <typename T>
+    class ColorDataSpan
+    {
+    private:
+        uint8_t *base;
+        size_t count;
+        size_t stride;
+
+    public:
+        class iterator
+        {
+        private:
+            uint8_t *p;
+            size_t stride;
+
+        public:
+            iterator(uint8_t *p, size_t stride) : p(p), stride(stride) {}
+
+            ColorData<T> &operator*() const
+            {
+                return *reinterpret_cast<ColorData<T> *>(p);
+            }
+
+            ColorData<T> *operator->() const
+            {
+                return reinterpret_cast<ColorData<T> *>(p);
+            }
+
+            iterator &operator++()
+            {
+                p += stride;
+                return *this;
+            }
+
+            bool operator==(const iterator &other) const
+            {
+                return p == other.p;
+            }
+
+            bool operator!=(const iterator &other) const
+            {
+                return p != other.p;
+            }
+        };
+
+        ColorDataSpan(ColorData<T> *data, size_t count)
+            : base(reinterpret_cast<uint8_t *>(data)), count(count), stride(sizeof(ColorData<T>)) {}
+
+        /**
+         * @param first The first sample.
+         * @param count Number of samples.
+         * @param stride Distance in bytes from one sample to the next.
+         */
+        ColorDataSpan(ColorData<T> *first, size_t count, size_t stride)
+            : base(reinterpret_cast<uint8_t *>(first)), count(count), stride(stride) {}
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        ColorData<T> &operator[](size_t pos) const
+        {
+            return *reinterpret_cast<ColorData<T> *>(base + pos * stride);
+        }
+
+        /**
+         * @brief A view of part of this span, e.g. the two halves of a wrapping ring buffer.
+         */
+        ColorDataSpan subspan(size_t offset, size_t length) const
+        {
+            if (offset > count)
+                offset = count;
+            if (length > count - offset)
+                length = count - offset;
+
+            return ColorDataSpan(reinterpret_cast<ColorData<T> *>(base + offset * stride), length, stride);
+        }
+
+        iterator begin() const
+        {
+            return iterator(base, stride);
+        }
+
+        iterator end() const
+        {
+            return iterator(base + count * stride, stride);
+        }
+    };
+
+} // namespace codal
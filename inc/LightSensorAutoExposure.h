@@ -0,0 +1,345 @@
+#pragma once
+
+#include "CodalLightSensor.h"
+#include "CodalFiber.h"
+#include "Timer.h"
+
+/**
+ * @file LightSensorAutoExposure.h
+ * @brief Automatic gain / integration time control for profiled CodalLightSensors.
+ *
+ * ExposureController is the pure decision logic: given a sample and the exposure it
+ * was taken with, it picks the gain and integration step for the next one. It has no
+ * bus access, so it can be driven with a simulated light trace on a host.
+ *
+ * Sensor counts are linear in light x gain x integration time, so one unsaturated
+ * sample is enough to jump straight to the right setting. A saturated sample only
+ * gives an upper bound, so exposure is cut by at least LIGHTSENSOR_AE_SATURATED_CUT
+ * until a usable sample arrives. Starting from anywhere, the controller therefore
+ * settles within log(exposure range) / log(LIGHTSENSOR_AE_SATURATED_CUT) + 2 reads
+ * (6 for a TCS34725).
+ */
+
+#ifndef LIGHTSENSOR_AE_TARGET
+#define LIGHTSENSOR_AE_TARGET 50 // Peak channel aimed for, in percent of full scale
+#endif
+
+#ifndef LIGHTSENSOR_AE_LOW
+#define LIGHTSENSOR_AE_LOW 12 // Below this percentage of full scale, exposure is raised
+#endif
+
+#ifndef LIGHTSENSOR_AE_HIGH
+#define LIGHTSENSOR_AE_HIGH 85 // Above this percentage of full scale, exposure is lowered
+#endif
+
+#ifndef LIGHTSENSOR_AE_SATURATED
+#define LIGHTSENSOR_AE_SATURATED 98 // At or above this percentage, the sample is treated as clipped
+#endif
+
+#ifndef LIGHTSENSOR_AE_SATURATED_CUT
+#define LIGHTSENSOR_AE_SATURATED_CUT 16 // Minimum exposure reduction after a clipped sample
+#endif
+
+#ifndef LIGHTSENSOR_AE_MAX_READS
+#define LIGHTSENSOR_AE_MAX_READS 8
+#endif
+
+namespace codal
+{
+
+    class ExposureController
+    {
+    private:
+        const LightSensorProfile &profile;
+        uint32_t maxIntegration;
+        uint8_t gainStep;
+        uint8_t integrationStep;
+        bool settled;
+
+        /**
+         * Picks the largest exposure for which fits(exposure, fullScale) holds, preferring
+         * longer integration over more gain for the same exposure. Falls back to the smallest.
+         */
+        template <typename Fits>
+        void select(Fits fits)
+        {
+            uint64_t best = 0;
+            uint8_t bestGain = 0, bestIntegration = 0;
+            bool found = false;
+
+            for (uint8_t i = 0; i < profile.integrationCount; i++)
+            {
+                if (i > 0 && profile.integrationTimes[i].value > maxIntegration)
+                    break;
+
+                for (uint8_t g = 0; g < profile.gainCount; g++)
+                {
+                    uint64_t e = exposure(g, i);
+                    if (!fits(e, fullScale(i)))
+                        continue;
+
+                    if (!found || e > best || (e == best && g < bestGain))
+                    {
+                        best = e;
+                        bestGain = g;
+                        bestIntegration = i;
+                        found = true;
+                    }
+                }
+            }
+
+            gainStep = bestGain;
+            integrationStep = bestIntegration;
+        }
+
+    public:
+        /**
+         * @param profile Sensor being controlled.
+         * @param maxIntegrationUs Longest integration time allowed, to bound read latency.
+         */
+        ExposureController(const LightSensorProfile &profile, uint32_t maxIntegrationUs = 0xFFFFFFFF)
+            : profile(profile), maxIntegration(maxIntegrationUs), gainStep(0), integrationStep(0), settled(false)
+        {
+        }
+
+        uint8_t getGainStep() const
+        {
+            return gainStep;
+        }
+
+        uint8_t getIntegrationStep() const
+        {
+            return integrationStep;
+        }
+
+        /**
+         * @brief True once the last sample fell inside the target window (or no better setting exists).
+         */
+        bool isSettled() const
+        {
+            return settled;
+        }
+
+        /**
+         * @brief Effective exposure (gain x microseconds) of a gain/integration step pair.
+         */
+        uint64_t exposure(uint8_t gain, uint8_t integration) const
+        {
+            return static_cast<uint64_t>(profile.gains[gain].value) * profile.integrationTimes[integration].value;
+        }
+
+        /**
+         * @brief Largest count a channel can reach at an integration step.
+         */
+        uint32_t fullScale(uint8_t integration) const
+        {
+            uint32_t range = profile.channelBytes >= 4 ? 0xFFFFFFFF : (1UL << (8 * profile.channelBytes)) - 1;
+
+            if (profile.countsPerSecond == 0)
+                return range;
+
+            uint64_t limit = static_cast<uint64_t>(profile.integrationTimes[integration].value) * profile.countsPerSecond / 1000000;
+            return limit < range ? static_cast<uint32_t>(limit) : range;
+        }
+
+        /**
+         * @brief Feeds back a sample taken at the current setting.
+         * @return true if the setting changed and should be applied before the next read.
+         */
+        template <typename T>
+        bool update(const ColorData<T> &sample)
+        {
+            uint64_t peak = sample.r;
+            peak = sample.g > peak ? sample.g : peak;
+            peak = sample.b > peak ? sample.b : peak;
+            peak = sample.d > peak ? sample.d : peak;
+            peak = sample.w > peak ? sample.w : peak;
+
+            uint8_t g = gainStep, i = integrationStep;
+            uint64_t current = exposure(g, i);
+            uint64_t max = fullScale(i);
+
+            if (peak * 100 >= max * LIGHTSENSOR_AE_SATURATED)
+            {
+                // Clipped: the true level is unknown, so cut hard.
+                select([&](uint64_t e, uint32_t) { return e * LIGHTSENSOR_AE_SATURATED_CUT <= current; });
+            }
+            else if (peak * 100 < max * LIGHTSENSOR_AE_LOW || peak * 100 > max * LIGHTSENSOR_AE_HIGH)
+            {
+                // Linear sensor: predicted peak at exposure e is peak * e / current.
+                select([&](uint64_t e, uint32_t scale) { return peak * e * 100 <= static_cast<uint64_t>(scale) * LIGHTSENSOR_AE_TARGET * current; });
+            }
+
+            settled = (g == gainStep && i == integrationStep);
+            return !settled;
+        }
+
+        /**
+         * @brief Rescales a sample to a common reference exposure, so samples taken at
+         *        different settings are directly comparable. The result is tagged with
+         *        the reference exposure.
+         * @param refGain Reference gain multiplier.
+         * @param refIntegrationUs Reference integration time, in microseconds.
+         * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the sample carries no exposure.
+         */
+        template <typename T>
+        static int normalise(const ColorData<T> &in, ColorData<uint32_t> &out, uint8_t refGain = 1, uint32_t refIntegrationUs = 100000)
+        {
+            uint64_t e = static_cast<uint64_t>(in.gain) * in.integrationTime;
+            if (e == 0)
+                return DEVICE_INVALID_PARAMETER;
+
+            uint64_t ref = static_cast<uint64_t>(refGain) * refIntegrationUs;
+
+            out.r = static_cast<uint32_t>((in.r * ref + e / 2) / e);
+            out.g = static_cast<uint32_t>((in.g * ref + e / 2) / e);
+            out.b = static_cast<uint32_t>((in.b * ref + e / 2) / e);
+            out.d = static_cast<uint32_t>((in.d * ref + e / 2) / e);
+            out.w = static_cast<uint32_t>((in.w * ref + e / 2) / e);
+            out.gain = refGain;
+            out.integrationTime = refIntegrationUs;
+
+            return DEVICE_OK;
+        }
+    };
+
+    /**
+     * @class LightSensorAutoExposure
+     * @brief Drives a profiled CodalLightSensor with an ExposureController.
+     *
+     * @code
+     * sensor.setProfile(LIGHTSENSOR_PROFILE_TCS34725);
+     * LightSensorAutoExposure ae(sensor, 160000);
+     * ColorData<uint16_t> sample;
+     * ae.readSettled<2>(sample); // sample.gain / sample.integrationTime give its exposure
+     * @endcode
+     */
+    class LightSensorAutoExposure
+    {
+    private:
+        CodalLightSensor &sensor;
+        ExposureController controller;
+        int status;
+        bool changed;              // A new exposure was applied since the last read
+        CODAL_TIMESTAMP changedAt; // When it was applied, in microseconds
+        uint32_t settleTime;       // How long after changedAt a sample reflects it, in microseconds
+
+        /**
+         * Stand-in for the controller when the sensor has no profile; never stepped through.
+         */
+        static const LightSensorProfile &noProfile()
+        {
+            static const LightSensorProfile empty = {};
+            return empty;
+        }
+
+        int apply()
+        {
+            uint32_t previous = sensor.getIntegrationTime();
+
+            int result = sensor.setIntegrationStep(controller.getIntegrationStep());
+            if (result == DEVICE_OK)
+                result = sensor.setGainStep(controller.getGainStep());
+
+            changed = true;
+            changedAt = system_timer_current_time_us();
+            settleTime = previous + sensor.getIntegrationTime();
+
+            return result;
+        }
+
+        /**
+         * A new setting only applies from the sensor's next integration cycle, so the
+         * data registers hold a sample taken entirely at it no sooner than the rest of
+         * the cycle in progress (up to one old integration time) plus one new one.
+         */
+        void waitForNewExposure()
+        {
+            if (!changed)
+                return;
+
+            CODAL_TIMESTAMP elapsed = system_timer_current_time_us() - changedAt;
+
+            if (elapsed < settleTime)
+                fiber_sleep((settleTime - elapsed + 999) / 1000);
+
+            changed = false;
+        }
+
+    public:
+        /**
+         * @param sensor A sensor with a profile already set. Without one, getStatus() and
+         *        every read return DEVICE_INVALID_STATE.
+         * @param maxIntegrationUs Longest integration time allowed.
+         */
+        LightSensorAutoExposure(CodalLightSensor &sensor, uint32_t maxIntegrationUs = 0xFFFFFFFF)
+            : sensor(sensor),
+              controller(sensor.getRegisters().getProfile() ? *sensor.getRegisters().getProfile() : noProfile(),
+                         maxIntegrationUs),
+              status(sensor.getRegisters().getProfile() ? DEVICE_OK : DEVICE_INVALID_STATE), changed(false),
+              changedAt(0), settleTime(0)
+        {
+            if (status == DEVICE_OK)
+                status = apply();
+        }
+
+        /**
+         * @brief Result of applying the initial exposure: DEVICE_OK, DEVICE_INVALID_STATE
+         *        if the sensor had no profile, or a bus error.
+         */
+        int getStatus() const
+        {
+            return status;
+        }
+
+        const ExposureController &getController() const
+        {
+            return controller;
+        }
+
+        /**
+         * @brief Reads one sample, then retunes the sensor for the next one.
+         *        The sample is tagged with the exposure it was actually taken with: after a
+         *        change, the read first sleeps until a sample integrated wholly at the new
+         *        setting is available (the old plus the new integration time after the change).
+         * @return DEVICE_OK, DEVICE_INVALID_STATE if the sensor has no profile, or a bus error.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename T>
+        int read(ColorData<T> &out)
+        {
+            if (status == DEVICE_INVALID_STATE)
+                return status;
+
+            waitForNewExposure();
+
+            int result = sensor.read<Bytes, Order>(out);
+            if (result != DEVICE_OK)
+                return result;
+
+            return controller.update(out) ? apply() : DEVICE_OK;
+        }
+
+        /**
+         * @brief Reads until the exposure is settled. Each read after a change waits for
+         *        a sample taken entirely at the new setting.
+         * @return DEVICE_OK once settled, DEVICE_BUSY if maxReads was not enough
+         *         (out still holds the latest sample), or a bus error.
+         */
+        template <uint8_t Bytes, ColorByteOrder Order = ColorByteOrder::LSB_FIRST, typename T>
+        int readSettled(ColorData<T> &out, int maxReads = LIGHTSENSOR_AE_MAX_READS)
+        {
+            for (int i = 0; i < maxReads; i++)
+            {
+                int result = read<Bytes, Order>(out);
+                if (result != DEVICE_OK)
+                    return result;
+
+                if (controller.isSettled())
+                    return DEVICE_OK;
+            }
+
+            return DEVICE_BUSY;
+        }
+    };
+
+} // namespace codal
@@ -0,0 +1,424 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CodalComponent.h"
+#include "ColorData.h"
+
+/**
+ * @file LightSensorRegisters.h
+ * @brief Declarative register maps with shadow copies for colour sensors.
+ *
+ * A LightSensorProfile describes where a sensor keeps its configuration, gain,
+ * integration time and channel data. LightSensorRegisterMap keeps a RAM shadow of
+ * the configuration registers, so changing a setting never needs a read-back:
+ * writes that match the shadow are dropped, and registers changed together at
+ * adjacent addresses go out as a single burst on flush().
+ *
+ * Nothing here depends on a particular bus; CodalLightSensor implements RegisterBus
+ * over I2C/SPI, and MockRegisterBus lets the same code run on a host.
+ */
+
+namespace codal
+{
+
+#define LIGHTSENSOR_MAX_REGISTERS 32 // Configuration registers per profile (one dirty bit each)
+#define LIGHTSENSOR_MAX_BURST 16     // Largest single register transfer
+
+    /**
+     * Register-level transport. reg is the full register/command byte sent on the wire.
+     */
+    class RegisterBus
+    {
+    public:
+        virtual int readRegisters(uint8_t reg, uint8_t *data, int length) = 0;
+        virtual int writeRegisters(uint8_t reg, const uint8_t *data, int length) = 0;
+        virtual ~RegisterBus() {}
+    };
+
+    /**
+     * A configuration register and its value after power-on reset.
+     */
+    struct LightSensorRegister
+    {
+        uint8_t address;
+        uint8_t resetValue;
+    };
+
+    /**
+     * A value a register must hold for the sensor to work, written whenever a profile is set.
+     */
+    struct LightSensorRegisterValue
+    {
+        uint8_t address;
+        uint8_t value;
+    };
+
+    /**
+     * One selectable gain or integration time: the field code written to the device,
+     * and what it means (gain multiplier, or integration time in microseconds).
+     */
+    struct ExposureStep
+    {
+        uint8_t code;
+        uint32_t value;
+    };
+
+    /**
+     * Describes one sensor model. Steps are listed in ascending order of value.
+     */
+    struct LightSensorProfile
+    {
+        const char *name;
+        uint8_t i2cAddress;       // In CODAL (8-bit) form
+        uint8_t commandBit;       // OR'd into every register address (0 if none)
+        uint8_t autoIncrementBit; // OR'd in for multi-byte transfers (0 if implicit)
+
+        const LightSensorRegister *registers; // Configuration registers, ascending address
+        uint8_t registerCount;
+
+        uint8_t powerRegister;
+        uint8_t powerMask;
+        uint8_t powerOnValue;
+
+        uint8_t gainRegister;
+        uint8_t gainMask;
+        const ExposureStep *gains;
+        uint8_t gainCount;
+
+        uint8_t integrationRegister;
+        uint8_t integrationMask;
+        const ExposureStep *integrationTimes;
+        uint8_t integrationCount;
+
+        uint8_t dataRegister;   // First channel data register
+        ColorFormat dataFormat; // Channel order of the data registers
+        uint8_t channelBytes;   // Width of each channel
+        uint32_t countsPerSecond; // ADC saturation rate: counts per second of integration (0 = full channel range)
+
+        const LightSensorRegisterValue *initWrites; // Required non-reset values (nullptr if none)
+        uint8_t initWriteCount;
+    };
+
+    /**
+     * RAM shadow of a sensor's configuration registers.
+     */
+    class LightSensorRegisterMap
+    {
+    private:
+        RegisterBus *bus;
+        const LightSensorProfile *profile;
+        uint8_t shadow[LIGHTSENSOR_MAX_REGISTERS];
+        uint32_t dirty;
+
+        int indexOf(uint8_t address) const
+        {
+            for (int i = 0; i < profile->registerCount; i++)
+                if (profile->registers[i].address == address)
+                    return i;
+
+            return -1;
+        }
+
+        uint8_t command(uint8_t address, int length) const
+        {
+            return address | profile->commandBit | (length > 1 ? profile->autoIncrementBit : 0);
+        }
+
+    public:
+        LightSensorRegisterMap() : bus(nullptr), profile(nullptr), dirty(0) {}
+
+        /**
+         * @brief Binds the map to a bus and profile. The shadow is loaded with the
+         *        profile's reset values; call sync() if the device may not be fresh from reset.
+         * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the profile has too many registers.
+         */
+        int attach(RegisterBus &bus, const LightSensorProfile &profile)
+        {
+            if (profile.registerCount > LIGHTSENSOR_MAX_REGISTERS)
+                return DEVICE_INVALID_PARAMETER;
+
+            this->bus = &bus;
+            this->profile = &profile;
+            this->dirty = 0;
+
+            for (int i = 0; i < profile.registerCount; i++)
+                shadow[i] = profile.registers[i].resetValue;
+
+            return DEVICE_OK;
+        }
+
+        bool isAttached() const
+        {
+            return profile != nullptr;
+        }
+
+        const LightSensorProfile *getProfile() const
+        {
+            return profile;
+        }
+
+        /**
+         * @brief Reloads the shadow from the device, one burst per run of adjacent registers.
+         *        Any staged writes are discarded.
+         */
+        int sync()
+        {
+            if (!isAttached())
+                return DEVICE_INVALID_STATE;
+
+            for (int i = 0; i < profile->registerCount;)
+            {
+                int end = i + 1;
+                while (end < profile->registerCount && end - i < LIGHTSENSOR_MAX_BURST &&
+                       profile->registers[end].address == profile->registers[end - 1].address + 1)
+                    end++;
+
+                int result = bus->readRegisters(command(profile->registers[i].address, end - i), &shadow[i], end - i);
+                if (result != DEVICE_OK)
+                    return result;
+
+                i = end;
+            }
+
+            dirty = 0;
+            return DEVICE_OK;
+        }
+
+        /**
+         * @brief Shadow value of a configuration register (0 if it is not in the map).
+         */
+        uint8_t get(uint8_t address) const
+        {
+            int i = isAttached() ? indexOf(address) : -1;
+            return i < 0 ? 0 : shadow[i];
+        }
+
+        /**
+         * @brief Stages a register write. Writing the value already held is a no-op.
+         * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if address is not a configuration register.
+         */
+        int set(uint8_t address, uint8_t value)
+        {
+            int i = isAttached() ? indexOf(address) : -1;
+            if (i < 0)
+                return DEVICE_INVALID_PARAMETER;
+
+            if (shadow[i] != value)
+            {
+                shadow[i] = value;
+                dirty |= 1UL << i;
+            }
+
+            return DEVICE_OK;
+        }
+
+        /**
+         * @brief Stages a write of the bits in mask, keeping the rest from the shadow.
+         */
+        int setField(uint8_t address, uint8_t mask, uint8_t value)
+        {
+            return set(address, (get(address) & ~mask) | (value & mask));
+        }
+
+        /**
+         * @brief Stages the profile's initWrites, so the next flush() sends any the device
+         *        does not already hold.
+         * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if an entry is not a configuration register.
+         */
+        int stageInitWrites()
+        {
+            if (!isAttached())
+                return DEVICE_INVALID_STATE;
+
+            for (int i = 0; i < profile->initWriteCount; i++)
+            {
+                int result = set(profile->initWrites[i].address, profile->initWrites[i].value);
+                if (result != DEVICE_OK)
+                    return result;
+            }
+
+            return DEVICE_OK;
+        }
+
+        bool isDirty() const
+        {
+            return dirty != 0;
+        }
+
+        /**
+         * @brief Writes all staged registers, coalescing adjacent ones into one burst each.
+         * @return DEVICE_OK, or the bus error (the failed registers stay dirty).
+         */
+        int flush()
+        {
+            if (!isAttached())
+                return DEVICE_INVALID_STATE;
+
+            for (int i = 0; i < profile->registerCount && dirty;)
+            {
+                if (!(dirty & (1UL << i)))
+                {
+                    i++;
+                    continue;
+                }
+
+                int end = i + 1;
+                while (end < profile->registerCount && end - i < LIGHTSENSOR_MAX_BURST && (dirty & (1UL << end)) &&
+                       profile->registers[end].address == profile->registers[end - 1].address + 1)
+                    end++;
+
+                int result = bus->writeRegisters(command(profile->registers[i].address, end - i), &shadow[i], end - i);
+                if (result != DEVICE_OK)
+                    return result;
+
+                for (int j = i; j < end; j++)
+                    dirty &= ~(1UL << j);
+
+                i = end;
+            }
+
+            return DEVICE_OK;
+        }
+
+        /**
+         * @brief Burst-reads non-configuration registers (e.g. channel data); bypasses the shadow.
+         */
+        int read(uint8_t address, uint8_t *data, int length)
+        {
+            if (!isAttached())
+                return DEVICE_INVALID_STATE;
+
+            return bus->readRegisters(command(address, length), data, length);
+        }
+    };
+
+    /**
+     * Host-side stand-in for a sensor: a 256-byte register file that counts bus traffic.
+     */
+    class MockRegisterBus : public RegisterBus
+    {
+    public:
+        uint8_t registers[256];
+        uint8_t addressMask; // Strips command bits from the wire register byte
+        uint32_t reads;
+        uint32_t writes;
+        uint32_t bytes;
+
+        MockRegisterBus(uint8_t addressMask = 0xFF) : addressMask(addressMask), reads(0), writes(0), bytes(0)
+        {
+            memset(registers, 0, sizeof(registers));
+        }
+
+        virtual int readRegisters(uint8_t reg, uint8_t *data, int length) override
+        {
+            for (int i = 0; i < length; i++)
+                data[i] = registers[(uint8_t)((reg & addressMask) + i)];
+
+            reads++;
+            bytes += length + 1;
+            return DEVICE_OK;
+        }
+
+        virtual int writeRegisters(uint8_t reg, const uint8_t *data, int length) override
+        {
+            for (int i = 0; i < length; i++)
+                registers[(uint8_t)((reg & addressMask) + i)] = data[i];
+
+            writes++;
+            bytes += length + 1;
+            return DEVICE_OK;
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // Sensor profiles
+    // -------------------------------------------------------------------------
+
+    namespace profiles
+    {
+        constexpr LightSensorRegister TCS34725_REGISTERS[] = {
+            {0x00, 0x00}, // ENABLE
+            {0x01, 0xFF}, // ATIME
+            {0x03, 0xFF}, // WTIME
+            {0x04, 0x00}, // AILTL
+            {0x05, 0x00}, // AILTH
+            {0x06, 0x00}, // AIHTL
+            {0x07, 0x00}, // AIHTH
+            {0x0C, 0x00}, // PERS
+            {0x0D, 0x00}, // CONFIG
+            {0x0F, 0x00}, // CONTROL
+        };
+        constexpr ExposureStep TCS34725_GAINS[] = {{0, 1}, {1, 4}, {2, 16}, {3, 60}};
+        constexpr ExposureStep TCS34725_INTEGRATION[] = {
+            {0xFF, 2400}, {0xF6, 24000}, {0xD5, 103200}, {0xC0, 153600}, {0x00, 614400}};
+
+        constexpr LightSensorRegister APDS9960_REGISTERS[] = {
+            {0x80, 0x00}, // ENABLE
+            {0x81, 0xFF}, // ATIME
+            {0x83, 0xFF}, // WTIME
+            {0x84, 0x00}, // AILTL
+            {0x85, 0x00}, // AILTH
+            {0x86, 0x00}, // AIHTL
+            {0x87, 0x00}, // AIHTH
+            {0x8C, 0x00}, // PERS
+            {0x8D, 0x40}, // CONFIG1
+            {0x8F, 0x00}, // CONTROL
+            {0x90, 0x01}, // CONFIG2
+        };
+        constexpr ExposureStep APDS9960_GAINS[] = {{0, 1}, {1, 4}, {2, 16}, {3, 64}};
+        constexpr ExposureStep APDS9960_INTEGRATION[] = {
+            {0xFF, 2780}, {0xF6, 27800}, {0xDB, 103000}, {0xB6, 206000}, {0x00, 712000}};
+
+        constexpr LightSensorRegister BH1745_REGISTERS[] = {
+            {0x41, 0x00}, // MODE_CONTROL1
+            {0x42, 0x00}, // MODE_CONTROL2
+            {0x44, 0x00}, // MODE_CONTROL3
+        };
+        constexpr LightSensorRegisterValue BH1745_INIT[] = {
+            {0x44, 0x02}, // MODE_CONTROL3: fixed value from the datasheet
+        };
+        constexpr ExposureStep BH1745_GAINS[] = {{0x00, 1}, {0x01, 2}, {0x02, 16}};
+        constexpr ExposureStep BH1745_INTEGRATION[] = {
+            {0x00, 160000}, {0x01, 320000}, {0x02, 640000}, {0x03, 1280000}, {0x04, 2560000}, {0x05, 5120000}};
+    } // namespace profiles
+
+    /**
+     * ams TCS34725 (and TCS3472x family): 16-bit clear/red/green/blue.
+     */
+    constexpr LightSensorProfile LIGHTSENSOR_PROFILE_TCS34725 = {
+        "TCS34725", 0x29 << 1, 0x80, 0x20,
+        profiles::TCS34725_REGISTERS, sizeof(profiles::TCS34725_REGISTERS) / sizeof(LightSensorRegister),
+        0x00, 0x03, 0x03, // ENABLE: PON | AEN
+        0x0F, 0x03, profiles::TCS34725_GAINS, sizeof(profiles::TCS34725_GAINS) / sizeof(ExposureStep),
+        0x01, 0xFF, profiles::TCS34725_INTEGRATION, sizeof(profiles::TCS34725_INTEGRATION) / sizeof(ExposureStep),
+        0x14, DRGB, 2, 426667, // 1024 counts per 2.4 ms cycle
+        nullptr, 0};
+
+    /**
+     * Broadcom APDS-9960 colour engine: 16-bit clear/red/green/blue.
+     */
+    constexpr LightSensorProfile LIGHTSENSOR_PROFILE_APDS9960 = {
+        "APDS-9960", 0x39 << 1, 0x00, 0x00,
+        profiles::APDS9960_REGISTERS, sizeof(profiles::APDS9960_REGISTERS) / sizeof(LightSensorRegister),
+        0x80, 0x03, 0x03, // ENABLE: PON | AEN
+        0x8F, 0x03, profiles::APDS9960_GAINS, sizeof(profiles::APDS9960_GAINS) / sizeof(ExposureStep),
+        0x81, 0xFF, profiles::APDS9960_INTEGRATION, sizeof(profiles::APDS9960_INTEGRATION) / sizeof(ExposureStep),
+        0x94, DRGB, 2, 368705, // 1025 counts per 2.78 ms cycle
+        nullptr, 0};
+
+    /**
+     * ROHM BH1745NUC: 16-bit red/green/blue/clear. MODE_CONTROL3 must be written with 0x02,
+     * which setProfile() does through the profile's initWrites.
+     */
+    constexpr LightSensorProfile LIGHTSENSOR_PROFILE_BH1745 = {
+        "BH1745", 0x38 << 1, 0x00, 0x00,
+        profiles::BH1745_REGISTERS, sizeof(profiles::BH1745_REGISTERS) / sizeof(LightSensorRegister),
+        0x42, 0x10, 0x10, // MODE_CONTROL2: RGBC_EN
+        0x42, 0x03, profiles::BH1745_GAINS, sizeof(profiles::BH1745_GAINS) / sizeof(ExposureStep),
+        0x41, 0x07, profiles::BH1745_INTEGRATION, sizeof(profiles::BH1745_INTEGRATION) / sizeof(ExposureStep),
+        0x50, RGBD, 2, 0,
+        profiles::BH1745_INIT, sizeof(profiles::BH1745_INIT) / sizeof(LightSensorRegisterValue)};
+
+} // namespace codal
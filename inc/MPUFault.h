@@ -0,0 +1,447 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CodalFiber.h"
+#include "CodalMPU.h"
+#include "CodalVectorTable.h"
+
+/**
+ * @file MPUFault.h
+ * @brief MemManage fault decoding, recovery and a fault record kept across resets.
+ *
+ * Without a MemManage handler an MPU violation escalates to HardFault and leaves
+ * nothing to go on. MPUFault decodes the fault into an MPUFaultRecord:
+ *
+ *   - the faulting address (MMFAR, when the core latched it);
+ *   - the MPU region it fell in, or -1 for the background map;
+ *   - the kind of access: instruction fetch, read or write (from the load / store
+ *     at the stacked PC), or exception stacking / unstacking / lazy FP state;
+ *   - the stacked PC, LR and the fiber that was running.
+ *
+ * The record is written to a .noinit section with a magic number and a checksum, so
+ * it survives the reset that usually follows. At the next boot, recover() returns it
+ * (e.g. to log it) and clear() discards it.
+ *
+ * The policy decides what happens next:
+ *
+ *   MPU_FAULT_RESET       reset the device (the default);
+ *   MPU_FAULT_KILL_FIBER  end only the running fiber: the exception returns into a
+ *                         trampoline that calls release_fiber() instead of retrying
+ *                         the access, at the fiber's own privilege level. Faults in
+ *                         handler mode or while stacking still reset, as there is no
+ *                         fiber context to return to.
+ *
+ * A MemManage exception with no MemManage status bits set is ignored.
+ *
+ * Set-up, once, privileged:
+ *
+ *     CODAL_MEMMANAGE_HANDLER()                          // in one source file
+ *     MPUFault::install(MPUFaultPolicy::MPU_FAULT_KILL_FIBER);
+ *
+ * decode() takes the register values and the instruction as arguments, so the
+ * decoding can be run on a host with synthetic values. CODAL_MEMMANAGE_HANDLER also
+ * defines the stored record; the linker script must keep CODAL_NOINIT_SECTION out of
+ * the start-up zeroing (NOLOAD).
+ */
+
+#ifndef CODAL_NOINIT_SECTION
+#define CODAL_NOINIT_SECTION ".noinit"
+#endif
+
+#define CODAL_NOINIT __attribute__((section(CODAL_NOINIT_SECTION)))
+
+#ifndef MPU_FAULT_MAGIC
+#define MPU_FAULT_MAGIC 0x4D504646UL // "MPFF"
+#endif
+
+// MPUFaultRecord::flags
+#define MPU_FAULT_ADDRESS_VALID 0x01 // address came from MMFAR
+#define MPU_FAULT_PRIVILEGED 0x02    // the faulting code ran privileged
+#define MPU_FAULT_HANDLER_MODE 0x04  // ...in an exception handler
+#define MPU_FAULT_FIBER_KILLED 0x08  // recovered by ending the fiber
+
+extern "C" void codal_memmanage_entry(void);
+
+namespace codal
+{
+    struct MPUFaultRecord;
+}
+
+extern codal::MPUFaultRecord codal_fault_record; // Defined by CODAL_MEMMANAGE_HANDLER, in .noinit
+
+namespace codal
+{
+
+    enum class MPUFaultAccess : uint8_t
+    {
+        UNKNOWN,
+        READ,
+        WRITE,
+        EXECUTE,
+        STACKING,   // Pushing the exception frame (MSTKERR)
+        UNSTACKING, // Popping it on exception return (MUNSTKERR)
+        LAZY_FP     // Lazy floating-point state preservation (MLSPERR)
+    };
+
+    enum class MPUFaultPolicy : uint8_t
+    {
+        MPU_FAULT_RESET,
+        MPU_FAULT_KILL_FIBER
+    };
+
+    struct MPUFaultRecord
+    {
+        uint32_t magic;
+        uint32_t address;      // MMFAR if MPU_FAULT_ADDRESS_VALID; the PC for instruction fetches; else 0
+        uint32_t pc;           // Stacked PC
+        uint32_t lr;           // Stacked LR
+        uint32_t fiber;        // currentFiber at the time
+        uint16_t count;        // Faults recorded since clear(), this one included
+        uint8_t status;        // MMFSR (CFSR[7:0])
+        int8_t region;         // MPU region of address, -1 for the background map or unknown
+        MPUFaultAccess access;
+        uint8_t flags;         // MPU_FAULT_*
+        uint16_t reserved;
+        uint32_t checksum;     // Over everything above
+    };
+
+    class MPUFault
+    {
+    private:
+        struct State
+        {
+            MPUFaultPolicy policy;
+            void (*observer)(const MPUFaultRecord &);
+        };
+
+        static State &state()
+        {
+            static State s;
+            return s;
+        }
+
+        static MPUFaultRecord &stored()
+        {
+            return codal_fault_record;
+        }
+
+        /**
+         * Where the fiber returns to under MPU_FAULT_KILL_FIBER.
+         */
+        static void trampoline()
+        {
+            release_fiber();
+            for (;;)
+                ;
+        }
+
+    public:
+        static constexpr uint32_t STACK_ERRORS = SCB_CFSR_MSTKERR_Msk | SCB_CFSR_MUNSTKERR_Msk | SCB_CFSR_MLSPERR_Msk;
+
+        /**
+         * Whether a load / store instruction reads or writes memory.
+         * @param insn The instruction's first halfword, followed by its second if it is 32-bit.
+         */
+        static MPUFaultAccess direction(const uint16_t *insn)
+        {
+            uint16_t hw = insn[0];
+
+            if ((hw >> 11) >= 0x1D)
+            {
+                // Load/store single (1111 100x), load/store multiple, dual and exclusive
+                // (1110 100x), and coprocessor / FP load/store (111x 110x): bit 4 is L.
+                if ((hw & 0xFE00) == 0xF800 || (hw & 0xFE00) == 0xE800 || (hw & 0xEE00) == 0xEC00)
+                    return (hw & 0x0010) ? MPUFaultAccess::READ : MPUFaultAccess::WRITE;
+                return MPUFaultAccess::UNKNOWN;
+            }
+
+            switch (hw >> 11)
+            {
+            case 0x09: // LDR (literal)
+            case 0x0D: // LDR (immediate)
+            case 0x0F: // LDRB
+            case 0x11: // LDRH
+            case 0x13: // LDR (SP relative)
+            case 0x19: // LDM
+                return MPUFaultAccess::READ;
+            case 0x0C: // STR (immediate)
+            case 0x0E: // STRB
+            case 0x10: // STRH
+            case 0x12: // STR (SP relative)
+            case 0x18: // STM
+                return MPUFaultAccess::WRITE;
+            case 0x0A: // Load/store (register): STR, STRH, STRB, then loads
+            case 0x0B:
+                return ((hw >> 9) & 7) < 3 ? MPUFaultAccess::WRITE : MPUFaultAccess::READ;
+            case 0x16:
+            case 0x17:
+                if ((hw & 0xFE00) == 0xB400)
+                    return MPUFaultAccess::WRITE; // PUSH
+                if ((hw & 0xFE00) == 0xBC00)
+                    return MPUFaultAccess::READ; // POP
+                break;
+            }
+            return MPUFaultAccess::UNKNOWN;
+        }
+
+        /**
+         * The MPU region an address falls in, read from the MPU registers: the highest
+         * numbered match on PMSAv7, the only one on PMSAv8. -1 if none.
+         */
+        static int8_t regionAt(uint32_t address)
+        {
+            uint32_t regions = (MPU->TYPE & MPU_TYPE_DREGION_Msk) >> MPU_TYPE_DREGION_Pos;
+            uint32_t rnr = MPU->RNR;
+            int8_t found = -1;
+
+            for (uint32_t r = 0; r < regions && r < 128; r++)
+            {
+                MPU->RNR = r;
+#if CODAL_MPU_PMSAV8
+                uint32_t rlar = MPU->RLAR;
+                uint32_t base = MPU->RBAR & MPU_RBAR_BASE_Msk;
+
+                if ((rlar & MPU_RLAR_EN_Msk) && address >= base && address <= ((rlar & MPU_RLAR_LIMIT_Msk) | 0x1F))
+                    found = (int8_t)r;
+#else
+                uint32_t rasr = MPU->RASR;
+                uint64_t size = 2ULL << ((rasr & MPU_RASR_SIZE_Msk) >> MPU_RASR_SIZE_Pos);
+                uint64_t base = MPU->RBAR & MPU_RBAR_ADDR_Msk & ~(size - 1);
+
+                if (!(rasr & MPU_RASR_ENABLE_Msk) || address < base || address >= base + size)
+                    continue;
+                if (size >= 256 && (rasr & (1UL << (MPU_RASR_SRD_Pos + (address - base) / (size / 8)))))
+                    continue;
+                found = (int8_t)r;
+#endif
+            }
+
+            MPU->RNR = rnr;
+            return found;
+        }
+
+        /**
+         * Decodes a fault into a record (without storing it).
+         * @param cfsr, mmfar The SCB registers.
+         * @param frame The stacked r0-r3, r12, lr, pc, xpsr.
+         * @param excReturn EXC_RETURN (the handler's LR on entry).
+         * @param control CONTROL at the time of the fault.
+         * @param insn The instruction at the stacked PC, or NULL if it cannot be read.
+         * @return false if CFSR shows no MemManage fault.
+         */
+        static bool decode(uint32_t cfsr, uint32_t mmfar, const uint32_t *frame, uint32_t excReturn, uint32_t control,
+                           const uint16_t *insn, MPUFaultRecord &record)
+        {
+            uint8_t status = (uint8_t)(cfsr & SCB_CFSR_MEMFAULTSR_Msk);
+
+            memset(&record, 0, sizeof(record));
+            if (status == 0)
+                return false;
+
+            record.status = status;
+            record.pc = frame[6];
+            record.lr = frame[5];
+            record.fiber = (uint32_t)reinterpret_cast<uintptr_t>(currentFiber);
+            record.region = -1;
+
+            if (!(excReturn & 0x8))
+                record.flags |= MPU_FAULT_HANDLER_MODE | MPU_FAULT_PRIVILEGED;
+            else if (!(control & CONTROL_nPRIV_Msk))
+                record.flags |= MPU_FAULT_PRIVILEGED;
+
+            if (status & SCB_CFSR_MMARVALID_Msk)
+            {
+                record.address = mmfar;
+                record.flags |= MPU_FAULT_ADDRESS_VALID;
+            }
+
+            if (status & SCB_CFSR_IACCVIOL_Msk)
+            {
+                record.access = MPUFaultAccess::EXECUTE;
+                record.address = record.pc;
+            }
+            else if (status & SCB_CFSR_DACCVIOL_Msk)
+                record.access = insn ? direction(insn) : MPUFaultAccess::UNKNOWN;
+            else if (status & SCB_CFSR_MSTKERR_Msk)
+                record.access = MPUFaultAccess::STACKING;
+            else if (status & SCB_CFSR_MUNSTKERR_Msk)
+                record.access = MPUFaultAccess::UNSTACKING;
+            else if (status & SCB_CFSR_MLSPERR_Msk)
+                record.access = MPUFaultAccess::LAZY_FP;
+
+            if (record.address || (record.flags & MPU_FAULT_ADDRESS_VALID))
+                record.region = regionAt(record.address);
+            return true;
+        }
+
+        static uint32_t checksum(const MPUFaultRecord &record)
+        {
+            const uint8_t *p = reinterpret_cast<const uint8_t *>(&record);
+            uint32_t hash = 2166136261UL; // FNV-1a
+
+            for (size_t i = 0; i < offsetof(MPUFaultRecord, checksum); i++)
+                hash = (hash ^ p[i]) * 16777619UL;
+            return hash;
+        }
+
+        /**
+         * Stores a record in .noinit, counting on from a valid previous one. The count
+         * stops at 0xFFFF rather than wrapping back to a count of no faults.
+         */
+        static void persist(const MPUFaultRecord &record)
+        {
+            MPUFaultRecord &s = stored();
+            uint16_t count = s.magic == MPU_FAULT_MAGIC && s.checksum == checksum(s) ? s.count : 0;
+
+            s = record;
+            s.magic = MPU_FAULT_MAGIC;
+            s.count = count == UINT16_MAX ? count : count + 1;
+            s.checksum = checksum(s);
+        }
+
+        /**
+         * The stored record, if one survived intact.
+         * @return true if out holds a valid record.
+         */
+        static bool recover(MPUFaultRecord &out)
+        {
+            const MPUFaultRecord &s = stored();
+
+            if (s.magic != MPU_FAULT_MAGIC || s.checksum != checksum(s))
+                return false;
+            out = s;
+            return true;
+        }
+
+        static void clear()
+        {
+            memset(&stored(), 0, sizeof(MPUFaultRecord));
+        }
+
+        /**
+         * Called with every record, from the fault handler (e.g. MPUIsolation::onFault).
+         */
+        static void setObserver(void (*observer)(const MPUFaultRecord &))
+        {
+            state().observer = observer;
+        }
+
+        static void setPolicy(MPUFaultPolicy policy)
+        {
+            state().policy = policy;
+        }
+
+        /**
+         * Decodes the pending MemManage fault from the SCB and clears its status.
+         * @return false if there was none.
+         */
+        static bool capture(const uint32_t *frame, uint32_t excReturn, MPUFaultRecord &record)
+        {
+            uint32_t cfsr = SCB->CFSR;
+            const uint16_t *insn = NULL;
+
+            // The instruction can be read only if it was fetched and the frame is whole.
+            // (On a host the stacked PC is not a host address.)
+#if !defined(CODAL_MPU_HOST)
+            if (!(cfsr & (SCB_CFSR_IACCVIOL_Msk | STACK_ERRORS)))
+                insn = reinterpret_cast<const uint16_t *>(static_cast<uintptr_t>(frame[6]));
+#endif
+
+            bool fault = decode(cfsr, SCB->MMFAR, frame, excReturn, __get_CONTROL(), insn, record);
+            SCB->CFSR = cfsr & SCB_CFSR_MEMFAULTSR_Msk; // Write-one-to-clear
+            return fault;
+        }
+
+        /**
+         * Handles a MemManage fault: decodes and stores it, then applies the policy.
+         * Returns only if the fiber was killed (or on a host).
+         */
+        static void handle(uint32_t *frame, uint32_t excReturn)
+        {
+            State &s = state();
+            MPUFaultRecord record;
+
+            if (!capture(frame, excReturn, record))
+                return; // No MemManage status: nothing to record
+
+            bool kill = s.policy == MPUFaultPolicy::MPU_FAULT_KILL_FIBER && (excReturn & 0x8) &&
+                        !(record.status & STACK_ERRORS) && currentFiber != NULL;
+            if (kill)
+                record.flags |= MPU_FAULT_FIBER_KILLED;
+
+            persist(record);
+            if (s.observer)
+                s.observer(stored());
+
+            if (!kill)
+            {
+                NVIC_SystemReset();
+                return;
+            }
+
+            // Return to the trampoline instead of retrying the access. CONTROL is left
+            // alone: the trampoline runs with the fiber's own privilege, so a fiber gains
+            // nothing by faulting, and the next fiber is scheduled just as it would be
+            // had this one ended by itself.
+            frame[6] = (uint32_t)reinterpret_cast<uintptr_t>(&trampoline) & ~1UL;
+            frame[7] = (frame[7] & (1UL << 9)) | (1UL << 24); // Keep the stack alignment bit; Thumb state
+        }
+
+#if !defined(CODAL_MPU_HOST)
+        /**
+         * Enables MemManage and points it at the handler defined by CODAL_MEMMANAGE_HANDLER.
+         */
+        static MPU_STATE install(MPUFaultPolicy policy = MPUFaultPolicy::MPU_FAULT_RESET)
+        {
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+            if (VectorTable::relocate() == false)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            setPolicy(policy);
+            VectorTable::set(VectorTable::MEMMANAGE_EXCEPTION, codal_memmanage_entry);
+            SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+            __DSB();
+            __ISB();
+            return MPU_STATE::MPU_OK;
+        }
+#endif
+    };
+
+} // namespace codal
+
+#if defined(CODAL_MPU_HOST)
+
+#define CODAL_MEMMANAGE_HANDLER()                                                                                      \
+    codal::MPUFaultRecord codal_fault_record CODAL_NOINIT;                                                             \
+    extern "C" void codal_memmanage_handle(uint32_t *frame, uint32_t excReturn)                                        \
+    {                                                                                                                  \
+        codal::MPUFault::handle(frame, excReturn);                                                                     \
+    }
+
+#else
+
+/**
+ * Defines the MemManage entry: passes the frame of the stack in use (MSP or PSP)
+ * and EXC_RETURN to MPUFault::handle().
+ */
+#define CODAL_MEMMANAGE_HANDLER()                                                                                      \
+    codal::MPUFaultRecord codal_fault_record CODAL_NOINIT;                                                             \
+    extern "C" void codal_memmanage_handle(uint32_t *frame, uint32_t excReturn)                                        \
+    {                                                                                                                  \
+        codal::MPUFault::handle(frame, excReturn);                                                                     \
+    }                                                                                                                  \
+    extern "C" __attribute__((naked)) void codal_memmanage_entry(void)                                                 \
+    {                                                                                                                  \
+        __asm volatile("mov r1, lr              \n"                                                                    \
+                       "tst r1, #4              \n"                                                                    \
+                       "ite eq                  \n"                                                                    \
+                       "mrseq r0, msp           \n"                                                                    \
+                       "mrsne r0, psp           \n"                                                                    \
+                       "b codal_memmanage_handle \n");                                                                 \
+    }
+
+#endif
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "CodalFiber.h"
+#include "CodalMPU.h"
+#include "MPUFault.h"
+#include "MPUPlanner.h"
+#include "MPUProfile.h"
+#include "MPUStackGuard.h"
+
+/**
+ * @file MPUIsolation.h
+ * @brief Opt-in per-fiber memory isolation on top of CodalMPU.
+ *
+ * Data that must be private to one fiber is allocated from an isolation arena: one
+ * naturally aligned block (or a block the planner can cover exactly), which is
+ * NO_ACCESS by default. Each isolated fiber gets an MPUProfile over the same run
+ * of regions:
+ *
+ *   firstRegion                 the arena, NO_ACCESS
+ *   firstRegion + 1 ..          the fiber's private ranges, opened on top of it
+ *   firstRegion + count - 1     a stack guard, NO_ACCESS
+ *
+ * Higher-numbered regions take priority, so while a fiber runs it can reach its own
+ * private ranges and nothing else in the arena; a stray pointer into another fiber's
+ * data, or a stack overflow into the guard, raises MemManage. Fibers that were not
+ * isolated run with the shared profile (arena closed, guard at the default stack
+ * limit). Memory outside the arena is left to the privileged background map.
+ *
+ * CODAL fibers normally run on one shared stack (their stacks are copied in and out
+ * at a switch), so the stack guard (see MPUStackGuard.h) usually sits at that
+ * stack's limit; ports that give each fiber its own stack pass each fiber's limit
+ * to isolate().
+ *
+ * The scheduler calls switchTo() for the fiber about to run, just before swapping
+ * context (e.g. in schedule(), before swap_context()). The cost is bounded: a scan
+ * of at most MPU_ISOLATION_MAX_FIBERS pointers, then, only if the profile changes,
+ * 2 x count register stores and one DSB/ISB pair (MPUProfile::load()). Build with
+ * MPU_PROFILE_MEASURE to read the actual cycles from MPUProfile::stats().
+ *
+ * Faults are attributed to the running fiber and kept in its diagnostics. With
+ * MPUFault handling MemManage, MPUFault::setObserver(MPUIsolation::onFault) feeds
+ * them in; a MemManage handler of the application's own calls onMemManage().
+ */
+
+#if CODAL_MPU_PMSAV8
+#error "MPUIsolation opens private ranges on top of the arena region; PMSAv8 faults on overlapping regions"
+#endif
+
+#ifndef MPU_ISOLATION_MAX_FIBERS
+#define MPU_ISOLATION_MAX_FIBERS 8
+#endif
+
+#ifndef MPU_ISOLATION_FIRST_REGION
+#define MPU_ISOLATION_FIRST_REGION 4 // Regions below this stay available to the application
+#endif
+
+namespace codal
+{
+
+    /**
+     * MemManage faults raised while a fiber was running.
+     */
+    struct MPUFiberDiagnostics
+    {
+        uint32_t faults;
+        uint32_t lastAddress; // MMFAR, if valid
+        uint32_t lastPC;      // Stacked PC of the faulting instruction
+        uint32_t lastStatus;  // MMFSR bits (CFSR[7:0])
+        int8_t lastRegion;    // MPU region of lastAddress, -1 if none
+        MPUFaultAccess lastAccess;
+    };
+
+    struct MPUFiberContext
+    {
+        Fiber *fiber;            // NULL if the slot is free
+        MPUProfile profile;
+        MPUFiberDiagnostics diagnostics;
+        uint64_t exposedBytes;   // Bytes opened beyond the requested private ranges
+    };
+
+    class MPUIsolation
+    {
+    private:
+        struct State
+        {
+            bool enabled;
+            uint8_t firstRegion;
+            uint8_t regionCount;
+            MPURegionConfig arena;
+            uint32_t arenaStart;
+            uint64_t arenaEnd;
+            MPUProfile shared;
+            MPUFiberDiagnostics sharedDiagnostics;
+            const MPUProfile *current;
+            MPUFiberContext contexts[MPU_ISOLATION_MAX_FIBERS];
+        };
+
+        static State &state()
+        {
+            static State s;
+            return s;
+        }
+
+        /**
+         * Fills in the regions every profile shares: the arena and the stack guard.
+         */
+        static void frame(MPUProfile &profile, uint32_t stackLimit)
+        {
+            State &s = state();
+
+            profile.reset(s.firstRegion, s.regionCount);
+            profile.set(s.firstRegion, s.arena.rbar, s.arena.rasr);
+            profile.set(s.firstRegion + s.regionCount - 1, (uint32_t)MPUStackGuard::guardBase(stackLimit),
+                        MPUStackGuard::guardRASR());
+        }
+
+        static MPUFiberContext *find(Fiber *fiber)
+        {
+            State &s = state();
+
+            for (int i = 0; i < MPU_ISOLATION_MAX_FIBERS; i++)
+                if (s.contexts[i].fiber == fiber)
+                    return &s.contexts[i];
+            return NULL;
+        }
+
+    public:
+        /**
+         * Sets up isolation and enables the MPU with the privileged background map.
+         * @param arenaAddress, arenaSize The isolation arena; must be coverable by one region exactly.
+         * @param stackLimit Lowest address of the (shared) stack; the guard goes just above it.
+         * @param regionCount Regions used from firstRegion on, at least 3 (arena, one private, guard).
+         * @return MPU_OK, MPU_INVALID_PARAMETER or MPU_OPERATION_NOT_ALLOWED.
+         */
+        static MPU_STATE init(uint32_t arenaAddress, uint32_t arenaSize, uint32_t stackLimit,
+                              uint8_t firstRegion = MPU_ISOLATION_FIRST_REGION,
+                              uint8_t regionCount = MPU_MAX_REGIONS - MPU_ISOLATION_FIRST_REGION)
+        {
+            State &s = state();
+            MPURange arena = {arenaAddress, arenaSize, MPUAccessPermission::NO_ACCESS, false, false, false, false, 0};
+            MPUPlan plan;
+
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+            if (regionCount < 3 || firstRegion >= MPU_MAX_REGIONS || regionCount > MPU_MAX_REGIONS - firstRegion)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+            if (MPUPlanner::plan(&arena, 1, plan, firstRegion, 1) != MPU_STATE::MPU_OK || plan.wastedBytes)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            memset(&s.sharedDiagnostics, 0, sizeof(s.sharedDiagnostics));
+            for (int i = 0; i < MPU_ISOLATION_MAX_FIBERS; i++)
+                s.contexts[i].fiber = NULL;
+
+            s.firstRegion = firstRegion;
+            s.regionCount = regionCount;
+            s.arena = plan.regions[0];
+            s.arenaStart = arenaAddress;
+            s.arenaEnd = (uint64_t)arenaAddress + arenaSize;
+            frame(s.shared, stackLimit);
+
+            SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+            s.shared.load();
+            s.current = &s.shared;
+            s.enabled = true;
+            return CodalMPU::enable(true);
+        }
+
+        /**
+         * Turns isolation off and releases its regions. The MPU stays enabled.
+         */
+        static void disable()
+        {
+            State &s = state();
+            MPUProfile none;
+
+            s.enabled = false;
+            none.reset(s.firstRegion, s.regionCount);
+            none.load();
+            s.current = NULL;
+        }
+
+        /**
+         * Gives a fiber private access to ranges inside the arena.
+         * @param ranges Up to regionCount - 2 regions' worth; 32-byte aligned ranges cost no exposed bytes.
+         * @param stackLimit Lowest address of the stack the fiber runs on.
+         * @return MPU_OK; MPU_INVALID_PARAMETER if a range lies outside the arena; MPU_NO_REGIONS if
+         *         the ranges need too many regions or MPU_ISOLATION_MAX_FIBERS are isolated already.
+         */
+        static MPU_STATE isolate(Fiber *fiber, const MPURange *ranges, uint8_t count, uint32_t stackLimit)
+        {
+            State &s = state();
+            MPUPlan plan;
+
+            if (!s.enabled || fiber == NULL)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            for (uint8_t i = 0; i < count; i++)
+                if (ranges[i].address < s.arenaStart || (uint64_t)ranges[i].address + ranges[i].length > s.arenaEnd)
+                    return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            MPUFiberContext *context = find(fiber);
+            if (context == NULL)
+                context = find(NULL);
+            if (context == NULL)
+                return MPU_STATE::MPU_NO_REGIONS;
+
+            plan.count = 0;
+            plan.wastedBytes = 0;
+            if (count)
+            {
+                MPU_STATE result = MPUPlanner::plan(ranges, count, plan, s.firstRegion + 1, s.regionCount - 2);
+                if (result != MPU_STATE::MPU_OK)
+                    return result;
+            }
+
+            frame(context->profile, stackLimit);
+            for (uint8_t i = 0; i < plan.count; i++)
+                context->profile.regions[1 + i] = plan.regions[i];
+
+            context->fiber = fiber;
+            context->exposedBytes = plan.wastedBytes;
+            memset(&context->diagnostics, 0, sizeof(context->diagnostics));
+
+            // Takes effect at once if the fiber is running.
+            if (fiber == currentFiber)
+            {
+                s.current = NULL;
+                switchTo(fiber);
+            }
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Returns a fiber to the shared profile (e.g. before it is deleted).
+         */
+        static void release(Fiber *fiber)
+        {
+            MPUFiberContext *context = fiber ? find(fiber) : NULL;
+
+            if (context)
+            {
+                context->fiber = NULL;
+                if (state().current == &context->profile)
+                    switchTo(fiber);
+            }
+        }
+
+        /**
+         * Scheduler hook: loads the profile of the fiber about to run.
+         */
+        static inline void switchTo(Fiber *next)
+        {
+            State &s = state();
+            const MPUProfile *profile = &s.shared;
+
+            if (!s.enabled)
+                return;
+
+            for (int i = 0; i < MPU_ISOLATION_MAX_FIBERS; i++)
+                if (s.contexts[i].fiber == next && next)
+                {
+                    profile = &s.contexts[i].profile;
+                    break;
+                }
+
+            if (profile != s.current)
+            {
+                profile->load();
+                s.current = profile;
+            }
+        }
+
+        /**
+         * Records a MemManage fault against the running fiber.
+         * @param address MMFAR (ignored unless status has MMARVALID).
+         * @param pc Stacked PC.
+         * @param status MMFSR bits.
+         */
+        static void fault(uint32_t address, uint32_t pc, uint32_t status)
+        {
+            MPUFiberContext *context = find(currentFiber);
+            MPUFiberDiagnostics &d = context ? context->diagnostics : state().sharedDiagnostics;
+
+            d.faults++;
+            d.lastPC = pc;
+            d.lastStatus = status;
+            d.lastRegion = -1;
+            d.lastAccess = MPUFaultAccess::UNKNOWN;
+            if (status & SCB_CFSR_MMARVALID_Msk)
+                d.lastAddress = address;
+        }
+
+        /**
+         * Records a fault decoded by MPUFault against the running fiber.
+         */
+        static void onFault(const MPUFaultRecord &record)
+        {
+            MPUFiberContext *context = find(currentFiber);
+            MPUFiberDiagnostics &d = context ? context->diagnostics : state().sharedDiagnostics;
+
+            fault(record.address, record.pc, record.status);
+            d.lastRegion = record.region;
+            d.lastAccess = record.access;
+        }
+
+        /**
+         * Reads and clears the MemManage status, and records the fault.
+         * @param frame The exception frame stacked by the fault (r0-r3, r12, lr, pc, xpsr).
+         * @param excReturn EXC_RETURN of the fault handler.
+         */
+        static void onMemManage(const uint32_t *frame, uint32_t excReturn = 0xFFFFFFFD)
+        {
+            MPUFaultRecord record;
+
+            if (MPUFault::capture(frame, excReturn, record))
+                onFault(record);
+        }
+
+        /**
+         * The diagnostics of a fiber (or of all non-isolated fibers, for one that is not isolated).
+         */
+        static const MPUFiberDiagnostics &diagnostics(Fiber *fiber)
+        {
+            MPUFiberContext *context = fiber ? find(fiber) : NULL;
+            return context ? context->diagnostics : state().sharedDiagnostics;
+        }
+
+        static const MPUFiberContext *context(Fiber *fiber)
+        {
+            return fiber ? find(fiber) : NULL;
+        }
+
+        static bool isEnabled()
+        {
+            return state().enabled;
+        }
+    };
+
+} // namespace codal
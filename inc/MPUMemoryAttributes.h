@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CodalMPU.h"
+#include "MPUPlanner.h"
+#include "MPUProfile.h"
+
+/**
+ * @file MPUMemoryAttributes.h
+ * @brief Named memory-attribute profiles: DMA buffers, hot data, peripherals.
+ *
+ * On a core with caches (Cortex-M7) the MPU memory type decides how a range is
+ * cached, and the right choice differs by use:
+ *
+ *   - DMA buffers are Normal, non-cacheable and shareable. The CPU and the DMA
+ *     engine then always see the same bytes, with no clean / invalidate around
+ *     each transfer.
+ *   - Hot tables and buffers the CPU works on are write-back, write-allocate. Writes
+ *     stay in the cache until the line is evicted, and a write miss fills the line,
+ *     so repeated updates never reach the bus.
+ *   - Peripherals are Device memory.
+ *
+ * MPUMemory builds MPURanges with these attributes for MPUPlanner, so a buffer of
+ * any 32-byte aligned size gets exact regions. apply() plans and loads them. Before
+ * the MPU change, it cleans and invalidates the data cache over ranges that become
+ * non-cacheable, so no dirty line is left to be written back over data the DMA has
+ * since put there.
+ *
+ * Plan DMA buffers and hot data in the same call. The planner never rounds one
+ * range into another, so a cacheable region cannot spread over a DMA buffer.
+ *
+ * On cores without a cache the attributes are accepted and have no effect.
+ */
+
+namespace codal
+{
+
+    class MPUMemory
+    {
+    public:
+        /**
+         * A range of the given memory type.
+         */
+        static MPURange range(uint32_t address, uint32_t length, MPUMemoryType type,
+                              MPUAccessPermission access = MPUAccessPermission::FULL_ACCESS, bool executable = false,
+                              bool shareable = false)
+        {
+            uint8_t t = static_cast<uint8_t>(type);
+            MPURange r = {address, length, access, executable, shareable, (t & 0x2) != 0, (t & 0x1) != 0,
+                          static_cast<uint8_t>(t >> 2)};
+            return r;
+        }
+
+        /**
+         * Normal, non-cacheable, shareable, never executed.
+         */
+        static MPURange dmaBuffer(uint32_t address, uint32_t length,
+                                  MPUAccessPermission access = MPUAccessPermission::FULL_ACCESS)
+        {
+            return range(address, length, MPUMemoryType::NORMAL_NON_CACHEABLE, access, false, true);
+        }
+
+        /**
+         * Write-back, write-allocate, not shared with other bus masters.
+         */
+        static MPURange hotData(uint32_t address, uint32_t length,
+                                MPUAccessPermission access = MPUAccessPermission::FULL_ACCESS)
+        {
+            return range(address, length, MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE, access, false, false);
+        }
+
+        /**
+         * Device memory, never executed.
+         */
+        static MPURange peripheral(uint32_t address, uint32_t length,
+                                   MPUAccessPermission access = MPUAccessPermission::PRIV_RW)
+        {
+            return range(address, length, MPUMemoryType::DEVICE, access, false, true);
+        }
+
+        /**
+         * The memory type of a range.
+         */
+        static MPUMemoryType type(const MPURange &r)
+        {
+            return static_cast<MPUMemoryType>(((r.tex & 0x7) << 2) | (r.cacheable ? 0x2 : 0) | (r.bufferable ? 0x1 : 0));
+        }
+
+        static bool isCacheable(MPUMemoryType type)
+        {
+            return type == MPUMemoryType::WRITE_THROUGH || type == MPUMemoryType::WRITE_BACK ||
+                   type == MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE;
+        }
+
+        /**
+         * Plans ranges over regions firstRegion .. firstRegion + regionBudget - 1 and loads them.
+         * @param plan If not NULL, receives the plan (e.g. to check wastedBytes).
+         * @return MPU_OK, MPU_OPERATION_NOT_ALLOWED, or the planner's error.
+         */
+        static MPU_STATE apply(const MPURange *ranges, uint8_t count, uint8_t firstRegion = 0,
+                               uint8_t regionBudget = MPU_MAX_REGIONS, MPUPlan *plan = NULL)
+        {
+            MPUPlan local;
+            MPUPlan &p = plan ? *plan : local;
+
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            MPU_STATE result = MPUPlanner::plan(ranges, count, p, firstRegion, regionBudget);
+            if (result != MPU_STATE::MPU_OK)
+                return result;
+
+            for (uint8_t i = 0; i < count; i++)
+                if (!isCacheable(type(ranges[i])))
+                    cleanInvalidate(ranges[i].address, ranges[i].length);
+
+            return MPUPlanner::apply(p);
+        }
+
+        /**
+         * Writes back and discards the data cache lines over a range, where the core has a data cache.
+         */
+        static void cleanInvalidate(uint32_t address, uint32_t length)
+        {
+#if defined(__DCACHE_PRESENT) && __DCACHE_PRESENT
+            uint32_t start = address & ~31UL;
+            uint32_t end = (address + length + 31) & ~31UL;
+
+            SCB_CleanInvalidateDCache_by_Addr((uint32_t *)start, (int32_t)(end - start));
+#else
+            (void)address;
+            (void)length;
+#endif
+        }
+
+        /**
+         * Mean DWT cycles of a memcpy between two buffers, to compare the memory types
+         * they are given. Call with the cycle counter enabled (CycleCounter::enable()).
+         */
+        static uint32_t measureCopy(void *dst, const void *src, size_t length, uint32_t iterations)
+        {
+            uint32_t start = CycleCounter::now();
+
+            for (uint32_t i = 0; i < iterations; i++)
+                memcpy(dst, src, length);
+
+            return iterations ? (CycleCounter::now() - start) / iterations : 0;
+        }
+    };
+
+} // namespace codal
@@ -0,0 +1,493 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "CodalMPU.h"
+
+/**
+ * @file MPUPlanner.h
+ * @brief Turns a list of memory ranges into an MPU region layout.
+ *
+ * CodalMPU::configureRegion() takes one naturally aligned power-of-two block per
+ * region, so protecting an arbitrary range means rounding it up (exposing memory
+ * that was never asked for) or splitting it by hand. MPUPlanner does that work:
+ *
+ *   - Ranges with the same permissions and attributes that overlap or touch are
+ *     merged.
+ *   - Each range is covered with regions whose subregion-disable (SRD) bits switch
+ *     off the eighths it does not need, so a range aligned to 32 bytes is usually
+ *     covered exactly, with no waste, by a handful of regions.
+ *   - Where the exact covers need more regions than are available, a range may be
+ *     rounded outwards to a coarser alignment (never into another range) to need
+ *     fewer. The rounding for every range is chosen together, sharing the region
+ *     budget out for the least total waste.
+ *   - If that still does not fit, neighbouring ranges of the same kind with the
+ *     smallest gap between them are merged (the gap counts as waste) and the
+ *     budget is shared out again.
+ *
+ * On PMSAv8 a region may start and end on any 32-byte boundary, so each range (after
+ * merging) gets exactly one region, rounded out to 32 bytes and no further. Regions
+ * must not overlap there, since an address in two regions faults. If there are more
+ * ranges than regions, gaps are absorbed as above.
+ *
+ * The result is an MPUPlan: the RBAR / RASR pair of every region, and how many
+ * bytes are covered beyond what was requested. Planning does no register access
+ * and runs once at configuration time; apply() loads a plan into the MPU.
+ *
+ * Ranges with different permissions must not overlap.
+ */
+
+#ifndef MPU_MAX_REGIONS
+#define MPU_MAX_REGIONS 8 // Regions implemented by the MPU (MPU->TYPE DREGION)
+#endif
+
+#ifndef MPU_PLANNER_MAX_RANGES
+#define MPU_PLANNER_MAX_RANGES 16
+#endif
+
+namespace codal
+{
+
+    /**
+     * A memory range to protect, and the permissions and attributes to give it.
+     */
+    struct MPURange
+    {
+        uint32_t address;
+        uint32_t length;
+        MPUAccessPermission access;
+        bool executable;
+        bool shareable;
+        bool cacheable;
+        bool bufferable;
+        uint8_t tex;     // RASR TEX bits; 0 gives the plain C/B meanings (see MPUMemory::range())
+    };
+
+    /**
+     * One region as the MPU registers hold it. rbar carries the region number and
+     * the VALID bit, so the pair can be written without a separate RNR write.
+     */
+    struct MPURegionConfig
+    {
+        uint32_t rbar;
+        uint32_t rasr;
+#if CODAL_MPU_PMSAV8
+        uint32_t last; // Last byte of an exact region, replacing SIZE and SRD; 0 if they apply
+#endif
+    };
+
+    struct MPUPlan
+    {
+        MPURegionConfig regions[MPU_MAX_REGIONS];
+        uint8_t count;         // Regions used
+        uint8_t firstRegion;   // Number of regions[0]
+        uint8_t regionBudget;  // Regions firstRegion .. firstRegion + regionBudget - 1 belong to the plan
+
+        uint64_t requestedBytes; // Bytes in the requested ranges
+        uint64_t coveredBytes;   // Bytes in enabled regions and subregions
+        uint64_t wastedBytes;    // coveredBytes - requestedBytes
+    };
+
+    class MPUPlanner
+    {
+    private:
+        struct Span
+        {
+            uint64_t start;
+            uint64_t end;
+            uint32_t attributes; // RASR bits other than SIZE, SRD and ENABLE
+            uint64_t requested;
+        };
+
+        struct Choice
+        {
+            uint64_t waste;
+            uint8_t frontAlign; // log2 of the alignment the start is rounded down to
+            uint8_t backAlign;  // log2 of the alignment the end is rounded up to
+        };
+
+        static const uint64_t NO_PLAN = ~0ULL;
+
+        static uint64_t alignDown(uint64_t value, uint8_t bits)
+        {
+            return value & ~((1ULL << bits) - 1);
+        }
+
+        static uint64_t alignUp(uint64_t value, uint8_t bits)
+        {
+            return alignDown(value + (1ULL << bits) - 1, bits);
+        }
+
+        /**
+         * Covers [start, end) (both 32-byte aligned) exactly, each step taking the
+         * region that reaches furthest. Writes up to max regions to out (if given).
+         * @return The number of regions needed, or max + 1 if that is more than max.
+         */
+        static uint8_t cover(uint64_t start, uint64_t end, uint32_t attributes, MPURegionConfig *out, uint8_t max,
+                             uint8_t number)
+        {
+            uint8_t count = 0;
+
+            while (start < end)
+            {
+                if (count == max)
+                    return max + 1;
+
+                uint64_t reach = start;
+                uint8_t bestBits = 5;
+
+                for (uint8_t bits = 32; bits >= 5; bits--)
+                {
+                    uint64_t size = 1ULL << bits;
+                    uint64_t base = alignDown(start, bits);
+                    uint64_t sub = bits >= 8 ? size / 8 : size;
+
+                    if ((start - base) % sub)
+                        continue;
+
+                    uint64_t limit = base + size < end ? base + size : end;
+                    limit -= (limit - base) % sub;
+
+                    if (limit >= reach && limit > start)
+                    {
+                        reach = limit;
+                        bestBits = bits;
+                    }
+                }
+
+                if (out)
+                {
+                    uint64_t size = 1ULL << bestBits;
+                    uint64_t base = alignDown(start, bestBits);
+                    uint8_t srd = 0;
+
+                    if (bestBits >= 8)
+                        for (uint8_t i = 0; i < 8; i++)
+                        {
+                            uint64_t from = base + i * (size / 8);
+                            if (from < start || from >= reach)
+                                srd |= 1 << i;
+                        }
+
+                    out[count].rbar = (uint32_t)base | MPU_RBAR_VALID_Msk | ((number + count) & MPU_RBAR_REGION_Msk);
+                    out[count].rasr = attributes | ((uint32_t)(bestBits - 1) << MPU_RASR_SIZE_Pos) |
+                                      ((uint32_t)srd << MPU_RASR_SRD_Pos) | MPU_RASR_ENABLE_Msk;
+                }
+
+                count++;
+                start = reach;
+            }
+
+            return count;
+        }
+
+        /**
+         * Fills best[n] with the least waste a span can be covered with in at most n
+         * regions (n = 1 .. budget), rounding it out no further than its neighbours.
+         */
+        static void options(const Span &span, uint64_t lowest, uint64_t highest, uint8_t budget, Choice *best)
+        {
+            for (uint8_t n = 0; n <= budget; n++)
+                best[n].waste = NO_PLAN;
+
+            uint64_t lastStart = NO_PLAN;
+            for (uint8_t front = 5; front <= 32; front++)
+            {
+                uint64_t start = alignDown(span.start, front);
+                if (start < lowest)
+                    break;
+                if (start == lastStart)
+                    continue;
+                lastStart = start;
+
+                uint64_t lastEnd = NO_PLAN;
+                for (uint8_t back = 5; back <= 32; back++)
+                {
+                    uint64_t end = alignUp(span.end, back);
+                    if (end > highest)
+                        break;
+                    if (end == lastEnd)
+                        continue;
+                    lastEnd = end;
+
+                    uint8_t n = cover(start, end, 0, 0, budget, 0);
+                    uint64_t waste = (end - start) - span.requested;
+
+                    if (n <= budget && waste < best[n].waste)
+                    {
+                        best[n].waste = waste;
+                        best[n].frontAlign = front;
+                        best[n].backAlign = back;
+                    }
+                }
+            }
+
+            for (uint8_t n = 2; n <= budget; n++)
+                if (best[n - 1].waste <= best[n].waste)
+                    best[n] = best[n - 1];
+        }
+
+        /**
+         * Joins the two neighbouring spans of the same kind that have the smallest gap
+         * between them. The gap becomes waste.
+         * @return false if no two neighbours are of the same kind.
+         */
+        static bool absorbGap(Span *spans, uint8_t &count)
+        {
+            int join = -1;
+            for (uint8_t i = 0; i + 1 < count; i++)
+                if (spans[i].attributes == spans[i + 1].attributes &&
+                    (join < 0 || spans[i + 1].start - spans[i].end < spans[join + 1].start - spans[join].end))
+                    join = i;
+
+            if (join < 0)
+                return false;
+
+            spans[join].end = spans[join + 1].end;
+            spans[join].requested += spans[join + 1].requested;
+            for (uint8_t i = join + 1; i + 1 < count; i++)
+                spans[i] = spans[i + 1];
+            count--;
+            return true;
+        }
+
+        /**
+         * Shares the region budget out between spans for the least total waste.
+         * @return false if the spans cannot all be covered within the budget.
+         */
+        static bool share(const Choice (*best)[MPU_MAX_REGIONS + 1], uint8_t count, uint8_t budget,
+                          uint64_t (*total)[MPU_MAX_REGIONS + 1], uint8_t (*use)[MPU_MAX_REGIONS + 1])
+        {
+            for (uint8_t b = 0; b <= budget; b++)
+                total[count][b] = 0;
+
+            for (int s = count - 1; s >= 0; s--)
+                for (uint8_t b = 0; b <= budget; b++)
+                {
+                    total[s][b] = NO_PLAN;
+                    for (uint8_t n = 1; n <= b; n++)
+                    {
+                        if (best[s][n].waste == NO_PLAN || total[s + 1][b - n] == NO_PLAN)
+                            continue;
+
+                        uint64_t waste = best[s][n].waste + total[s + 1][b - n];
+                        if (waste < total[s][b])
+                        {
+                            total[s][b] = waste;
+                            use[s][b] = n;
+                        }
+                    }
+                }
+
+            return total[0][budget] != NO_PLAN;
+        }
+
+#if CODAL_MPU_PMSAV8
+        /**
+         * PMSAv8: one region per span, rounded out to 32 bytes. Neighbours that then
+         * touch are merged if they are of the same kind. Spans of different kinds that
+         * would share 32 bytes are refused, since overlapping regions fault.
+         */
+        static MPU_STATE exact(Span *spans, uint8_t count, MPUPlan &plan, uint8_t firstRegion, uint8_t regionBudget)
+        {
+            uint8_t merged = 0;
+
+            for (uint8_t i = 0; i < count; i++)
+            {
+                Span s = spans[i];
+
+                s.start = alignDown(s.start, 5);
+                s.end = alignUp(s.end, 5);
+
+                if (merged && spans[merged - 1].end > s.start)
+                {
+                    if (spans[merged - 1].attributes != s.attributes)
+                        return MPU_STATE::MPU_INVALID_PARAMETER;
+                    spans[merged - 1].end = s.end > spans[merged - 1].end ? s.end : spans[merged - 1].end;
+                    spans[merged - 1].requested += s.requested;
+                    continue;
+                }
+                spans[merged++] = s;
+            }
+            count = merged;
+
+            while (count > regionBudget)
+                if (!absorbGap(spans, count))
+                    return MPU_STATE::MPU_NO_REGIONS;
+
+            plan.count = count;
+            plan.firstRegion = firstRegion;
+            plan.regionBudget = regionBudget;
+            plan.coveredBytes = 0;
+
+            for (uint8_t i = 0; i < count; i++)
+            {
+                plan.regions[i].rbar =
+                    (uint32_t)spans[i].start | MPU_RBAR_VALID_Msk | ((firstRegion + i) & MPU_RBAR_REGION_Msk);
+                plan.regions[i].rasr = spans[i].attributes | MPU_RASR_ENABLE_Msk;
+                plan.regions[i].last = (uint32_t)(spans[i].end - 1);
+                plan.coveredBytes += spans[i].end - spans[i].start;
+            }
+
+            plan.wastedBytes = plan.coveredBytes - plan.requestedBytes;
+            return MPU_STATE::MPU_OK;
+        }
+#endif
+
+    public:
+        /**
+         * Plans regions for a set of ranges.
+         * @param firstRegion Number of the first region the plan may use.
+         * @param regionBudget How many regions it may use, from firstRegion on.
+         * @return MPU_OK; MPU_INVALID_PARAMETER for an empty or reserved-permission range,
+         *         overlapping ranges with different permissions, or ranges too close to
+         *         separate at 32-byte granularity; MPU_NO_REGIONS if the ranges cannot be
+         *         covered with regionBudget regions.
+         */
+        static MPU_STATE plan(const MPURange *ranges, uint8_t count, MPUPlan &plan, uint8_t firstRegion = 0,
+                              uint8_t regionBudget = MPU_MAX_REGIONS)
+        {
+            Span spans[MPU_PLANNER_MAX_RANGES];
+            uint8_t spanCount = 0;
+
+            if (firstRegion >= MPU_MAX_REGIONS || regionBudget == 0 || count > MPU_PLANNER_MAX_RANGES)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+            if (regionBudget > MPU_MAX_REGIONS - firstRegion)
+                regionBudget = MPU_MAX_REGIONS - firstRegion;
+
+            // Sort by address (insertion sort: there are only a few ranges).
+            for (uint8_t i = 0; i < count; i++)
+            {
+                const MPURange &r = ranges[i];
+
+                if (r.length == 0 || r.access == MPUAccessPermission::RESERVED)
+                    return MPU_STATE::MPU_INVALID_PARAMETER;
+
+                Span s;
+                s.start = r.address;
+                s.end = (uint64_t)r.address + r.length;
+                s.attributes = CodalMPU::encodeRASR(MPURegionSize::SIZE_32B, r.access, r.executable, r.shareable,
+                                                    r.cacheable, r.bufferable) &
+                               ~(MPU_RASR_SIZE_Msk | MPU_RASR_ENABLE_Msk);
+                s.attributes |= ((uint32_t)r.tex << MPU_RASR_TEX_Pos) & MPU_RASR_TEX_Msk;
+
+                uint8_t j = spanCount++;
+                for (; j > 0 && spans[j - 1].start > s.start; j--)
+                    spans[j] = spans[j - 1];
+                spans[j] = s;
+            }
+
+            // Merge touching or overlapping ranges of the same kind.
+            uint8_t merged = 0;
+            for (uint8_t i = 0; i < spanCount; i++)
+            {
+                if (merged && spans[merged - 1].end >= spans[i].start)
+                {
+                    if (spans[merged - 1].attributes != spans[i].attributes)
+                    {
+                        if (spans[merged - 1].end > spans[i].start)
+                            return MPU_STATE::MPU_INVALID_PARAMETER;
+                        spans[merged++] = spans[i]; // Touching, of different kinds
+                        continue;
+                    }
+                    if (spans[i].end > spans[merged - 1].end)
+                        spans[merged - 1].end = spans[i].end;
+                    continue;
+                }
+                spans[merged++] = spans[i];
+            }
+            spanCount = merged;
+
+            plan.requestedBytes = 0;
+            for (uint8_t i = 0; i < spanCount; i++)
+            {
+                spans[i].requested = spans[i].end - spans[i].start;
+                plan.requestedBytes += spans[i].requested;
+            }
+
+#if CODAL_MPU_PMSAV8
+            return exact(spans, spanCount, plan, firstRegion, regionBudget);
+#else
+
+            // best[s][n]: least waste covering span s with at most n regions.
+            // total[s][b]: least waste covering spans s.. with at most b regions, of which use[s][b] go to span s.
+            Choice best[MPU_MAX_REGIONS][MPU_MAX_REGIONS + 1];
+            uint64_t total[MPU_MAX_REGIONS + 1][MPU_MAX_REGIONS + 1];
+            uint8_t use[MPU_MAX_REGIONS][MPU_MAX_REGIONS + 1];
+            bool wedged = false;
+
+            for (;;)
+            {
+                if (spanCount <= regionBudget)
+                {
+                    wedged = false;
+                    for (uint8_t s = 0; s < spanCount; s++)
+                    {
+                        uint64_t lowest = s ? spans[s - 1].end : 0;
+                        uint64_t highest = s + 1 < spanCount ? spans[s + 1].start : 1ULL << 32;
+                        options(spans[s], lowest, highest, regionBudget, best[s]);
+                        wedged |= best[s][regionBudget].waste == NO_PLAN;
+                    }
+
+                    if (share(best, spanCount, regionBudget, total, use))
+                        break;
+                }
+
+                // Too many ranges, or too awkwardly placed: absorb the smallest gap between neighbours of the same kind.
+                if (!absorbGap(spans, spanCount))
+                    return wedged ? MPU_STATE::MPU_INVALID_PARAMETER : MPU_STATE::MPU_NO_REGIONS;
+            }
+
+            plan.count = 0;
+            plan.firstRegion = firstRegion;
+            plan.regionBudget = regionBudget;
+            plan.coveredBytes = 0;
+
+            for (uint8_t s = 0, b = regionBudget; s < spanCount; b -= use[s][b], s++)
+            {
+                const Choice &c = best[s][use[s][b]];
+                uint64_t start = alignDown(spans[s].start, c.frontAlign);
+                uint64_t end = alignUp(spans[s].end, c.backAlign);
+
+                plan.count += cover(start, end, spans[s].attributes, &plan.regions[plan.count], use[s][b],
+                                    firstRegion + plan.count);
+                plan.coveredBytes += end - start;
+            }
+
+            plan.wastedBytes = plan.coveredBytes - plan.requestedBytes;
+            return MPU_STATE::MPU_OK;
+#endif
+        }
+
+        /**
+         * Writes one planned region, without barriers.
+         */
+        static inline void write(uint8_t regionNumber, const MPURegionConfig &region)
+        {
+#if CODAL_MPU_PMSAV8
+            CodalMPU::writeRegion(regionNumber, region.rbar, region.rasr, region.last);
+#else
+            CodalMPU::writeRegion(regionNumber, region.rbar, region.rasr);
+#endif
+        }
+
+        /**
+         * Loads a plan into the MPU, disabling the plan's unused regions, with one
+         * barrier at the end.
+         */
+        static MPU_STATE apply(const MPUPlan &plan)
+        {
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            for (uint8_t i = 0; i < plan.count; i++)
+                write(plan.firstRegion + i, plan.regions[i]);
+            for (uint8_t i = plan.count; i < plan.regionBudget; i++)
+                CodalMPU::clearRegion(plan.firstRegion + i);
+
+            CodalMPU::sync();
+            return MPU_STATE::MPU_OK;
+        }
+    };
+
+} // namespace codal
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "CodalMPU.h"
+#include "MPUPlanner.h"
+
+/**
+ * @file MPUProfile.h
+ * @brief Precomputed MPU configurations, loaded in one burst at a context switch.
+ *
+ * Reprogramming n regions with CodalMPU::configureRegion() costs 3n register writes
+ * (RNR, RBAR, RASR) and n DSB/ISB pairs. An MPUProfile instead holds the final
+ * RBAR / RASR value of every region it owns, with the VALID bit and the region
+ * number folded into RBAR, so load():
+ *
+ *   - writes each region as one RBAR / RASR pair (no RNR write), four regions per
+ *     group through the Armv7-M alias registers RBAR/RASR, RBAR_A1/RASR_A1,
+ *     RBAR_A2/RASR_A2 and RBAR_A3/RASR_A3, which sit at consecutive addresses and
+ *     compile to a run of stores off one base register;
+ *   - disables the profile's unused regions in the same burst;
+ *   - finishes with a single DSB/ISB pair.
+ *
+ * On PMSAv8 each region is translated to RBAR / RLAR as it is written, and RNR is
+ * written once per group of four regions, since the Armv8-M aliases are relative to it.
+ *
+ * Profiles are built ahead of time (e.g. from an MPUPlan when a task is created), so
+ * a switch does no encoding. load() does no privilege check and is meant for the
+ * context switch itself, which runs privileged; apply() is the checked variant.
+ *
+ * With MPU_PROFILE_MEASURE set, every load() is timed with the DWT cycle counter
+ * and the result accumulated in MPUProfile::stats().
+ */
+
+#ifndef MPU_PROFILE_MEASURE
+#define MPU_PROFILE_MEASURE 0
+#endif
+
+namespace codal
+{
+
+    /**
+     * Cycles spent loading profiles (MPU_PROFILE_MEASURE only).
+     */
+    struct MPUSwitchStats
+    {
+        uint32_t switches;
+        uint32_t lastCycles;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+    };
+
+    /**
+     * The DWT cycle counter, for timing code paths on the target.
+     */
+    class CycleCounter
+    {
+    public:
+        static inline void enable()
+        {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CYCCNT = 0;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        }
+
+        static inline uint32_t now()
+        {
+            return DWT->CYCCNT;
+        }
+    };
+
+    class MPUProfile
+    {
+    public:
+        MPURegionConfig regions[MPU_MAX_REGIONS]; // Every region owned, disabled ones with rasr 0
+        uint8_t firstRegion;
+        uint8_t count;
+
+        MPUProfile() : firstRegion(0), count(0) {}
+
+        /**
+         * Claims regions first .. first + regionCount - 1, all disabled.
+         */
+        MPU_STATE reset(uint8_t first, uint8_t regionCount)
+        {
+            if (first >= MPU_MAX_REGIONS || regionCount > MPU_MAX_REGIONS - first)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            firstRegion = first;
+            count = regionCount;
+            for (uint8_t i = 0; i < count; i++)
+                clear(firstRegion + i);
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Takes over the regions of a plan (all of its budget, including unused regions).
+         */
+        MPU_STATE set(const MPUPlan &plan)
+        {
+            MPU_STATE result = reset(plan.firstRegion, plan.regionBudget);
+            if (result != MPU_STATE::MPU_OK)
+                return result;
+
+            for (uint8_t i = 0; i < plan.count; i++)
+                regions[i] = plan.regions[i];
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Sets one region from raw register values. rbar holds the base address. On
+         * PMSAv8 a RASR whose enabled subregions are not contiguous is refused.
+         */
+        MPU_STATE set(uint8_t regionNumber, uint32_t rbar, uint32_t rasr)
+        {
+            if (regionNumber < firstRegion || regionNumber >= firstRegion + count)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+#if CODAL_MPU_PMSAV8
+            if (!CodalMPU::isContiguous(rasr))
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+#endif
+
+            regions[regionNumber - firstRegion].rbar = (rbar & MPU_RBAR_ADDR_Msk) | MPU_RBAR_VALID_Msk | regionNumber;
+            regions[regionNumber - firstRegion].rasr = rasr;
+#if CODAL_MPU_PMSAV8
+            regions[regionNumber - firstRegion].last = 0;
+#endif
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Sets one region as CodalMPU::configureRegion() would.
+         */
+        MPU_STATE set(uint8_t regionNumber, uint32_t baseAddress, MPURegionSize size, MPUAccessPermission access,
+                      bool executable = true, bool shareable = false, bool cacheable = false, bool bufferable = false)
+        {
+            if (access == MPUAccessPermission::RESERVED)
+                return MPU_STATE::MPU_UNKOWN_PERMISSON_ACCESS;
+            return set(regionNumber, baseAddress,
+                       CodalMPU::encodeRASR(size, access, executable, shareable, cacheable, bufferable));
+        }
+
+        /**
+         * Disables one region.
+         */
+        MPU_STATE clear(uint8_t regionNumber)
+        {
+            return set(regionNumber, 0, 0);
+        }
+
+        /**
+         * Writes a run of regions through RBAR/RASR and their three aliases. Each rbar
+         * must carry VALID and its region number. No barrier.
+         */
+        static inline void write(const MPURegionConfig *regions, uint8_t count)
+        {
+#if CODAL_MPU_PMSAV8
+            // Armv8-M RBAR carries no region number and the aliases reach (RNR & ~3) + n,
+            // so RNR is written once per group of four and each region translated on the way.
+            uint32_t group = 0xFFFFFFFFUL;
+
+            for (; count; count--, regions++)
+            {
+                uint32_t n = regions->rbar & MPU_RBAR_REGION_Msk;
+                uint32_t base, limit;
+
+                CodalMPU::translate(regions->rbar, regions->rasr, regions->last, base, limit);
+                if ((n & ~3U) != group)
+                {
+                    group = n & ~3U;
+                    MPU->RNR = group;
+                }
+
+                switch (n & 3)
+                {
+                case 0:
+                    MPU->RBAR = base;
+                    MPU->RLAR = limit;
+                    break;
+                case 1:
+                    MPU->RBAR_A1 = base;
+                    MPU->RLAR_A1 = limit;
+                    break;
+                case 2:
+                    MPU->RBAR_A2 = base;
+                    MPU->RLAR_A2 = limit;
+                    break;
+                case 3:
+                    MPU->RBAR_A3 = base;
+                    MPU->RLAR_A3 = limit;
+                    break;
+                }
+            }
+#else
+            for (; count >= 4; count -= 4, regions += 4)
+            {
+                MPU->RBAR = regions[0].rbar;
+                MPU->RASR = regions[0].rasr;
+                MPU->RBAR_A1 = regions[1].rbar;
+                MPU->RASR_A1 = regions[1].rasr;
+                MPU->RBAR_A2 = regions[2].rbar;
+                MPU->RASR_A2 = regions[2].rasr;
+                MPU->RBAR_A3 = regions[3].rbar;
+                MPU->RASR_A3 = regions[3].rasr;
+            }
+
+            switch (count)
+            {
+            case 3:
+                MPU->RBAR_A2 = regions[2].rbar;
+                MPU->RASR_A2 = regions[2].rasr;
+                // fall through
+            case 2:
+                MPU->RBAR_A1 = regions[1].rbar;
+                MPU->RASR_A1 = regions[1].rasr;
+                // fall through
+            case 1:
+                MPU->RBAR = regions[0].rbar;
+                MPU->RASR = regions[0].rasr;
+            }
+#endif
+        }
+
+        /**
+         * Loads the profile with a single barrier. Privileged code only (e.g. PendSV).
+         */
+        inline void load() const
+        {
+#if MPU_PROFILE_MEASURE
+            uint32_t start = CycleCounter::now();
+#endif
+
+            write(regions, count);
+            __DSB();
+            __ISB();
+
+#if MPU_PROFILE_MEASURE
+            uint32_t cycles = CycleCounter::now() - start;
+            MPUSwitchStats &s = stats();
+            s.switches++;
+            s.lastCycles = cycles;
+            s.totalCycles += cycles;
+            if (cycles > s.maxCycles)
+                s.maxCycles = cycles;
+#endif
+        }
+
+        /**
+         * Loads the profile, after checking that the caller is privileged.
+         */
+        MPU_STATE apply() const
+        {
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            load();
+            return MPU_STATE::MPU_OK;
+        }
+
+        static MPUSwitchStats &stats()
+        {
+            static MPUSwitchStats s;
+            return s;
+        }
+    };
+
+} // namespace codal
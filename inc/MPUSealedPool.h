@@ -0,0 +1,185 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CodalMPU.h"
+#include "MPUMemoryAttributes.h"
+#include "MPUPlanner.h"
+
+/**
+ * @file MPUSealedPool.h
+ * @brief Constant pools that the MPU makes read-only once they are filled.
+ *
+ * Lookup tables and scene data (e.g. Object3d vertices) are built at start-up and
+ * never written again, but they sit in RAM where a stray write can corrupt them.
+ * A sealed pool replaces the periodic CRC scans used to catch that:
+ *
+ *     static uint8_t lutPool[4096] CODAL_SEALED;
+ *     MPUSealedPool pool;
+ *
+ *     pool.init(lutPool, sizeof(lutPool), 2);  // regions from 2 on, state OPEN
+ *     uint16_t *gamma = (uint16_t *)pool.allocate(512);
+ *     ...fill gamma...
+ *     pool.seal();                             // state SEALED: any write raises MemManage
+ *
+ * A pool moves between two states:
+ *
+ *   OPEN    regions FULL_ACCESS; allocate() hands out memory.
+ *   SEALED  regions RO (or PRIV_RO); privileged writes fault too.
+ *
+ * unseal() reopens a pool to update it, and seal() closes it again. Regions are
+ * planned once, at init(), for the exact extent of the pool. The pool must therefore
+ * be 32-byte aligned and a multiple of 32 bytes long: rounding out would make the
+ * neighbouring memory read-only as well. CODAL_SEALED gives that alignment. The
+ * linker script should keep CODAL_SEALED_SECTION together and pad its end to 32
+ * bytes.
+ *
+ * The pool is mapped write-back, write-allocate, since its data is only read.
+ */
+
+#ifndef CODAL_SEALED_SECTION
+#define CODAL_SEALED_SECTION ".codal_sealed"
+#endif
+
+#define CODAL_SEALED __attribute__((section(CODAL_SEALED_SECTION), aligned(32)))
+
+namespace codal
+{
+
+    enum class MPUPoolState : uint8_t
+    {
+        UNINITIALISED,
+        OPEN,
+        SEALED
+    };
+
+    class MPUSealedPool
+    {
+    private:
+        uint8_t *memory;
+        uint32_t size;
+        uint32_t used;
+        MPUPoolState poolState;
+        MPUPlan plan; // The sealed configuration
+
+        /**
+         * Loads the pool's regions with the given access.
+         */
+        void load(MPUAccessPermission access)
+        {
+            for (uint8_t i = 0; i < plan.count; i++)
+            {
+                MPURegionConfig region = plan.regions[i];
+
+                region.rasr = (region.rasr & ~MPU_RASR_AP_Msk) | (static_cast<uint32_t>(access) << MPU_RASR_AP_Pos);
+                MPUPlanner::write(plan.firstRegion + i, region);
+            }
+            CodalMPU::sync();
+        }
+
+    public:
+        MPUSealedPool() : memory(NULL), size(0), used(0), poolState(MPUPoolState::UNINITIALISED) {}
+
+        /**
+         * Takes over a block of memory and opens it.
+         * @param unprivilegedRead Whether unprivileged code may read the sealed pool (RO) or not (PRIV_RO).
+         * @return MPU_OK; MPU_INVALID_PARAMETER if the block is not 32-byte aligned or does not fit
+         *         regionBudget regions; MPU_OPERATION_NOT_ALLOWED if not privileged.
+         */
+        MPU_STATE init(void *memory, uint32_t size, uint8_t firstRegion, uint8_t regionBudget = 1,
+                       bool unprivilegedRead = true)
+        {
+            uint32_t address = (uint32_t)reinterpret_cast<uintptr_t>(memory);
+            MPURange range = MPUMemory::range(address, size, MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE,
+                                              unprivilegedRead ? MPUAccessPermission::RO
+                                                               : MPUAccessPermission::PRIV_RO);
+
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+            if ((address | size) & 31)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            MPU_STATE result = MPUPlanner::plan(&range, 1, plan, firstRegion, regionBudget);
+            if (result != MPU_STATE::MPU_OK)
+                return result;
+            if (plan.wastedBytes)
+                return MPU_STATE::MPU_INVALID_PARAMETER;
+
+            this->memory = static_cast<uint8_t *>(memory);
+            this->size = size;
+            used = 0;
+            poolState = MPUPoolState::OPEN;
+            load(MPUAccessPermission::FULL_ACCESS);
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Hands out memory from an open pool.
+         * @param align A power of two.
+         * @return The memory, or NULL if the pool is not open or is full, or align is not a power of two.
+         */
+        void *allocate(uint32_t length, uint32_t align = 4)
+        {
+            if (poolState != MPUPoolState::OPEN || align == 0 || (align & (align - 1)))
+                return NULL;
+
+            uint32_t offset = (used + align - 1) & ~(align - 1);
+            if (offset > size || length > size - offset)
+                return NULL;
+
+            used = offset + length;
+            return memory + offset;
+        }
+
+        /**
+         * Makes the pool read-only.
+         * @return MPU_OK, or MPU_OPERATION_NOT_ALLOWED if the pool is not open or the caller not privileged.
+         */
+        MPU_STATE seal()
+        {
+            if (poolState != MPUPoolState::OPEN || CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            MPUPlanner::apply(plan);
+            poolState = MPUPoolState::SEALED;
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Reopens a sealed pool for writing. Memory already allocated stays allocated.
+         * @return MPU_OK, or MPU_OPERATION_NOT_ALLOWED if the pool is not sealed or the caller not privileged.
+         */
+        MPU_STATE unseal()
+        {
+            if (poolState != MPUPoolState::SEALED || CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            load(MPUAccessPermission::FULL_ACCESS);
+            poolState = MPUPoolState::OPEN;
+            return MPU_STATE::MPU_OK;
+        }
+
+        MPUPoolState state() const
+        {
+            return poolState;
+        }
+
+        bool contains(const void *p) const
+        {
+            const uint8_t *b = static_cast<const uint8_t *>(p);
+            return memory && b >= memory && b < memory + size;
+        }
+
+        uint32_t bytesUsed() const
+        {
+            return used;
+        }
+
+        uint32_t capacity() const
+        {
+            return size;
+        }
+    };
+
+} // namespace codal
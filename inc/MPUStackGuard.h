@@ -0,0 +1,270 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "CodalFiber.h"
+#include "CodalMPU.h"
+
+/**
+ * @file MPUStackGuard.h
+ * @brief Stack overflow guards and high-water marks for fiber stacks.
+ *
+ * Guard: a NO_ACCESS region of MPU_STACK_GUARD_SIZE bytes at the bottom of a stack,
+ * so running off the end raises MemManage at the first push into it instead of
+ * silently corrupting the heap below.
+ *
+ * Watermark: stacks are painted with MPU_STACK_PAINT; the lowest word that no longer
+ * holds the pattern is the deepest the stack has ever been used. Two layouts are
+ * tracked:
+ *
+ *   - Stacks owned by one fiber (track()): the watermark is read when queried.
+ *   - The stack CODAL fibers share (trackShared()): the scheduler calls sample()
+ *     with the fiber that just ran. The depth reached is credited to that fiber and
+ *     the dirtied part below the current stack pointer is repainted, so the next
+ *     fiber starts clean. This costs one scan of the unused part of the stack and
+ *     one repaint of what the fiber used, so it is meant for sizing runs rather than
+ *     production builds.
+ *
+ * peak() then reports each fiber's deepest use, to trim stack allocations against.
+ *
+ * Addresses are uintptr_t so that the painting and scanning run unchanged on a host,
+ * over ordinary arrays; only install() needs an MPU.
+ */
+
+#ifndef MPU_STACK_GUARD_SIZE
+#define MPU_STACK_GUARD_SIZE 32 // Power of two, at least 32
+#endif
+
+#ifndef MPU_STACK_PAINT
+#define MPU_STACK_PAINT 0xDEADC0DEUL
+#endif
+
+#ifndef MPU_STACK_MAX_FIBERS
+#define MPU_STACK_MAX_FIBERS 16
+#endif
+
+#ifndef MPU_STACK_PAINT_MARGIN
+#define MPU_STACK_PAINT_MARGIN 64 // Bytes below the stack pointer left alone by sample()
+#endif
+
+namespace codal
+{
+
+    struct MPUStackUsage
+    {
+        Fiber *fiber;
+        uintptr_t bottom; // Lowest address of the stack; 0 for a fiber on the shared stack
+        uintptr_t top;    // One past the highest address
+        uint32_t peak;    // Deepest use seen, in bytes
+    };
+
+    class MPUStackGuard
+    {
+    private:
+        struct State
+        {
+            MPUStackUsage shared;
+            MPUStackUsage fibers[MPU_STACK_MAX_FIBERS];
+        };
+
+        static State &state()
+        {
+            static State s;
+            return s;
+        }
+
+        static MPUStackUsage *find(Fiber *fiber)
+        {
+            State &s = state();
+
+            for (int i = 0; i < MPU_STACK_MAX_FIBERS; i++)
+                if (s.fibers[i].fiber == fiber)
+                    return &s.fibers[i];
+            return NULL;
+        }
+
+        static MPUStackUsage *claim(Fiber *fiber)
+        {
+            MPUStackUsage *usage = find(fiber);
+
+            if (usage == NULL && (usage = find(NULL)) != NULL)
+            {
+                usage->fiber = fiber;
+                usage->bottom = 0;
+                usage->top = 0;
+                usage->peak = 0;
+            }
+            return usage;
+        }
+
+    public:
+        /**
+         * Address of the guard of a stack whose lowest address is stackLimit.
+         */
+        static uintptr_t guardBase(uintptr_t stackLimit)
+        {
+            return (stackLimit + MPU_STACK_GUARD_SIZE - 1) & ~(uintptr_t)(MPU_STACK_GUARD_SIZE - 1);
+        }
+
+        /**
+         * Lowest address above the guard: where painting and scanning start.
+         */
+        static uintptr_t usableBottom(uintptr_t stackLimit)
+        {
+            return guardBase(stackLimit) + MPU_STACK_GUARD_SIZE;
+        }
+
+        /**
+         * RASR value of a guard region: NO_ACCESS, XN, MPU_STACK_GUARD_SIZE bytes.
+         */
+        static uint32_t guardRASR()
+        {
+            uint8_t bits = 0;
+
+            for (uint32_t size = MPU_STACK_GUARD_SIZE; size > 1; size >>= 1)
+                bits++;
+
+            return CodalMPU::encodeRASR(static_cast<MPURegionSize>(bits - 1), MPUAccessPermission::NO_ACCESS, false);
+        }
+
+        /**
+         * Places a guard at the bottom of a stack, in the given region.
+         */
+        static MPU_STATE install(uint8_t regionNumber, uintptr_t stackLimit)
+        {
+            if (CodalMPU::isPrivileged() == false)
+                return MPU_STATE::MPU_OPERATION_NOT_ALLOWED;
+
+            CodalMPU::writeRegion(regionNumber, (uint32_t)guardBase(stackLimit), guardRASR());
+            CodalMPU::sync();
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Fills [from, to) with MPU_STACK_PAINT, a word at a time.
+         */
+        static void paint(uintptr_t from, uintptr_t to)
+        {
+            uint32_t *p = reinterpret_cast<uint32_t *>((from + 3) & ~(uintptr_t)3);
+            uint32_t *end = reinterpret_cast<uint32_t *>(to & ~(uintptr_t)3);
+
+            while (p < end)
+                *p++ = MPU_STACK_PAINT;
+        }
+
+        /**
+         * Lowest address in [from, to) no longer holding the paint, or to if all of it does.
+         */
+        static uintptr_t watermark(uintptr_t from, uintptr_t to)
+        {
+            const uint32_t *p = reinterpret_cast<const uint32_t *>((from + 3) & ~(uintptr_t)3);
+            const uint32_t *end = reinterpret_cast<const uint32_t *>(to & ~(uintptr_t)3);
+
+            while (p < end && *p == MPU_STACK_PAINT)
+                p++;
+            return reinterpret_cast<uintptr_t>(p);
+        }
+
+        /**
+         * Tracks a stack owned by one fiber, painting its free part.
+         * @param sp Current stack pointer if the stack is live (painting stops
+         *        MPU_STACK_PAINT_MARGIN below it), or top for a fresh stack.
+         * @return MPU_OK, or MPU_NO_REGIONS if MPU_STACK_MAX_FIBERS are tracked already.
+         */
+        static MPU_STATE track(Fiber *fiber, uintptr_t bottom, uintptr_t top, uintptr_t sp)
+        {
+            MPUStackUsage *usage = claim(fiber);
+            if (usage == NULL)
+                return MPU_STATE::MPU_NO_REGIONS;
+
+            usage->bottom = bottom;
+            usage->top = top;
+            if (sp > usableBottom(bottom) + MPU_STACK_PAINT_MARGIN)
+                paint(usableBottom(bottom), sp < top ? sp - MPU_STACK_PAINT_MARGIN : top);
+            return MPU_STATE::MPU_OK;
+        }
+
+        /**
+         * Tracks the shared stack, painting it below sp.
+         */
+        static void trackShared(uintptr_t bottom, uintptr_t top, uintptr_t sp)
+        {
+            MPUStackUsage &shared = state().shared;
+
+            shared.fiber = NULL;
+            shared.bottom = bottom;
+            shared.top = top;
+            shared.peak = 0;
+            if (sp > usableBottom(bottom) + MPU_STACK_PAINT_MARGIN)
+                paint(usableBottom(bottom), sp - MPU_STACK_PAINT_MARGIN);
+        }
+
+        /**
+         * Scheduler hook for the shared stack: credits the depth reached since the last
+         * sample to the fiber that ran, and repaints below sp.
+         */
+        static void sample(Fiber *ran, uintptr_t sp)
+        {
+            MPUStackUsage &shared = state().shared;
+            if (shared.top == 0)
+                return;
+
+            uintptr_t from = usableBottom(shared.bottom);
+            uintptr_t low = watermark(from, shared.top);
+            uint32_t depth = (uint32_t)(shared.top - low);
+
+            if (depth > shared.peak)
+                shared.peak = depth;
+
+            MPUStackUsage *usage = claim(ran);
+            if (usage && depth > usage->peak)
+                usage->peak = depth;
+
+            if (sp > low + MPU_STACK_PAINT_MARGIN)
+                paint(low, sp - MPU_STACK_PAINT_MARGIN);
+        }
+
+        /**
+         * Stops tracking a fiber (e.g. when it is deleted).
+         */
+        static void untrack(Fiber *fiber)
+        {
+            MPUStackUsage *usage = fiber ? find(fiber) : NULL;
+            if (usage)
+                usage->fiber = NULL;
+        }
+
+        /**
+         * The deepest a fiber has used its stack, in bytes, or 0 if it is not tracked.
+         * Pass NULL for the shared stack's overall peak.
+         */
+        static uint32_t peak(Fiber *fiber)
+        {
+            if (fiber == NULL)
+                return state().shared.peak;
+
+            MPUStackUsage *usage = find(fiber);
+            if (usage == NULL)
+                return 0;
+
+            if (usage->bottom)
+            {
+                uint32_t depth = (uint32_t)(usage->top - watermark(usableBottom(usage->bottom), usage->top));
+                if (depth > usage->peak)
+                    usage->peak = depth;
+            }
+            return usage->peak;
+        }
+
+        /**
+         * Bytes a fiber's stack can hold above its guard, or 0 for a fiber on the shared stack.
+         */
+        static uint32_t capacity(Fiber *fiber)
+        {
+            MPUStackUsage *usage = fiber ? find(fiber) : NULL;
+            return usage && usage->bottom ? (uint32_t)(usage->top - usableBottom(usage->bottom)) : 0;
+        }
+    };
+
+} // namespace codal
@@ -0,0 +1,243 @@
+#pragma once
+/**
+ * @file net_access.h
+ * @brief Alignment-safe accessors for the packed headers in network.h.
+ *
+ * Taking the address of a NET_PACKED field and dereferencing it as a uint16_t or
+ * uint32_t is undefined, and hard-faults on Cortex-M0/M0+ when the address is odd.
+ * Reading through the packed struct is safe but makes the compiler emit byte loads
+ * for every access. The helpers here pick the cheapest safe sequence per target:
+ *
+ *   - Cores with unaligned access (__ARM_FEATURE_UNALIGNED, x86): one halfword/word
+ *     load plus a byte reverse (LDR + REV on Cortex-M3/M4/M7).
+ *   - Cores without (Cortex-M0/M0+): byte loads assembled directly in big-endian
+ *     order, so no separate reverse is needed.
+ *
+ * The net_parse_*() routines decode a whole header into a plain host-order struct,
+ * reading each 32-bit word of it exactly once (with the widest loads its alignment
+ * allows) and extracting every field from that word.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_UNALIGNED_OK
+  #if defined(__ARM_FEATURE_UNALIGNED) || defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    #define NET_UNALIGNED_OK 1
+  #else
+    #define NET_UNALIGNED_OK 0
+  #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define NET_BSWAP16(x) __builtin_bswap16(x)
+  #define NET_BSWAP32(x) __builtin_bswap32(x)
+#else
+  #define NET_BSWAP16(x) ((uint16_t)(((x) << 8) | ((x) >> 8)))
+  #define NET_BSWAP32(x) ((((x) & 0xFF) << 24) | (((x) & 0xFF00) << 8) | (((x) >> 8) & 0xFF00) | ((x) >> 24))
+#endif
+
+/** p, which the caller knows to be aligned to n bytes; lets memcpy() become one LDR/LDRH */
+#if defined(__GNUC__) || defined(__clang__)
+  #define NET_ASSUME_ALIGNED(p, n) __builtin_assume_aligned((p), (n))
+#else
+  #define NET_ASSUME_ALIGNED(p, n) (p)
+#endif
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  #define NET_BE16(x) (x)
+  #define NET_BE32(x) (x)
+#else
+  #define NET_BE16(x) NET_BSWAP16(x)
+  #define NET_BE32(x) NET_BSWAP32(x)
+#endif
+
+// -----------------------------------------------------------------------------
+// Single fields
+// -----------------------------------------------------------------------------
+
+/** Load a big-endian 16-bit value from any address */
+static inline uint16_t net_load_be16(const void *p) {
+#if NET_UNALIGNED_OK
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return NET_BE16(v);
+#else
+    const uint8_t *b = (const uint8_t *)p;
+    return (uint16_t)((b[0] << 8) | b[1]);
+#endif
+}
+
+/** Load a big-endian 32-bit value from any address */
+static inline uint32_t net_load_be32(const void *p) {
+#if NET_UNALIGNED_OK
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return NET_BE32(v);
+#else
+    const uint8_t *b = (const uint8_t *)p;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+#endif
+}
+
+/** Store a 16-bit value big-endian at any address */
+static inline void net_store_be16(void *p, uint16_t v) {
+#if NET_UNALIGNED_OK
+    v = NET_BE16(v);
+    memcpy(p, &v, 2);
+#else
+    uint8_t *b = (uint8_t *)p;
+    b[0] = (uint8_t)(v >> 8);
+    b[1] = (uint8_t)v;
+#endif
+}
+
+/** Store a 32-bit value big-endian at any address */
+static inline void net_store_be32(void *p, uint32_t v) {
+#if NET_UNALIGNED_OK
+    v = NET_BE32(v);
+    memcpy(p, &v, 4);
+#else
+    uint8_t *b = (uint8_t *)p;
+    b[0] = (uint8_t)(v >> 24);
+    b[1] = (uint8_t)(v >> 16);
+    b[2] = (uint8_t)(v >> 8);
+    b[3] = (uint8_t)v;
+#endif
+}
+
+/** Load a host-order 16-bit value from any address (e.g. net_packet_t fields) */
+static inline uint16_t net_load_u16(const void *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+/** Store a host-order 16-bit value at any address */
+static inline void net_store_u16(void *p, uint16_t v) {
+    memcpy(p, &v, 2);
+}
+
+/**
+ * Read/write a big-endian field of a packed header through a pointer to it,
+ * e.g. NET_GET_BE16(udp, udp_header_t, dest_port).
+ */
+#define NET_GET_BE16(ptr, type, field)    net_load_be16((const uint8_t *)(ptr) + offsetof(type, field))
+#define NET_GET_BE32(ptr, type, field)    net_load_be32((const uint8_t *)(ptr) + offsetof(type, field))
+#define NET_SET_BE16(ptr, type, field, v) net_store_be16((uint8_t *)(ptr) + offsetof(type, field), (v))
+#define NET_SET_BE32(ptr, type, field, v) net_store_be32((uint8_t *)(ptr) + offsetof(type, field), (v))
+
+/** net_packet_t keeps its ports and length in host order, at unaligned offsets */
+#define NET_PACKET_GET(ptr, field)        net_load_u16((const uint8_t *)(ptr) + offsetof(net_packet_t, field))
+#define NET_PACKET_SET(ptr, field, v)     net_store_u16((uint8_t *)(ptr) + offsetof(net_packet_t, field), (v))
+
+/** EtherType / length of an Ethernet header */
+static inline uint16_t net_eth_type(const void *eth) {
+    return NET_GET_BE16(eth, eth_header_t, ethertype);
+}
+
+/** Protocol ID of a SNAP header (always at an odd offset) */
+static inline uint16_t net_snap_protocol(const void *snap) {
+    return NET_GET_BE16(snap, snap_header_t, protocol_id);
+}
+
+// -----------------------------------------------------------------------------
+// Whole headers
+// -----------------------------------------------------------------------------
+
+/**
+ * Loads the n-th big-endian word of a header given its address modulo 4: one aligned
+ * LDR (+ REV) if the header is word aligned; on cores without unaligned access, two
+ * LDRH if it is halfword aligned (an IP header behind a 14-byte Ethernet header);
+ * otherwise the byte path. The loads go through memcpy(), so packet bytes are never
+ * accessed through an incompatible pointer type.
+ */
+static inline uint32_t net_header_word(const uint8_t *p, uintptr_t misalign, int n) {
+    if (misalign == 0) {
+        uint32_t v;
+        memcpy(&v, NET_ASSUME_ALIGNED(p + 4 * n, 4), 4);
+        return NET_BE32(v);
+    }
+#if !NET_UNALIGNED_OK
+    if ((misalign & 1) == 0) {
+        uint16_t h[2];
+        memcpy(&h[0], NET_ASSUME_ALIGNED(p + 4 * n, 2), 2);
+        memcpy(&h[1], NET_ASSUME_ALIGNED(p + 4 * n + 2, 2), 2);
+        return ((uint32_t)NET_BE16(h[0]) << 16) | NET_BE16(h[1]);
+    }
+#endif
+    return net_load_be32(p + 4 * n);
+}
+
+#define NET_MISALIGNMENT(p) (((uintptr_t)(p)) & 3)
+
+/**
+ * UDP header. Every field is in host order, the checksum included, as in
+ * ipv4_fields_t; compare it with 0 or with net_ntohs() of a value read from the packet.
+ */
+typedef struct {
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint16_t length;
+    uint16_t checksum;
+} udp_fields_t;
+
+static inline void net_parse_udp(const void *hdr, udp_fields_t *out) {
+    const uint8_t *p = (const uint8_t *)hdr;
+    uintptr_t misalign = NET_MISALIGNMENT(p);
+    uint32_t w0 = net_header_word(p, misalign, 0);
+    uint32_t w1 = net_header_word(p, misalign, 1);
+
+    out->src_port = (uint16_t)(w0 >> 16);
+    out->dest_port = (uint16_t)w0;
+    out->length = (uint16_t)(w1 >> 16);
+    out->checksum = (uint16_t)w1;
+}
+
+/** IPv4 header (without options). Every field is in host order, the checksum included */
+typedef struct {
+    uint8_t version;
+    uint8_t header_len;     /**< Bytes */
+    uint8_t tos;
+    uint8_t ttl;
+    uint16_t total_length;
+    uint16_t id;
+    uint16_t flags;         /**< IPV4_FLAG_DF / IPV4_FLAG_MF */
+    uint16_t fragment;      /**< Offset in bytes */
+    uint8_t protocol;
+    uint16_t checksum;
+    ipv4_addr_t src;
+    ipv4_addr_t dest;
+} ipv4_fields_t;
+
+static inline void net_parse_ipv4(const void *hdr, ipv4_fields_t *out) {
+    const uint8_t *p = (const uint8_t *)hdr;
+    uintptr_t misalign = NET_MISALIGNMENT(p);
+    uint32_t w0 = net_header_word(p, misalign, 0);
+    uint32_t w1 = net_header_word(p, misalign, 1);
+    uint32_t w2 = net_header_word(p, misalign, 2);
+
+    out->version = (uint8_t)(w0 >> 28);
+    out->header_len = (uint8_t)(((w0 >> 24) & 0x0F) * 4);
+    out->tos = (uint8_t)(w0 >> 16);
+    out->total_length = (uint16_t)w0;
+    out->id = (uint16_t)(w1 >> 16);
+    out->flags = (uint16_t)(w1 & (IPV4_FLAG_DF | IPV4_FLAG_MF));
+    out->fragment = (uint16_t)((w1 & IPV4_FRAGMENT_MASK) * 8);
+    out->ttl = (uint8_t)(w2 >> 24);
+    out->protocol = (uint8_t)(w2 >> 16);
+    out->checksum = (uint16_t)w2;
+    out->src = u32_to_ipv4(net_header_word(p, misalign, 3));
+    out->dest = u32_to_ipv4(net_header_word(p, misalign, 4));
+}
+
+#ifdef __cplusplus
+}
+#endif
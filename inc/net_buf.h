@@ -0,0 +1,406 @@
+#pragma once
+/**
+ * @file net_buf.h
+ * @brief Pooled, reference-counted packet buffers for CODAL-style network addons.
+ *
+ * Packet memory comes from fixed-size slab classes (e.g. 128, 512 and 1536 bytes)
+ * instead of a 1500-byte array in every packet, so a 40-byte datagram costs one
+ * small slot. Every buffer starts with NET_BUF_HEADROOM spare bytes so Ethernet,
+ * IP and UDP headers can be prepended in place with net_buf_push(). Payloads larger
+ * than one slot are carried as a chain of fragments linked through next.
+ *
+ * Allocation and release are lock-free (a tagged Treiber stack per slab) and may be
+ * called from interrupt handlers. On cores without LDREX/STREX (Cortex-M0/M0+) the
+ * compare-and-swap falls back to a few instructions with interrupts masked.
+ *
+ * @code
+ * NET_SLAB_DEFINE(small, 16, 128);
+ * NET_SLAB_DEFINE(large, 4, 1536);
+ * static net_slab_t slabs[] = { NET_SLAB_INIT(small), NET_SLAB_INIT(large) };
+ * static net_pool_t pool = { slabs, 2 };
+ *
+ * net_pool_init(&pool);
+ * net_buf_t *buf = net_buf_alloc(&pool, 40);
+ * memcpy(net_buf_put(buf, 40), reading, 40);
+ * udp_header_t *udp = (udp_header_t *)net_buf_push(buf, sizeof(udp_header_t));
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_BUF_HEADROOM
+#define NET_BUF_HEADROOM 64 // Ethernet (14) + IPv6 (40) + UDP (8), rounded up
+#endif
+
+/** Free-list terminator */
+#define NET_BUF_NONE 0xFFFF
+
+// -----------------------------------------------------------------------------
+// Atomics
+// -----------------------------------------------------------------------------
+
+#if defined(__ARM_ARCH_6M__)
+  #define NET_ATOMIC_IRQ_MASK 1 // No exclusive load/store: mask interrupts instead
+#else
+  #define NET_ATOMIC_IRQ_MASK 0
+#endif
+
+#if NET_ATOMIC_IRQ_MASK
+static inline uint32_t net_irq_save(void) {
+    uint32_t primask;
+    __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r"(primask) :: "memory");
+    return primask;
+}
+
+static inline void net_irq_restore(uint32_t primask) {
+    __asm volatile ("msr primask, %0" :: "r"(primask) : "memory");
+}
+#endif
+
+/**
+ * @brief Compare-and-swap. On failure, *expected is updated with the current value.
+ */
+static inline int net_cas32(volatile uint32_t *p, uint32_t *expected, uint32_t desired) {
+#if NET_ATOMIC_IRQ_MASK
+    uint32_t primask = net_irq_save();
+    int ok = (*p == *expected);
+    if (ok) *p = desired;
+    else *expected = *p;
+    net_irq_restore(primask);
+    return ok;
+#else
+    return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Atomically adds delta to *p and returns the new value.
+ */
+static inline uint16_t net_atomic_add16(volatile uint16_t *p, int16_t delta) {
+#if NET_ATOMIC_IRQ_MASK
+    uint32_t primask = net_irq_save();
+    uint16_t v = (uint16_t)(*p + delta);
+    *p = v;
+    net_irq_restore(primask);
+    return v;
+#else
+    return __atomic_add_fetch(p, (uint16_t)delta, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Buffers and slabs
+// -----------------------------------------------------------------------------
+
+struct net_slab;
+
+/**
+ * @brief One packet buffer (or one fragment of a chained packet).
+ */
+typedef struct net_buf {
+    struct net_buf *next;      /**< Next fragment of the same packet, or NULL */
+    uint8_t *data;             /**< First valid byte */
+    uint16_t len;              /**< Valid bytes at data */
+    volatile uint16_t refcnt;  /**< Owners; the buffer returns to its slab at zero */
+    uint8_t *storage;          /**< Start of the slab slot */
+    struct net_slab *slab;     /**< Slab the buffer belongs to */
+    uint32_t user;             /**< Free for use by the current owner */
+} net_buf_t;
+
+/**
+ * @brief A slab class: count buffers of buf_size bytes each (headroom included).
+ */
+typedef struct net_slab {
+    uint8_t *storage;              /**< count * buf_size bytes */
+    net_buf_t *bufs;               /**< count descriptors */
+    uint16_t *links;               /**< Free-list links, count entries */
+    uint16_t count;
+    uint16_t buf_size;
+    volatile uint32_t free_head;   /**< (ABA tag << 16) | index of first free buffer */
+    volatile uint16_t available;   /**< Free buffers (statistics only) */
+} net_slab_t;
+
+/**
+ * @brief A set of slab classes, in ascending buf_size order.
+ */
+typedef struct {
+    net_slab_t *slabs;
+    uint8_t slab_count;
+} net_pool_t;
+
+/** Declare the static storage for a slab class */
+#define NET_SLAB_DEFINE(name, count, size) \
+    static uint8_t name##_storage[(count) * (size)] NET_ALIGNED(4); \
+    static net_buf_t name##_bufs[count]; \
+    static uint16_t name##_links[count]
+
+/** Initialiser for a net_slab_t declared with NET_SLAB_DEFINE */
+#define NET_SLAB_INIT(name) \
+    { name##_storage, name##_bufs, name##_links, \
+      (uint16_t)(sizeof(name##_bufs) / sizeof(net_buf_t)), \
+      (uint16_t)(sizeof(name##_storage) / (sizeof(name##_bufs) / sizeof(net_buf_t))), \
+      NET_BUF_NONE, 0 }
+
+/**
+ * @brief Links every buffer of every slab onto its free list. Call once before use.
+ * @return NET_OK, or NET_ERR_TOO_BIG (and nothing is initialised) if a slab's buffers
+ *         leave no room after NET_BUF_HEADROOM.
+ */
+static inline int net_pool_init(net_pool_t *pool) {
+    for (uint8_t s = 0; s < pool->slab_count; s++)
+        if (pool->slabs[s].buf_size <= NET_BUF_HEADROOM)
+            return NET_ERR_TOO_BIG;
+
+    for (uint8_t s = 0; s < pool->slab_count; s++) {
+        net_slab_t *slab = &pool->slabs[s];
+
+        for (uint16_t i = 0; i < slab->count; i++) {
+            net_buf_t *buf = &slab->bufs[i];
+            buf->storage = slab->storage + (uint32_t)i * slab->buf_size;
+            buf->slab = slab;
+            buf->refcnt = 0;
+            slab->links[i] = (i + 1 < slab->count) ? (uint16_t)(i + 1) : NET_BUF_NONE;
+        }
+
+        slab->free_head = slab->count ? 0 : NET_BUF_NONE;
+        slab->available = slab->count;
+    }
+
+    return NET_OK;
+}
+
+/**
+ * @brief Pops a buffer off a slab's free list. Lock-free; safe from interrupts.
+ */
+static inline net_buf_t *net_slab_alloc(net_slab_t *slab) {
+    uint32_t head = slab->free_head;
+    uint16_t index;
+
+    for (;;) {
+        index = (uint16_t)(head & 0xFFFF);
+        if (index == NET_BUF_NONE)
+            return NULL;
+
+        // A stale link read here is harmless: the tag makes the CAS fail.
+        uint32_t next = ((head + 0x10000) & 0xFFFF0000) | slab->links[index];
+        if (net_cas32(&slab->free_head, &head, next))
+            break;
+    }
+
+    net_atomic_add16(&slab->available, -1);
+
+    net_buf_t *buf = &slab->bufs[index];
+    buf->next = NULL;
+    buf->data = buf->storage;
+    buf->len = 0;
+    buf->refcnt = 1;
+    buf->user = 0;
+    return buf;
+}
+
+/**
+ * @brief Pushes a buffer back onto its slab's free list. Lock-free; safe from interrupts.
+ */
+static inline void net_slab_free(net_buf_t *buf) {
+    net_slab_t *slab = buf->slab;
+    uint16_t index = (uint16_t)(buf - slab->bufs);
+    uint32_t head = slab->free_head;
+
+    do {
+        slab->links[index] = (uint16_t)(head & 0xFFFF);
+    } while (!net_cas32(&slab->free_head, &head, ((head + 0x10000) & 0xFFFF0000) | index));
+
+    net_atomic_add16(&slab->available, 1);
+}
+
+/**
+ * @brief Allocates a buffer with room for size payload bytes after NET_BUF_HEADROOM.
+ *        Uses the smallest slab class that fits and has a free buffer.
+ * @return The buffer (data positioned after the headroom, len 0), or NULL.
+ */
+static inline net_buf_t *net_buf_alloc(net_pool_t *pool, uint16_t size) {
+    for (uint8_t s = 0; s < pool->slab_count; s++) {
+        net_slab_t *slab = &pool->slabs[s];
+        if (slab->buf_size < (uint32_t)size + NET_BUF_HEADROOM)
+            continue;
+
+        net_buf_t *buf = net_slab_alloc(slab);
+        if (buf) {
+            buf->data = buf->storage + NET_BUF_HEADROOM;
+            return buf;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Takes another reference to a buffer (and, implicitly, its chain).
+ */
+static inline net_buf_t *net_buf_ref(net_buf_t *buf) {
+    net_atomic_add16(&buf->refcnt, 1);
+    return buf;
+}
+
+/**
+ * @brief Drops a reference. When the last one goes, the buffer returns to its slab
+ *        and the reference it held on the rest of the chain is dropped too.
+ */
+static inline void net_buf_unref(net_buf_t *buf) {
+    while (buf && net_atomic_add16(&buf->refcnt, -1) == 0) {
+        net_buf_t *next = buf->next;
+        net_slab_free(buf);
+        buf = next;
+    }
+}
+
+/**
+ * @brief Allocates a chain able to hold size bytes, using the largest slab class for
+ *        every fragment. Only the first fragment reserves headroom.
+ * @return The head of the chain, or NULL (nothing is left allocated).
+ */
+static inline net_buf_t *net_buf_alloc_chain(net_pool_t *pool, uint32_t size) {
+    net_buf_t *head = NULL, *tail = NULL;
+    uint32_t remaining = size;
+
+    do {
+        net_buf_t *buf = NULL;
+
+        for (int s = pool->slab_count - 1; s >= 0 && !buf; s--)
+            buf = net_slab_alloc(&pool->slabs[s]);
+
+        if (!buf) {
+            net_buf_unref(head);
+            return NULL;
+        }
+
+        uint16_t room = buf->slab->buf_size; // More than NET_BUF_HEADROOM (net_pool_init)
+        if (!head) {
+            buf->data = buf->storage + NET_BUF_HEADROOM;
+            room -= NET_BUF_HEADROOM;
+            head = buf;
+        } else {
+            tail->next = buf;
+        }
+        tail = buf;
+
+        remaining = remaining > room ? remaining - room : 0;
+    } while (remaining);
+
+    return head;
+}
+
+/** Bytes free before data */
+static inline uint16_t net_buf_headroom(const net_buf_t *buf) {
+    return (uint16_t)(buf->data - buf->storage);
+}
+
+/** Bytes free after data + len */
+static inline uint16_t net_buf_tailroom(const net_buf_t *buf) {
+    return (uint16_t)(buf->slab->buf_size - net_buf_headroom(buf) - buf->len);
+}
+
+/**
+ * @brief Prepends len bytes in the headroom (e.g. for a header).
+ * @return Pointer to the new first byte, or NULL if the headroom is too small.
+ */
+static inline uint8_t *net_buf_push(net_buf_t *buf, uint16_t len) {
+    if (net_buf_headroom(buf) < len)
+        return NULL;
+
+    buf->data -= len;
+    buf->len += len;
+    return buf->data;
+}
+
+/**
+ * @brief Removes len bytes from the front (e.g. a parsed header).
+ * @return Pointer to the new first byte, or NULL if the buffer holds less than len.
+ */
+static inline uint8_t *net_buf_pull(net_buf_t *buf, uint16_t len) {
+    if (buf->len < len)
+        return NULL;
+
+    buf->data += len;
+    buf->len -= len;
+    return buf->data;
+}
+
+/**
+ * @brief Appends len bytes at the tail.
+ * @return Pointer to the first appended byte, or NULL if the tailroom is too small.
+ */
+static inline uint8_t *net_buf_put(net_buf_t *buf, uint16_t len) {
+    if (net_buf_tailroom(buf) < len)
+        return NULL;
+
+    uint8_t *tail = buf->data + buf->len;
+    buf->len += len;
+    return tail;
+}
+
+/**
+ * @brief Total valid bytes across a chain.
+ */
+static inline uint32_t net_buf_chain_len(const net_buf_t *buf) {
+    uint32_t len = 0;
+    for (; buf; buf = buf->next)
+        len += buf->len;
+    return len;
+}
+
+/**
+ * @brief Links frag (and its chain) onto the end of head's chain. Ownership of frag passes to head.
+ */
+static inline void net_buf_append(net_buf_t *head, net_buf_t *frag) {
+    while (head->next)
+        head = head->next;
+    head->next = frag;
+}
+
+// -----------------------------------------------------------------------------
+// Pooled packet
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief net_packet_t with its payload held in pooled buffers instead of inline.
+ *
+ * Same metadata as net_packet_t, but costs a pointer rather than 1500 bytes, and can
+ * be handed between layers (or queued twice, via net_buf_ref) without copying.
+ */
+typedef struct {
+    /** Source IP address (IPv4 or IPv6) */
+    union {
+        ipv4_addr_t v4;
+        ipv6_addr_t v6;
+    } src;
+
+    /** Destination IP address (IPv4 or IPv6) */
+    union {
+        ipv4_addr_t v4;
+        ipv6_addr_t v6;
+    } dest;
+
+    /** Source port (TCP/UDP) in host byte order */
+    uint16_t srcPort;
+
+    /** Destination port (TCP/UDP) in host byte order */
+    uint16_t destPort;
+
+    /** Protocol number (e.g., 6 = TCP, 17 = UDP, per IANA) */
+    uint8_t protocol;
+
+    /** Payload chain; the total length is net_buf_chain_len(payload) */
+    net_buf_t *payload;
+} net_pkt_t;
+
+#ifdef __cplusplus
+}
+#endif
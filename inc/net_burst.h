@@ -0,0 +1,280 @@
+#pragma once
+/**
+ * @file net_burst.h
+ * @brief Burst-oriented RX/TX queues between the stack and network drivers.
+ *
+ * Modelled on DPDK's rx_burst / tx_burst: the application moves arrays of net_buf_t
+ * pointers in and out of per-queue descriptor rings, and ownership of each buffer
+ * moves with its pointer, so frames are never copied.
+ *
+ *   - net_tx_burst() enqueues up to n frames and rings the driver's doorbell once for
+ *     the whole batch (not once per frame). Frames that did not fit stay with the
+ *     caller, as in DPDK.
+ *   - net_rx_burst() dequeues up to n received frames without calling the driver.
+ *     A consumer that finds the queue empty can net_dev_rx_arm() it; the driver then
+ *     raises its RX event only on the next delivery, i.e. once per batch.
+ *
+ * Each ring is single-producer / single-consumer and lock-free: the application is
+ * the only producer of TX rings and the only consumer of RX rings, the driver (thread
+ * or ISR) the reverse. Indices are free-running 32-bit counters published with
+ * release/acquire ordering.
+ *
+ * A driver implements one callback, the TX doorbell, and uses net_dev_tx_reap() /
+ * net_dev_rx_deliver() from its TX and RX paths. net_loopback_doorbell() is a
+ * complete driver that delivers every transmitted frame to a device's RX queue.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+#include "net_buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// SPSC descriptor ring
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    net_buf_t **slots;
+    uint32_t mask;
+    volatile uint32_t head;     /**< Written by the producer only */
+    volatile uint32_t tail;     /**< Written by the consumer only */
+} net_ring_t;
+
+static inline uint32_t net_ring_load_acquire(const volatile uint32_t *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+    return *p;
+#endif
+}
+
+static inline void net_ring_store_release(volatile uint32_t *p, uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#else
+    *p = v;
+#endif
+}
+
+/**
+ * @param size Number of slots, a power of two.
+ */
+static inline int net_ring_init(net_ring_t *ring, net_buf_t **slots, uint32_t size) {
+    if (size == 0 || (size & (size - 1)))
+        return NET_ERR_MALFORMED;
+
+    ring->slots = slots;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    return NET_OK;
+}
+
+/** Frames waiting in the ring (exact for the consumer, a lower bound for the producer) */
+static inline uint32_t net_ring_count(const net_ring_t *ring) {
+    return net_ring_load_acquire(&ring->head) - net_ring_load_acquire(&ring->tail);
+}
+
+/** Free slots (exact for the producer, a lower bound for the consumer) */
+static inline uint32_t net_ring_space(const net_ring_t *ring) {
+    return ring->mask + 1 - net_ring_count(ring);
+}
+
+/**
+ * @brief Producer side: enqueues up to n buffers.
+ * @return Number enqueued; the ring owns those, the caller keeps the rest.
+ */
+static inline uint32_t net_ring_enqueue_burst(net_ring_t *ring, net_buf_t *const *bufs, uint32_t n) {
+    uint32_t head = ring->head;
+    uint32_t space = ring->mask + 1 - (head - net_ring_load_acquire(&ring->tail));
+
+    if (n > space)
+        n = space;
+
+    for (uint32_t i = 0; i < n; i++)
+        ring->slots[(head + i) & ring->mask] = bufs[i];
+
+    net_ring_store_release(&ring->head, head + n);
+    return n;
+}
+
+/**
+ * @brief Consumer side: dequeues up to n buffers, oldest first.
+ * @return Number dequeued.
+ */
+static inline uint32_t net_ring_dequeue_burst(net_ring_t *ring, net_buf_t **bufs, uint32_t n) {
+    uint32_t tail = ring->tail;
+    uint32_t count = net_ring_load_acquire(&ring->head) - tail;
+
+    if (n > count)
+        n = count;
+
+    for (uint32_t i = 0; i < n; i++)
+        bufs[i] = ring->slots[(tail + i) & ring->mask];
+
+    net_ring_store_release(&ring->tail, tail + n);
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Devices
+// -----------------------------------------------------------------------------
+
+struct net_dev;
+
+/**
+ * @brief Tells the driver that TX queue has new frames. Called at most once per
+ *        net_tx_burst(); the driver drains the queue with net_dev_tx_reap(), now
+ *        or later (e.g. from its TX-complete interrupt).
+ */
+typedef void (*net_doorbell_fn)(void *ctx, struct net_dev *dev, uint16_t queue);
+
+typedef struct {
+    uint32_t rx_packets;
+    uint32_t rx_dropped;    /**< Delivered by the driver into a full RX queue */
+    uint32_t tx_packets;
+    uint32_t tx_full;       /**< Frames net_tx_burst() handed back for lack of space */
+    uint32_t doorbells;
+} net_dev_stats_t;
+
+typedef struct net_dev {
+    net_ring_t *rx;             /**< rx_queues rings */
+    net_ring_t *tx;             /**< tx_queues rings */
+    volatile uint8_t *rx_armed; /**< Per RX queue: consumer waits for an event */
+    uint16_t rx_queues;
+    uint16_t tx_queues;
+
+    net_doorbell_fn doorbell;
+    void *ctx;
+    net_dev_stats_t stats;
+} net_dev_t;
+
+/**
+ * @brief Binds a device to its queue rings (initialised with net_ring_init()).
+ * @param rx_armed rx_queues flags, may be NULL if the consumer polls.
+ */
+static inline void net_dev_init(net_dev_t *dev, net_ring_t *rx, uint16_t rx_queues, volatile uint8_t *rx_armed,
+                                net_ring_t *tx, uint16_t tx_queues, net_doorbell_fn doorbell, void *ctx) {
+    dev->rx = rx;
+    dev->rx_queues = rx_queues;
+    dev->rx_armed = rx_armed;
+    dev->tx = tx;
+    dev->tx_queues = tx_queues;
+    dev->doorbell = doorbell;
+    dev->ctx = ctx;
+    memset(&dev->stats, 0, sizeof(dev->stats));
+
+    for (uint16_t q = 0; rx_armed && q < rx_queues; q++)
+        rx_armed[q] = 0;
+}
+
+/**
+ * @brief Queues up to n frames for transmission with a single doorbell.
+ * @return Number accepted. Those now belong to the driver (which unrefs them once
+ *         sent); the caller still owns bufs[result..n-1].
+ */
+static inline uint16_t net_tx_burst(net_dev_t *dev, uint16_t queue, net_buf_t *const *bufs, uint16_t n) {
+    uint16_t sent = (uint16_t)net_ring_enqueue_burst(&dev->tx[queue], bufs, n);
+
+    dev->stats.tx_packets += sent;
+    dev->stats.tx_full += (uint32_t)(n - sent);
+
+    if (sent) {
+        dev->stats.doorbells++;
+        dev->doorbell(dev->ctx, dev, queue);
+    }
+    return sent;
+}
+
+/**
+ * @brief Takes up to n received frames. Does not call into the driver.
+ * @return Number received; the caller now owns (and must unref) each of them.
+ */
+static inline uint16_t net_rx_burst(net_dev_t *dev, uint16_t queue, net_buf_t **bufs, uint16_t n) {
+    return (uint16_t)net_ring_dequeue_burst(&dev->rx[queue], bufs, n);
+}
+
+/**
+ * @brief Asks for an RX event on the next delivery to queue, before sleeping on it.
+ * @return 1 if armed, 0 if frames arrived meanwhile or the device has no rx_armed
+ *         flags to arm (poll again instead of sleeping).
+ */
+static inline int net_dev_rx_arm(net_dev_t *dev, uint16_t queue) {
+    if (!dev->rx_armed)
+        return 0;
+
+    dev->rx_armed[queue] = 1;
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+    if (net_ring_count(&dev->rx[queue])) {
+        dev->rx_armed[queue] = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Driver side
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Takes up to n frames queued for transmission on queue.
+ */
+static inline uint16_t net_dev_tx_reap(net_dev_t *dev, uint16_t queue, net_buf_t **bufs, uint16_t n) {
+    return (uint16_t)net_ring_dequeue_burst(&dev->tx[queue], bufs, n);
+}
+
+/**
+ * @brief Hands a batch of received frames to the stack. Frames that do not fit are
+ *        unreferenced and counted as dropped.
+ * @return 1 if the consumer armed the queue and should be signalled now (once for
+ *         the whole batch), else 0.
+ */
+static inline int net_dev_rx_deliver(net_dev_t *dev, uint16_t queue, net_buf_t *const *bufs, uint16_t n) {
+    uint16_t accepted = (uint16_t)net_ring_enqueue_burst(&dev->rx[queue], bufs, n);
+
+    for (uint16_t i = accepted; i < n; i++)
+        net_buf_unref(bufs[i]);
+
+    dev->stats.rx_packets += accepted;
+    dev->stats.rx_dropped += (uint32_t)(n - accepted);
+
+    // Pairs with the fence in net_dev_rx_arm(): either the consumer sees these frames
+    // or this side sees it armed, never neither.
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+    if (accepted && dev->rx_armed && dev->rx_armed[queue]) {
+        dev->rx_armed[queue] = 0;
+        return 1;
+    }
+    return 0;
+}
+
+#ifndef NET_LOOPBACK_BATCH
+#define NET_LOOPBACK_BATCH 32
+#endif
+
+/**
+ * @brief Loopback driver: delivers everything transmitted on a TX queue to the same
+ *        RX queue of the device passed as ctx (which may be the sending device).
+ */
+static inline void net_loopback_doorbell(void *ctx, net_dev_t *dev, uint16_t queue) {
+    net_dev_t *peer = (net_dev_t *)ctx;
+    net_buf_t *batch[NET_LOOPBACK_BATCH];
+    uint16_t n;
+
+    while ((n = net_dev_tx_reap(dev, queue, batch, NET_LOOPBACK_BATCH)) != 0)
+        net_dev_rx_deliver(peer, queue, batch, n);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,467 @@
+#pragma once
+/**
+ * @file net_capture.h
+ * @brief In-RAM packet capture ring with pcap / pcapng export.
+ *
+ * Frames are copied, truncated to a snap length, into a caller-provided byte ring
+ * together with a timestamp and their original length. When the ring is full the
+ * oldest records are overwritten, so it always holds the most recent traffic.
+ * net_packet_t containers are recorded as synthesised Ethernet + IPv4/IPv6 (+ UDP)
+ * frames, so every record has the same link type and opens in standard tools.
+ *
+ * An optional filter of BPF-like predicates (load 1, 2 or 4 bytes at an offset, mask,
+ * compare) decides which frames are kept; all predicates must match.
+ *
+ * The ring is drained as a pcap or pcapng byte stream through a write callback, so it
+ * can go to a serial port, a USB endpoint or a host file alike.
+ *
+ * Overhead: a disabled capture costs one load and branch per frame. Defining
+ * NET_CAPTURE_ENABLED to 0 removes capture entirely; the functions stay callable
+ * and compile to nothing.
+ *
+ * Not re-entrant: capture and drain must run in the same context, or be serialised
+ * by the caller (e.g. with net_irq_save() from net_buf.h).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_CAPTURE_ENABLED
+#define NET_CAPTURE_ENABLED 1
+#endif
+
+#ifndef NET_CAPTURE_MAX_TESTS
+#define NET_CAPTURE_MAX_TESTS 8
+#endif
+
+#define NET_CAPTURE_LINKTYPE_ETHERNET 1
+
+/** Returns the current time in microseconds */
+typedef uint64_t (*net_capture_clock_fn)(void *ctx);
+
+/** Writes len bytes of exported capture. Returns NET_OK or an error, which stops the export. */
+typedef int (*net_capture_write_fn)(void *ctx, const void *data, size_t len);
+
+typedef enum {
+    NET_CAPTURE_PCAP,
+    NET_CAPTURE_PCAPNG
+} net_capture_format_t;
+
+typedef enum {
+    NET_CAPTURE_EQ,     /**< (field & mask) == value */
+    NET_CAPTURE_NE,     /**< (field & mask) != value */
+    NET_CAPTURE_GT,     /**< (field & mask) > value */
+    NET_CAPTURE_LT      /**< (field & mask) < value */
+} net_capture_op_t;
+
+/** One filter predicate over the captured frame. Fields are read big-endian. */
+typedef struct {
+    uint16_t offset;    /**< Byte offset from the start of the Ethernet header */
+    uint8_t size;       /**< 1, 2 or 4 */
+    uint8_t op;         /**< net_capture_op_t */
+    uint32_t mask;
+    uint32_t value;
+} net_capture_test_t;
+
+/** Record header, stored in the ring exactly as pcap writes it */
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t caplen;
+    uint32_t origlen;
+} net_capture_record_t;
+
+typedef struct {
+    uint32_t captured;
+    uint32_t filtered;      /**< Rejected by the filter */
+    uint32_t overwritten;   /**< Oldest records lost to make room */
+    uint32_t too_big;       /**< Larger than the whole ring even after truncation */
+} net_capture_stats_t;
+
+typedef struct {
+    uint8_t *ring;
+    uint32_t size;
+    uint32_t head;          /**< Next write offset */
+    uint32_t tail;          /**< Oldest record */
+    uint32_t wrap;          /**< End of valid data when head has wrapped behind tail */
+    uint32_t used;
+    uint32_t records;
+
+    uint16_t snaplen;
+    uint8_t enabled;
+    uint8_t test_count;
+    net_capture_test_t tests[NET_CAPTURE_MAX_TESTS];
+
+    net_capture_clock_fn clock;
+    void *clock_ctx;
+    net_capture_stats_t stats;
+} net_capture_t;
+
+#define NET_CAPTURE_ALIGN(n) (((n) + 3u) & ~3u)
+
+// -----------------------------------------------------------------------------
+// Setup
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Initialises a capture over a caller-provided ring. Capture starts disabled.
+ * @param ring Word-aligned storage; each record takes 16 bytes plus its data rounded up to 4.
+ * @param snaplen Bytes kept per frame (e.g. 64 for headers only, 1514 for whole frames).
+ * @param clock Timestamp source, or NULL to record zero timestamps.
+ */
+static inline void net_capture_init(net_capture_t *cap, uint8_t *ring, uint32_t size, uint16_t snaplen,
+                                    net_capture_clock_fn clock, void *clock_ctx) {
+    memset(cap, 0, sizeof(*cap));
+    cap->ring = ring;
+    cap->size = size & ~3u;
+    cap->snaplen = snaplen;
+    cap->clock = clock;
+    cap->clock_ctx = clock_ctx;
+}
+
+static inline void net_capture_enable(net_capture_t *cap, int enabled) {
+    cap->enabled = (uint8_t)(enabled != 0);
+}
+
+/** Discards all records */
+static inline void net_capture_clear(net_capture_t *cap) {
+    cap->head = cap->tail = cap->wrap = cap->used = cap->records = 0;
+}
+
+/**
+ * @brief Adds a filter predicate; a frame is kept only if all predicates match.
+ * @return NET_OK, NET_ERR_FULL, or NET_ERR_MALFORMED for a bad size.
+ */
+static inline int net_capture_filter(net_capture_t *cap, uint16_t offset, uint8_t size, net_capture_op_t op,
+                                     uint32_t mask, uint32_t value) {
+    if (size != 1 && size != 2 && size != 4)
+        return NET_ERR_MALFORMED;
+    if (cap->test_count >= NET_CAPTURE_MAX_TESTS)
+        return NET_ERR_FULL;
+
+    net_capture_test_t *t = &cap->tests[cap->test_count++];
+    t->offset = offset;
+    t->size = size;
+    t->op = (uint8_t)op;
+    t->mask = mask;
+    t->value = value;
+    return NET_OK;
+}
+
+static inline void net_capture_filter_clear(net_capture_t *cap) {
+    cap->test_count = 0;
+}
+
+/** Keep only frames of one EtherType */
+static inline int net_capture_filter_ethertype(net_capture_t *cap, uint16_t ethertype) {
+    return net_capture_filter(cap, 12, 2, NET_CAPTURE_EQ, 0xFFFF, ethertype);
+}
+
+/** Keep only IPv4 frames of one protocol (e.g. NET_PROTO_UDP) */
+static inline int net_capture_filter_ipv4_protocol(net_capture_t *cap, uint8_t protocol) {
+    int result = net_capture_filter_ethertype(cap, ETH_TYPE_IPV4);
+    return result != NET_OK ? result : net_capture_filter(cap, 14 + 9, 1, NET_CAPTURE_EQ, 0xFF, protocol);
+}
+
+/** Keep only IPv4 UDP/TCP frames to one destination port (assumes no IP options) */
+static inline int net_capture_filter_ipv4_dest_port(net_capture_t *cap, uint16_t port) {
+    int result = net_capture_filter_ethertype(cap, ETH_TYPE_IPV4);
+    return result != NET_OK ? result : net_capture_filter(cap, 14 + 20 + 2, 2, NET_CAPTURE_EQ, 0xFFFF, port);
+}
+
+// -----------------------------------------------------------------------------
+// Capture
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Runs the filter over a frame. A predicate reaching past the end of the
+ *        frame does not match.
+ */
+static inline int net_capture_match(const net_capture_t *cap, const uint8_t *frame, uint32_t len) {
+    for (uint8_t i = 0; i < cap->test_count; i++) {
+        const net_capture_test_t *t = &cap->tests[i];
+        uint32_t v = 0;
+
+        if ((uint32_t)t->offset + t->size > len)
+            return 0;
+        for (uint8_t b = 0; b < t->size; b++)
+            v = (v << 8) | frame[t->offset + b];
+        v &= t->mask;
+
+        switch (t->op) {
+        case NET_CAPTURE_EQ: if (v != t->value) return 0; break;
+        case NET_CAPTURE_NE: if (v == t->value) return 0; break;
+        case NET_CAPTURE_GT: if (v <= t->value) return 0; break;
+        case NET_CAPTURE_LT: if (v >= t->value) return 0; break;
+        default: return 0;
+        }
+    }
+    return 1;
+}
+
+/** Drops the oldest record */
+static inline void net_capture_pop(net_capture_t *cap) {
+    const net_capture_record_t *r = (const net_capture_record_t *)(const void *)(cap->ring + cap->tail);
+    uint32_t bytes = (uint32_t)sizeof(net_capture_record_t) + NET_CAPTURE_ALIGN(r->caplen);
+
+    cap->tail += bytes;
+    cap->used -= bytes;
+    cap->records--;
+
+    if (cap->records == 0) {
+        cap->head = cap->tail = cap->wrap = 0;
+    } else if (cap->wrap && cap->tail >= cap->wrap) {
+        cap->tail = 0;
+        cap->wrap = 0;
+    }
+}
+
+/**
+ * @brief Reserves a contiguous record of bytes (header included), overwriting the
+ *        oldest records as needed.
+ */
+static inline uint8_t *net_capture_reserve(net_capture_t *cap, uint32_t bytes) {
+    for (;;) {
+        if (cap->records == 0) {
+            cap->head = cap->tail = cap->wrap = 0;
+            break;
+        }
+        if (cap->head > cap->tail || (cap->head == cap->tail && !cap->wrap)) {
+            // Free space is [head, size) and [0, tail).
+            if (cap->size - cap->head >= bytes)
+                break;
+            if (cap->tail >= bytes) {
+                cap->wrap = cap->head;
+                cap->head = 0;
+                break;
+            }
+        } else if (cap->tail - cap->head >= bytes) {
+            // Wrapped: free space is [head, tail).
+            break;
+        }
+        net_capture_pop(cap);
+        cap->stats.overwritten++;
+    }
+
+    uint8_t *p = cap->ring + cap->head;
+    cap->head += bytes;
+    cap->used += bytes;
+    cap->records++;
+    return p;
+}
+
+static inline net_capture_record_t *net_capture_begin(net_capture_t *cap, uint32_t caplen, uint32_t origlen) {
+    uint32_t bytes = (uint32_t)sizeof(net_capture_record_t) + NET_CAPTURE_ALIGN(caplen);
+
+    if (bytes > cap->size) {
+        cap->stats.too_big++;
+        return NULL;
+    }
+
+    net_capture_record_t *r = (net_capture_record_t *)(void *)net_capture_reserve(cap, bytes);
+    uint64_t now = cap->clock ? cap->clock(cap->clock_ctx) : 0;
+
+    r->ts_sec = (uint32_t)(now / 1000000);
+    r->ts_usec = (uint32_t)(now % 1000000);
+    r->caplen = caplen;
+    r->origlen = origlen;
+    cap->stats.captured++;
+    return r;
+}
+
+/**
+ * @brief Records an Ethernet frame (from the destination MAC, without FCS).
+ * @return 1 if it was recorded.
+ */
+static inline int net_capture_frame(net_capture_t *cap, const uint8_t *frame, uint32_t len) {
+#if NET_CAPTURE_ENABLED
+    if (!cap->enabled)
+        return 0;
+
+    if (!net_capture_match(cap, frame, len)) {
+        cap->stats.filtered++;
+        return 0;
+    }
+
+    uint32_t caplen = len < cap->snaplen ? len : cap->snaplen;
+    net_capture_record_t *r = net_capture_begin(cap, caplen, len);
+    if (!r)
+        return 0;
+
+    memcpy(r + 1, frame, caplen);
+    return 1;
+#else
+    (void)cap; (void)frame; (void)len;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Records a net_packet_t as an Ethernet + IPv4/IPv6 frame, with a UDP header
+ *        when protocol is UDP. MACs are zero; the IPv4 header checksum is filled in,
+ *        the UDP checksum is left 0 (none). The filter sees only the synthesised
+ *        headers; predicates reaching into the payload do not match.
+ * @param ipv6 net_packet_t does not record its family: nonzero if src/dest hold IPv6 addresses.
+ */
+static inline int net_capture_packet(net_capture_t *cap, const net_packet_t *pkt, int ipv6) {
+#if NET_CAPTURE_ENABLED
+    uint8_t hdr[14 + 40 + 8];
+    uint16_t src_port, dest_port, length;
+    uint32_t ip_len = ipv6 ? 40 : 20;
+
+    if (!cap->enabled)
+        return 0;
+
+    memcpy(&src_port, (const uint8_t *)pkt + offsetof(net_packet_t, srcPort), 2);
+    memcpy(&dest_port, (const uint8_t *)pkt + offsetof(net_packet_t, destPort), 2);
+    memcpy(&length, (const uint8_t *)pkt + offsetof(net_packet_t, length), 2);
+    if (length > sizeof(pkt->payload))
+        length = sizeof(pkt->payload);
+
+    uint32_t l4 = (pkt->protocol == NET_PROTO_UDP ? 8u : 0u) + length;
+    uint32_t hdr_len = 14 + ip_len + (pkt->protocol == NET_PROTO_UDP ? 8 : 0);
+
+    memset(hdr, 0, sizeof(hdr));
+    hdr[12] = (uint8_t)((ipv6 ? ETH_TYPE_IPV6 : ETH_TYPE_IPV4) >> 8);
+    hdr[13] = (uint8_t)(ipv6 ? ETH_TYPE_IPV6 : ETH_TYPE_IPV4);
+
+    uint8_t *ip = hdr + 14;
+    if (ipv6) {
+        ip[0] = 0x60;
+        ip[4] = (uint8_t)(l4 >> 8);
+        ip[5] = (uint8_t)l4;
+        ip[6] = pkt->protocol;
+        ip[7] = 64;
+        memcpy(ip + 8, pkt->src.v6.bytes, 16);
+        memcpy(ip + 24, pkt->dest.v6.bytes, 16);
+    } else {
+        uint32_t total = 20 + l4, sum = 0;
+        ip[0] = 0x45;
+        ip[2] = (uint8_t)(total >> 8);
+        ip[3] = (uint8_t)total;
+        ip[8] = 64;
+        ip[9] = pkt->protocol;
+        memcpy(ip + 12, pkt->src.v4.bytes, 4);
+        memcpy(ip + 16, pkt->dest.v4.bytes, 4);
+        for (int i = 0; i < 20; i += 2)
+            sum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        ip[10] = (uint8_t)(~sum >> 8);
+        ip[11] = (uint8_t)~sum;
+    }
+
+    if (pkt->protocol == NET_PROTO_UDP) {
+        uint8_t *udp = ip + ip_len;
+        udp[0] = (uint8_t)(src_port >> 8);
+        udp[1] = (uint8_t)src_port;
+        udp[2] = (uint8_t)(dest_port >> 8);
+        udp[3] = (uint8_t)dest_port;
+        udp[4] = (uint8_t)(l4 >> 8);
+        udp[5] = (uint8_t)l4;
+    }
+
+    uint32_t len = hdr_len + length;
+    if (!net_capture_match(cap, hdr, hdr_len)) {
+        cap->stats.filtered++;
+        return 0;
+    }
+
+    uint32_t caplen = len < cap->snaplen ? len : cap->snaplen;
+    net_capture_record_t *r = net_capture_begin(cap, caplen, len);
+    if (!r)
+        return 0;
+
+    uint8_t *out = (uint8_t *)(r + 1);
+    uint32_t first = caplen < hdr_len ? caplen : hdr_len;
+    memcpy(out, hdr, first);
+    memcpy(out + first, pkt->payload, caplen - first);
+    return 1;
+#else
+    (void)cap; (void)pkt; (void)ipv6;
+    return 0;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Export
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Writes the file header: the pcap global header, or a pcapng Section Header
+ *        and Interface Description block (microsecond timestamps).
+ */
+static inline int net_capture_write_header(const net_capture_t *cap, net_capture_format_t format,
+                                           net_capture_write_fn write, void *ctx) {
+    if (format == NET_CAPTURE_PCAP) {
+        uint32_t hdr[6] = {0xA1B2C3D4, 0, 0, 0, cap->snaplen, NET_CAPTURE_LINKTYPE_ETHERNET};
+        uint16_t version[2] = {2, 4};
+        memcpy(&hdr[1], version, 4);
+        return write(ctx, hdr, sizeof(hdr));
+    }
+
+    uint32_t shb[7] = {0x0A0D0D0A, 28, 0x1A2B3C4D, 0, 0xFFFFFFFF, 0xFFFFFFFF, 28};
+    uint16_t version[2] = {1, 0};
+    memcpy(&shb[3], version, 4);
+
+    uint32_t idb[5] = {1, 20, 0, cap->snaplen, 20};
+    uint16_t link[2] = {NET_CAPTURE_LINKTYPE_ETHERNET, 0};
+    memcpy(&idb[2], link, 4);
+
+    int result = write(ctx, shb, sizeof(shb));
+    return result != NET_OK ? result : write(ctx, idb, sizeof(idb));
+}
+
+/**
+ * @brief Writes and removes the oldest records, in order, as pcap records or pcapng
+ *        Enhanced Packet Blocks. Call net_capture_write_header() first in each file.
+ * @param max_records Maximum number to drain; 0 for all.
+ * @return Number of records written, or the write callback's error (the failed
+ *         record stays in the ring).
+ */
+static inline int net_capture_drain(net_capture_t *cap, net_capture_format_t format,
+                                    net_capture_write_fn write, void *ctx, uint32_t max_records) {
+    static const uint8_t zero[4] = {0, 0, 0, 0};
+    int written = 0;
+
+    while (cap->records && (max_records == 0 || (uint32_t)written < max_records)) {
+        const net_capture_record_t *r = (const net_capture_record_t *)(const void *)(cap->ring + cap->tail);
+        int result;
+
+        if (format == NET_CAPTURE_PCAP) {
+            result = write(ctx, r, sizeof(*r) + r->caplen);
+        } else {
+            uint64_t ts = (uint64_t)r->ts_sec * 1000000 + r->ts_usec;
+            uint32_t padded = NET_CAPTURE_ALIGN(r->caplen);
+            uint32_t total = 32 + padded;
+            uint32_t epb[7] = {6, total, 0, (uint32_t)(ts >> 32), (uint32_t)ts, r->caplen, r->origlen};
+
+            result = write(ctx, epb, sizeof(epb));
+            if (result == NET_OK)
+                result = write(ctx, r + 1, r->caplen);
+            if (result == NET_OK && padded != r->caplen)
+                result = write(ctx, zero, padded - r->caplen);
+            if (result == NET_OK)
+                result = write(ctx, &total, 4);
+        }
+
+        if (result != NET_OK)
+            return result;
+
+        net_capture_pop(cap);
+        written++;
+    }
+
+    return written;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,430 @@
+#pragma once
+/**
+ * @file net_flow.h
+ * @brief Fixed-capacity IPv4/IPv6 flow table keyed on the 5-tuple.
+ *
+ * Flows are keyed on {src, dest, src port, dest port, protocol}. IPv4 addresses are
+ * stored IPv4-mapped (::ffff:a.b.c.d), so both families share one key layout and
+ * never collide. Each flow carries packet/byte counters and an optional token bucket
+ * for rate limiting.
+ *
+ * The index is an open-addressing hash table with robin-hood probing and
+ * backward-shift deletion: each 8-byte slot holds the flow's hash, its probe distance
+ * and the index of its entry, so a probe compares hashes in one small array and only
+ * touches an entry on a hash match. Entries live in a separate caller-provided array
+ * and never move, so an entry pointer stays valid until that flow is removed or
+ * evicted.
+ *
+ * Entries are kept on an LRU list. When every entry is in use, inserting a new flow
+ * evicts the least recently seen one; net_flow_expire() drops flows idle for longer
+ * than the table's timeout, walking from the LRU end so it only visits expired flows.
+ *
+ * All memory is caller-provided; nothing is allocated.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NET_FLOW_NONE 0xFFFF
+
+/** Largest usable entry count (indices are 16-bit, NET_FLOW_NONE is reserved) */
+#define NET_FLOW_MAX_ENTRIES 0xFFFF
+
+/** Flow key. Addresses are in network byte order, ports in host byte order. */
+typedef struct {
+    uint32_t src[4];        /**< IPv6, or IPv4-mapped IPv6 */
+    uint32_t dest[4];
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint8_t protocol;
+    uint8_t pad[3];         /**< Always zero, so keys compare and hash as whole words */
+} net_flow_key_t;
+
+#define NET_FLOW_KEY_WORDS (sizeof(net_flow_key_t) / 4)
+
+typedef struct {
+    net_flow_key_t key;
+    uint32_t hash;
+
+    uint32_t created;       /**< Table time (ms) of the first packet */
+    uint32_t last_seen;     /**< Table time (ms) of the latest packet */
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t dropped;       /**< Packets refused by the token bucket */
+
+    uint32_t rate;          /**< Bytes per second; 0 = unlimited */
+    uint32_t burst;         /**< Bucket depth in bytes */
+    uint32_t tokens;        /**< Current fill, in thousandths of a byte */
+    uint32_t refilled;      /**< Table time (ms) of the last refill */
+
+    uint16_t lru_prev;
+    uint16_t lru_next;      /**< Also links the free list */
+    uint32_t user;          /**< Free for the application */
+} net_flow_entry_t;
+
+typedef struct {
+    uint32_t hash;
+    uint16_t entry;
+    uint16_t dist;          /**< Probe distance + 1; 0 = empty slot */
+} net_flow_slot_t;
+
+typedef struct {
+    uint32_t inserts;
+    uint32_t evictions;     /**< Flows dropped to make room */
+    uint32_t expirations;   /**< Flows dropped by net_flow_expire() */
+} net_flow_stats_t;
+
+typedef struct {
+    net_flow_slot_t *slots;
+    uint32_t slot_mask;
+    net_flow_entry_t *entries;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t free_head;
+    uint16_t lru_head;      /**< Most recently seen */
+    uint16_t lru_tail;      /**< Least recently seen */
+
+    uint32_t seed;
+    uint32_t timeout_ms;
+    uint32_t now;           /**< Milliseconds, advanced by net_flow_tick() */
+    net_flow_stats_t stats;
+} net_flow_table_t;
+
+// -----------------------------------------------------------------------------
+// Keys
+// -----------------------------------------------------------------------------
+
+static inline void net_flow_key_ipv4(net_flow_key_t *key, ipv4_addr_t src, ipv4_addr_t dest,
+                                     uint16_t src_port, uint16_t dest_port, uint8_t protocol) {
+    static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+    memset(key, 0, sizeof(*key));
+    memcpy(key->src, mapped, 12);
+    memcpy((uint8_t *)key->src + 12, src.bytes, 4);
+    memcpy(key->dest, mapped, 12);
+    memcpy((uint8_t *)key->dest + 12, dest.bytes, 4);
+    key->src_port = src_port;
+    key->dest_port = dest_port;
+    key->protocol = protocol;
+}
+
+static inline void net_flow_key_ipv6(net_flow_key_t *key, const ipv6_addr_t *src, const ipv6_addr_t *dest,
+                                     uint16_t src_port, uint16_t dest_port, uint8_t protocol) {
+    memset(key, 0, sizeof(*key));
+    memcpy(key->src, src->bytes, 16);
+    memcpy(key->dest, dest->bytes, 16);
+    key->src_port = src_port;
+    key->dest_port = dest_port;
+    key->protocol = protocol;
+}
+
+/**
+ * @brief Builds the key of a net_packet_t.
+ * @param ipv6 net_packet_t does not record its family: nonzero if src/dest hold IPv6 addresses.
+ */
+static inline void net_flow_key_packet(net_flow_key_t *key, const net_packet_t *pkt, int ipv6) {
+    uint16_t src_port, dest_port;
+
+    // The packed struct puts these at unaligned offsets.
+    memcpy(&src_port, (const uint8_t *)pkt + offsetof(net_packet_t, srcPort), 2);
+    memcpy(&dest_port, (const uint8_t *)pkt + offsetof(net_packet_t, destPort), 2);
+
+    if (ipv6) {
+        ipv6_addr_t src = pkt->src.v6, dest = pkt->dest.v6;
+        net_flow_key_ipv6(key, &src, &dest, src_port, dest_port, pkt->protocol);
+    } else {
+        net_flow_key_ipv4(key, pkt->src.v4, pkt->dest.v4, src_port, dest_port, pkt->protocol);
+    }
+}
+
+static inline uint32_t net_flow_rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+/**
+ * @brief Hashes a key: a multiply-rotate step per word, finished with the
+ *        MurmurHash3 avalanche.
+ */
+static inline uint32_t net_flow_hash(const net_flow_key_t *key, uint32_t seed) {
+    const uint32_t *w = (const uint32_t *)key;
+    uint32_t h = seed ^ (uint32_t)sizeof(net_flow_key_t);
+
+    for (size_t i = 0; i < NET_FLOW_KEY_WORDS; i++)
+        h = net_flow_rotl(h ^ (w[i] * 0x9E3779B1u), 13) * 5 + 0xE6546B64u;
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline int net_flow_key_equal(const net_flow_key_t *a, const net_flow_key_t *b) {
+    const uint32_t *x = (const uint32_t *)a, *y = (const uint32_t *)b;
+    uint32_t diff = 0;
+
+    for (size_t i = 0; i < NET_FLOW_KEY_WORDS; i++)
+        diff |= x[i] ^ y[i];
+    return diff == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Table
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Initialises a table over caller-provided storage.
+ * @param slot_count Power of two, at least entry_count. Lookups stay short up to
+ *        about 90% load; 2 * entry_count rounded up is a good choice.
+ * @param entry_count Maximum number of live flows, at most NET_FLOW_MAX_ENTRIES.
+ * @param timeout_ms Idle time after which net_flow_expire() drops a flow.
+ * @return NET_OK, or NET_ERR_MALFORMED if the sizes are unusable.
+ */
+static inline int net_flow_init(net_flow_table_t *table, net_flow_slot_t *slots, uint32_t slot_count,
+                                net_flow_entry_t *entries, uint32_t entry_count, uint32_t timeout_ms) {
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) || entry_count == 0 ||
+        entry_count > NET_FLOW_MAX_ENTRIES || slot_count < entry_count)
+        return NET_ERR_MALFORMED;
+
+    memset(table, 0, sizeof(*table));
+    table->slots = slots;
+    table->slot_mask = slot_count - 1;
+    table->entries = entries;
+    table->capacity = (uint16_t)entry_count;
+    table->timeout_ms = timeout_ms;
+    table->seed = 0x2545F491u;
+    table->lru_head = NET_FLOW_NONE;
+    table->lru_tail = NET_FLOW_NONE;
+
+    memset(slots, 0, sizeof(net_flow_slot_t) * slot_count);
+    for (uint32_t i = 0; i < entry_count; i++)
+        entries[i].lru_next = (uint16_t)(i + 1 < entry_count ? i + 1 : NET_FLOW_NONE);
+    table->free_head = 0;
+
+    return NET_OK;
+}
+
+/**
+ * @brief Advances the table clock, used for timestamps, expiry and rate limiting.
+ */
+static inline void net_flow_tick(net_flow_table_t *table, uint32_t now_ms) {
+    table->now = now_ms;
+}
+
+static inline void net_flow_lru_unlink(net_flow_table_t *table, uint16_t idx) {
+    net_flow_entry_t *e = &table->entries[idx];
+
+    if (e->lru_prev != NET_FLOW_NONE)
+        table->entries[e->lru_prev].lru_next = e->lru_next;
+    else
+        table->lru_head = e->lru_next;
+
+    if (e->lru_next != NET_FLOW_NONE)
+        table->entries[e->lru_next].lru_prev = e->lru_prev;
+    else
+        table->lru_tail = e->lru_prev;
+}
+
+static inline void net_flow_lru_push(net_flow_table_t *table, uint16_t idx) {
+    net_flow_entry_t *e = &table->entries[idx];
+
+    e->lru_prev = NET_FLOW_NONE;
+    e->lru_next = table->lru_head;
+    if (table->lru_head != NET_FLOW_NONE)
+        table->entries[table->lru_head].lru_prev = idx;
+    else
+        table->lru_tail = idx;
+    table->lru_head = idx;
+}
+
+/**
+ * @brief Finds the slot holding a flow, or -1.
+ */
+static inline int32_t net_flow_find_slot(const net_flow_table_t *table, const net_flow_key_t *key, uint32_t hash) {
+    uint32_t pos = hash & table->slot_mask;
+
+    for (uint32_t dist = 1;; dist++, pos = (pos + 1) & table->slot_mask) {
+        const net_flow_slot_t *s = &table->slots[pos];
+
+        // Robin-hood invariant: the key would have displaced any slot closer to home.
+        if (s->dist < dist)
+            return -1;
+        if (s->hash == hash && net_flow_key_equal(&table->entries[s->entry].key, key))
+            return (int32_t)pos;
+    }
+}
+
+/**
+ * @brief Looks a flow up without updating it.
+ * @return The entry, or NULL.
+ */
+static inline net_flow_entry_t *net_flow_lookup(const net_flow_table_t *table, const net_flow_key_t *key) {
+    int32_t pos = net_flow_find_slot(table, key, net_flow_hash(key, table->seed));
+    return pos < 0 ? NULL : &table->entries[table->slots[pos].entry];
+}
+
+/**
+ * @brief Removes the flow in slot pos, shifting its successors back one place.
+ */
+static inline void net_flow_remove_slot(net_flow_table_t *table, uint32_t pos) {
+    uint16_t idx = table->slots[pos].entry;
+    uint32_t next = (pos + 1) & table->slot_mask;
+
+    while (table->slots[next].dist > 1) {
+        table->slots[pos] = table->slots[next];
+        table->slots[pos].dist--;
+        pos = next;
+        next = (next + 1) & table->slot_mask;
+    }
+    table->slots[pos].dist = 0;
+
+    net_flow_lru_unlink(table, idx);
+    table->entries[idx].lru_next = table->free_head;
+    table->free_head = idx;
+    table->count--;
+}
+
+/**
+ * @brief Removes a flow. Its entry pointer must not be used afterwards.
+ */
+static inline void net_flow_remove(net_flow_table_t *table, net_flow_entry_t *entry) {
+    int32_t pos = net_flow_find_slot(table, &entry->key, entry->hash);
+    if (pos >= 0)
+        net_flow_remove_slot(table, (uint32_t)pos);
+}
+
+/**
+ * @brief Finds a flow, creating it if it is new (evicting the least recently seen
+ *        flow if the table is full), and marks it seen now.
+ */
+static inline net_flow_entry_t *net_flow_get(net_flow_table_t *table, const net_flow_key_t *key) {
+    uint32_t hash = net_flow_hash(key, table->seed);
+    int32_t found = net_flow_find_slot(table, key, hash);
+    uint16_t idx;
+
+    if (found >= 0) {
+        idx = table->slots[found].entry;
+        if (table->lru_head != idx) {
+            net_flow_lru_unlink(table, idx);
+            net_flow_lru_push(table, idx);
+        }
+        table->entries[idx].last_seen = table->now;
+        return &table->entries[idx];
+    }
+
+    if (table->free_head == NET_FLOW_NONE) {
+        net_flow_entry_t *victim = &table->entries[table->lru_tail];
+        net_flow_remove_slot(table, (uint32_t)net_flow_find_slot(table, &victim->key, victim->hash));
+        table->stats.evictions++;
+    }
+
+    idx = table->free_head;
+    net_flow_entry_t *e = &table->entries[idx];
+    table->free_head = e->lru_next;
+
+    memset(e, 0, sizeof(*e));
+    e->key = *key;
+    e->hash = hash;
+    e->created = table->now;
+    e->last_seen = table->now;
+    e->refilled = table->now;
+    net_flow_lru_push(table, idx);
+    table->count++;
+    table->stats.inserts++;
+
+    // Robin-hood insert: take the slot of any flow that is closer to its home.
+    net_flow_slot_t cur = {hash, idx, 1};
+    uint32_t pos = hash & table->slot_mask;
+
+    for (;; pos = (pos + 1) & table->slot_mask, cur.dist++) {
+        net_flow_slot_t *s = &table->slots[pos];
+
+        if (s->dist == 0) {
+            *s = cur;
+            break;
+        }
+        if (s->dist < cur.dist) {
+            net_flow_slot_t tmp = *s;
+            *s = cur;
+            cur = tmp;
+        }
+    }
+
+    return e;
+}
+
+/**
+ * @brief Drops flows idle for longer than the table timeout.
+ * @return Number of flows dropped.
+ */
+static inline uint32_t net_flow_expire(net_flow_table_t *table) {
+    uint32_t expired = 0;
+
+    while (table->lru_tail != NET_FLOW_NONE) {
+        net_flow_entry_t *e = &table->entries[table->lru_tail];
+
+        if (table->now - e->last_seen <= table->timeout_ms)
+            break;
+
+        net_flow_remove(table, e);
+        expired++;
+    }
+
+    table->stats.expirations += expired;
+    return expired;
+}
+
+// -----------------------------------------------------------------------------
+// Accounting and rate limiting
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Sets a flow's token bucket. The bucket starts full.
+ * @param rate Bytes per second; 0 removes the limit.
+ * @param burst Largest burst in bytes, at most 4 MB.
+ */
+static inline void net_flow_set_rate(net_flow_table_t *table, net_flow_entry_t *entry, uint32_t rate, uint32_t burst) {
+    if (burst > 0x400000)
+        burst = 0x400000;
+
+    entry->rate = rate;
+    entry->burst = burst;
+    entry->tokens = burst * 1000;
+    entry->refilled = table->now;
+}
+
+/**
+ * @brief Accounts one packet against a flow.
+ * @return 1 if it is within the flow's rate and may be forwarded, 0 if it should be dropped.
+ */
+static inline int net_flow_admit(net_flow_table_t *table, net_flow_entry_t *entry, uint16_t bytes) {
+    if (entry->rate) {
+        uint32_t cap = entry->burst * 1000;
+        uint64_t tokens = entry->tokens + (uint64_t)(table->now - entry->refilled) * entry->rate;
+
+        entry->tokens = tokens > cap ? cap : (uint32_t)tokens;
+        entry->refilled = table->now;
+
+        if (entry->tokens < (uint32_t)bytes * 1000) {
+            entry->dropped++;
+            return 0;
+        }
+        entry->tokens -= (uint32_t)bytes * 1000;
+    }
+
+    entry->packets++;
+    entry->bytes += bytes;
+    return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
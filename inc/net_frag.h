@@ -0,0 +1,480 @@
+#pragma once
+/**
+ * @file net_frag.h
+ * @brief IPv4/IPv6 fragmentation and bounded-memory reassembly over net_buf_t chains.
+ *
+ * Fragmentation never copies payload: for each fragment the emit callback receives
+ * the fragment's IP header (and IPv6 Fragment header) plus a position and length in
+ * the original payload chain, ready for a scatter-gather transmit (or a single copy
+ * into the driver's TX buffer with net_frag_copy()).
+ *
+ * Reassembly keeps each received fragment in the buffer it arrived in. Fragments of
+ * one datagram are kept sorted by offset (held in buf->user) and linked through
+ * buf->next, so once the datagram is complete that list *is* the reassembled payload:
+ * a net_buf_t chain handed to the caller without copying.
+ *
+ * Memory is bounded by a fixed array of reassembly contexts, a per-datagram fragment
+ * limit and the buffer pool itself. When every context is busy, a new datagram evicts
+ * the oldest one; net_reasm_expire() drops datagrams that did not complete within the
+ * timeout, releasing their buffers.
+ *
+ * Overlapping fragments: IPv6 discards the whole datagram (RFC 5722). IPv4 keeps the
+ * data received first: the newcomer is trimmed (and dropped if nothing new remains),
+ * or, where it spans held fragments, has their bytes copied over its own.
+ *
+ * IPv4 options and IPv6 extension headers other than the Fragment header are not
+ * supported on the fragmentation side.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+#include "net_buf.h"
+#include "net_access.h"
+#include "net_checksum.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_REASM_MAX_FRAGMENTS
+#define NET_REASM_MAX_FRAGMENTS 64
+#endif
+
+#ifndef NET_REASM_TIMEOUT_MS
+#define NET_REASM_TIMEOUT_MS (30 * 1000)
+#endif
+
+/** Largest reassembled payload (the 13-bit fragment offset limit) */
+#define NET_REASM_MAX_SIZE 65535
+
+/**
+ * @brief Sends one fragment: header_len bytes of header followed by len bytes of the
+ *        payload chain, starting offset bytes into buf.
+ * @return NET_OK, or an error that stops fragmentation.
+ */
+typedef int (*net_frag_emit_fn)(void *ctx, const uint8_t *header, uint16_t header_len,
+                                const net_buf_t *buf, uint16_t offset, uint16_t len);
+
+// -----------------------------------------------------------------------------
+// Fragmentation
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Copies len bytes starting offset bytes into a chain.
+ */
+static inline void net_frag_copy(const net_buf_t *buf, uint32_t offset, uint8_t *dest, uint32_t len) {
+    for (; buf && len; buf = buf->next) {
+        if (offset >= buf->len) {
+            offset -= buf->len;
+            continue;
+        }
+
+        uint32_t n = buf->len - offset < len ? buf->len - offset : len;
+        memcpy(dest, buf->data + offset, n);
+        dest += n;
+        len -= n;
+        offset = 0;
+    }
+}
+
+/** Advances (buf, offset) to the buffer that holds byte offset */
+static inline void net_frag_seek(const net_buf_t **buf, uint32_t *offset) {
+    while ((*buf)->next && *offset >= (*buf)->len) {
+        *offset -= (*buf)->len;
+        *buf = (*buf)->next;
+    }
+}
+
+/**
+ * @brief Sends an IPv4 datagram, fragmented to fit mtu if needed.
+ * @param ip Header to send with (options not supported). If it is itself a fragment,
+ *        the fragments produced carry the right offsets and MF flag.
+ * @param payload Chain holding the IP payload.
+ * @return NET_OK, NET_ERR_TOO_BIG if DF is set and the datagram does not fit,
+ *         NET_ERR_UNSUPPORTED for IPv4 options, or the emit callback's error.
+ */
+static inline int net_frag_ipv4(const ipv4_header_t *ip, const net_buf_t *payload, uint16_t mtu,
+                                net_frag_emit_fn emit, void *ctx) {
+    ipv4_header_t hdr;
+    uint32_t total = net_buf_chain_len(payload);
+    uint16_t ff = NET_GET_BE16(ip, ipv4_header_t, flags_fragment);
+    uint32_t base = (uint32_t)(ff & IPV4_FRAGMENT_MASK) * 8;
+
+    if (ip->version_ihl != 0x45)
+        return NET_ERR_UNSUPPORTED;
+    if (mtu < sizeof(ipv4_header_t) + 8)
+        return NET_ERR_MALFORMED;
+    if (base + total + sizeof(ipv4_header_t) > 65535)
+        return NET_ERR_TOO_BIG;
+
+    uint32_t chunk = total + sizeof(ipv4_header_t) <= mtu ? total : ((mtu - sizeof(ipv4_header_t)) & ~7u);
+    if (chunk < total && (ff & IPV4_FLAG_DF))
+        return NET_ERR_TOO_BIG;
+
+    memcpy(&hdr, ip, sizeof(hdr));
+
+    const net_buf_t *buf = payload;
+    uint32_t offset = 0, done = 0;
+
+    do {
+        uint32_t len = total - done < chunk ? total - done : chunk;
+        int more = done + len < total || (ff & IPV4_FLAG_MF);
+
+        NET_SET_BE16(&hdr, ipv4_header_t, total_length, (uint16_t)(sizeof(ipv4_header_t) + len));
+        NET_SET_BE16(&hdr, ipv4_header_t, flags_fragment,
+                     (uint16_t)((ff & IPV4_FLAG_DF) | (more ? IPV4_FLAG_MF : 0) | ((base + done) / 8)));
+        hdr.checksum = 0;
+        hdr.checksum = net_csum_fold(net_csum_partial(&hdr, sizeof(hdr), 0));
+
+        if (buf)
+            net_frag_seek(&buf, &offset);
+
+        int result = emit(ctx, (const uint8_t *)&hdr, sizeof(hdr), buf, (uint16_t)offset, (uint16_t)len);
+        if (result != NET_OK)
+            return result;
+
+        done += len;
+        offset += len;
+    } while (done < total);
+
+    return NET_OK;
+}
+
+/**
+ * @brief Sends an IPv6 datagram, adding a Fragment header and fragmenting to fit mtu
+ *        if needed.
+ * @param ip Header to send with; next_header is the payload's protocol.
+ * @param id Fragment identification, unique per (src, dest) for the reassembly lifetime.
+ * @return NET_OK, NET_ERR_TOO_BIG, or the emit callback's error.
+ */
+static inline int net_frag_ipv6(const ipv6_header_t *ip, const net_buf_t *payload, uint16_t mtu, uint32_t id,
+                                net_frag_emit_fn emit, void *ctx) {
+    uint8_t hdr[sizeof(ipv6_header_t) + sizeof(ipv6_frag_header_t)];
+    ipv6_frag_header_t *fh = (ipv6_frag_header_t *)(void *)(hdr + sizeof(ipv6_header_t));
+    uint32_t total = net_buf_chain_len(payload);
+
+    memcpy(hdr, ip, sizeof(ipv6_header_t));
+
+    if (total + sizeof(ipv6_header_t) <= mtu) {
+        NET_SET_BE16(hdr, ipv6_header_t, payload_length, (uint16_t)total);
+        return emit(ctx, hdr, sizeof(ipv6_header_t), payload, 0, (uint16_t)total);
+    }
+
+    if (mtu < sizeof(hdr) + 8)
+        return NET_ERR_MALFORMED;
+    if (total > NET_REASM_MAX_SIZE)
+        return NET_ERR_TOO_BIG;
+
+    uint32_t chunk = (mtu - sizeof(hdr)) & ~7u;
+    const net_buf_t *buf = payload;
+    uint32_t offset = 0, done = 0;
+
+    hdr[offsetof(ipv6_header_t, next_header)] = NET_PROTO_IPV6_FRAG;
+    fh->next_header = ip->next_header;
+    fh->reserved = 0;
+    NET_SET_BE32(fh, ipv6_frag_header_t, identification, id);
+
+    do {
+        uint32_t len = total - done < chunk ? total - done : chunk;
+        int more = done + len < total;
+
+        NET_SET_BE16(hdr, ipv6_header_t, payload_length, (uint16_t)(sizeof(ipv6_frag_header_t) + len));
+        NET_SET_BE16(fh, ipv6_frag_header_t, offset_flags, (uint16_t)(done | (more ? IPV6_FRAG_MF : 0)));
+
+        net_frag_seek(&buf, &offset);
+
+        int result = emit(ctx, hdr, sizeof(hdr), buf, (uint16_t)offset, (uint16_t)len);
+        if (result != NET_OK)
+            return result;
+
+        done += len;
+        offset += len;
+    } while (done < total);
+
+    return NET_OK;
+}
+
+// -----------------------------------------------------------------------------
+// Reassembly
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    net_buf_t *frags;       /**< Sorted by offset (buf->user), linked through next */
+    uint32_t created;       /**< Reassembly time (ms) of the first fragment */
+    uint32_t id;
+    uint8_t src[16];
+    uint8_t dest[16];
+    uint16_t total;         /**< Payload length, known once the last fragment arrived */
+    uint8_t family;         /**< 0 = free, 4 or 6 */
+    uint8_t protocol;
+    uint8_t count;          /**< Fragments held */
+    uint8_t has_last;
+} net_reasm_ctx_t;
+
+typedef struct {
+    uint32_t completed;
+    uint32_t timeouts;      /**< Datagrams dropped by net_reasm_expire() */
+    uint32_t evicted;       /**< Datagrams dropped to free a context */
+    uint32_t overlaps;      /**< Fragments that overlapped data already held */
+    uint32_t dropped;       /**< Datagrams dropped as malformed or too large */
+} net_reasm_stats_t;
+
+typedef struct {
+    net_reasm_ctx_t *ctx;
+    uint8_t count;
+    uint32_t timeout_ms;
+    uint32_t now;           /**< Milliseconds, advanced by net_reasm_tick() */
+    net_reasm_stats_t stats;
+} net_reasm_t;
+
+static inline void net_reasm_init(net_reasm_t *reasm, net_reasm_ctx_t *ctx, uint8_t count, uint32_t timeout_ms) {
+    memset(reasm, 0, sizeof(*reasm));
+    memset(ctx, 0, sizeof(net_reasm_ctx_t) * count);
+    reasm->ctx = ctx;
+    reasm->count = count;
+    reasm->timeout_ms = timeout_ms;
+}
+
+static inline void net_reasm_tick(net_reasm_t *reasm, uint32_t now_ms) {
+    reasm->now = now_ms;
+}
+
+/** Releases a context and every fragment it holds */
+static inline void net_reasm_release(net_reasm_ctx_t *ctx) {
+    net_buf_unref(ctx->frags);
+    ctx->frags = NULL;
+    ctx->family = 0;
+}
+
+/**
+ * @brief Drops datagrams older than the timeout.
+ * @return Number dropped.
+ */
+static inline uint32_t net_reasm_expire(net_reasm_t *reasm) {
+    uint32_t expired = 0;
+
+    for (uint8_t i = 0; i < reasm->count; i++) {
+        net_reasm_ctx_t *ctx = &reasm->ctx[i];
+        if (ctx->family && reasm->now - ctx->created > reasm->timeout_ms) {
+            net_reasm_release(ctx);
+            expired++;
+        }
+    }
+
+    reasm->stats.timeouts += expired;
+    return expired;
+}
+
+/**
+ * Finds the context of a datagram, or claims one (evicting the oldest if needed).
+ * Returns NULL if the table has no contexts at all.
+ */
+static inline net_reasm_ctx_t *net_reasm_context(net_reasm_t *reasm, uint8_t family, const uint8_t *src,
+                                                 const uint8_t *dest, uint32_t id, uint8_t protocol) {
+    net_reasm_ctx_t *free_ctx = NULL, *oldest = NULL;
+
+    for (uint8_t i = 0; i < reasm->count; i++) {
+        net_reasm_ctx_t *ctx = &reasm->ctx[i];
+
+        if (!ctx->family) {
+            if (!free_ctx)
+                free_ctx = ctx;
+            continue;
+        }
+
+        if (ctx->family == family && ctx->id == id && ctx->protocol == protocol &&
+            !memcmp(ctx->src, src, 16) && !memcmp(ctx->dest, dest, 16))
+            return ctx;
+
+        if (!oldest || (int32_t)(ctx->created - oldest->created) < 0)
+            oldest = ctx;
+    }
+
+    if (!free_ctx) {
+        if (!oldest)
+            return NULL;
+        net_reasm_release(oldest);
+        reasm->stats.evicted++;
+        free_ctx = oldest;
+    }
+
+    memset(free_ctx, 0, sizeof(*free_ctx));
+    free_ctx->family = family;
+    free_ctx->id = id;
+    free_ctx->protocol = protocol;
+    memcpy(free_ctx->src, src, 16);
+    memcpy(free_ctx->dest, dest, 16);
+    free_ctx->created = reasm->now;
+    return free_ctx;
+}
+
+/**
+ * @brief Adds one fragment (payload bytes [offset, offset + frag->len)) to its datagram.
+ *        frag is always consumed.
+ * @param out Set to the reassembled payload chain once complete, else NULL.
+ */
+static inline int net_reasm_add(net_reasm_t *reasm, uint8_t family, const uint8_t *src, const uint8_t *dest,
+                                uint32_t id, uint8_t protocol, uint32_t offset, int more, net_buf_t *frag,
+                                net_buf_t **out) {
+    *out = NULL;
+
+    if (frag->next || (more && (frag->len & 7)) || (more && frag->len == 0)) {
+        net_buf_unref(frag);
+        return NET_ERR_MALFORMED;
+    }
+    if (offset + frag->len > NET_REASM_MAX_SIZE) {
+        net_buf_unref(frag);
+        return NET_ERR_TOO_BIG;
+    }
+
+    net_reasm_ctx_t *ctx = net_reasm_context(reasm, family, src, dest, id, protocol);
+    if (!ctx) {
+        net_buf_unref(frag);
+        return NET_ERR_FULL;
+    }
+
+    uint32_t end = offset + frag->len;
+    int result = NET_OK;
+
+    // The last fragment fixes the length; nothing may lie beyond it, and it may not change.
+    if (ctx->has_last) {
+        if (end > ctx->total || (!more && end != ctx->total))
+            result = NET_ERR_MALFORMED;
+    } else if (!more) {
+        for (net_buf_t *f = ctx->frags; f; f = f->next)
+            if (f->user + f->len > end)
+                result = NET_ERR_MALFORMED;
+        ctx->has_last = 1;
+        ctx->total = (uint16_t)end;
+    }
+    if (result == NET_OK && ctx->count >= NET_REASM_MAX_FRAGMENTS)
+        result = NET_ERR_FULL;
+
+    net_buf_t *prev = NULL, *cur = ctx->frags;
+    while (result == NET_OK && cur && cur->user < offset) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    // Overlap with the fragment before.
+    if (result == NET_OK && prev && prev->user + prev->len > offset) {
+        reasm->stats.overlaps++;
+        if (family == 6) {
+            result = NET_ERR_MALFORMED;
+        } else if (prev->user + prev->len >= end) {
+            net_buf_unref(frag);
+            return NET_OK;
+        } else {
+            net_buf_pull(frag, (uint16_t)(prev->user + prev->len - offset));
+            offset = prev->user + prev->len;
+        }
+    }
+
+    // Overlap with the fragments after.
+    while (result == NET_OK && cur && cur->user < end) {
+        reasm->stats.overlaps++;
+        if (family == 6) {
+            result = NET_ERR_MALFORMED;
+        } else if (cur->user + cur->len <= end && offset <= cur->user) {
+            // Entirely covered: the held bytes are copied over the newcomer's, which
+            // then takes the old buffer's place, so the data received first still wins.
+            net_buf_t *next = cur->next;
+            memcpy(frag->data + (cur->user - offset), cur->data, cur->len);
+            if (prev)
+                prev->next = next;
+            else
+                ctx->frags = next;
+            cur->next = NULL;
+            net_buf_unref(cur);
+            ctx->count--;
+            cur = next;
+        } else {
+            frag->len = (uint16_t)(cur->user - offset);
+            end = cur->user;
+            break;
+        }
+    }
+
+    if (result != NET_OK) {
+        net_buf_unref(frag);
+        net_reasm_release(ctx);
+        reasm->stats.dropped++;
+        return result;
+    }
+
+    if (frag->len == 0) {
+        net_buf_unref(frag);
+    } else {
+        frag->user = offset;
+        frag->next = cur;
+        if (prev)
+            prev->next = frag;
+        else
+            ctx->frags = frag;
+        ctx->count++;
+    }
+
+    if (!ctx->has_last)
+        return NET_OK;
+
+    uint32_t expect = 0;
+    for (net_buf_t *f = ctx->frags; f && f->user == expect; f = f->next)
+        expect += f->len;
+
+    if (expect == ctx->total) {
+        *out = ctx->frags;
+        ctx->frags = NULL;
+        ctx->family = 0;
+        reasm->stats.completed++;
+    }
+    return NET_OK;
+}
+
+/**
+ * @brief Reassembles IPv4. Non-fragments pass straight through to *out.
+ * @param ip Header the fragment arrived with.
+ * @param frag Single buffer holding the fragment's IP payload; always consumed.
+ * @param out Set to the complete payload chain once all fragments are in, else NULL.
+ * @return NET_OK, or why the fragment (and its datagram) was dropped.
+ */
+static inline int net_reasm_ipv4(net_reasm_t *reasm, const ipv4_header_t *ip, net_buf_t *frag, net_buf_t **out) {
+    uint16_t ff = NET_GET_BE16(ip, ipv4_header_t, flags_fragment);
+    uint8_t src[16] = {0}, dest[16] = {0};
+
+    if (!(ff & (IPV4_FLAG_MF | IPV4_FRAGMENT_MASK))) {
+        *out = frag;
+        return NET_OK;
+    }
+
+    memcpy(src, ip->src.bytes, 4);
+    memcpy(dest, ip->dest.bytes, 4);
+    return net_reasm_add(reasm, 4, src, dest, NET_GET_BE16(ip, ipv4_header_t, id), ip->protocol,
+                         (uint32_t)(ff & IPV4_FRAGMENT_MASK) * 8, (ff & IPV4_FLAG_MF) != 0, frag, out);
+}
+
+/**
+ * @brief Reassembles IPv6. Atomic fragments (offset 0, no M flag) pass straight
+ *        through (RFC 6946).
+ * @param fh The Fragment header; its next_header is the payload's protocol.
+ * @param frag Single buffer holding the fragmentable part; always consumed.
+ */
+static inline int net_reasm_ipv6(net_reasm_t *reasm, const ipv6_header_t *ip, const ipv6_frag_header_t *fh,
+                                 net_buf_t *frag, net_buf_t **out) {
+    uint16_t of = NET_GET_BE16(fh, ipv6_frag_header_t, offset_flags);
+
+    // Reserved bits are ignored: only the offset and M flag make this a real fragment.
+    if ((of & (IPV6_FRAG_OFFSET_MASK | IPV6_FRAG_MF)) == 0) {
+        *out = frag;
+        return NET_OK;
+    }
+
+    return net_reasm_add(reasm, 6, ip->src.bytes, ip->dest.bytes, NET_GET_BE32(fh, ipv6_frag_header_t, identification),
+                         fh->next_header, of & IPV6_FRAG_OFFSET_MASK, (of & IPV6_FRAG_MF) != 0, frag, out);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,293 @@
+#pragma once
+/**
+ * @file net_route.h
+ * @brief Longest-prefix-match routing tables for IPv4 and IPv6.
+ *
+ * Each table is a multibit trie with a fixed stride of 4 bits, built from nodes in a
+ * caller-provided array: a lookup reads at most 8 nodes for IPv4 and 32 for IPv6,
+ * with one nibble extract, one next-hop load and one child load per node.
+ *
+ * Every node keeps two views of the prefixes that end inside it:
+ *   - hop[16]:  the controlled-prefix-expansion view read by lookups; slot i holds the
+ *               next hop of the longest prefix in this node covering nibble i.
+ *   - orig[30]: the prefixes as added (2 of length 1, 4 of length 2, ... 16 of length
+ *               4 relative to the node), so that adding or deleting a route only
+ *               recomputes the hop[] slots that prefix covers.
+ * Nodes left with no prefixes and no children are returned to the free list on delete.
+ * A prefix of length 4k is stored at relative length 4 in the node above, so host
+ * routes (/32, /128) do not need a node of their own.
+ *
+ * A node is 80 bytes. Each prefix needs at most one node per 4 bits of length, less
+ * whatever it shares with other prefixes: as a sizing guide, 1000 unrelated IPv4
+ * prefixes of /8-/24 used about 2800 nodes, while a gateway with a handful of
+ * interfaces and a default route fits in a few dozen.
+ *
+ * Next hops are application-defined ids 1-255 (e.g. an interface index or an index
+ * into a gateway array); 0 means "no route".
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NET_ROUTE_NONE 0
+
+typedef struct {
+    uint16_t child[16];     /**< Node index per nibble; 0 = none (node 0 is the root) */
+    uint8_t hop[16];        /**< Expanded best next hop per nibble */
+    uint8_t orig[30];       /**< Prefixes ending here, by relative length: [(1 << len) - 2 + bits] */
+    uint8_t used;           /**< Number of nonzero orig[] entries */
+} net_route_node_t;
+
+typedef struct {
+    net_route_node_t *nodes;
+    uint16_t node_count;
+    uint16_t free_head;     /**< Free nodes are linked through child[0]; 0 = none */
+    uint16_t nodes_used;
+    uint8_t address_bits;   /**< 32 or 128 */
+    uint8_t default_hop;    /**< Next hop of the /0 route */
+    uint32_t routes;
+} net_route_table_t;
+
+/**
+ * @brief Initialises a table over caller-provided nodes.
+ * @param address_bits 32 for IPv4, 128 for IPv6.
+ * @param node_count Between 1 and 65535; node 0 becomes the root.
+ */
+static inline int net_route_init(net_route_table_t *table, net_route_node_t *nodes, uint32_t node_count, uint8_t address_bits) {
+    if (node_count == 0 || node_count > 0xFFFF || (address_bits != 32 && address_bits != 128))
+        return NET_ERR_MALFORMED;
+
+    memset(table, 0, sizeof(*table));
+    table->nodes = nodes;
+    table->node_count = (uint16_t)node_count;
+    table->address_bits = address_bits;
+    table->nodes_used = 1;
+
+    memset(nodes, 0, sizeof(net_route_node_t) * node_count);
+    for (uint32_t i = 1; i < node_count; i++)
+        nodes[i].child[0] = (uint16_t)(i + 1 < node_count ? i + 1 : 0);
+    table->free_head = node_count > 1 ? 1 : 0;
+
+    return NET_OK;
+}
+
+/** Nibble n (0 = most significant) of a big-endian address */
+static inline uint8_t net_route_nibble(const uint8_t *addr, uint32_t n) {
+    uint8_t b = addr[n >> 1];
+    return (n & 1) ? (b & 0x0F) : (b >> 4);
+}
+
+/**
+ * @brief Returns the next hop for addr, or NET_ROUTE_NONE.
+ * @param addr Big-endian address of table->address_bits bits.
+ */
+static inline uint8_t net_route_lookup(const net_route_table_t *table, const uint8_t *addr) {
+    const net_route_node_t *nodes = table->nodes;
+    const net_route_node_t *node = &nodes[0];
+    uint32_t levels = table->address_bits / 4;
+    uint8_t best = table->default_hop;
+
+    for (uint32_t n = 0; n < levels; n++) {
+        uint8_t nibble = net_route_nibble(addr, n);
+
+        if (node->hop[nibble])
+            best = node->hop[nibble];
+        if (!node->child[nibble])
+            break;
+        node = &nodes[node->child[nibble]];
+    }
+
+    return best;
+}
+
+/**
+ * @brief Recomputes hop[] for the nibbles covered by the prefix (len, bits) of a node.
+ */
+static inline void net_route_expand(net_route_node_t *node, uint8_t len, uint8_t bits) {
+    uint8_t first = (uint8_t)(bits << (4 - len));
+    uint8_t last = (uint8_t)(first + (1 << (4 - len)));
+
+    for (uint8_t i = first; i < last; i++) {
+        uint8_t hop = NET_ROUTE_NONE;
+
+        for (int l = 4; l >= 1 && !hop; l--)
+            hop = node->orig[(1 << l) - 2 + (i >> (4 - l))];
+        node->hop[i] = hop;
+    }
+}
+
+/**
+ * @brief Splits a prefix length into the depth of the node that stores it and its
+ *        length relative to that node (1-4).
+ */
+static inline void net_route_locate(uint8_t len, uint32_t *depth, uint8_t *rel) {
+    *depth = (uint32_t)(len - 1) / 4;
+    *rel = (uint8_t)(len - *depth * 4);
+}
+
+/** The rel bits of prefix following the first depth nibbles */
+static inline uint8_t net_route_prefix_bits(const uint8_t *prefix, uint32_t depth, uint8_t rel) {
+    return (uint8_t)(net_route_nibble(prefix, depth) >> (4 - rel));
+}
+
+/**
+ * @brief Frees the empty nodes at the bottom of path (path[0] is the root, never freed).
+ */
+static inline void net_route_prune(net_route_table_t *table, const uint8_t *prefix, const uint16_t *path, uint32_t depth) {
+    for (uint32_t n = depth; n > 0; n--) {
+        net_route_node_t *node = &table->nodes[path[n]];
+        uint16_t children = 0;
+
+        for (int i = 0; i < 16; i++)
+            children |= node->child[i];
+        if (node->used || children)
+            break;
+
+        table->nodes[path[n - 1]].child[net_route_nibble(prefix, n - 1)] = 0;
+        node->child[0] = table->free_head;
+        table->free_head = path[n];
+        table->nodes_used--;
+    }
+}
+
+/**
+ * @brief Adds a route, or replaces the next hop of an existing one.
+ * @param prefix Big-endian address; bits beyond len are ignored.
+ * @param hop Next hop id, 1-255.
+ * @return NET_OK, NET_ERR_FULL if the node array is exhausted (the table is left
+ *         unchanged), or NET_ERR_MALFORMED.
+ */
+static inline int net_route_add(net_route_table_t *table, const uint8_t *prefix, uint8_t len, uint8_t hop) {
+    uint16_t path[32];
+
+    if (len > table->address_bits || hop == NET_ROUTE_NONE)
+        return NET_ERR_MALFORMED;
+
+    if (len == 0) {
+        if (table->default_hop == NET_ROUTE_NONE)
+            table->routes++;
+        table->default_hop = hop;
+        return NET_OK;
+    }
+
+    uint32_t depth;
+    uint8_t rel;
+    net_route_locate(len, &depth, &rel);
+
+    path[0] = 0;
+    for (uint32_t n = 0; n < depth; n++) {
+        net_route_node_t *parent = &table->nodes[path[n]];
+        uint8_t nibble = net_route_nibble(prefix, n);
+
+        if (!parent->child[nibble]) {
+            uint16_t idx = table->free_head;
+            if (!idx) {
+                net_route_prune(table, prefix, path, n);
+                return NET_ERR_FULL;
+            }
+
+            table->free_head = table->nodes[idx].child[0];
+            memset(&table->nodes[idx], 0, sizeof(net_route_node_t));
+            table->nodes_used++;
+            parent->child[nibble] = idx;
+        }
+        path[n + 1] = parent->child[nibble];
+    }
+
+    net_route_node_t *node = &table->nodes[path[depth]];
+    uint8_t bits = net_route_prefix_bits(prefix, depth, rel);
+    uint8_t *slot = &node->orig[(1 << rel) - 2 + bits];
+
+    if (*slot == NET_ROUTE_NONE) {
+        node->used++;
+        table->routes++;
+    }
+    *slot = hop;
+    net_route_expand(node, rel, bits);
+    return NET_OK;
+}
+
+/**
+ * @brief Deletes a route, freeing any nodes it leaves empty.
+ * @return NET_OK, or NET_ERR_NOT_FOUND.
+ */
+static inline int net_route_delete(net_route_table_t *table, const uint8_t *prefix, uint8_t len) {
+    uint16_t path[32];
+
+    if (len > table->address_bits)
+        return NET_ERR_MALFORMED;
+
+    if (len == 0) {
+        if (table->default_hop == NET_ROUTE_NONE)
+            return NET_ERR_NOT_FOUND;
+        table->default_hop = NET_ROUTE_NONE;
+        table->routes--;
+        return NET_OK;
+    }
+
+    uint32_t depth;
+    uint8_t rel;
+    net_route_locate(len, &depth, &rel);
+
+    path[0] = 0;
+    for (uint32_t n = 0; n < depth; n++) {
+        uint16_t next = table->nodes[path[n]].child[net_route_nibble(prefix, n)];
+        if (!next)
+            return NET_ERR_NOT_FOUND;
+        path[n + 1] = next;
+    }
+
+    net_route_node_t *node = &table->nodes[path[depth]];
+    uint8_t bits = net_route_prefix_bits(prefix, depth, rel);
+    uint8_t *slot = &node->orig[(1 << rel) - 2 + bits];
+
+    if (*slot == NET_ROUTE_NONE)
+        return NET_ERR_NOT_FOUND;
+
+    *slot = NET_ROUTE_NONE;
+    node->used--;
+    table->routes--;
+    net_route_expand(node, rel, bits);
+
+    net_route_prune(table, prefix, path, depth);
+    return NET_OK;
+}
+
+// -----------------------------------------------------------------------------
+// Typed wrappers
+// -----------------------------------------------------------------------------
+
+static inline int net_route_add_ipv4(net_route_table_t *table, ipv4_addr_t prefix, uint8_t len, uint8_t hop) {
+    return net_route_add(table, prefix.bytes, len, hop);
+}
+
+static inline int net_route_delete_ipv4(net_route_table_t *table, ipv4_addr_t prefix, uint8_t len) {
+    return net_route_delete(table, prefix.bytes, len);
+}
+
+static inline uint8_t net_route_lookup_ipv4(const net_route_table_t *table, ipv4_addr_t addr) {
+    return net_route_lookup(table, addr.bytes);
+}
+
+static inline int net_route_add_ipv6(net_route_table_t *table, const ipv6_addr_t *prefix, uint8_t len, uint8_t hop) {
+    return net_route_add(table, prefix->bytes, len, hop);
+}
+
+static inline int net_route_delete_ipv6(net_route_table_t *table, const ipv6_addr_t *prefix, uint8_t len) {
+    return net_route_delete(table, prefix->bytes, len);
+}
+
+static inline uint8_t net_route_lookup_ipv6(const net_route_table_t *table, const ipv6_addr_t *addr) {
+    return net_route_lookup(table, addr->bytes);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,413 @@
+#pragma once
+/**
+ * @file net_stack.h
+ * @brief Minimal allocation-free UDP/IPv4 stack over Ethernet.
+ *
+ * Frames are parsed and built in place using the packed headers from network.h,
+ * with multi-byte fields read through the alignment-safe helpers in net_access.h
+ * (a received frame's IP header is rarely word aligned behind a 14-byte Ethernet
+ * header): received datagrams are handed to port handlers as a pointer into the frame, and
+ * outgoing datagrams get their UDP, IPv4 and Ethernet headers pushed into the
+ * headroom of a net_buf_t. All state (ARP cache, port table) lives in
+ * caller-provided fixed-size arrays.
+ *
+ * Supported: ARP (request/reply, fixed-size cache with expiry), IPv4 without options
+ * or fragmentation, UDP with checksums, unicast and limited broadcast.
+ *
+ * The link layer is two functions: the driver calls net_stack_input() for every
+ * received frame, and the stack calls the tx callback to send one. Any loopback,
+ * TAP or pcap-replay link can be plugged in the same way.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "network.h"
+#include "net_buf.h"
+#include "net_checksum.h"
+#include "net_access.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef NET_ARP_TIMEOUT_MS
+#define NET_ARP_TIMEOUT_MS  (5 * 60 * 1000)
+#endif
+
+#ifndef NET_IPV4_TTL
+#define NET_IPV4_TTL 64
+#endif
+
+#define NET_ETH_MTU 1500
+
+/** Sends one complete Ethernet frame. Returns NET_OK or NET_ERR_LINK. */
+typedef int (*net_link_tx_fn)(void *ctx, const uint8_t *frame, uint16_t len);
+
+/** Receives one UDP datagram; data points into the received frame and is only valid during the call. */
+typedef void (*net_udp_recv_fn)(void *ctx, ipv4_addr_t src, uint16_t src_port, uint16_t dest_port,
+                                const uint8_t *data, uint16_t len);
+
+typedef struct {
+    ipv4_addr_t ip;
+    uint8_t mac[6];
+    uint8_t valid;
+    uint32_t expires;   /**< Stack time (ms) after which the entry is stale */
+} net_arp_entry_t;
+
+typedef struct {
+    uint16_t port;      /**< Host byte order; 0 = free slot */
+    net_udp_recv_fn recv;
+    void *ctx;
+} net_udp_port_t;
+
+typedef struct {
+    uint32_t rx_frames;
+    uint32_t rx_dropped;
+    uint32_t tx_frames;
+    uint32_t arp_misses;
+} net_stack_stats_t;
+
+typedef struct {
+    uint8_t mac[6];
+    ipv4_addr_t ip;
+    ipv4_addr_t netmask;
+    ipv4_addr_t gateway;
+
+    net_link_tx_fn tx;
+    void *tx_ctx;
+
+    net_arp_entry_t *arp;
+    uint8_t arp_size;
+    net_udp_port_t *ports;
+    uint8_t port_count;
+
+    uint16_t next_id;
+    uint32_t now;       /**< Milliseconds, advanced by net_stack_tick() */
+    net_stack_stats_t stats;
+} net_stack_t;
+
+/**
+ * @brief Initialises a stack over caller-provided ARP and port tables.
+ */
+static inline void net_stack_init(net_stack_t *stack, const uint8_t mac[6], ipv4_addr_t ip, ipv4_addr_t netmask,
+                                  ipv4_addr_t gateway, net_link_tx_fn tx, void *tx_ctx,
+                                  net_arp_entry_t *arp, uint8_t arp_size, net_udp_port_t *ports, uint8_t port_count) {
+    memset(stack, 0, sizeof(*stack));
+    memcpy(stack->mac, mac, 6);
+    stack->ip = ip;
+    stack->netmask = netmask;
+    stack->gateway = gateway;
+    stack->tx = tx;
+    stack->tx_ctx = tx_ctx;
+    stack->arp = arp;
+    stack->arp_size = arp_size;
+    stack->ports = ports;
+    stack->port_count = port_count;
+
+    memset(arp, 0, sizeof(net_arp_entry_t) * arp_size);
+    memset(ports, 0, sizeof(net_udp_port_t) * port_count);
+}
+
+/**
+ * @brief Advances the stack clock, used for ARP expiry.
+ */
+static inline void net_stack_tick(net_stack_t *stack, uint32_t now_ms) {
+    stack->now = now_ms;
+}
+
+// -----------------------------------------------------------------------------
+// Port table
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Registers a handler for datagrams to port (host byte order).
+ * @return NET_OK, NET_ERR_FULL if the table is full, NET_ERR_MALFORMED if port is 0 or taken.
+ */
+static inline int net_udp_bind(net_stack_t *stack, uint16_t port, net_udp_recv_fn recv, void *ctx) {
+    net_udp_port_t *free_slot = NULL;
+
+    if (port == 0)
+        return NET_ERR_MALFORMED;
+
+    for (uint8_t i = 0; i < stack->port_count; i++) {
+        if (stack->ports[i].port == port)
+            return NET_ERR_MALFORMED;
+        if (stack->ports[i].port == 0 && !free_slot)
+            free_slot = &stack->ports[i];
+    }
+
+    if (!free_slot)
+        return NET_ERR_FULL;
+
+    free_slot->recv = recv;
+    free_slot->ctx = ctx;
+    free_slot->port = port;
+    return NET_OK;
+}
+
+static inline void net_udp_unbind(net_stack_t *stack, uint16_t port) {
+    for (uint8_t i = 0; i < stack->port_count; i++)
+        if (stack->ports[i].port == port)
+            stack->ports[i].port = 0;
+}
+
+// -----------------------------------------------------------------------------
+// ARP
+// -----------------------------------------------------------------------------
+
+static inline net_arp_entry_t *net_arp_find(net_stack_t *stack, ipv4_addr_t ip) {
+    for (uint8_t i = 0; i < stack->arp_size; i++) {
+        net_arp_entry_t *e = &stack->arp[i];
+        if (e->valid && ipv4_equal(e->ip, ip) && (int32_t)(e->expires - stack->now) > 0)
+            return e;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Records ip -> mac. Replaces an existing entry for ip, else a free or
+ *        expired one, else the one closest to expiry.
+ * @param create 0 to only refresh an entry that already exists.
+ */
+static inline void net_arp_update(net_stack_t *stack, ipv4_addr_t ip, const uint8_t mac[6], int create) {
+    net_arp_entry_t *slot = NULL;
+
+    for (uint8_t i = 0; i < stack->arp_size; i++) {
+        net_arp_entry_t *e = &stack->arp[i];
+
+        if (e->valid && ipv4_equal(e->ip, ip)) {
+            slot = e;
+            break;
+        }
+        if (!slot || !e->valid || (slot->valid && (int32_t)(e->expires - slot->expires) < 0))
+            slot = e;
+    }
+
+    if (!slot || (!create && !(slot->valid && ipv4_equal(slot->ip, ip))))
+        return;
+
+    slot->ip = ip;
+    memcpy(slot->mac, mac, 6);
+    slot->valid = 1;
+    slot->expires = stack->now + NET_ARP_TIMEOUT_MS;
+}
+
+static inline int net_arp_send(net_stack_t *stack, uint16_t oper, const uint8_t dest_mac[6],
+                               const uint8_t target_mac[6], ipv4_addr_t target_ip) {
+    uint8_t frame[sizeof(eth_header_t) + sizeof(arp_packet_t)];
+    eth_header_t *eth = (eth_header_t *)frame;
+    arp_packet_t *arp = (arp_packet_t *)(frame + sizeof(eth_header_t));
+
+    memcpy(eth->dest_mac, dest_mac, 6);
+    memcpy(eth->src_mac, stack->mac, 6);
+    eth->ethertype = net_htons(ETH_TYPE_ARP);
+
+    arp->htype = net_htons(1);
+    arp->ptype = net_htons(ETH_TYPE_IPV4);
+    arp->hlen = 6;
+    arp->plen = 4;
+    arp->oper = net_htons(oper);
+    memcpy(arp->sha, stack->mac, 6);
+    arp->spa = stack->ip;
+    memcpy(arp->tha, target_mac, 6);
+    arp->tpa = target_ip;
+
+    stack->stats.tx_frames++;
+    return stack->tx(stack->tx_ctx, frame, sizeof(frame));
+}
+
+static inline int net_arp_input(net_stack_t *stack, const uint8_t *payload, uint16_t len) {
+    if (len < sizeof(arp_packet_t))
+        return NET_ERR_MALFORMED;
+
+    const arp_packet_t *arp = (const arp_packet_t *)payload;
+    if (NET_GET_BE16(arp, arp_packet_t, htype) != 1 || NET_GET_BE16(arp, arp_packet_t, ptype) != ETH_TYPE_IPV4 ||
+        arp->hlen != 6 || arp->plen != 4)
+        return NET_ERR_UNSUPPORTED;
+
+    int for_us = ipv4_equal(arp->tpa, stack->ip);
+
+    // RFC 826: refresh a known sender always; learn a new one only if it is talking to us.
+    net_arp_update(stack, arp->spa, arp->sha, for_us);
+
+    if (!for_us)
+        return NET_ERR_NOT_FOR_US;
+
+    if (NET_GET_BE16(arp, arp_packet_t, oper) == ARP_OP_REQUEST)
+        return net_arp_send(stack, ARP_OP_REPLY, arp->sha, arp->sha, arp->spa);
+
+    return NET_OK;
+}
+
+// -----------------------------------------------------------------------------
+// Receive
+// -----------------------------------------------------------------------------
+
+static inline int net_udp_input(net_stack_t *stack, const ipv4_fields_t *ip, const uint8_t *payload, uint16_t len) {
+    if (len < sizeof(udp_header_t))
+        return NET_ERR_MALFORMED;
+
+    udp_fields_t udp;
+    net_parse_udp(payload, &udp);
+    if (udp.length < sizeof(udp_header_t) || udp.length > len)
+        return NET_ERR_MALFORMED;
+
+    if (udp.checksum != 0) {
+        uint32_t sum = net_csum_pseudo_ipv4(ip->src, ip->dest, NET_PROTO_UDP, udp.length);
+        if (net_csum_fold(net_csum_partial(payload, udp.length, sum)) != 0)
+            return NET_ERR_CHECKSUM;
+    }
+
+    for (uint8_t i = 0; i < stack->port_count; i++) {
+        net_udp_port_t *p = &stack->ports[i];
+        if (p->port == udp.dest_port) {
+            p->recv(p->ctx, ip->src, udp.src_port, udp.dest_port,
+                    payload + sizeof(udp_header_t), (uint16_t)(udp.length - sizeof(udp_header_t)));
+            return NET_OK;
+        }
+    }
+
+    return NET_ERR_NO_PORT;
+}
+
+static inline int net_ipv4_input(net_stack_t *stack, const uint8_t *payload, uint16_t len) {
+    if (len < sizeof(ipv4_header_t))
+        return NET_ERR_MALFORMED;
+
+    ipv4_fields_t ip;
+    net_parse_ipv4(payload, &ip);
+
+    if (ip.version != 4 || ip.header_len < sizeof(ipv4_header_t) || ip.total_length < ip.header_len || ip.total_length > len)
+        return NET_ERR_MALFORMED;
+
+    if (net_csum_fold(net_csum_partial(payload, ip.header_len, 0)) != 0)
+        return NET_ERR_CHECKSUM;
+
+    if (!ipv4_equal(ip.dest, stack->ip) && !ipv4_equal(ip.dest, IPV4_ADDR_BROADCAST))
+        return NET_ERR_NOT_FOR_US;
+
+    if ((ip.flags & IPV4_FLAG_MF) || ip.fragment)
+        return NET_ERR_UNSUPPORTED;
+
+    if (ip.protocol != NET_PROTO_UDP)
+        return NET_ERR_UNSUPPORTED;
+
+    return net_udp_input(stack, &ip, payload + ip.header_len, (uint16_t)(ip.total_length - ip.header_len));
+}
+
+/**
+ * @brief Processes one received Ethernet frame.
+ * @param frame Frame starting at the destination MAC (no preamble or FCS).
+ * @return NET_OK if it was consumed, otherwise why it was dropped.
+ */
+static inline int net_stack_input(net_stack_t *stack, const uint8_t *frame, uint16_t len) {
+    int result;
+
+    stack->stats.rx_frames++;
+
+    if (len < sizeof(eth_header_t)) {
+        result = NET_ERR_MALFORMED;
+    } else {
+        const uint8_t *payload = frame + sizeof(eth_header_t);
+        uint16_t payload_len = (uint16_t)(len - sizeof(eth_header_t));
+
+        switch (net_eth_type(frame)) {
+        case ETH_TYPE_ARP:
+            result = net_arp_input(stack, payload, payload_len);
+            break;
+        case ETH_TYPE_IPV4:
+            result = net_ipv4_input(stack, payload, payload_len);
+            break;
+        default:
+            result = NET_ERR_UNSUPPORTED;
+            break;
+        }
+    }
+
+    if (result != NET_OK)
+        stack->stats.rx_dropped++;
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+// Send
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Sends buf's contents as one UDP datagram.
+ *
+ * Headers are written into buf's headroom, so on NET_OK buf holds the complete frame.
+ * buf is not consumed: the caller still owns its reference. If the next hop's MAC is
+ * unknown an ARP request is sent, buf is left untouched and NET_ERR_ARP_PENDING is
+ * returned; retry once the reply has been processed.
+ *
+ * @param buf A single (unchained) buffer with at least Ethernet + IPv4 + UDP headroom.
+ */
+static inline int net_udp_send(net_stack_t *stack, ipv4_addr_t dest, uint16_t src_port, uint16_t dest_port, net_buf_t *buf) {
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t unknown[6] = {0, 0, 0, 0, 0, 0};
+    const uint8_t *dest_mac;
+
+    if (buf->next || buf->len > NET_ETH_MTU - sizeof(ipv4_header_t) - sizeof(udp_header_t) ||
+        net_buf_headroom(buf) < sizeof(eth_header_t) + sizeof(ipv4_header_t) + sizeof(udp_header_t))
+        return NET_ERR_TOO_BIG;
+
+    if (ipv4_equal(dest, IPV4_ADDR_BROADCAST)) {
+        dest_mac = broadcast;
+    } else {
+        uint32_t mask = ipv4_to_u32(stack->netmask);
+        int on_link = (ipv4_to_u32(dest) & mask) == (ipv4_to_u32(stack->ip) & mask);
+        ipv4_addr_t hop = on_link ? dest : stack->gateway;
+        net_arp_entry_t *e = net_arp_find(stack, hop);
+
+        if (!e) {
+            stack->stats.arp_misses++;
+            net_arp_send(stack, ARP_OP_REQUEST, broadcast, unknown, hop);
+            return NET_ERR_ARP_PENDING;
+        }
+        dest_mac = e->mac;
+    }
+
+    // One push for all three headers; the headroom check above means it cannot fail.
+    uint16_t udp_len = (uint16_t)(buf->len + sizeof(udp_header_t));
+    uint8_t *frame = net_buf_push(buf, sizeof(eth_header_t) + sizeof(ipv4_header_t) + sizeof(udp_header_t));
+    if (!frame)
+        return NET_ERR_TOO_BIG;
+
+    eth_header_t *eth = (eth_header_t *)frame;
+    ipv4_header_t *ip = (ipv4_header_t *)(frame + sizeof(eth_header_t));
+    udp_header_t *udp = (udp_header_t *)(frame + sizeof(eth_header_t) + sizeof(ipv4_header_t));
+
+    NET_SET_BE16(udp, udp_header_t, src_port, src_port);
+    NET_SET_BE16(udp, udp_header_t, dest_port, dest_port);
+    NET_SET_BE16(udp, udp_header_t, length, udp_len);
+    udp->checksum = 0;
+    udp->checksum = net_csum_udp_final(net_csum_partial(udp, udp_len,
+                                        net_csum_pseudo_ipv4(stack->ip, dest, NET_PROTO_UDP, udp_len)));
+
+    ip->version_ihl = 0x45;
+    ip->tos = 0;
+    NET_SET_BE16(ip, ipv4_header_t, total_length, (uint16_t)(udp_len + sizeof(ipv4_header_t)));
+    NET_SET_BE16(ip, ipv4_header_t, id, stack->next_id++);
+    NET_SET_BE16(ip, ipv4_header_t, flags_fragment, IPV4_FLAG_DF);
+    ip->ttl = NET_IPV4_TTL;
+    ip->protocol = NET_PROTO_UDP;
+    ip->checksum = 0;
+    ip->src = stack->ip;
+    ip->dest = dest;
+    ip->checksum = net_csum_fold(net_csum_partial(ip, sizeof(ipv4_header_t), 0));
+
+    memcpy(eth->dest_mac, dest_mac, 6);
+    memcpy(eth->src_mac, stack->mac, 6);
+    NET_SET_BE16(eth, eth_header_t, ethertype, ETH_TYPE_IPV4);
+
+    stack->stats.tx_frames++;
+    return stack->tx(stack->tx_ctx, buf->data, buf->len) == NET_OK ? NET_OK : NET_ERR_LINK;
+}
+
+#ifdef __cplusplus
+}
+#endif
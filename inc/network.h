@@ -12,6 +12,11 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -98,28 +103,218 @@ typedef struct NET_PACKED {
 #define PORT_NTP    123
 #define PORT_MQTT   1883
 
+/** IP protocol numbers (IANA) */
+#define NET_PROTO_ICMP  1
+#define NET_PROTO_TCP   6
+#define NET_PROTO_UDP   17
+
+// -----------------------------------------------------------------------------
+// Status codes
+// -----------------------------------------------------------------------------
+
+#define NET_OK                0
+#define NET_ERR_MALFORMED    -1   /**< Frame or header failed validation */
+#define NET_ERR_NOT_FOR_US   -2   /**< Valid, but addressed elsewhere */
+#define NET_ERR_CHECKSUM     -3   /**< Checksum mismatch */
+#define NET_ERR_NO_PORT      -4   /**< No handler bound to the destination port */
+#define NET_ERR_ARP_PENDING  -5   /**< Next-hop MAC unknown; an ARP request was sent */
+#define NET_ERR_TOO_BIG      -6   /**< Does not fit (MTU, headroom or table size) */
+#define NET_ERR_LINK         -7   /**< The link layer refused the frame */
+#define NET_ERR_FULL         -8   /**< No free table entry */
+#define NET_ERR_UNSUPPORTED  -9   /**< Valid, but uses a feature not implemented */
+#define NET_ERR_NOT_FOUND   -10   /**< No such entry (e.g. route) to update or remove */
+
+// -----------------------------------------------------------------------------
+// Byte order
+// -----------------------------------------------------------------------------
+
+/** Host to network byte order (16-bit) */
+static inline uint16_t net_htons(uint16_t v) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return v;
+#else
+    return (uint16_t)((v << 8) | (v >> 8));
+#endif
+}
+
+/** Host to network byte order (32-bit) */
+static inline uint32_t net_htonl(uint32_t v) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return v;
+#else
+    return ((v & 0xFF) << 24) | ((v & 0xFF00) << 8) | ((v >> 8) & 0xFF00) | (v >> 24);
+#endif
+}
+
+#define net_ntohs(v) net_htons(v)
+#define net_ntohl(v) net_htonl(v)
+
 // -----------------------------------------------------------------------------
 // Utility
 // -----------------------------------------------------------------------------
 
+static inline uint32_t net_addr_word(const uint8_t *p) {
+    uint32_t w;
+    memcpy(&w, p, 4);
+    return w;
+}
+
 /**
  * @brief Compare two IPv4 addresses for equality.
  */
 static inline int ipv4_equal(ipv4_addr_t a, ipv4_addr_t b) {
-    return (a.bytes[0] == b.bytes[0] &&
-            a.bytes[1] == b.bytes[1] &&
-            a.bytes[2] == b.bytes[2] &&
-            a.bytes[3] == b.bytes[3]);
+    return net_addr_word(a.bytes) == net_addr_word(b.bytes);
 }
 
 /**
  * @brief Compare two IPv6 addresses for equality.
  */
 static inline int ipv6_equal(ipv6_addr_t a, ipv6_addr_t b) {
-    for (int i = 0; i < 16; i++) {
-        if (a.bytes[i] != b.bytes[i]) return 0;
+    uint32_t diff = (net_addr_word(a.bytes) ^ net_addr_word(b.bytes)) |
+                    (net_addr_word(a.bytes + 4) ^ net_addr_word(b.bytes + 4)) |
+                    (net_addr_word(a.bytes + 8) ^ net_addr_word(b.bytes + 8)) |
+                    (net_addr_word(a.bytes + 12) ^ net_addr_word(b.bytes + 12));
+    return diff == 0;
+}
+
+/** Network-order mask of the first len (0-32) bits of a word */
+static inline uint32_t net_prefix_mask(int len) {
+    return len <= 0 ? 0 : net_htonl(len >= 32 ? 0xFFFFFFFF : ~(0xFFFFFFFF >> len));
+}
+
+/**
+ * @brief Compare the first len bits (0-32) of two IPv4 addresses.
+ */
+static inline int ipv4_prefix_equal(ipv4_addr_t a, ipv4_addr_t b, int len) {
+    return ((net_addr_word(a.bytes) ^ net_addr_word(b.bytes)) & net_prefix_mask(len)) == 0;
+}
+
+/**
+ * @brief Compare the first len bits (0-128) of two IPv6 addresses.
+ */
+static inline int ipv6_prefix_equal(ipv6_addr_t a, ipv6_addr_t b, int len) {
+    uint32_t diff = 0;
+
+    for (int i = 0; i < 16; i += 4, len -= 32)
+        diff |= (net_addr_word(a.bytes + i) ^ net_addr_word(b.bytes + i)) & net_prefix_mask(len);
+    return diff == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Address classes
+// -----------------------------------------------------------------------------
+
+/** 0.0.0.0 */
+static inline int ipv4_is_any(ipv4_addr_t a) {
+    return net_addr_word(a.bytes) == 0;
+}
+
+/** 255.255.255.255 (limited broadcast) */
+static inline int ipv4_is_broadcast(ipv4_addr_t a) {
+    return net_addr_word(a.bytes) == 0xFFFFFFFF;
+}
+
+/** Broadcast of the subnet given by netmask (e.g. 192.168.1.255/24), or limited broadcast */
+static inline int ipv4_is_subnet_broadcast(ipv4_addr_t a, ipv4_addr_t netmask) {
+    return (net_addr_word(a.bytes) | net_addr_word(netmask.bytes)) == 0xFFFFFFFF;
+}
+
+/** 224.0.0.0/4 */
+static inline int ipv4_is_multicast(ipv4_addr_t a) {
+    return (a.bytes[0] & 0xF0) == 224;
+}
+
+/** 127.0.0.0/8 */
+static inline int ipv4_is_loopback(ipv4_addr_t a) {
+    return a.bytes[0] == 127;
+}
+
+/** 169.254.0.0/16 */
+static inline int ipv4_is_link_local(ipv4_addr_t a) {
+    return a.bytes[0] == 169 && a.bytes[1] == 254;
+}
+
+/** :: */
+static inline int ipv6_is_any(ipv6_addr_t a) {
+    return (net_addr_word(a.bytes) | net_addr_word(a.bytes + 4) |
+            net_addr_word(a.bytes + 8) | net_addr_word(a.bytes + 12)) == 0;
+}
+
+/** ::1 */
+static inline int ipv6_is_loopback(ipv6_addr_t a) {
+    return (net_addr_word(a.bytes) | net_addr_word(a.bytes + 4) | net_addr_word(a.bytes + 8)) == 0 &&
+           net_addr_word(a.bytes + 12) == net_htonl(1);
+}
+
+/** ff00::/8 */
+static inline int ipv6_is_multicast(ipv6_addr_t a) {
+    return a.bytes[0] == 0xFF;
+}
+
+/** fe80::/10 */
+static inline int ipv6_is_link_local(ipv6_addr_t a) {
+    return a.bytes[0] == 0xFE && (a.bytes[1] & 0xC0) == 0x80;
+}
+
+/** ::ffff:0:0/96 (IPv4-mapped) */
+static inline int ipv6_is_v4_mapped(ipv6_addr_t a) {
+    return (net_addr_word(a.bytes) | net_addr_word(a.bytes + 4)) == 0 &&
+           net_addr_word(a.bytes + 8) == net_htonl(0xFFFF);
+}
+
+// -----------------------------------------------------------------------------
+// Address lists
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Finds addr in a list of count addresses (e.g. an allow-list).
+ * @return Index of the first match, or -1.
+ */
+static inline int ipv4_find(ipv4_addr_t addr, const ipv4_addr_t *list, int count) {
+    const uint8_t *p = (const uint8_t *)list;
+    uint32_t key = net_addr_word(addr.bytes);
+    int i = 0;
+
+#if defined(__SSE2__)
+    // Four addresses per compare.
+    __m128i k = _mm_set1_epi32((int)key);
+    for (; i + 4 <= count; i += 4) {
+        int hits = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(k, _mm_loadu_si128((const __m128i *)(const void *)(p + 4 * i)))));
+        if (hits)
+            return i + __builtin_ctz((unsigned)hits);
+    }
+#endif
+
+    for (; i < count; i++)
+        if (net_addr_word(p + 4 * i) == key)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief Finds addr in a list of count addresses.
+ * @return Index of the first match, or -1.
+ */
+static inline int ipv6_find(const ipv6_addr_t *addr, const ipv6_addr_t *list, int count) {
+#if defined(__SSE2__)
+    __m128i k = _mm_loadu_si128((const __m128i *)(const void *)addr->bytes);
+    for (int i = 0; i < count; i++)
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(k, _mm_loadu_si128((const __m128i *)(const void *)list[i].bytes))) == 0xFFFF)
+            return i;
+#else
+    uint32_t k0 = net_addr_word(addr->bytes), k1 = net_addr_word(addr->bytes + 4);
+    uint32_t k2 = net_addr_word(addr->bytes + 8), k3 = net_addr_word(addr->bytes + 12);
+
+    for (int i = 0; i < count; i++) {
+        const uint8_t *p = list[i].bytes;
+        // Most non-matches differ in the first word; test it alone before the rest.
+        if (net_addr_word(p) == k0 &&
+            ((net_addr_word(p + 4) ^ k1) | (net_addr_word(p + 8) ^ k2) | (net_addr_word(p + 12) ^ k3)) == 0)
+            return i;
     }
-    return 1;
+#endif
+    return -1;
 }
 
 /**
@@ -217,7 +412,9 @@ typedef struct NET_PACKED {
     uint16_t type_length;   /**< EtherType (II) or length (802.3 / I) */
 } eth_mac_header_t;
 
-_Static_assert(sizeof(eth_mac_header_t) == 14, "Ethernet MAC header must be 14 bytes");
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(eth_mac_header_t) == 14, "Ethernet MAC header must be 14 bytes");
+#endif
 
 // -----------------------------------------------------------------------------
 // Ethernet II interpretation
@@ -242,7 +439,9 @@ typedef struct NET_PACKED {
     // Followed by LLC/SNAP header
 } eth8023_header_t;
 
-_Static_assert(sizeof(eth8023_header_t) == 14, "802.3 header must be 14 bytes");
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(eth8023_header_t) == 14, "802.3 header must be 14 bytes");
+#endif
 
 // LLC header (802.2)
 typedef struct NET_PACKED {
@@ -257,6 +456,104 @@ typedef struct NET_PACKED {
     uint16_t protocol_id;   /**< Protocol type (same values as EtherType) */
 } snap_header_t;
 
+// -----------------------------------------------------------------------------
+// IPv4 header
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief IPv4 header without options (20 bytes).
+ *
+ * Packed to match the exact on‑wire layout.
+ * All multi‑byte fields are in network byte order.
+ */
+typedef struct NET_PACKED {
+    uint8_t     version_ihl;     /**< Version (4) << 4 | header length in 32-bit words */
+    uint8_t     tos;             /**< DSCP / ECN */
+    uint16_t    total_length;    /**< Header + payload length */
+    uint16_t    id;              /**< Identification, for fragment reassembly */
+    uint16_t    flags_fragment;  /**< Flags (DF = 0x4000, MF = 0x2000) | offset in 8-byte units */
+    uint8_t     ttl;             /**< Time to live */
+    uint8_t     protocol;        /**< Payload protocol (e.g. 17 = UDP) */
+    uint16_t    checksum;        /**< Header checksum */
+    ipv4_addr_t src;             /**< Source address */
+    ipv4_addr_t dest;            /**< Destination address */
+} ipv4_header_t;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(ipv4_header_t) == 20, "IPv4 header must be 20 bytes");
+#endif
+
+#define IPV4_FLAG_DF         0x4000
+#define IPV4_FLAG_MF         0x2000
+#define IPV4_FRAGMENT_MASK   0x1FFF
+
+// -----------------------------------------------------------------------------
+// ARP (Ethernet / IPv4)
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief ARP packet for IPv4 over Ethernet (28 bytes).
+ */
+typedef struct NET_PACKED {
+    uint16_t    htype;           /**< Hardware type (1 = Ethernet) */
+    uint16_t    ptype;           /**< Protocol type (0x0800 = IPv4) */
+    uint8_t     hlen;            /**< Hardware address length (6) */
+    uint8_t     plen;            /**< Protocol address length (4) */
+    uint16_t    oper;            /**< 1 = request, 2 = reply */
+    uint8_t     sha[6];          /**< Sender MAC */
+    ipv4_addr_t spa;             /**< Sender IP */
+    uint8_t     tha[6];          /**< Target MAC */
+    ipv4_addr_t tpa;             /**< Target IP */
+} arp_packet_t;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(arp_packet_t) == 28, "ARP packet must be 28 bytes");
+#endif
+
+#define ARP_OP_REQUEST  1
+#define ARP_OP_REPLY    2
+
+// -----------------------------------------------------------------------------
+// IPv6 header
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief IPv6 fixed header (40 bytes).
+ *
+ * Packed to match the exact on‑wire layout.
+ * All multi‑byte fields are in network byte order.
+ */
+typedef struct NET_PACKED {
+    uint32_t    version_class_flow; /**< Version (6) << 28 | traffic class << 20 | flow label */
+    uint16_t    payload_length;     /**< Bytes following this header, extension headers included */
+    uint8_t     next_header;        /**< Protocol of the next header (e.g. 17 = UDP, 44 = fragment) */
+    uint8_t     hop_limit;
+    ipv6_addr_t src;
+    ipv6_addr_t dest;
+} ipv6_header_t;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(ipv6_header_t) == 40, "IPv6 header must be 40 bytes");
+#endif
+
+/**
+ * @brief IPv6 Fragment extension header (8 bytes, RFC 8200 section 4.5).
+ */
+typedef struct NET_PACKED {
+    uint8_t     next_header;        /**< Protocol of the fragmented payload */
+    uint8_t     reserved;
+    uint16_t    offset_flags;       /**< Offset in 8-byte units << 3 | M flag */
+    uint32_t    identification;
+} ipv6_frag_header_t;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+  _Static_assert(sizeof(ipv6_frag_header_t) == 8, "IPv6 fragment header must be 8 bytes");
+#endif
+
+#define NET_PROTO_IPV6_FRAG   44
+#define IPV6_FRAG_MF          0x0001
+#define IPV6_FRAG_OFFSET_MASK 0xFFF8
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,99 @@
+/**
+ * Host test of CodalSVC with a CODAL_SVC_TABLE: r0-r3 reach the entry and its
+ * result lands in the frame's r0, out-of-range and null entries give
+ * DEVICE_NOT_SUPPORTED, the SVC number is decoded from the Thumb halfword before
+ * the stacked PC, and measure<N>() averages the cycle counter over its calls.
+ * The host round trip is timed for reference.
+ */
+
+#include "CodalSVC.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static const uint32_t CYCLES_PER_CALL = 37;
+
+static uint32_t seen[4];
+static uint32_t calls;
+
+static int32_t sysRecord(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    seen[0] = a0;
+    seen[1] = a1;
+    seen[2] = a2;
+    seen[3] = a3;
+    calls++;
+    return static_cast<int32_t>(a0 ^ a1 ^ a2 ^ a3);
+}
+
+static int32_t sysNegate(uint32_t a0, uint32_t, uint32_t, uint32_t)
+{
+    return -static_cast<int32_t>(a0);
+}
+
+/** Stands in for a service that takes a fixed time on the target. */
+static int32_t sysTimed(uint32_t, uint32_t, uint32_t, uint32_t)
+{
+    DWT->CYCCNT += CYCLES_PER_CALL;
+    return 0;
+}
+
+static constexpr SVCFunction syscalls[] = {sysRecord, sysNegate, nullptr, sysTimed};
+CODAL_SVC_TABLE(syscalls)
+
+static void testArguments()
+{
+    CHECK_EQ(svcCall<0>(0x11111111, 0x22222222, 0x44444444, 0x88888888), static_cast<int32_t>(0xFFFFFFFF));
+    CHECK(seen[0] == 0x11111111 && seen[1] == 0x22222222 && seen[2] == 0x44444444 && seen[3] == 0x88888888);
+    CHECK_EQ(svcCall<1>(7), -7);
+
+    // The result replaces r0 only; the rest of the frame is untouched.
+    uint32_t frame[SVC_FRAME_WORDS] = {5, 6, 7, 8, 12, 0xFFFFFFFD, 0x08001000, 0x01000000};
+    CodalSVC::dispatch(syscalls, frame, 0);
+    CHECK_EQ(frame[SVC_FRAME_R0], 5 ^ 6 ^ 7 ^ 8);
+    CHECK(frame[SVC_FRAME_R1] == 6 && frame[SVC_FRAME_R2] == 7 && frame[SVC_FRAME_R3] == 8);
+    CHECK(frame[SVC_FRAME_R12] == 12 && frame[SVC_FRAME_PC] == 0x08001000 && frame[SVC_FRAME_XPSR] == 0x01000000);
+}
+
+static void testUnsupported()
+{
+    uint32_t before = calls;
+
+    CHECK_EQ(svcCall<2>(1), DEVICE_NOT_SUPPORTED);
+    CHECK_EQ(svcCall<4>(1), DEVICE_NOT_SUPPORTED);
+    CHECK_EQ(svcCall<255>(1), DEVICE_NOT_SUPPORTED);
+    CHECK_EQ(calls, before);
+}
+
+static void testNumber()
+{
+    // "svc #n; nop": the stacked PC points at the instruction after the SVC.
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint16_t code[2] = {static_cast<uint16_t>(0xDF00 | n), 0xBF00};
+        CHECK_EQ(CodalSVC::number(code + 1), n);
+    }
+}
+
+static void testMeasure()
+{
+    CHECK_EQ(CodalSVC::measure<3>(0), 0);
+    CHECK_EQ(CodalSVC::measure<3>(1000), CYCLES_PER_CALL);
+
+    const uint32_t iterations = 10000000;
+    volatile int32_t sink = 0;
+    uint64_t start = host_test_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += svcCall<1>(i);
+    printf("host dispatch: %.2f ns per call\n", static_cast<double>(host_test_now_ns() - start) / iterations);
+}
+
+int main()
+{
+    testArguments();
+    testUnsupported();
+    testNumber();
+    testMeasure();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+/**
+ * Host test of VectorTable against the emulated SCB: relocate() refuses a table
+ * smaller than the interrupt lines ICTR reports, copies the whole flash table
+ * before it moves VTOR and is a no-op once done, and set() returns the handler
+ * it replaces, or NULL for exception 0 and numbers past the table.
+ */
+
+#include "CodalVectorTable.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static int hits;
+static uintptr_t flashTable[CODAL_VECTOR_TABLE_ENTRIES];
+
+static void handlerA()
+{
+    hits += 1;
+}
+
+static void handlerB()
+{
+    hits += 2;
+}
+
+static void testRefusedWhenDeviceHasMoreLines()
+{
+    // 16 + 32 * 3 = 112 vectors do not fit a table of 80.
+    scnScbHost().ICTR = 2;
+    CHECK_EQ(VectorTable::deviceEntries(), 112);
+    CHECK(!VectorTable::relocate());
+    CHECK(VectorTable::set(VectorTable::SVC_EXCEPTION, handlerA) == NULL);
+    CHECK(scbHost().VTOR == reinterpret_cast<uintptr_t>(flashTable));
+    CHECK(!VectorTable::isRelocated());
+
+    scnScbHost().ICTR = 1;
+    CHECK_EQ(VectorTable::deviceEntries(), CODAL_VECTOR_TABLE_ENTRIES);
+}
+
+static void testCopyThenSwitch()
+{
+    CHECK(VectorTable::get(VectorTable::FIRST_IRQ + 1) == handlerA);
+
+    mpuHost().resetCounters();
+    CHECK(VectorTable::relocate());
+    CHECK(VectorTable::isRelocated());
+    CHECK(scbHost().VTOR != reinterpret_cast<uintptr_t>(flashTable));
+    CHECK_EQ(scbHost().VTOR % vectorTableAlignment(CODAL_VECTOR_TABLE_ENTRIES * sizeof(uintptr_t)), 0);
+
+    // Every entry arrived, and the switch was fenced: DSB before, DSB and ISB after.
+    const uintptr_t *ram = reinterpret_cast<const uintptr_t *>(scbHost().VTOR);
+    CHECK(memcmp(ram, flashTable, sizeof(flashTable)) == 0);
+    CHECK_EQ(mpuHost().barriers, 3);
+}
+
+static void testRelocateIsIdempotent()
+{
+    uintptr_t vtor = scbHost().VTOR;
+
+    // A second call neither copies again nor touches VTOR.
+    flashTable[VectorTable::SYSTICK_EXCEPTION] = 0xBAD;
+    mpuHost().resetCounters();
+    CHECK(VectorTable::relocate());
+    CHECK_EQ(scbHost().VTOR, vtor);
+    CHECK_EQ(mpuHost().barriers, 0);
+    CHECK(VectorTable::get(VectorTable::SYSTICK_EXCEPTION) == reinterpret_cast<VectorHandler>(0x1000 + 15));
+}
+
+static void testSet()
+{
+    CHECK(VectorTable::setIRQ(1, handlerB) == handlerA);
+    CHECK(VectorTable::set(VectorTable::FIRST_IRQ + 1, handlerA) == handlerB);
+    CHECK(VectorTable::set(VectorTable::FIRST_IRQ + 1, handlerB) == handlerA);
+    VectorTable::get(VectorTable::FIRST_IRQ + 1)();
+    CHECK_EQ(hits, 2);
+
+    CHECK(VectorTable::set(VectorTable::PENDSV_EXCEPTION, handlerA) == reinterpret_cast<VectorHandler>(0x1000 + 14));
+    CHECK(flashTable[VectorTable::PENDSV_EXCEPTION] == 0x1000 + 14);
+
+    // Exception 0 is the initial stack pointer, not a handler.
+    uintptr_t stack = reinterpret_cast<const uintptr_t *>(scbHost().VTOR)[0];
+    CHECK(VectorTable::set(0, handlerA) == NULL);
+    CHECK(VectorTable::set(CODAL_VECTOR_TABLE_ENTRIES, handlerA) == NULL);
+    CHECK(VectorTable::setIRQ(CODAL_VECTOR_TABLE_ENTRIES - VectorTable::FIRST_IRQ, handlerA) == NULL);
+    CHECK(VectorTable::get(CODAL_VECTOR_TABLE_ENTRIES) == NULL);
+    CHECK_EQ(reinterpret_cast<const uintptr_t *>(scbHost().VTOR)[0], stack);
+
+    CHECK(VectorTable::set(CODAL_VECTOR_TABLE_ENTRIES - 1, handlerA) ==
+          reinterpret_cast<VectorHandler>(0x1000 + CODAL_VECTOR_TABLE_ENTRIES - 1));
+}
+
+int main()
+{
+    for (uint32_t i = 0; i < CODAL_VECTOR_TABLE_ENTRIES; i++)
+        flashTable[i] = 0x1000 + i;
+    flashTable[VectorTable::FIRST_IRQ + 1] = reinterpret_cast<uintptr_t>(handlerA);
+    scbHost().VTOR = reinterpret_cast<uintptr_t>(flashTable);
+
+    testRefusedWhenDeviceHasMoreLines();
+    testCopyThenSwitch();
+    testRelocateIsIdempotent();
+    testSet();
+
+    return HOST_TEST_RESULT();
+}
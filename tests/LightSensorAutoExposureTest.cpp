@@ -0,0 +1,235 @@
+/**
+ * Host test of LightSensorAutoExposure against a simulated TCS34725 following a
+ * light trace. The simulated device integrates in cycles and only picks up a new
+ * gain or integration time at the start of a cycle, like the real part, so a
+ * sample read too soon after a change was taken at the old setting.
+ */
+
+#include "LightSensorAutoExposure.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static uint64_t now; // Simulated time, in microseconds
+
+namespace codal
+{
+    Fiber *currentFiber;
+
+    CODAL_TIMESTAMP system_timer_current_time_us()
+    {
+        return now;
+    }
+
+    void fiber_sleep(unsigned long t)
+    {
+        now += t * 1000;
+    }
+} // namespace codal
+
+/**
+ * A TCS34725 on an I2C bus. light(t) gives counts per microsecond at unity gain.
+ */
+class SimulatedTCS34725 : public I2C
+{
+public:
+    uint8_t registers[32];
+    double (*light)(uint64_t t);
+
+    // The cycle in progress, with the setting it started with.
+    uint64_t cycleStart;
+    uint8_t cycleGain;
+    uint32_t cycleTime;
+
+    // The last completed cycle's result, the setting it was taken with and the light level.
+    uint16_t data[4];
+    uint8_t dataGain;
+    uint32_t dataTime;
+    double dataLight;
+
+    SimulatedTCS34725(double (*light)(uint64_t)) : light(light), cycleStart(0), cycleGain(0), cycleTime(0), dataGain(0),
+                                                  dataTime(0), dataLight(0)
+    {
+        memset(registers, 0, sizeof(registers));
+        memset(data, 0, sizeof(data));
+        registers[0x01] = 0xFF;
+        registers[0x03] = 0xFF;
+    }
+
+    uint8_t gain() const
+    {
+        static const uint8_t gains[] = {1, 4, 16, 60};
+        return gains[registers[0x0F] & 0x03];
+    }
+
+    uint32_t integrationTime() const
+    {
+        return (256 - registers[0x01]) * 2400;
+    }
+
+    void advance()
+    {
+        if (!(registers[0x00] & 0x02))
+            return;
+
+        while (cycleStart + cycleTime <= now)
+        {
+            dataLight = light(cycleStart + cycleTime);
+
+            double counts = dataLight * cycleGain * cycleTime;
+            double limit = cycleTime / 2400 * 1024.0 < 65535 ? cycleTime / 2400 * 1024.0 : 65535;
+            uint16_t clear = static_cast<uint16_t>(counts < limit ? counts : limit);
+
+            // Clear, red, green, blue: a slightly warm white.
+            data[0] = clear;
+            data[1] = clear / 2;
+            data[2] = clear / 3;
+            data[3] = clear / 4;
+            dataGain = cycleGain;
+            dataTime = cycleTime;
+
+            cycleStart += cycleTime;
+            cycleGain = gain();
+            cycleTime = integrationTime();
+        }
+    }
+
+    virtual int write(uint16_t, uint8_t *buffer, int len, bool = false) override
+    {
+        now += 100;
+        advance();
+
+        uint8_t reg = buffer[0] & 0x1F;
+        bool powerOn = reg == 0x00 && !(registers[0x00] & 0x02) && (buffer[1] & 0x02);
+
+        for (int i = 1; i < len; i++)
+            registers[(reg + i - 1) & 0x1F] = buffer[i];
+
+        if (powerOn)
+        {
+            cycleStart = now;
+            cycleGain = gain();
+            cycleTime = integrationTime();
+        }
+
+        return DEVICE_OK;
+    }
+
+    virtual int readRegister(uint16_t, uint8_t reg, uint8_t *buffer, int length, bool = false) override
+    {
+        now += 100;
+        advance();
+
+        reg &= 0x1F;
+        for (int i = 0; i < length; i++, reg++)
+            buffer[i] = reg >= 0x14 && reg < 0x1C ? data[(reg - 0x14) / 2] >> (8 * (reg & 1)) : registers[reg];
+
+        return DEVICE_OK;
+    }
+};
+
+// Dim room, then bright light at 3 s (near full scale at the shortest, lowest setting),
+// then near darkness at 6 s.
+static double lightTrace(uint64_t t)
+{
+    return t < 3000000 ? 0.02 : t < 6000000 ? 0.3 : 0.002;
+}
+
+static void testSamplesCarryTheirExposure()
+{
+    now = 0;
+    SimulatedTCS34725 device(lightTrace);
+    CodalLightSensor sensor(device, 0);
+
+    CHECK_EQ(sensor.setProfile(LIGHTSENSOR_PROFILE_TCS34725), DEVICE_OK);
+
+    LightSensorAutoExposure ae(sensor);
+    CHECK_EQ(ae.getStatus(), DEVICE_OK);
+
+    int readsSinceStep = 0, maxReadsToSettle = 0, samples = 0;
+    uint64_t lastStep = 0;
+    bool settledSinceStep = false;
+
+    while (now < 9000000)
+    {
+        ColorData<uint16_t> sample;
+        CHECK_EQ(ae.read<2>(sample), DEVICE_OK);
+        samples++;
+
+        // Every sample is tagged with the setting the device actually integrated it at,
+        // including the first one after each change.
+        CHECK_EQ(sample.gain, device.dataGain);
+        CHECK_EQ(sample.integrationTime, device.dataTime);
+        CHECK_EQ(sample.d, device.data[0]);
+
+        uint64_t step = now < 3000000 ? 0 : now < 6000000 ? 3000000 : 6000000;
+        if (step != lastStep)
+        {
+            lastStep = step;
+            readsSinceStep = 0;
+            settledSinceStep = false;
+        }
+        readsSinceStep++;
+
+        if (ae.getController().isSettled())
+        {
+            if (!settledSinceStep && readsSinceStep > maxReadsToSettle)
+                maxReadsToSettle = readsSinceStep;
+            settledSinceStep = true;
+
+            // Settled samples normalise back to the light level.
+            ColorData<uint32_t> normalised = {};
+            CHECK_EQ(ExposureController::normalise(sample, normalised), DEVICE_OK);
+            double expected = device.dataLight * 100000;
+            CHECK(normalised.d > expected * 0.95 && normalised.d < expected * 1.05);
+        }
+
+        // The application samples every 50 ms.
+        fiber_sleep(50);
+    }
+
+    CHECK(samples > 20);
+    CHECK(maxReadsToSettle > 0);
+    CHECK(maxReadsToSettle <= 6);
+}
+
+static void testNoWaitWithoutAChange()
+{
+    now = 0;
+    SimulatedTCS34725 device(lightTrace);
+    CodalLightSensor sensor(device, 0);
+    sensor.setProfile(LIGHTSENSOR_PROFILE_TCS34725);
+
+    LightSensorAutoExposure ae(sensor);
+    ColorData<uint16_t> sample;
+
+    CHECK_EQ(ae.readSettled<2>(sample), DEVICE_OK);
+    CHECK(ae.getController().isSettled());
+
+    // A settled controller applies nothing, so the next read goes straight to the bus.
+    uint64_t before = now;
+    CHECK_EQ(ae.read<2>(sample), DEVICE_OK);
+    CHECK_EQ(now - before, 100);
+}
+
+static void testNoProfile()
+{
+    now = 0;
+    SimulatedTCS34725 device(lightTrace);
+    CodalLightSensor sensor(device, 0x52);
+
+    LightSensorAutoExposure ae(sensor);
+    ColorData<uint16_t> sample;
+
+    CHECK_EQ(ae.getStatus(), DEVICE_INVALID_STATE);
+    CHECK_EQ(ae.read<2>(sample), DEVICE_INVALID_STATE);
+}
+
+int main()
+{
+    testSamplesCarryTheirExposure();
+    testNoWaitWithoutAChange();
+    testNoProfile();
+
+    return HOST_TEST_RESULT();
+}
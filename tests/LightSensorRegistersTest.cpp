@@ -0,0 +1,182 @@
+/**
+ * Host test of the shadowed register map and CodalLightSensor's read path,
+ * counting the bus transactions each operation costs on a MockRegisterBus.
+ */
+
+#include "CodalLightSensor.h"
+#include "host_test.h"
+
+using namespace codal;
+
+/**
+ * An I2C bus with one MockRegisterBus device behind it, in the register
+ * framing CodalLightSensor uses (register byte first on writes).
+ */
+class MockI2C : public I2C
+{
+public:
+    MockRegisterBus &device;
+    uint16_t lastAddress;
+
+    MockI2C(MockRegisterBus &device) : device(device), lastAddress(0) {}
+
+    virtual int write(uint16_t address, uint8_t *data, int len, bool = false) override
+    {
+        lastAddress = address;
+        return device.writeRegisters(data[0], data + 1, len - 1);
+    }
+
+    virtual int readRegister(uint16_t address, uint8_t reg, uint8_t *data, int length, bool = false) override
+    {
+        lastAddress = address;
+        return device.readRegisters(reg, data, length);
+    }
+};
+
+static void testShadowSkipsRedundantWrites()
+{
+    MockRegisterBus bus(0x1F);
+    LightSensorRegisterMap map;
+
+    CHECK_EQ(map.attach(bus, LIGHTSENSOR_PROFILE_TCS34725), DEVICE_OK);
+
+    // Reset values are already in the shadow: nothing to send.
+    CHECK_EQ(map.set(0x01, 0xFF), DEVICE_OK);
+    CHECK_EQ(map.set(0x0F, 0x00), DEVICE_OK);
+    CHECK(!map.isDirty());
+    CHECK_EQ(map.flush(), DEVICE_OK);
+    CHECK_EQ(bus.writes, 0);
+
+    // A second flush of the same values is free too.
+    CHECK_EQ(map.set(0x0F, 0x02), DEVICE_OK);
+    CHECK_EQ(map.flush(), DEVICE_OK);
+    CHECK_EQ(map.set(0x0F, 0x02), DEVICE_OK);
+    CHECK_EQ(map.flush(), DEVICE_OK);
+    CHECK_EQ(bus.writes, 1);
+    CHECK_EQ(bus.registers[0x0F], 0x02);
+
+    CHECK_EQ(map.set(0x10, 0x00), DEVICE_INVALID_PARAMETER);
+}
+
+static void testAdjacentWritesCoalesce()
+{
+    MockRegisterBus bus(0x1F);
+    LightSensorRegisterMap map;
+    map.attach(bus, LIGHTSENSOR_PROFILE_TCS34725);
+
+    // ENABLE, ATIME are adjacent; AILTL..AIHTH are adjacent; CONTROL stands alone.
+    map.set(0x00, 0x03);
+    map.set(0x01, 0xC0);
+    map.set(0x04, 0x10);
+    map.set(0x05, 0x20);
+    map.set(0x06, 0x30);
+    map.set(0x07, 0x40);
+    map.set(0x0F, 0x01);
+
+    CHECK_EQ(map.flush(), DEVICE_OK);
+    CHECK_EQ(bus.writes, 3);
+    CHECK_EQ(bus.bytes, (2 + 1) + (4 + 1) + (1 + 1));
+    CHECK_EQ(bus.registers[0x01], 0xC0);
+    CHECK_EQ(bus.registers[0x07], 0x40);
+    CHECK(!map.isDirty());
+
+    // setField keeps the other bits from the shadow, without a read-back.
+    map.setField(0x0F, 0x03, 0x02);
+    CHECK_EQ(map.get(0x0F), 0x02);
+    CHECK_EQ(map.flush(), DEVICE_OK);
+    CHECK_EQ(bus.reads, 0);
+}
+
+static void testSyncReadsOneBurstPerRun()
+{
+    MockRegisterBus bus(0x1F);
+    LightSensorRegisterMap map;
+    map.attach(bus, LIGHTSENSOR_PROFILE_TCS34725);
+
+    bus.registers[0x01] = 0xD5;
+    CHECK_EQ(map.sync(), DEVICE_OK);
+
+    // Runs: 0x00-0x01, 0x03-0x07, 0x0C-0x0D, 0x0F.
+    CHECK_EQ(bus.reads, 4);
+    CHECK_EQ(map.get(0x01), 0xD5);
+}
+
+static void testSensorProfileAndReads()
+{
+    MockRegisterBus device(0x1F);
+    MockI2C i2c(device);
+    CodalLightSensor sensor(i2c, 0);
+
+    // Address 0 adopts the profile's; ENABLE goes out as the single power-on write.
+    CHECK_EQ(sensor.setProfile(LIGHTSENSOR_PROFILE_TCS34725), DEVICE_OK);
+    CHECK_EQ(i2c.lastAddress, LIGHTSENSOR_PROFILE_TCS34725.i2cAddress);
+    CHECK_EQ(device.writes, 1);
+    CHECK_EQ(device.registers[0x00], 0x03);
+    CHECK_EQ(sensor.getIntegrationTime(), 2400);
+
+    // Clear, red, green, blue at 0x14, 16-bit little endian: one burst read.
+    const uint8_t raw[] = {0x00, 0x10, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    memcpy(&device.registers[0x14], raw, sizeof(raw));
+
+    ColorData<uint16_t> sample;
+    CHECK_EQ(sensor.read<2>(sample), DEVICE_OK);
+    CHECK_EQ(device.reads, 1);
+    CHECK_EQ(sample.d, 0x1000);
+    CHECK_EQ(sample.r, 0x0201);
+    CHECK_EQ(sample.g, 0x0403);
+    CHECK_EQ(sample.b, 0x0605);
+    CHECK_EQ(sample.integrationTime, 2400);
+
+    // 16-bit channels do not fit ColorData<>, and a width other than the profile's
+    // would misalign the channels; neither touches the bus.
+    ColorData<> narrow;
+    CHECK_EQ(sensor.read(narrow), DEVICE_INVALID_PARAMETER);
+    CHECK_EQ(sensor.read<1>(sample), DEVICE_INVALID_PARAMETER);
+    CHECK_EQ(device.reads, 1);
+
+    // A strided span reads one burst per sample.
+    struct Record
+    {
+        uint32_t time;
+        ColorData<uint16_t> sample;
+    } log[4];
+    CHECK_EQ(sensor.read<2>(ColorDataSpan<uint16_t>(&log[0].sample, 4, sizeof(Record))), 4);
+    CHECK_EQ(device.reads, 5);
+    CHECK_EQ(log[3].sample.b, 0x0605);
+
+    // Each exposure change is a single register write.
+    CHECK_EQ(sensor.setGainStep(2), DEVICE_OK);
+    CHECK_EQ(sensor.setIntegrationStep(4), DEVICE_OK);
+    CHECK_EQ(device.writes, 3);
+    CHECK_EQ(sensor.getGain(), 16);
+    CHECK_EQ(sensor.setGainStep(4), DEVICE_INVALID_PARAMETER);
+}
+
+static void testInitWrites()
+{
+    MockRegisterBus device;
+    MockI2C i2c(device);
+    CodalLightSensor sensor(i2c, 0x70);
+
+    // MODE_CONTROL2 (power) and MODE_CONTROL3 (init value) are not adjacent.
+    CHECK_EQ(sensor.setProfile(LIGHTSENSOR_PROFILE_BH1745), DEVICE_OK);
+    CHECK_EQ(i2c.lastAddress, 0x70);
+    CHECK_EQ(device.writes, 2);
+    CHECK_EQ(device.registers[0x42], 0x10);
+    CHECK_EQ(device.registers[0x44], 0x02);
+
+    // Setting the profile again finds both already in the shadow.
+    CHECK_EQ(sensor.setProfile(LIGHTSENSOR_PROFILE_BH1745, true), DEVICE_OK);
+    CHECK_EQ(device.writes, 2);
+}
+
+int main()
+{
+    testShadowSkipsRedundantWrites();
+    testAdjacentWritesCoalesce();
+    testSyncReadsOneBurstPerRun();
+    testSensorProfileAndReads();
+    testInitWrites();
+
+    return HOST_TEST_RESULT();
+}
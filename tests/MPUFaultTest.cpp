@@ -0,0 +1,310 @@
+/**
+ * Host test of MPUFault with synthetic fault state: decode() for each MemManage
+ * status bit, with MMARVALID clear and set, from thread and handler mode; the
+ * direction direction() reads from 16- and 32-bit Thumb load / store encodings;
+ * the .noinit record's checksum and fault count in persist() and recover(); and
+ * the policy handle() applies.
+ */
+
+#include "MPUFault.h"
+#include "host_test.h"
+
+using namespace codal;
+
+namespace codal
+{
+    Fiber *currentFiber;
+
+    void release_fiber(void)
+    {
+    }
+} // namespace codal
+
+CODAL_MEMMANAGE_HANDLER()
+
+static const uint32_t THREAD_PSP = 0xFFFFFFFD;
+static const uint32_t THREAD_MSP = 0xFFFFFFF9;
+static const uint32_t HANDLER = 0xFFFFFFF1;
+
+static const uint32_t LR = 0x08000123;
+static const uint32_t PC = 0x08000400;
+
+static Fiber fiber;
+
+static void testDirection()
+{
+    const struct
+    {
+        uint16_t insn[2];
+        MPUFaultAccess access;
+    } expected[] = {
+        // 16-bit
+        {{0x6001}, MPUFaultAccess::WRITE},  // STR r1, [r0]
+        {{0x6801}, MPUFaultAccess::READ},   // LDR r1, [r0]
+        {{0x7001}, MPUFaultAccess::WRITE},  // STRB r1, [r0]
+        {{0x7801}, MPUFaultAccess::READ},   // LDRB r1, [r0]
+        {{0x8001}, MPUFaultAccess::WRITE},  // STRH r1, [r0]
+        {{0x8801}, MPUFaultAccess::READ},   // LDRH r1, [r0]
+        {{0x9001}, MPUFaultAccess::WRITE},  // STR r0, [sp, #4]
+        {{0x9801}, MPUFaultAccess::READ},   // LDR r0, [sp, #4]
+        {{0x4801}, MPUFaultAccess::READ},   // LDR r0, [pc, #4]
+        {{0x5088}, MPUFaultAccess::WRITE},  // STR r0, [r1, r2]
+        {{0x5288}, MPUFaultAccess::WRITE},  // STRH r0, [r1, r2]
+        {{0x5488}, MPUFaultAccess::WRITE},  // STRB r0, [r1, r2]
+        {{0x5688}, MPUFaultAccess::READ},   // LDRSB r0, [r1, r2]
+        {{0x5888}, MPUFaultAccess::READ},   // LDR r0, [r1, r2]
+        {{0x5A88}, MPUFaultAccess::READ},   // LDRH r0, [r1, r2]
+        {{0x5C88}, MPUFaultAccess::READ},   // LDRB r0, [r1, r2]
+        {{0x5E88}, MPUFaultAccess::READ},   // LDRSH r0, [r1, r2]
+        {{0xC003}, MPUFaultAccess::WRITE},  // STM r0!, {r0, r1}
+        {{0xC803}, MPUFaultAccess::READ},   // LDM r0, {r0, r1}
+        {{0xB510}, MPUFaultAccess::WRITE},  // PUSH {r4, lr}
+        {{0xBD10}, MPUFaultAccess::READ},   // POP {r4, pc}
+        {{0x1840}, MPUFaultAccess::UNKNOWN}, // ADDS r0, r0, r1
+        {{0xB082}, MPUFaultAccess::UNKNOWN}, // SUB sp, #8
+        {{0xB108}, MPUFaultAccess::UNKNOWN}, // CBZ r0, ...
+        {{0xE000}, MPUFaultAccess::UNKNOWN}, // B ...
+        // 32-bit
+        {{0xF8C0, 0x1004}, MPUFaultAccess::WRITE},  // STR.W r1, [r0, #4]
+        {{0xF8D0, 0x1004}, MPUFaultAccess::READ},   // LDR.W r1, [r0, #4]
+        {{0xF880, 0x1004}, MPUFaultAccess::WRITE},  // STRB.W r1, [r0, #4]
+        {{0xF9B0, 0x1004}, MPUFaultAccess::READ},   // LDRSH.W r1, [r0, #4]
+        {{0xE9C0, 0x2300}, MPUFaultAccess::WRITE},  // STRD r2, r3, [r0]
+        {{0xE9D0, 0x2300}, MPUFaultAccess::READ},   // LDRD r2, r3, [r0]
+        {{0xE880, 0x000C}, MPUFaultAccess::WRITE},  // STM.W r0, {r2, r3}
+        {{0xE890, 0x000C}, MPUFaultAccess::READ},   // LDM.W r0, {r2, r3}
+        {{0xE92D, 0x4010}, MPUFaultAccess::WRITE},  // PUSH.W {r4, lr}
+        {{0xE8BD, 0x8010}, MPUFaultAccess::READ},   // POP.W {r4, pc}
+        {{0xE840, 0x1200}, MPUFaultAccess::WRITE},  // STREX r2, r1, [r0]
+        {{0xE850, 0x1F00}, MPUFaultAccess::READ},   // LDREX r1, [r0]
+        {{0xED80, 0x0A00}, MPUFaultAccess::WRITE},  // VSTR s0, [r0]
+        {{0xED90, 0x0A00}, MPUFaultAccess::READ},   // VLDR s0, [r0]
+        {{0xED2D, 0x8A02}, MPUFaultAccess::WRITE},  // VPUSH {s16, s17}
+        {{0xECBD, 0x8A02}, MPUFaultAccess::READ},   // VPOP {s16, s17}
+        {{0xF000, 0xF800}, MPUFaultAccess::UNKNOWN}, // BL ...
+        {{0xF04F, 0x0000}, MPUFaultAccess::UNKNOWN}, // MOV.W r0, #0
+        {{0xEA4F, 0x0001}, MPUFaultAccess::UNKNOWN}, // MOV.W r0, r1
+        {{0xEE10, 0x0A10}, MPUFaultAccess::UNKNOWN}, // VMOV r0, s0
+    };
+
+    int wrong = 0;
+    for (const auto &e : expected)
+        if (MPUFault::direction(e.insn) != e.access)
+        {
+            printf("direction(%04X %04X) is %d\n", e.insn[0], e.insn[1], static_cast<int>(MPUFault::direction(e.insn)));
+            wrong++;
+        }
+    CHECK_EQ(wrong, 0);
+}
+
+static void testDecode()
+{
+    const uint32_t frame[8] = {1, 2, 3, 4, 12, LR, PC, 0x01000000};
+    const uint16_t store[1] = {0x6001};
+    const uint16_t load[2] = {0xF8D0, 0x1004};
+    MPUFaultRecord r;
+
+    mpuHost().reset();
+    CHECK(CodalMPU::configureRegion(2, 0x20000000, MPURegionSize::SIZE_8KB, MPUAccessPermission::FULL_ACCESS) ==
+          MPU_STATE::MPU_OK);
+    CHECK(CodalMPU::configureRegion(5, 0x20001000, MPURegionSize::SIZE_256B, MPUAccessPermission::RO) ==
+          MPU_STATE::MPU_OK);
+    CHECK(CodalMPU::configureRegion(6, 0x08000000, MPURegionSize::SIZE_2KB, MPUAccessPermission::RO) ==
+          MPU_STATE::MPU_OK);
+    CHECK(CodalMPU::enable() == MPU_STATE::MPU_OK);
+    currentFiber = &fiber;
+
+    // No MemManage status (a BusFault bit only): nothing to decode.
+    CHECK(!MPUFault::decode(1UL << 8, 0x20001010, frame, THREAD_PSP, 0, store, r));
+    CHECK(r.status == 0 && r.pc == 0 && r.region == 0);
+
+    // DACCVIOL with MMARVALID: the address, its region and the direction of the store.
+    CHECK(MPUFault::decode(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, 0x20001010, frame, THREAD_PSP,
+                           CONTROL_nPRIV_Msk, store, r));
+    CHECK_EQ(r.status, SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk);
+    CHECK(r.access == MPUFaultAccess::WRITE);
+    CHECK_EQ(r.address, 0x20001010);
+    CHECK_EQ(r.region, 5);
+    CHECK_EQ(r.flags, MPU_FAULT_ADDRESS_VALID);
+    CHECK(r.pc == PC && r.lr == LR && r.fiber == static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&fiber)));
+
+    // The highest numbered region wins on PMSAv7; outside every region is -1.
+    CHECK(MPUFault::decode(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, 0x20000800, frame, THREAD_PSP, 0, load, r));
+    CHECK(r.access == MPUFaultAccess::READ && r.region == 2);
+    CHECK_EQ(r.flags, MPU_FAULT_ADDRESS_VALID | MPU_FAULT_PRIVILEGED);
+    CHECK(MPUFault::decode(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, 0x30000000, frame, THREAD_PSP, 0, load, r));
+    CHECK_EQ(r.region, -1);
+
+    // Address 0 is still a valid MMFAR, and looked up.
+    CHECK(MPUFault::decode(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, 0, frame, THREAD_PSP, 0, load, r));
+    CHECK(r.address == 0 && (r.flags & MPU_FAULT_ADDRESS_VALID) && r.region == -1);
+
+    // DACCVIOL without MMARVALID: MMFAR is stale and ignored; no instruction gives UNKNOWN.
+    CHECK(MPUFault::decode(SCB_CFSR_DACCVIOL_Msk, 0x20001010, frame, THREAD_MSP, 0, NULL, r));
+    CHECK(r.access == MPUFaultAccess::UNKNOWN && r.address == 0 && r.region == -1);
+    CHECK_EQ(r.flags, MPU_FAULT_PRIVILEGED);
+
+    // IACCVIOL: the fetch address is the PC, whatever MMFAR says.
+    CHECK(MPUFault::decode(SCB_CFSR_IACCVIOL_Msk, 0x20001010, frame, THREAD_PSP, CONTROL_nPRIV_Msk, NULL, r));
+    CHECK(r.access == MPUFaultAccess::EXECUTE && r.address == PC && r.region == 6 && r.flags == 0);
+
+    // Handler mode is privileged whatever CONTROL holds.
+    CHECK(MPUFault::decode(SCB_CFSR_IACCVIOL_Msk, 0, frame, HANDLER, CONTROL_nPRIV_Msk, NULL, r));
+    CHECK_EQ(r.flags, MPU_FAULT_HANDLER_MODE | MPU_FAULT_PRIVILEGED);
+
+    // Stacking, unstacking and lazy FP state: no instruction and no MMFAR.
+    const struct
+    {
+        uint32_t status;
+        MPUFaultAccess access;
+    } stack[] = {
+        {SCB_CFSR_MSTKERR_Msk, MPUFaultAccess::STACKING},
+        {SCB_CFSR_MUNSTKERR_Msk, MPUFaultAccess::UNSTACKING},
+        {SCB_CFSR_MLSPERR_Msk, MPUFaultAccess::LAZY_FP},
+        {SCB_CFSR_MLSPERR_Msk | SCB_CFSR_MMARVALID_Msk, MPUFaultAccess::LAZY_FP},
+    };
+
+    for (const auto &s : stack)
+    {
+        CHECK(MPUFault::decode(s.status, 0x20000010, frame, THREAD_PSP, 0, NULL, r));
+        CHECK(r.access == s.access);
+        bool valid = s.status & SCB_CFSR_MMARVALID_Msk;
+        CHECK_EQ(r.address, valid ? 0x20000010 : 0);
+        CHECK_EQ(r.region, valid ? 2 : -1);
+    }
+
+    currentFiber = NULL;
+    CHECK(MPUFault::decode(SCB_CFSR_MSTKERR_Msk, 0, frame, THREAD_PSP, 0, NULL, r) && r.fiber == 0);
+}
+
+static MPUFaultRecord sample()
+{
+    const uint32_t frame[8] = {0, 0, 0, 0, 0, LR, PC, 0x01000000};
+    const uint16_t store[1] = {0x6001};
+    MPUFaultRecord r;
+
+    MPUFault::decode(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, 0x20001010, frame, THREAD_PSP, 0, store, r);
+    return r;
+}
+
+static void testPersistence()
+{
+    MPUFaultRecord r = sample(), out;
+
+    MPUFault::clear();
+    CHECK(!MPUFault::recover(out));
+
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out));
+    CHECK(out.magic == MPU_FAULT_MAGIC && out.count == 1 && out.checksum == MPUFault::checksum(out));
+    CHECK(out.address == r.address && out.pc == r.pc && out.region == r.region && out.access == r.access);
+
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == 2);
+
+    // Any byte before the checksum invalidates the record, and the count restarts.
+    int wrong = 0;
+    for (size_t i = 0; i < offsetof(MPUFaultRecord, checksum); i++)
+    {
+        reinterpret_cast<uint8_t *>(&codal_fault_record)[i] ^= 0x40;
+        wrong += MPUFault::recover(out);
+        reinterpret_cast<uint8_t *>(&codal_fault_record)[i] ^= 0x40;
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK(MPUFault::recover(out) && out.count == 2);
+
+    codal_fault_record.checksum ^= 1;
+    CHECK(!MPUFault::recover(out));
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == 1);
+
+    // Garbage from a cold boot with the right magic is not a record either.
+    memset(&codal_fault_record, 0xA5, sizeof(codal_fault_record));
+    codal_fault_record.magic = MPU_FAULT_MAGIC;
+    CHECK(!MPUFault::recover(out));
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == 1);
+
+    // The count stops at its maximum instead of wrapping to zero.
+    codal_fault_record.count = UINT16_MAX - 1;
+    codal_fault_record.checksum = MPUFault::checksum(codal_fault_record);
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == UINT16_MAX);
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == UINT16_MAX);
+
+    MPUFault::clear();
+    CHECK(!MPUFault::recover(out));
+    MPUFault::persist(r);
+    CHECK(MPUFault::recover(out) && out.count == 1);
+}
+
+static int observed;
+static MPUFaultRecord seen;
+
+static void observer(const MPUFaultRecord &record)
+{
+    observed++;
+    seen = record;
+}
+
+static uint32_t handle(uint32_t cfsr, uint32_t *frame, uint32_t excReturn)
+{
+    scbHost().CFSR = cfsr | (1UL << 8); // With a BusFault bit that must survive
+    scbHost().MMFAR = 0x20001010;
+    scbHost().AIRCR = 0;
+    MPUFault::handle(frame, excReturn);
+    return scbHost().AIRCR;
+}
+
+static void testHandle()
+{
+    MPUFaultRecord out;
+    uint32_t frame[8] = {0, 0, 0, 0, 0, LR, PC, 0x01000200};
+
+    MPUFault::clear();
+    MPUFault::setObserver(observer);
+    currentFiber = &fiber;
+
+    // The default policy records, tells the observer and resets, and clears (writes
+    // one to) the MemManage status bits only.
+    MPUFault::setPolicy(MPUFaultPolicy::MPU_FAULT_RESET);
+    CHECK(handle(SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk, frame, THREAD_PSP) & SCB_AIRCR_SYSRESETREQ_Msk);
+    CHECK_EQ(scbHost().CFSR, SCB_CFSR_DACCVIOL_Msk | SCB_CFSR_MMARVALID_Msk);
+    CHECK(observed == 1 && seen.count == 1 && seen.region == 5 && seen.address == 0x20001010);
+    CHECK(MPUFault::recover(out) && out.count == 1 && frame[6] == PC);
+
+    // Killing the fiber returns into the trampoline, in Thumb state with the alignment bit kept.
+    MPUFault::setPolicy(MPUFaultPolicy::MPU_FAULT_KILL_FIBER);
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK_EQ(handle(SCB_CFSR_IACCVIOL_Msk, frame, THREAD_PSP), 0);
+    CHECK(frame[6] != PC && !(frame[6] & 1) && frame[7] == 0x01000200);
+    CHECK(observed == 2 && seen.count == 2 && (seen.flags & MPU_FAULT_FIBER_KILLED));
+    CHECK_EQ(__get_CONTROL(), CONTROL_nPRIV_Msk);
+    __set_CONTROL(0);
+
+    // Stacking errors, handler mode and faults with no fiber still reset.
+    frame[6] = PC;
+    CHECK(handle(SCB_CFSR_MSTKERR_Msk, frame, THREAD_PSP) != 0);
+    CHECK(handle(SCB_CFSR_DACCVIOL_Msk, frame, HANDLER) != 0);
+    currentFiber = NULL;
+    CHECK(handle(SCB_CFSR_DACCVIOL_Msk, frame, THREAD_PSP) != 0);
+    CHECK(frame[6] == PC && observed == 5 && !(seen.flags & MPU_FAULT_FIBER_KILLED));
+
+    // No MemManage status: nothing recorded, observed or reset.
+    CHECK_EQ(handle(0, frame, THREAD_PSP), 0);
+    CHECK(observed == 5 && MPUFault::recover(out) && out.count == 5);
+
+    MPUFault::setObserver(NULL);
+    MPUFault::setPolicy(MPUFaultPolicy::MPU_FAULT_RESET);
+}
+
+int main()
+{
+    testDirection();
+    testDecode();
+    testPersistence();
+    testHandle();
+
+    return HOST_TEST_RESULT();
+}
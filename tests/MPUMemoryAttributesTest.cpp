@@ -0,0 +1,261 @@
+/**
+ * Host test and benchmark of MPUMemoryAttributes.h. The named profiles are
+ * planned and loaded into the emulated MPU and their TEX/C/B/S bits checked.
+ *
+ * A host has no MPU-controlled cache, so the access patterns the profiles are
+ * meant for are shown two ways: a model of the Cortex-M7 data cache (4-way,
+ * 32-byte lines, 16 KB) counts the bus words and cache maintenance each memory
+ * type costs for hot-table updates, a write-only scratch buffer and a DMA
+ * ping-pong; and the host's own cache is timed on a hot and a cold table.
+ */
+
+#include <stdlib.h>
+
+#include "MPUMemoryAttributes.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static const uint32_t BASE = 0x20000000;
+
+static void testProfiles()
+{
+    MPURange ranges[3] = {MPUMemory::dmaBuffer(BASE, 0x600), MPUMemory::hotData(BASE + 0x600, 0x1A00),
+                          MPUMemory::peripheral(0x40000000, 0x400)};
+    MPUPlan plan;
+
+    CHECK(MPUMemory::type(ranges[0]) == MPUMemoryType::NORMAL_NON_CACHEABLE);
+    CHECK(MPUMemory::type(ranges[1]) == MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE);
+    CHECK(MPUMemory::type(ranges[2]) == MPUMemoryType::DEVICE);
+
+    mpuHost().reset();
+    CHECK(MPUMemory::apply(ranges, 3, 0, MPU_MAX_REGIONS, &plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(plan.wastedBytes, 0);
+
+    const uint32_t mask = MPU_RASR_TEX_Msk | MPU_RASR_S_Msk | MPU_RASR_C_Msk | MPU_RASR_B_Msk;
+    const struct
+    {
+        uint32_t address;
+        uint32_t attributes;
+    } expected[] = {
+        {BASE, CodalMPU::encodeAttributes(MPUMemoryType::NORMAL_NON_CACHEABLE, true)},
+        {BASE + 0x5FF, CodalMPU::encodeAttributes(MPUMemoryType::NORMAL_NON_CACHEABLE, true)},
+        {BASE + 0x600, CodalMPU::encodeAttributes(MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE)},
+        {BASE + 0x1FFF, CodalMPU::encodeAttributes(MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE)},
+        {0x40000000, CodalMPU::encodeAttributes(MPUMemoryType::DEVICE, true)},
+    };
+
+    for (const auto &e : expected)
+    {
+        int r = mpuHost().regionAt(e.address);
+        CHECK(r >= 0);
+        if (r >= 0)
+            CHECK_EQ(mpuHost().rasr[r] & mask, e.attributes);
+    }
+
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK(MPUMemory::apply(ranges, 3) == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    __set_CONTROL(0);
+}
+
+/**
+ * The Cortex-M7 data cache as the TEX/C/B memory types drive it. Counts 32-bit bus
+ * words and the lines cache maintenance touches.
+ */
+class CacheModel
+{
+public:
+    static const uint32_t LINE = 32, WAYS = 4, SETS = 16384 / LINE / WAYS;
+
+    uint64_t busWords = 0;
+    uint64_t maintainedLines = 0;
+
+    explicit CacheModel(MPUMemoryType type) : type(type)
+    {
+        memset(lines, 0, sizeof(lines));
+    }
+
+    void read(uint32_t address)
+    {
+        if (!MPUMemory::isCacheable(type))
+            busWords++;
+        else if (!lookup(address))
+            fill(address);
+    }
+
+    void write(uint32_t address)
+    {
+        Line *l = MPUMemory::isCacheable(type) ? lookup(address) : NULL;
+
+        if (!l && type == MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE)
+            l = fill(address);
+        if (!l || type == MPUMemoryType::WRITE_THROUGH)
+            busWords++;
+        if (l && type != MPUMemoryType::WRITE_THROUGH)
+            l->dirty = true;
+    }
+
+    /** Before a DMA read: dirty lines in the range are written back. */
+    void clean(uint32_t address, uint32_t length)
+    {
+        forEachLine(address, length, [this](Line *l) {
+            if (l->dirty)
+                busWords += LINE / 4;
+            l->dirty = false;
+        });
+    }
+
+    /** Before the CPU reads what a DMA wrote: stale lines are discarded. */
+    void invalidate(uint32_t address, uint32_t length)
+    {
+        forEachLine(address, length, [](Line *l) { l->valid = false; });
+    }
+
+private:
+    struct Line
+    {
+        uint32_t tag;
+        uint32_t age;
+        bool valid;
+        bool dirty;
+    };
+
+    MPUMemoryType type;
+    Line lines[SETS][WAYS];
+    uint32_t clock = 0;
+
+    Line *lookup(uint32_t address)
+    {
+        Line *set = lines[(address / LINE) % SETS];
+        for (uint32_t w = 0; w < WAYS; w++)
+            if (set[w].valid && set[w].tag == address / LINE)
+            {
+                set[w].age = ++clock;
+                return &set[w];
+            }
+        return NULL;
+    }
+
+    Line *fill(uint32_t address)
+    {
+        Line *set = lines[(address / LINE) % SETS], *victim = &set[0];
+        for (uint32_t w = 1; w < WAYS; w++)
+            if (!set[w].valid || (victim->valid && set[w].age < victim->age))
+                victim = &set[w];
+
+        if (victim->valid && victim->dirty)
+            busWords += LINE / 4;
+        busWords += LINE / 4;
+        *victim = {address / LINE, ++clock, true, false};
+        return victim;
+    }
+
+    template <typename F>
+    void forEachLine(uint32_t address, uint32_t length, F f)
+    {
+        for (uint32_t a = address & ~(LINE - 1); a < address + length; a += LINE)
+        {
+            maintainedLines++;
+            if (Line *l = lookup(a))
+                f(l);
+        }
+    }
+};
+
+static const MPUMemoryType TYPES[] = {MPUMemoryType::NORMAL_NON_CACHEABLE, MPUMemoryType::WRITE_THROUGH,
+                                      MPUMemoryType::WRITE_BACK, MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE};
+static const char *const NAMES[] = {"non-cacheable", "write-through", "write-back", "write-back/allocate"};
+
+static void benchModel()
+{
+    uint64_t hot[4], scratch[4], dma[4], maintenance[4];
+
+    for (int t = 0; t < 4; t++)
+    {
+        // Hot table: 2 KB of counters, 100k random read-modify-writes.
+        CacheModel table(TYPES[t]);
+        srand(7);
+        for (int i = 0; i < 100000; i++)
+        {
+            uint32_t a = BASE + 4 * (rand() % 512);
+            table.read(a);
+            table.write(a);
+        }
+        hot[t] = table.busWords;
+
+        // Scratch: a 2 KB buffer written from start to end, 100 times, never read.
+        CacheModel buffer(TYPES[t]);
+        for (int pass = 0; pass < 100; pass++)
+            for (uint32_t a = 0; a < 2048; a += 4)
+                buffer.write(BASE + a);
+        scratch[t] = buffer.busWords;
+
+        // DMA ping-pong on 1 KB: the CPU fills it and a DMA sends it, a DMA fills it
+        // and the CPU reads it. Cached types must clean and invalidate each time.
+        CacheModel ring(TYPES[t]);
+        for (int round = 0; round < 100; round++)
+        {
+            for (uint32_t a = 0; a < 1024; a += 4)
+                ring.write(BASE + a);
+            if (MPUMemory::isCacheable(TYPES[t]))
+            {
+                ring.clean(BASE, 1024);
+                ring.invalidate(BASE, 1024);
+            }
+            for (uint32_t a = 0; a < 1024; a += 4)
+                ring.read(BASE + a);
+        }
+        dma[t] = ring.busWords;
+        maintenance[t] = ring.maintainedLines;
+
+        printf("%-20s hot table %7llu bus words, scratch %7llu, DMA ring %6llu (+%llu lines maintained)\n",
+               NAMES[t], (unsigned long long)hot[t], (unsigned long long)scratch[t], (unsigned long long)dma[t],
+               (unsigned long long)maintenance[t]);
+    }
+
+    // Hot data belongs in write-back/allocate: the table and scratch stay in the cache.
+    CHECK(hot[3] * 100 < hot[0]);
+    CHECK(hot[3] * 100 < hot[1]);
+    CHECK(scratch[3] * 50 < scratch[2]);
+    CHECK_EQ(scratch[2], scratch[0]);
+
+    // DMA buffers belong in non-cacheable memory: no maintenance, and no more traffic.
+    CHECK_EQ(maintenance[0], 0);
+    for (int t = 1; t < 4; t++)
+    {
+        CHECK(maintenance[t] > 0);
+        CHECK(dma[0] <= dma[t]);
+    }
+}
+
+static void benchHost()
+{
+    const uint32_t small = 4096 / 4, large = 64u * 1024 * 1024 / 4, updates = 4000000;
+    uint32_t *table = static_cast<uint32_t *>(calloc(large, sizeof(uint32_t)));
+    uint32_t sizes[2] = {small, large};
+    double ns[2];
+
+    for (int s = 0; s < 2; s++)
+    {
+        uint32_t x = 1;
+        uint64_t start = host_test_now_ns();
+        for (uint32_t i = 0; i < updates; i++)
+        {
+            x = x * 1664525u + 1013904223u;
+            table[(x >> 4) % sizes[s]]++;
+        }
+        ns[s] = static_cast<double>(host_test_now_ns() - start) / updates;
+    }
+
+    printf("host random update: 4 KB table %.2f ns, 64 MB table %.2f ns\n", ns[0], ns[1]);
+    free(table);
+}
+
+int main()
+{
+    testProfiles();
+    benchModel();
+    benchHost();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,216 @@
+/**
+ * Host test of the PMSAv8 translation against the emulated Armv8-M MPU: what each
+ * PMSAv7 access permission becomes (NO_ACCESS is privileged read-only and never
+ * executable, PRIV_RW_UNPRIV_RO is privileged read-write), the MAIR attribute every
+ * TEX:C:B combination selects, the subregion spans that translate() accepts and the
+ * ones with a hole it refuses, and that MPUProfile::write() writes RNR once per
+ * group of four regions and reaches each region through the right alias.
+ */
+
+#include "MPUProfile.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static const uint32_t BASE = 0x20000000;
+static const uint32_t GARBAGE_RBAR = 0xDEAD0000;
+static const uint32_t GARBAGE_RLAR = 0x0BAD0001;
+
+static void enableMPU()
+{
+    mpuHost().reset();
+    CHECK(CodalMPU::enable() == MPU_STATE::MPU_OK);
+}
+
+static void testAccessPermissions()
+{
+    // Allowed accesses: privileged read / write / execute, then unprivileged.
+    const struct
+    {
+        MPUAccessPermission access;
+        const char *allowed;
+    } expected[] = {
+        {MPUAccessPermission::NO_ACCESS, "r-----"},
+        {MPUAccessPermission::PRIV_RW, "rwx---"},
+        {MPUAccessPermission::PRIV_RW_UNPRIV_RO, "rwx---"},
+        {MPUAccessPermission::FULL_ACCESS, "rwxrwx"},
+        {MPUAccessPermission::PRIV_RO, "r-x---"},
+        {MPUAccessPermission::RO, "r-xr-x"},
+    };
+    const MPUHostAccess accesses[3] = {MPUHostAccess::READ, MPUHostAccess::WRITE, MPUHostAccess::EXECUTE};
+
+    for (const auto &e : expected)
+        for (int executable = 0; executable < 2; executable++)
+        {
+            enableMPU();
+            CHECK(CodalMPU::configureRegion(0, BASE, MPURegionSize::SIZE_1KB, e.access, executable) ==
+                  MPU_STATE::MPU_OK);
+
+            int wrong = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                bool allowed = e.allowed[i] != '-' && (i % 3 != 2 || executable);
+                bool privileged = i < 3;
+
+                wrong += mpuHost().check(BASE, accesses[i % 3], privileged) != allowed;
+                wrong += mpuHost().check(BASE + 0x3FF, accesses[i % 3], privileged) != allowed;
+            }
+            CHECK_EQ(wrong, 0);
+            CHECK(mpuHost().regionAt(BASE + 0x400) == -1);
+        }
+
+    CHECK(CodalMPU::configureRegion(1, BASE, MPURegionSize::SIZE_1KB, MPUAccessPermission::RESERVED) ==
+          MPU_STATE::MPU_UNKOWN_PERMISSON_ACCESS);
+    CHECK_EQ(mpuHost().rlar[1], 0);
+}
+
+static void testMemoryAttributes()
+{
+    // The MAIR byte each TEX:C:B selects; TEX 1xx carries the inner policy in C:B.
+    const uint8_t expected[8][4] = {
+        {0x00, 0x04, 0xAA, 0xEE}, // TEX 000: strongly ordered, device, write-through, write-back
+        {0x44, 0x44, 0x00, 0xFF}, // TEX 001: non-cacheable, reserved, implementation defined, write-allocate
+        {0x04, 0x04, 0x04, 0x04}, // TEX 010: non-shareable device
+        {0x00, 0x00, 0x00, 0x00}, // TEX 011: reserved
+        {0x44, 0xFF, 0xAA, 0xEE}, {0x44, 0xFF, 0xAA, 0xEE}, {0x44, 0xFF, 0xAA, 0xEE}, {0x44, 0xFF, 0xAA, 0xEE},
+    };
+
+    enableMPU();
+    for (uint32_t tex = 0; tex < 8; tex++)
+        for (uint32_t cb = 0; cb < 4; cb++)
+            for (int shareable = 0; shareable < 2; shareable++)
+            {
+                uint32_t rasr = CodalMPU::encodeRASR(MPURegionSize::SIZE_4KB, MPUAccessPermission::FULL_ACCESS, false,
+                                                     shareable, cb & 2, cb & 1) |
+                                (tex << MPU_RASR_TEX_Pos);
+
+                CodalMPU::writeRegion(2, BASE, rasr);
+                CHECK_EQ(mpuHost().attributes(2), expected[tex][cb]);
+                CHECK_EQ((mpuHost().rbar[2] & MPU_RBAR_SH_Msk) != 0, shareable);
+                CHECK_EQ(mpuHost().rlar[2] & MPU_RLAR_LIMIT_Msk, BASE + 0xFE0);
+            }
+
+    // Every memory type of the public API lands on its own attribute.
+    const struct
+    {
+        MPUMemoryType type;
+        uint8_t attribute;
+    } types[] = {
+        {MPUMemoryType::STRONGLY_ORDERED, 0x00},     {MPUMemoryType::DEVICE, 0x04},
+        {MPUMemoryType::WRITE_THROUGH, 0xAA},        {MPUMemoryType::WRITE_BACK, 0xEE},
+        {MPUMemoryType::NORMAL_NON_CACHEABLE, 0x44}, {MPUMemoryType::WRITE_BACK_WRITE_ALLOCATE, 0xFF},
+    };
+
+    for (const auto &t : types)
+    {
+        CHECK(CodalMPU::configureRange(3, BASE, 0x100, MPUAccessPermission::FULL_ACCESS, t.type) ==
+              MPU_STATE::MPU_OK);
+        CHECK_EQ(mpuHost().attributes(3), t.attribute);
+    }
+}
+
+static void testSubregions()
+{
+    const uint32_t rasr = CodalMPU::encodeRASR(MPURegionSize::SIZE_2KB, MPUAccessPermission::FULL_ACCESS, false);
+    uint32_t base, limit;
+
+    // isContiguous() against a subregion-by-subregion count of runs.
+    for (uint32_t srd = 0; srd < 256; srd++)
+    {
+        int runs = 0;
+        for (int i = 0; i < 8; i++)
+            runs += !(srd & (1 << i)) && (i == 0 || (srd & (1 << (i - 1))));
+        CHECK_EQ(CodalMPU::isContiguous(rasr | (srd << MPU_RASR_SRD_Pos)), runs <= 1);
+    }
+
+    // Below 256 bytes there are no subregions, so SRD is ignored.
+    CHECK(CodalMPU::isContiguous(CodalMPU::encodeRASR(MPURegionSize::SIZE_128B, MPUAccessPermission::RO,
+                                                      false, false, false, false, 0x5A)));
+
+    // SRD 0x81: subregions 1 to 6 of 256 bytes.
+    CHECK(CodalMPU::translate(BASE, rasr | (0x81 << MPU_RASR_SRD_Pos), 0, base, limit));
+    CHECK_EQ(base & MPU_RBAR_BASE_Msk, BASE + 0x100);
+    CHECK_EQ(limit & MPU_RLAR_LIMIT_Msk, BASE + 0x6E0);
+    CHECK(limit & MPU_RLAR_EN_Msk);
+
+    // SRD 0xFF enables nothing, which is valid and disabled.
+    CHECK(CodalMPU::translate(BASE, rasr | (0xFF << MPU_RASR_SRD_Pos), 0, base, limit));
+    CHECK_EQ(limit, 0);
+
+    // SRD 0x3C leaves 0-1 and 6-7 enabled: no single base / limit pair covers them.
+    base = limit = 1;
+    CHECK(!CodalMPU::translate(BASE, rasr | (0x3C << MPU_RASR_SRD_Pos), 0, base, limit));
+    CHECK(base == 0 && limit == 0);
+
+    // configureRegion() refuses such an SRD and leaves the region as it was.
+    enableMPU();
+    CHECK(CodalMPU::configureRegion(4, BASE, MPURegionSize::SIZE_2KB, MPUAccessPermission::FULL_ACCESS, false, false,
+                                    false, false, 0x81) == MPU_STATE::MPU_OK);
+    uint32_t rbar4 = mpuHost().rbar[4], rlar4 = mpuHost().rlar[4];
+    mpuHost().resetCounters();
+    CHECK(CodalMPU::configureRegion(4, BASE, MPURegionSize::SIZE_2KB, MPUAccessPermission::FULL_ACCESS, false, false,
+                                    false, false, 0x3C) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(mpuHost().writes == 0 && mpuHost().rbar[4] == rbar4 && mpuHost().rlar[4] == rlar4);
+    CHECK(!mpuHost().check(BASE, MPUHostAccess::READ, false));
+    CHECK(mpuHost().check(BASE + 0x100, MPUHostAccess::WRITE, false));
+
+    // So does MPUProfile::set(), which keeps the region it had.
+    MPUProfile profile;
+    CHECK(profile.reset(4, 1) == MPU_STATE::MPU_OK);
+    CHECK(profile.set(4, BASE, rasr | (0x3C << MPU_RASR_SRD_Pos)) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK_EQ(profile.regions[0].rasr, 0);
+    CHECK(profile.set(4, BASE, rasr | (0xC3 << MPU_RASR_SRD_Pos)) == MPU_STATE::MPU_OK);
+}
+
+static void testProfileGroups()
+{
+    MPUHost &mpu = mpuHost();
+
+    for (uint8_t first = 0; first < MPU_MAX_REGIONS; first++)
+        for (uint8_t count = 0; first + count <= MPU_MAX_REGIONS; count++)
+        {
+            MPUProfile profile;
+            CHECK(profile.reset(first, count) == MPU_STATE::MPU_OK);
+            for (uint8_t i = 0; i < count; i++)
+                if (i % 3 != 1)
+                    CHECK(profile.set(first + i, BASE + i * 0x1000, MPURegionSize::SIZE_4KB,
+                                      MPUAccessPermission::FULL_ACCESS, false) == MPU_STATE::MPU_OK);
+
+            mpu.reset();
+            for (int r = 0; r < MPU_HOST_REGIONS; r++)
+            {
+                mpu.rbar[r] = GARBAGE_RBAR;
+                mpu.rlar[r] = GARBAGE_RLAR;
+            }
+
+            // RNR once for each group of four regions the run touches.
+            int groups = count ? (first + count - 1) / 4 - first / 4 + 1 : 0;
+            profile.load();
+            CHECK_EQ(mpu.writes, 2 * count + groups);
+            CHECK_EQ(mpu.barriers, 2);
+
+            int mismatches = 0;
+            for (int r = 0; r < MPU_HOST_REGIONS; r++)
+            {
+                int i = r - first;
+                if (i < 0 || i >= count)
+                    mismatches += mpu.rbar[r] != GARBAGE_RBAR || mpu.rlar[r] != GARBAGE_RLAR;
+                else if (i % 3 == 1)
+                    mismatches += mpu.rlar[r] != 0;
+                else
+                    mismatches += (mpu.rbar[r] & MPU_RBAR_BASE_Msk) != BASE + i * 0x1000u ||
+                                  (mpu.rlar[r] & MPU_RLAR_LIMIT_Msk) != BASE + i * 0x1000u + 0xFE0;
+            }
+            CHECK_EQ(mismatches, 0);
+        }
+}
+
+int main()
+{
+    testAccessPermissions();
+    testMemoryAttributes();
+    testSubregions();
+    testProfileGroups();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,201 @@
+/**
+ * Host test of MPUPlanner against the emulated MPU. Each range set is planned,
+ * loaded with apply(), and every byte around it is resolved with MPUHost::check()
+ * for privileged and unprivileged read, write and execute; the bytes the MPU
+ * covers must match the plan's coveredBytes and wastedBytes.
+ */
+
+#include "MPUPlanner.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static const uint32_t BASE = 0x20000000;
+
+static MPURange range(uint32_t address, uint32_t length, MPUAccessPermission access, bool executable = false)
+{
+    MPURange r = {address, length, access, executable, false, false, false, 0};
+    return r;
+}
+
+static bool readable(MPUAccessPermission access, bool privileged)
+{
+    switch (access)
+    {
+    case MPUAccessPermission::PRIV_RW:
+    case MPUAccessPermission::PRIV_RO:
+        return privileged;
+    case MPUAccessPermission::PRIV_RW_UNPRIV_RO:
+    case MPUAccessPermission::FULL_ACCESS:
+    case MPUAccessPermission::RO:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool writable(MPUAccessPermission access, bool privileged)
+{
+    return access == MPUAccessPermission::FULL_ACCESS ||
+           (privileged && (access == MPUAccessPermission::PRIV_RW || access == MPUAccessPermission::PRIV_RW_UNPRIV_RO));
+}
+
+/**
+ * Applies a plan and checks it byte by byte over [from, to): every requested byte
+ * gets exactly its range's permissions, and the covered bytes add up to the plan's.
+ */
+static void verify(const MPURange *ranges, uint8_t count, const MPUPlan &plan, uint32_t from, uint32_t to)
+{
+    MPUHost &mpu = mpuHost();
+
+    mpu.reset();
+    CHECK(MPUPlanner::apply(plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(mpu.barriers, 2);
+    mpu.ctrl = MPU_CTRL_ENABLE_Msk;
+
+    uint64_t requested = 0, covered = 0;
+    int mismatches = 0;
+
+    for (uint32_t a = from; a < to; a++)
+    {
+        int in = -1;
+        for (uint8_t i = 0; i < count; i++)
+            if (a >= ranges[i].address && a - ranges[i].address < ranges[i].length)
+                in = i;
+
+        if (mpu.regionAt(a) >= 0)
+            covered++;
+        if (in < 0)
+            continue;
+
+        requested++;
+        const MPURange &r = ranges[in];
+        for (int privileged = 0; privileged < 2; privileged++)
+        {
+            mismatches += mpu.check(a, MPUHostAccess::READ, privileged) != readable(r.access, privileged);
+            mismatches += mpu.check(a, MPUHostAccess::WRITE, privileged) != writable(r.access, privileged);
+            mismatches += mpu.check(a, MPUHostAccess::EXECUTE, privileged) !=
+                          (readable(r.access, privileged) && r.executable);
+        }
+    }
+
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(requested, plan.requestedBytes);
+    CHECK_EQ(covered, plan.coveredBytes);
+    CHECK_EQ(covered - requested, plan.wastedBytes);
+}
+
+static void testUnaligned()
+{
+    MPURange r = range(BASE + 0x123, 1000, MPUAccessPermission::PRIV_RW);
+    MPUPlan plan;
+
+    // Covered to 32-byte granularity: only the slop at either end is wasted.
+    CHECK(MPUPlanner::plan(&r, 1, plan) == MPU_STATE::MPU_OK);
+    CHECK(plan.wastedBytes < 64);
+    verify(&r, 1, plan, BASE, BASE + 0x1000);
+
+    // A 0x5C00 block at +0x400: one region must round it out, several cover it exactly.
+    r = range(BASE + 0x400, 0x5C00, MPUAccessPermission::FULL_ACCESS, true);
+    CHECK(MPUPlanner::plan(&r, 1, plan, 0, 1) == MPU_STATE::MPU_OK);
+    CHECK_EQ(plan.count, 1);
+    CHECK(plan.wastedBytes > 0);
+    verify(&r, 1, plan, BASE, BASE + 0x8000);
+
+    CHECK(MPUPlanner::plan(&r, 1, plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(plan.wastedBytes, 0);
+    verify(&r, 1, plan, BASE, BASE + 0x8000);
+}
+
+static void testOverlapping()
+{
+    MPURange r[3] = {range(BASE + 0x800, 0x1000, MPUAccessPermission::PRIV_RW),
+                     range(BASE, 0x1000, MPUAccessPermission::PRIV_RW),
+                     range(BASE + 0x1000, 0x100, MPUAccessPermission::PRIV_RW)};
+    MPUPlan plan;
+
+    // Same kind: merged into [BASE, BASE + 0x1800).
+    CHECK(MPUPlanner::plan(r, 3, plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(plan.requestedBytes, 0x1800);
+    CHECK_EQ(plan.wastedBytes, 0);
+    verify(r, 3, plan, BASE - 0x400, BASE + 0x2000);
+
+    // Different kinds may not overlap.
+    r[1].access = MPUAccessPermission::RO;
+    CHECK(MPUPlanner::plan(r, 3, plan) == MPU_STATE::MPU_INVALID_PARAMETER);
+}
+
+static void testTouchingDifferentKinds()
+{
+    MPURange r[3] = {range(BASE, 0x400, MPUAccessPermission::PRIV_RW),
+                     range(BASE + 0x400, 0x2C0, MPUAccessPermission::RO, true),
+                     range(BASE + 0x6C0, 0x140, MPUAccessPermission::PRIV_RW_UNPRIV_RO)};
+    MPUPlan plan;
+
+    CHECK(MPUPlanner::plan(r, 3, plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(plan.wastedBytes, 0);
+    verify(r, 3, plan, BASE - 0x100, BASE + 0x1000);
+}
+
+static void testOverBudget()
+{
+    MPURange r[12];
+    MPUPlan plan;
+
+    for (int i = 0; i < 12; i++)
+        r[i] = range(BASE + i * 8192u, 3000u + i * 100, MPUAccessPermission::FULL_ACCESS);
+
+    // Twelve ranges in regions 2..7: gaps are absorbed, and the plan starts at region 2.
+    CHECK(MPUPlanner::plan(r, 12, plan, 2, 6) == MPU_STATE::MPU_OK);
+    CHECK(plan.count <= 6);
+    CHECK(plan.wastedBytes > 0);
+    CHECK_EQ(plan.regions[0].rbar & MPU_RBAR_REGION_Msk, 2);
+    verify(r, 12, plan, BASE - 0x1000, BASE + 13 * 8192u);
+
+    // Regions the plan does not use are cleared, those before firstRegion left alone.
+    mpuHost().reset();
+    mpuHost().rbar[1] = BASE;
+    mpuHost().rasr[1] = mpuHost().rasr[7] = MPU_RASR_ENABLE_Msk | (31UL << MPU_RASR_SIZE_Pos);
+    CHECK(MPUPlanner::plan(r, 1, plan, 2, 6) == MPU_STATE::MPU_OK);
+    CHECK(MPUPlanner::apply(plan) == MPU_STATE::MPU_OK);
+    CHECK(mpuHost().rasr[1] & MPU_RASR_ENABLE_Msk);
+    CHECK(!(mpuHost().rasr[7] & MPU_RASR_ENABLE_Msk));
+
+    // Alternating kinds leave no gap that may be absorbed.
+    MPURange mixed[3] = {range(BASE, 0x100, MPUAccessPermission::PRIV_RW),
+                         range(BASE + 0x1000, 0x100, MPUAccessPermission::RO),
+                         range(BASE + 0x2000, 0x100, MPUAccessPermission::PRIV_RW)};
+    CHECK(MPUPlanner::plan(mixed, 3, plan, 0, 2) == MPU_STATE::MPU_NO_REGIONS);
+}
+
+static void testRefusals()
+{
+    MPURange r = range(BASE, 0x100, MPUAccessPermission::PRIV_RW);
+    MPUPlan plan;
+
+    CHECK(MPUPlanner::plan(&r, 1, plan, MPU_MAX_REGIONS) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(MPUPlanner::plan(&r, 1, plan, 0, 0) == MPU_STATE::MPU_INVALID_PARAMETER);
+
+    r.length = 0;
+    CHECK(MPUPlanner::plan(&r, 1, plan) == MPU_STATE::MPU_INVALID_PARAMETER);
+    r.length = 0x100;
+    r.access = MPUAccessPermission::RESERVED;
+    CHECK(MPUPlanner::plan(&r, 1, plan) == MPU_STATE::MPU_INVALID_PARAMETER);
+
+    r.access = MPUAccessPermission::PRIV_RW;
+    CHECK(MPUPlanner::plan(&r, 1, plan) == MPU_STATE::MPU_OK);
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK(MPUPlanner::apply(plan) == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    __set_CONTROL(0);
+}
+
+int main()
+{
+    testUnaligned();
+    testOverlapping();
+    testTouchingDifferentKinds();
+    testOverBudget();
+    testRefusals();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+/**
+ * Host test of MPUProfile::load() against the emulated MPU: for every run of
+ * regions a profile can own, a load costs two register writes per region and a
+ * single DSB/ISB pair, the alias registers reach the right regions, and regions
+ * outside the profile are left alone.
+ */
+
+#include "MPUProfile.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static const uint32_t BASE = 0x20000000;
+static const uint32_t GARBAGE_RBAR = 0xDEAD0000;
+static const uint32_t GARBAGE_RASR = 0x01234567;
+
+static MPUAccessPermission accessOf(uint8_t i)
+{
+    return i & 1 ? MPUAccessPermission::RO : MPUAccessPermission::FULL_ACCESS;
+}
+
+static void testEveryRun()
+{
+    MPUHost &mpu = mpuHost();
+
+    for (uint8_t first = 0; first < MPU_MAX_REGIONS; first++)
+        for (uint8_t count = 0; first + count <= MPU_MAX_REGIONS; count++)
+        {
+            MPUProfile profile;
+            CHECK(profile.reset(first, count) == MPU_STATE::MPU_OK);
+
+            // Every third region stays disabled, so load() must clear it.
+            for (uint8_t i = 0; i < count; i++)
+                if (i % 3 != 1)
+                    CHECK(profile.set(first + i, BASE + i * 0x1000, MPURegionSize::SIZE_4KB, accessOf(i), false) ==
+                          MPU_STATE::MPU_OK);
+
+            mpu.reset();
+            for (int r = 0; r < MPU_HOST_REGIONS; r++)
+            {
+                mpu.rbar[r] = GARBAGE_RBAR;
+                mpu.rasr[r] = GARBAGE_RASR;
+            }
+            mpu.resetCounters();
+
+            profile.load();
+            CHECK_EQ(mpu.writes, 2 * count);
+            CHECK_EQ(mpu.barriers, 2);
+
+            int mismatches = 0;
+            for (int r = 0; r < MPU_HOST_REGIONS; r++)
+            {
+                int i = r - first;
+                if (i < 0 || i >= count)
+                    mismatches += mpu.rbar[r] != GARBAGE_RBAR || mpu.rasr[r] != GARBAGE_RASR;
+                else if (i % 3 == 1)
+                    mismatches += mpu.rasr[r] != 0;
+                else
+                    mismatches += mpu.rbar[r] != BASE + i * 0x1000u || mpu.rasr[r] !=
+                                    CodalMPU::encodeRASR(MPURegionSize::SIZE_4KB, accessOf((uint8_t)i), false);
+            }
+            CHECK_EQ(mismatches, 0);
+        }
+}
+
+static void testAgainstConfigureRegion()
+{
+    MPUHost &mpu = mpuHost();
+    MPUProfile profile;
+
+    profile.reset(0, MPU_MAX_REGIONS);
+    for (uint8_t i = 0; i < MPU_MAX_REGIONS; i++)
+        profile.set(i, BASE + i * 0x1000, MPURegionSize::SIZE_4KB, MPUAccessPermission::FULL_ACCESS, false);
+
+    // configureRegion() pays RNR, RBAR, RASR and a barrier pair for every region.
+    mpu.reset();
+    for (uint8_t i = 0; i < MPU_MAX_REGIONS; i++)
+        CodalMPU::configureRegion(i, BASE + i * 0x1000, MPURegionSize::SIZE_4KB, MPUAccessPermission::FULL_ACCESS,
+                                  false);
+    uint32_t rbar[MPU_HOST_REGIONS], rasr[MPU_HOST_REGIONS];
+    memcpy(rbar, mpu.rbar, sizeof(rbar));
+    memcpy(rasr, mpu.rasr, sizeof(rasr));
+    CHECK(mpu.writes > 2 * MPU_MAX_REGIONS);
+    CHECK(mpu.barriers > 2);
+
+    mpu.reset();
+    profile.load();
+    CHECK_EQ(mpu.writes, 2 * MPU_MAX_REGIONS);
+    CHECK_EQ(mpu.barriers, 2);
+    CHECK(memcmp(rbar, mpu.rbar, sizeof(rbar)) == 0);
+    CHECK(memcmp(rasr, mpu.rasr, sizeof(rasr)) == 0);
+}
+
+static void testFromPlan()
+{
+    MPURange r[2] = {{BASE + 0x400, 0x5C00, MPUAccessPermission::PRIV_RW, false, false, false, false, 0},
+                     {BASE + 0x10000, 0x900, MPUAccessPermission::FULL_ACCESS, true, false, false, false, 0}};
+    MPUPlan plan;
+    MPUProfile profile;
+
+    CHECK(MPUPlanner::plan(r, 2, plan, 1, 7) == MPU_STATE::MPU_OK);
+    CHECK(profile.set(plan) == MPU_STATE::MPU_OK);
+    CHECK_EQ(profile.count, 7);
+
+    MPUHost &mpu = mpuHost();
+    mpu.reset();
+    CHECK(profile.apply() == MPU_STATE::MPU_OK);
+    CHECK_EQ(mpu.writes, 2 * 7);
+    CHECK_EQ(mpu.barriers, 2);
+    mpu.ctrl = MPU_CTRL_ENABLE_Msk;
+
+    int mismatches = 0;
+    for (uint32_t a = BASE; a < BASE + 0x12000; a++)
+    {
+        bool in = (a >= BASE + 0x400 && a < BASE + 0x6000) || (a >= BASE + 0x10000 && a < BASE + 0x10900);
+        mismatches += (mpu.regionAt(a) >= 0) != in;
+    }
+    CHECK_EQ(mismatches, 0);
+
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    mpu.resetCounters();
+    CHECK(profile.apply() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK_EQ(mpu.writes, 0);
+    __set_CONTROL(0);
+}
+
+static void testRefusals()
+{
+    MPUProfile profile;
+
+    CHECK(profile.reset(MPU_MAX_REGIONS, 1) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(profile.reset(4, MPU_MAX_REGIONS - 3) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(profile.reset(2, 3) == MPU_STATE::MPU_OK);
+    CHECK(profile.set(1, BASE, 0) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(profile.set(5, BASE, 0) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(profile.set(3, BASE, MPURegionSize::SIZE_4KB, MPUAccessPermission::RESERVED) ==
+          MPU_STATE::MPU_UNKOWN_PERMISSON_ACCESS);
+}
+
+int main()
+{
+    testEveryRun();
+    testAgainstConfigureRegion();
+    testFromPlan();
+    testRefusals();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,136 @@
+/**
+ * Host test of MPUSealedPool against the emulated MPU: the OPEN / SEALED state
+ * machine and the transitions it refuses, that a sealed pool refuses every write
+ * (privileged too) for both RO and PRIV_RO pools while an open one takes them,
+ * and the parameter checks of init() and allocate().
+ */
+
+#include "MPUSealedPool.h"
+#include "host_test.h"
+
+using namespace codal;
+
+static uint8_t memory[1024] CODAL_SEALED;
+
+static uint32_t address(const void *p)
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(p));
+}
+
+static bool allowed(uint32_t a, MPUHostAccess access, bool privileged)
+{
+    return mpuHost().check(a, access, privileged);
+}
+
+static void enableMPU()
+{
+    mpuHost().reset();
+    mpuHost().ctrl = MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk;
+}
+
+static void testStateMachine()
+{
+    MPUSealedPool pool;
+    enableMPU();
+
+    CHECK(pool.state() == MPUPoolState::UNINITIALISED);
+    CHECK(pool.allocate(16) == NULL);
+    CHECK(pool.seal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK(pool.unseal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+
+    CHECK(pool.init(memory, sizeof(memory), 2, 6) == MPU_STATE::MPU_OK);
+    CHECK(pool.state() == MPUPoolState::OPEN);
+    CHECK(pool.unseal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK(pool.state() == MPUPoolState::OPEN);
+    CHECK(pool.allocate(100) == memory);
+
+    CHECK(pool.seal() == MPU_STATE::MPU_OK);
+    CHECK(pool.state() == MPUPoolState::SEALED);
+    CHECK(pool.seal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK(pool.allocate(16) == NULL);
+    CHECK_EQ(pool.bytesUsed(), 100);
+
+    // Unprivileged code can neither reopen nor seal.
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK(pool.unseal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK(pool.state() == MPUPoolState::SEALED);
+    __set_CONTROL(0);
+
+    CHECK(pool.unseal() == MPU_STATE::MPU_OK);
+    CHECK(pool.state() == MPUPoolState::OPEN);
+    CHECK(pool.allocate(16) == memory + 100);
+
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK(pool.seal() == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    CHECK(pool.state() == MPUPoolState::OPEN);
+    __set_CONTROL(0);
+}
+
+static void testSealedRefusesWrites(bool unprivilegedRead)
+{
+    MPUSealedPool pool;
+    enableMPU();
+
+    CHECK(pool.init(memory, sizeof(memory), 0, MPU_MAX_REGIONS, unprivilegedRead) == MPU_STATE::MPU_OK);
+
+    int wrong = 0;
+    for (uint32_t a = address(memory); a < address(memory + sizeof(memory)); a += 4)
+        for (int privileged = 0; privileged < 2; privileged++)
+            wrong += !allowed(a, MPUHostAccess::WRITE, privileged) || !allowed(a, MPUHostAccess::READ, privileged);
+    CHECK_EQ(wrong, 0);
+
+    CHECK(pool.seal() == MPU_STATE::MPU_OK);
+    for (uint32_t a = address(memory); a < address(memory + sizeof(memory)); a += 4)
+    {
+        wrong += allowed(a, MPUHostAccess::WRITE, true) || allowed(a, MPUHostAccess::WRITE, false);
+        wrong += !allowed(a, MPUHostAccess::READ, true);
+        wrong += allowed(a, MPUHostAccess::READ, false) != unprivilegedRead;
+        wrong += allowed(a, MPUHostAccess::EXECUTE, true);
+    }
+    CHECK_EQ(wrong, 0);
+
+    // Nothing outside the pool is affected.
+    CHECK(allowed(address(memory) - 1, MPUHostAccess::WRITE, true));
+    CHECK(allowed(address(memory + sizeof(memory)), MPUHostAccess::WRITE, true));
+
+    CHECK(pool.unseal() == MPU_STATE::MPU_OK);
+    CHECK(allowed(address(memory), MPUHostAccess::WRITE, false));
+}
+
+static void testParameters()
+{
+    MPUSealedPool pool;
+    enableMPU();
+
+    CHECK(pool.init(memory + 4, 512, 0, MPU_MAX_REGIONS) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(pool.init(memory, 500, 0, MPU_MAX_REGIONS) == MPU_STATE::MPU_INVALID_PARAMETER);
+    CHECK(pool.state() == MPUPoolState::UNINITIALISED);
+
+    __set_CONTROL(CONTROL_nPRIV_Msk);
+    CHECK(pool.init(memory, sizeof(memory), 0, MPU_MAX_REGIONS) == MPU_STATE::MPU_OPERATION_NOT_ALLOWED);
+    __set_CONTROL(0);
+
+    CHECK(pool.init(memory, sizeof(memory), 0, MPU_MAX_REGIONS) == MPU_STATE::MPU_OK);
+    CHECK(pool.allocate(3, 1) == memory);
+
+    // Alignments that are not powers of two are refused, and use nothing.
+    CHECK(pool.allocate(8, 0) == NULL);
+    CHECK(pool.allocate(8, 3) == NULL);
+    CHECK(pool.allocate(8, 24) == NULL);
+    CHECK_EQ(pool.bytesUsed(), 3);
+
+    CHECK(pool.allocate(8, 16) == memory + 16);
+    CHECK(pool.allocate(sizeof(memory) - 24) == memory + 24);
+    CHECK(pool.allocate(1, 1) == NULL);
+    CHECK(pool.contains(memory + sizeof(memory) - 1) && !pool.contains(memory + sizeof(memory)));
+}
+
+int main()
+{
+    testStateMachine();
+    testSealedRefusesWrites(true);
+    testSealedRefusesWrites(false);
+    testParameters();
+
+    return HOST_TEST_RESULT();
+}
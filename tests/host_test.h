@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @file host_test.h
+ * @brief Minimal check macros shared by the C and C++ host tests.
+ *
+ * A failed check is reported and counted, and the test carries on; main() ends
+ * with return HOST_TEST_RESULT(); so ctest sees a non-zero exit code.
+ */
+
+static int host_test_failures;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);  \
+            host_test_failures++;                                                    \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                   \
+    do {                                                                             \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);              \
+        if (a_ != e_) {                                                              \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %s == %lld\n", __FILE__,     \
+                    __LINE__, #actual, a_, #expected, e_);                           \
+            host_test_failures++;                                                    \
+        }                                                                            \
+    } while (0)
+
+#define HOST_TEST_RESULT()                                                           \
+    (host_test_failures ? (fprintf(stderr, "%d check(s) failed\n", host_test_failures), 1) : 0)
+
+/**
+ * Monotonic time in nanoseconds, for the benchmarks.
+ */
+static inline uint64_t host_test_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,258 @@
+/**
+ * Host test of net_capture.h. A ring is filled past capacity with raw and
+ * synthesised frames, drained to capture.pcap and capture.pcapng in the working
+ * directory, and both files are read back with an independent parser that
+ * applies the checks a pcap reader does: magic, version, link type and snap
+ * length, block and record lengths, timestamp order, and the synthesised headers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "net_capture.h"
+
+#define SNAPLEN 96
+#define BASE_US 1700000000000000ull
+
+typedef struct {
+    uint64_t ts;
+    uint32_t caplen;
+    uint32_t origlen;
+    uint8_t data[SNAPLEN];
+} parsed_t;
+
+static uint64_t now_us;
+static uint8_t ring[4096] __attribute__((aligned(4)));
+
+static uint64_t test_clock(void *ctx) {
+    (void)ctx;
+    return now_us;
+}
+
+static int file_write(void *ctx, const void *data, size_t len) {
+    return fwrite(data, 1, len, (FILE *)ctx) == len ? NET_OK : NET_ERR_LINK;
+}
+
+static size_t read_file(const char *name, uint8_t *buf, size_t size) {
+    FILE *f = fopen(name, "rb");
+    size_t n = f ? fread(buf, 1, size, f) : 0;
+
+    if (f)
+        fclose(f);
+    return n;
+}
+
+static uint32_t u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint16_t u16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+/** Parses a pcap file; returns the record count, or -1 if a reader would reject it. */
+static int parse_pcap(const uint8_t *f, size_t len, parsed_t *out, int max) {
+    if (len < 24 || u32(f) != 0xA1B2C3D4 || u16(f + 4) != 2 || u16(f + 6) != 4)
+        return -1;
+    if (u32(f + 8) != 0 || u32(f + 12) != 0 || u32(f + 16) != SNAPLEN || u32(f + 20) != NET_CAPTURE_LINKTYPE_ETHERNET)
+        return -1;
+
+    int n = 0;
+    for (size_t pos = 24; pos < len; n++) {
+        if (n == max || len - pos < 16)
+            return -1;
+
+        uint32_t usec = u32(f + pos + 4), caplen = u32(f + pos + 8), origlen = u32(f + pos + 12);
+        if (usec >= 1000000 || caplen > SNAPLEN || caplen > origlen || len - pos - 16 < caplen)
+            return -1;
+
+        out[n].ts = (uint64_t)u32(f + pos) * 1000000 + usec;
+        out[n].caplen = caplen;
+        out[n].origlen = origlen;
+        memcpy(out[n].data, f + pos + 16, caplen);
+        pos += 16 + caplen;
+    }
+    return n;
+}
+
+/** Parses a pcapng section with one interface; returns the packet count, or -1. */
+static int parse_pcapng(const uint8_t *f, size_t len, parsed_t *out, int max) {
+    int n = 0, interfaces = 0;
+
+    if (len < 28 || u32(f) != 0x0A0D0D0A || u32(f + 8) != 0x1A2B3C4D || u16(f + 12) != 1 || u16(f + 14) != 0)
+        return -1;
+
+    for (size_t pos = 0; pos < len;) {
+        uint32_t type = u32(f + pos), total = len - pos >= 12 ? u32(f + pos + 4) : 0;
+
+        // Every block is a multiple of 4 bytes and repeats its length at the end.
+        if (total < 12 || total % 4 || total > len - pos || u32(f + pos + total - 4) != total)
+            return -1;
+
+        if (type == 1) {
+            if (total < 20 || u16(f + pos + 8) != NET_CAPTURE_LINKTYPE_ETHERNET || u32(f + pos + 12) != SNAPLEN)
+                return -1;
+            interfaces++;
+        } else if (type == 6) {
+            uint32_t caplen = u32(f + pos + 20), origlen = u32(f + pos + 24);
+            if (!interfaces || u32(f + pos + 8) != 0 || n == max || caplen > SNAPLEN || caplen > origlen ||
+                total != 32 + NET_CAPTURE_ALIGN(caplen))
+                return -1;
+
+            out[n].ts = (uint64_t)u32(f + pos + 12) << 32 | u32(f + pos + 16);
+            out[n].caplen = caplen;
+            out[n].origlen = origlen;
+            memcpy(out[n].data, f + pos + 28, caplen);
+            n++;
+        } else if (type != 0x0A0D0D0A) {
+            return -1;
+        }
+        pos += total;
+    }
+    return n;
+}
+
+static int ipv4_header_ok(const uint8_t *ip) {
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2)
+        sum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ip[0] == 0x45 && sum == 0xFFFF;
+}
+
+static void fill(net_capture_t *cap) {
+    uint8_t frame[200];
+    net_packet_t pkt;
+
+    memset(frame, 0xAB, sizeof(frame));
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+
+    // Disabled capture records nothing.
+    CHECK_EQ(net_capture_frame(cap, frame, 60), 0);
+    net_capture_enable(cap, 1);
+
+    // Far more than the ring holds; only the newest survive, still in order.
+    for (int i = 0; i < 100; i++) {
+        now_us = BASE_US + (uint64_t)i * 1000;
+        frame[14] = (uint8_t)i;
+        CHECK_EQ(net_capture_frame(cap, frame, i % 3 ? 200 : 45), 1);
+    }
+    CHECK(cap->stats.overwritten > 0);
+    CHECK_EQ(cap->stats.overwritten + cap->records, 100);
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.src.v4 = IPV4_ADDR(10, 0, 0, 1);
+    pkt.dest.v4 = IPV4_ADDR(10, 0, 0, 2);
+    pkt.srcPort = 5000;
+    pkt.destPort = 53;
+    pkt.protocol = NET_PROTO_UDP;
+    pkt.length = 12;
+    memcpy(pkt.payload, "hello world!", 12);
+
+    net_capture_filter_ipv4_protocol(cap, NET_PROTO_UDP);
+    now_us += 1999999;
+    CHECK_EQ(net_capture_packet(cap, &pkt, 0), 1);
+    pkt.protocol = NET_PROTO_TCP;
+    CHECK_EQ(net_capture_packet(cap, &pkt, 0), 0);
+    CHECK_EQ(cap->stats.filtered, 1);
+    net_capture_filter_clear(cap);
+
+    pkt.src.v6 = IPV6_ADDR(0xFE, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1);
+    pkt.dest.v6 = IPV6_ADDR(0xFE, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2);
+    pkt.protocol = NET_PROTO_UDP;
+    now_us += 1;
+    CHECK_EQ(net_capture_packet(cap, &pkt, 1), 1);
+}
+
+/** The two synthesised records at the end, as a dissector would decode them. */
+static void check_synthesised(const parsed_t *p) {
+    const uint8_t *ip = p[0].data + 14;
+    CHECK_EQ(p[0].origlen, 14 + 20 + 8 + 12);
+    CHECK_EQ(p[0].caplen, p[0].origlen);
+    CHECK_EQ(u16(p[0].data + 12), 0x0008);
+    CHECK(ipv4_header_ok(ip));
+    CHECK_EQ(ip[2] << 8 | ip[3], 20 + 8 + 12);
+    CHECK_EQ(ip[9], NET_PROTO_UDP);
+    CHECK_EQ(ip[22] << 8 | ip[23], 53);
+    CHECK_EQ(ip[24] << 8 | ip[25], 8 + 12);
+    CHECK(memcmp(ip + 28, "hello world!", 12) == 0);
+
+    ip = p[1].data + 14;
+    CHECK_EQ(p[1].origlen, 14 + 40 + 8 + 12);
+    CHECK_EQ(p[1].caplen, p[1].origlen);
+    CHECK_EQ(u16(p[1].data + 12), 0xDD86);
+    CHECK_EQ(ip[0] >> 4, 6);
+    CHECK_EQ(ip[4] << 8 | ip[5], 8 + 12);
+    CHECK_EQ(ip[6], NET_PROTO_UDP);
+    CHECK(memcmp(ip + 48, "hello world!", 12) == 0);
+}
+
+static void check_records(const parsed_t *p, int n, int expected) {
+    CHECK_EQ(n, expected);
+    if (n != expected || n < 3)
+        return;
+
+    // Raw frames: consecutive sequence numbers, snap length applied, timestamps from the clock.
+    for (int i = 0; i < n - 2; i++) {
+        int seq = p[i].data[14];
+        CHECK_EQ(seq, p[n - 3].data[14] - (n - 3 - i));
+        CHECK_EQ(p[i].origlen, seq % 3 ? 200 : 45);
+        CHECK_EQ(p[i].caplen, seq % 3 ? SNAPLEN : 45);
+        CHECK_EQ(p[i].ts, BASE_US + (uint64_t)seq * 1000);
+    }
+    CHECK_EQ(p[n - 3].data[14], 99);
+
+    for (int i = 1; i < n; i++)
+        CHECK(p[i].ts >= p[i - 1].ts);
+
+    check_synthesised(p + n - 2);
+}
+
+int main(void) {
+    static uint8_t file[8192];
+    static parsed_t parsed[64];
+    net_capture_t cap, copy;
+
+    net_capture_init(&cap, ring, sizeof(ring), SNAPLEN, test_clock, NULL);
+    fill(&cap);
+
+    // Drain a copy of the ring as pcapng, then the original as pcap.
+    static uint8_t ring_copy[sizeof(ring)] __attribute__((aligned(4)));
+    memcpy(ring_copy, ring, sizeof(ring));
+    copy = cap;
+    copy.ring = ring_copy;
+
+    int records = (int)cap.records;
+    FILE *f = fopen("capture.pcap", "wb");
+    CHECK(f != NULL);
+    if (!f)
+        return HOST_TEST_RESULT();
+    CHECK_EQ(net_capture_write_header(&cap, NET_CAPTURE_PCAP, file_write, f), NET_OK);
+    CHECK_EQ(net_capture_drain(&cap, NET_CAPTURE_PCAP, file_write, f, 0), records);
+    fclose(f);
+    CHECK_EQ(cap.records, 0);
+
+    f = fopen("capture.pcapng", "wb");
+    CHECK(f != NULL);
+    if (!f)
+        return HOST_TEST_RESULT();
+    CHECK_EQ(net_capture_write_header(&copy, NET_CAPTURE_PCAPNG, file_write, f), NET_OK);
+    CHECK_EQ(net_capture_drain(&copy, NET_CAPTURE_PCAPNG, file_write, f, 2), 2);
+    CHECK_EQ(net_capture_drain(&copy, NET_CAPTURE_PCAPNG, file_write, f, 0), records - 2);
+    fclose(f);
+
+    size_t len = read_file("capture.pcap", file, sizeof(file));
+    check_records(parsed, parse_pcap(file, len, parsed, 64), records);
+
+    len = read_file("capture.pcapng", file, sizeof(file));
+    check_records(parsed, parse_pcapng(file, len, parsed, 64), records);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+/**
+ * Host test of net_checksum.h: the word/SSE2 paths against the byte-at-a-time
+ * reference, chained buffers, incremental updates and UDP datagrams.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "net_checksum.h"
+
+NET_SLAB_DEFINE(small, 8, 256);
+static net_slab_t slabs[] = { NET_SLAB_INIT(small) };
+static net_pool_t pool = { slabs, 1 };
+
+static uint8_t data[4096];
+
+static void test_partial_matches_reference(void) {
+    for (int t = 0; t < 5000; t++) {
+        size_t offset = (size_t)(rand() % 16);
+        size_t len = (size_t)(rand() % (t < 100 ? 4000 : 300));
+
+        CHECK_EQ(net_csum_fold(net_csum_partial(data + offset, len, 0)),
+                 net_csum_fold(net_csum_partial_naive(data + offset, len, 0)));
+    }
+}
+
+static void test_chain_with_odd_fragments(void) {
+    net_pool_init(&pool);
+
+    net_buf_t *a = net_buf_alloc(&pool, 100), *b = net_buf_alloc(&pool, 100), *c = net_buf_alloc(&pool, 100);
+    memcpy(net_buf_put(a, 33), data, 33);
+    memcpy(net_buf_put(b, 51), data + 33, 51);
+    memcpy(net_buf_put(c, 20), data + 84, 20);
+    net_buf_append(a, b);
+    net_buf_append(a, c);
+
+    CHECK_EQ(net_csum_fold(net_csum_buf(a, 0)), net_csum_fold(net_csum_partial(data, 104, 0)));
+    net_buf_unref(a);
+}
+
+static void test_incremental_update(void) {
+    uint8_t copy[100];
+    memcpy(copy, data, sizeof(copy));
+
+    uint16_t csum = net_csum_fold(net_csum_partial(copy, sizeof(copy), 0));
+    uint16_t old16, new16 = 0x1234;
+    memcpy(&old16, copy + 10, 2);
+    memcpy(copy + 10, &new16, 2);
+    csum = net_csum_update16(csum, old16, new16);
+    CHECK_EQ(csum, net_csum_fold(net_csum_partial(copy, sizeof(copy), 0)));
+
+    uint32_t old32, new32 = 0xDEADBEEF;
+    memcpy(&old32, copy + 20, 4);
+    memcpy(copy + 20, &new32, 4);
+    csum = net_csum_update32(csum, old32, new32);
+    CHECK_EQ(csum, net_csum_fold(net_csum_partial(copy, sizeof(copy), 0)));
+}
+
+static void test_udp(void) {
+    // Ports 1234 -> 5678, length 12, "hi!\n".
+    uint8_t datagram[] = { 0x04, 0xD2, 0x16, 0x2E, 0x00, 0x0C, 0x00, 0x00, 'h', 'i', '!', '\n' };
+    udp_header_t udp;
+    memcpy(&udp, datagram, sizeof(udp));
+
+    ipv4_addr_t src = IPV4_ADDR(192, 168, 0, 1), dest = IPV4_ADDR(192, 168, 0, 2);
+    uint16_t csum = net_udp_checksum_ipv4(src, dest, &udp, datagram + 8);
+    CHECK(csum != 0);
+
+    // A receiver summing everything, checksum included, gets 0.
+    memcpy(datagram + 6, &csum, 2);
+    uint32_t sum = net_csum_pseudo_ipv4(src, dest, 17, sizeof(datagram));
+    CHECK_EQ(net_csum_fold(net_csum_partial_naive(datagram, sizeof(datagram), sum)), 0);
+
+    ipv6_addr_t src6, dest6;
+    memset(&src6, 0, sizeof(src6));
+    memset(&dest6, 0, sizeof(dest6));
+    src6.bytes[15] = 1;
+    dest6.bytes[15] = 2;
+    memcpy(&udp, datagram, sizeof(udp));
+    udp.checksum = 0;
+    csum = net_udp_checksum_ipv6(&src6, &dest6, &udp, datagram + 8);
+    memcpy(datagram + 6, &csum, 2);
+    sum = net_csum_pseudo_ipv6(&src6, &dest6, 17, sizeof(datagram));
+    CHECK_EQ(net_csum_fold(net_csum_partial_naive(datagram, sizeof(datagram), sum)), 0);
+
+    // A length field shorter than the header is refused rather than read past the data.
+    for (uint8_t length = 0; length < sizeof(udp_header_t); length++) {
+        NET_SET_BE16(&udp, udp_header_t, length, length);
+        CHECK_EQ(net_udp_checksum_ipv4(src, dest, &udp, NULL), 0);
+        CHECK_EQ(net_udp_checksum_ipv6(&src6, &dest6, &udp, NULL), 0);
+    }
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)rand();
+
+    test_partial_matches_reference();
+    test_chain_with_odd_fragments();
+    test_incremental_update();
+    test_udp();
+
+    return HOST_TEST_RESULT();
+}
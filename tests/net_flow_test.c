@@ -0,0 +1,188 @@
+/**
+ * Host test and benchmark of net_flow.h. Random insert/remove/expire traffic is
+ * checked against the robin-hood and LRU invariants, then insert, hit and miss
+ * costs are timed at 1k and 64k flows, each at half and full slot load.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+#include "net_flow.h"
+
+static void make_key(net_flow_key_t *key, uint32_t i) {
+    net_flow_key_ipv4(key, u32_to_ipv4(0x0A000000 | (i >> 8)), u32_to_ipv4(0xC0A80000 | (i & 0xFF)),
+                      (uint16_t)(1024 + i % 5000), 80, NET_PROTO_TCP);
+}
+
+/** Every slot sits at its recorded probe distance, and the LRU list holds every flow once. */
+static void check_invariants(const net_flow_table_t *table) {
+    uint32_t used = 0, listed = 0;
+
+    for (uint32_t pos = 0; pos <= table->slot_mask; pos++) {
+        const net_flow_slot_t *s = &table->slots[pos];
+        if (!s->dist)
+            continue;
+
+        used++;
+        CHECK_EQ(((pos - (s->hash & table->slot_mask)) & table->slot_mask) + 1, s->dist);
+        CHECK_EQ(table->entries[s->entry].hash, s->hash);
+    }
+
+    for (uint16_t i = table->lru_head; i != NET_FLOW_NONE && listed <= table->count; i = table->entries[i].lru_next)
+        listed++;
+
+    CHECK_EQ(used, table->count);
+    CHECK_EQ(listed, table->count);
+}
+
+static void test_random_traffic(void) {
+    enum { ENTRIES = 200, SLOTS = 256, KEYS = 4096 };
+    static net_flow_slot_t slots[SLOTS];
+    static net_flow_entry_t entries[ENTRIES];
+    static uint8_t present[KEYS];
+    net_flow_table_t table;
+
+    CHECK_EQ(net_flow_init(&table, slots, SLOTS, entries, ENTRIES, 1000), NET_OK);
+    srand(1);
+
+    for (uint32_t step = 0; step < 100000; step++) {
+        uint32_t k = (uint32_t)rand() % KEYS;
+        net_flow_key_t key;
+        make_key(&key, k);
+        net_flow_tick(&table, step);
+
+        // A flow may have been evicted, but one never inserted must not appear.
+        net_flow_entry_t *e = net_flow_lookup(&table, &key);
+        CHECK(!e || present[k]);
+        CHECK(!e || net_flow_key_equal(&e->key, &key));
+
+        if (rand() % 3) {
+            e = net_flow_get(&table, &key);
+            CHECK(e != NULL && e->last_seen == step);
+            present[k] = 1;
+        } else if (e) {
+            net_flow_remove(&table, e);
+            present[k] = 0;
+        }
+
+        if (step % 1000 == 0)
+            check_invariants(&table);
+    }
+
+    CHECK(table.stats.evictions > 0);
+}
+
+static void test_lru_expiry_and_rate(void) {
+    static net_flow_slot_t slots[16];
+    static net_flow_entry_t entries[4];
+    net_flow_table_t table;
+    net_flow_key_t keys[6];
+
+    for (int i = 0; i < 6; i++)
+        make_key(&keys[i], (uint32_t)i);
+
+    net_flow_init(&table, slots, 16, entries, 4, 1000);
+    for (int i = 0; i < 4; i++) {
+        net_flow_tick(&table, (uint32_t)i);
+        net_flow_get(&table, &keys[i]);
+    }
+
+    // Touching k0 makes k1 the least recently seen, so k4 evicts it.
+    net_flow_tick(&table, 500);
+    net_flow_get(&table, &keys[0]);
+    net_flow_get(&table, &keys[4]);
+    CHECK(net_flow_lookup(&table, &keys[1]) == NULL);
+    CHECK(net_flow_lookup(&table, &keys[0]) != NULL);
+    CHECK_EQ(table.stats.evictions, 1);
+
+    // k2 (seen at 2) and k3 (seen at 3) are idle for more than the timeout at 1004.
+    net_flow_tick(&table, 1004);
+    CHECK_EQ(net_flow_expire(&table), 2);
+    CHECK_EQ(table.count, 2);
+    check_invariants(&table);
+
+    // 10 kB/s with a 3 kB burst admits about 13 kB of 1 kB packets in one second.
+    net_flow_entry_t *e = net_flow_get(&table, &keys[5]);
+    net_flow_set_rate(&table, e, 10000, 3000);
+    int admitted = 0;
+    for (uint32_t ms = 0; ms < 1000; ms++) {
+        net_flow_tick(&table, 2000 + ms);
+        admitted += net_flow_admit(&table, e, 1000);
+        admitted += net_flow_admit(&table, e, 1000);
+    }
+    CHECK(admitted >= 12 && admitted <= 13);
+    CHECK_EQ(e->dropped, 2000 - admitted);
+
+    net_packet_t pkt;
+    net_flow_key_t from_packet, direct;
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.src.v4 = IPV4_ADDR(10, 0, 0, 1);
+    pkt.dest.v4 = IPV4_ADDR(10, 0, 0, 2);
+    pkt.srcPort = 5;
+    pkt.destPort = 6;
+    pkt.protocol = NET_PROTO_UDP;
+    net_flow_key_packet(&from_packet, &pkt, 0);
+    net_flow_key_ipv4(&direct, IPV4_ADDR(10, 0, 0, 1), IPV4_ADDR(10, 0, 0, 2), 5, 6, NET_PROTO_UDP);
+    CHECK(net_flow_key_equal(&from_packet, &direct));
+}
+
+static void bench(uint32_t flows, uint32_t slot_count) {
+    net_flow_slot_t *slots = malloc(sizeof(*slots) * slot_count);
+    net_flow_entry_t *entries = malloc(sizeof(*entries) * flows);
+    net_flow_key_t *keys = malloc(sizeof(*keys) * flows);
+    net_flow_table_t table;
+
+    net_flow_init(&table, slots, slot_count, entries, flows, 1000);
+    for (uint32_t i = 0; i < flows; i++)
+        make_key(&keys[i], (i * 2654435761u) >> 8);
+
+    uint64_t start = host_test_now_ns();
+    for (uint32_t i = 0; i < flows; i++)
+        net_flow_get(&table, &keys[i]);
+    double insert = (double)(host_test_now_ns() - start) / flows;
+    CHECK_EQ(table.count, flows);
+
+    const uint32_t rounds = 2000000;
+    volatile uintptr_t sink = 0;
+    uint32_t x = 1;
+
+    start = host_test_now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        x = x * 1664525u + 1013904223u;
+        sink += (uintptr_t)net_flow_lookup(&table, &keys[(x >> 8) % flows]);
+    }
+    double hit = (double)(host_test_now_ns() - start) / rounds;
+
+    net_flow_key_t miss;
+    start = host_test_now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        make_key(&miss, 0x40000000u + r);
+        sink += (uintptr_t)net_flow_lookup(&table, &miss);
+    }
+    double missed = (double)(host_test_now_ns() - start) / rounds;
+
+    uint32_t longest = 0;
+    for (uint32_t pos = 0; pos < slot_count; pos++)
+        longest = slots[pos].dist > longest ? slots[pos].dist : longest;
+
+    check_invariants(&table);
+    printf("%6u flows / %6u slots: insert %5.1f ns, hit %5.1f ns, miss %5.1f ns, longest probe %u\n", flows,
+           slot_count, insert, hit, missed, longest);
+
+    free(slots);
+    free(entries);
+    free(keys);
+}
+
+int main(void) {
+    test_random_traffic();
+    test_lru_expiry_and_rate();
+
+    bench(1024, 2048);
+    bench(1024, 1024);
+    bench(65535, 131072);
+    bench(65535, 65536);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,256 @@
+/**
+ * Host test of net_frag.h: datagrams fragmented by net_frag_ipv4/ipv6 and fed
+ * back in shuffled order, the IPv4 overlap policy (data received first wins)
+ * for every way a newcomer can overlap held fragments, IPv6 overlap and atomic
+ * fragment handling, and that every buffer returns to the pool.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "net_frag.h"
+
+#define BUFFERS 64
+#define MAX_FRAGS 16
+
+NET_SLAB_DEFINE(big, BUFFERS, 1536);
+static net_slab_t slabs[] = { NET_SLAB_INIT(big) };
+static net_pool_t pool = { slabs, 1 };
+
+static net_reasm_ctx_t contexts[4];
+static net_reasm_t reasm;
+static uint8_t payload[3000];
+
+/** Fragments captured from net_frag_ipv4/ipv6: header and payload bytes. */
+typedef struct {
+    uint8_t header[sizeof(ipv6_header_t) + sizeof(ipv6_frag_header_t)];
+    net_buf_t *buf;
+} fragment_t;
+
+static fragment_t frags[MAX_FRAGS];
+static int frag_count;
+
+static int collect(void *ctx, const uint8_t *header, uint16_t header_len, const net_buf_t *buf, uint16_t offset,
+                   uint16_t len) {
+    (void)ctx;
+    if (frag_count == MAX_FRAGS)
+        return NET_ERR_FULL;
+
+    fragment_t *f = &frags[frag_count++];
+    memcpy(f->header, header, header_len);
+    f->buf = net_buf_alloc(&pool, len);
+    net_frag_copy(buf, offset, net_buf_put(f->buf, len), len);
+    return NET_OK;
+}
+
+static net_buf_t *payload_chain(void) {
+    net_buf_t *head = NULL;
+
+    for (uint32_t done = 0; done < sizeof(payload); done += 700) {
+        uint16_t len = (uint16_t)(sizeof(payload) - done < 700 ? sizeof(payload) - done : 700);
+        net_buf_t *buf = net_buf_alloc(&pool, len);
+        memcpy(net_buf_put(buf, len), payload + done, len);
+        if (head)
+            net_buf_append(head, buf);
+        else
+            head = buf;
+    }
+    return head;
+}
+
+static void shuffle(int seed) {
+    srand((unsigned)seed);
+    for (int i = frag_count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        fragment_t t = frags[i];
+        frags[i] = frags[j];
+        frags[j] = t;
+    }
+}
+
+static int chain_equals(const net_buf_t *chain, const uint8_t *data, uint32_t len) {
+    uint8_t copy[sizeof(payload)];
+
+    if (net_buf_chain_len(chain) != len || len > sizeof(copy))
+        return 0;
+    net_frag_copy(chain, 0, copy, len);
+    return memcmp(copy, data, len) == 0;
+}
+
+static void test_ipv4_out_of_order(void) {
+    for (int order = 0; order < 8; order++) {
+        ipv4_header_t ip;
+        memset(&ip, 0, sizeof(ip));
+        ip.version_ihl = 0x45;
+        ip.protocol = NET_PROTO_UDP;
+        ip.src = IPV4_ADDR(10, 0, 0, 1);
+        ip.dest = IPV4_ADDR(10, 0, 0, 2);
+        NET_SET_BE16(&ip, ipv4_header_t, id, (uint16_t)(100 + order));
+
+        net_buf_t *chain = payload_chain();
+        frag_count = 0;
+        CHECK_EQ(net_frag_ipv4(&ip, chain, 576, collect, NULL), NET_OK);
+        net_buf_unref(chain);
+        CHECK_EQ(frag_count, 6);
+
+        // Order 0 is reversed, so the last fragment arrives first.
+        if (order == 0)
+            for (int i = 0; i < frag_count / 2; i++) {
+                fragment_t t = frags[i];
+                frags[i] = frags[frag_count - 1 - i];
+                frags[frag_count - 1 - i] = t;
+            }
+        else
+            shuffle(order);
+
+        net_buf_t *out = NULL;
+        for (int i = 0; i < frag_count; i++) {
+            CHECK(out == NULL);
+            CHECK_EQ(net_reasm_ipv4(&reasm, (const ipv4_header_t *)(void *)frags[i].header, frags[i].buf, &out),
+                     NET_OK);
+        }
+        CHECK(chain_equals(out, payload, sizeof(payload)));
+        net_buf_unref(out);
+    }
+}
+
+static void test_ipv6_out_of_order(void) {
+    ipv6_header_t ip;
+    memset(&ip, 0, sizeof(ip));
+    NET_SET_BE32(&ip, ipv6_header_t, version_class_flow, 0x60000000);
+    ip.next_header = NET_PROTO_UDP;
+    ip.src = IPV6_ADDR(0xFE, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1);
+    ip.dest = IPV6_ADDR(0xFE, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2);
+
+    net_buf_t *chain = payload_chain();
+    frag_count = 0;
+    CHECK_EQ(net_frag_ipv6(&ip, chain, 1280, 77, collect, NULL), NET_OK);
+    net_buf_unref(chain);
+    CHECK_EQ(frag_count, 3);
+    shuffle(5);
+
+    net_buf_t *out = NULL;
+    for (int i = 0; i < frag_count; i++) {
+        const ipv6_frag_header_t *fh = (const ipv6_frag_header_t *)(void *)(frags[i].header + sizeof(ip));
+        CHECK_EQ(fh->next_header, NET_PROTO_UDP);
+        CHECK_EQ(net_reasm_ipv6(&reasm, (const ipv6_header_t *)(void *)frags[i].header, fh, frags[i].buf, &out),
+                 NET_OK);
+    }
+    CHECK(chain_equals(out, payload, sizeof(payload)));
+    net_buf_unref(out);
+}
+
+/** One fragment of datagram id, payload bytes [offset, offset + len) all set to tag. */
+static int add(uint32_t id, uint32_t offset, uint32_t len, int more, uint8_t tag, net_buf_t **out) {
+    static const uint8_t src[16] = { 10, 0, 0, 1 }, dest[16] = { 10, 0, 0, 2 };
+    net_buf_t *buf = net_buf_alloc(&pool, (uint16_t)len);
+
+    memset(net_buf_put(buf, (uint16_t)len), tag, len);
+    return net_reasm_add(&reasm, 4, src, dest, id, NET_PROTO_UDP, offset, more, buf, out);
+}
+
+/** Completes datagram id with A/B tagged fragments and checks the result against expected. */
+static void check_overlap(uint32_t id, const char *expected) {
+    uint32_t len = (uint32_t)strlen(expected);
+    net_buf_t *out = NULL;
+
+    CHECK_EQ(add(id, len, 8, 0, 'Z', &out), NET_OK);
+    CHECK(out != NULL);
+
+    uint8_t want[64];
+    memcpy(want, expected, len);
+    memset(want + len, 'Z', 8);
+    CHECK(chain_equals(out, want, len + 8));
+    net_buf_unref(out);
+}
+
+static void test_ipv4_overlap_keeps_first(void) {
+    net_buf_t *out;
+    uint32_t overlaps = reasm.stats.overlaps;
+
+    // Newcomer overlaps the tail of the fragment before: trimmed at the front.
+    add(1, 0, 16, 1, 'A', &out);
+    add(1, 8, 16, 1, 'B', &out);
+    check_overlap(1, "AAAAAAAAAAAAAAAABBBBBBBB");
+
+    // Newcomer overlaps the head of the fragment after: trimmed at the back.
+    add(2, 16, 16, 1, 'A', &out);
+    add(2, 8, 16, 1, 'B', &out);
+    add(2, 0, 8, 1, 'C', &out);
+    check_overlap(2, "CCCCCCCCBBBBBBBBAAAAAAAAAAAAAAAA");
+
+    // Newcomer entirely inside held data: dropped.
+    add(3, 0, 32, 1, 'A', &out);
+    add(3, 8, 8, 1, 'B', &out);
+    check_overlap(3, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA");
+
+    // Newcomer spanning held fragments with gaps around them: the held bytes survive.
+    add(4, 8, 8, 1, 'A', &out);
+    add(4, 24, 8, 1, 'A', &out);
+    add(4, 0, 40, 1, 'B', &out);
+    check_overlap(4, "BBBBBBBBAAAAAAAABBBBBBBBAAAAAAAABBBBBBBB");
+
+    // Exact duplicate.
+    add(5, 0, 16, 1, 'A', &out);
+    add(5, 0, 16, 1, 'B', &out);
+    check_overlap(5, "AAAAAAAAAAAAAAAA");
+
+    CHECK_EQ(reasm.stats.overlaps - overlaps, 6);
+}
+
+static void test_ipv6_overlap_and_atomic(void) {
+    static const uint8_t src[16] = { 0xFE, 0x80 }, dest[16] = { 0xFE, 0x81 };
+    net_buf_t *out, *buf;
+    uint32_t dropped = reasm.stats.dropped;
+
+    buf = net_buf_alloc(&pool, 16);
+    net_buf_put(buf, 16);
+    CHECK_EQ(net_reasm_add(&reasm, 6, src, dest, 9, NET_PROTO_UDP, 0, 1, buf, &out), NET_OK);
+    buf = net_buf_alloc(&pool, 16);
+    net_buf_put(buf, 16);
+    CHECK_EQ(net_reasm_add(&reasm, 6, src, dest, 9, NET_PROTO_UDP, 8, 1, buf, &out), NET_ERR_MALFORMED);
+    CHECK_EQ(reasm.stats.dropped - dropped, 1);
+
+    // Offset 0 and no M flag is atomic whatever the reserved bits hold (RFC 6946).
+    ipv6_header_t ip;
+    ipv6_frag_header_t fh;
+    memset(&ip, 0, sizeof(ip));
+    memset(&fh, 0, sizeof(fh));
+    fh.next_header = NET_PROTO_UDP;
+
+    buf = net_buf_alloc(&pool, 16);
+    net_buf_put(buf, 16);
+    NET_SET_BE16(&fh, ipv6_frag_header_t, offset_flags, 0x0006);
+    CHECK_EQ(net_reasm_ipv6(&reasm, &ip, &fh, buf, &out), NET_OK);
+    CHECK(out == buf);
+    net_buf_unref(out);
+
+    // With the M flag it is a real first fragment and is held.
+    buf = net_buf_alloc(&pool, 16);
+    net_buf_put(buf, 16);
+    NET_SET_BE16(&fh, ipv6_frag_header_t, offset_flags, IPV6_FRAG_MF | 0x0006);
+    CHECK_EQ(net_reasm_ipv6(&reasm, &ip, &fh, buf, &out), NET_OK);
+    CHECK(out == NULL);
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    net_pool_init(&pool);
+    net_reasm_init(&reasm, contexts, 4, NET_REASM_TIMEOUT_MS);
+
+    test_ipv4_out_of_order();
+    test_ipv6_out_of_order();
+    test_ipv4_overlap_keeps_first();
+    test_ipv6_overlap_and_atomic();
+
+    // The held IPv6 fragment times out; then every buffer is back in the pool.
+    net_reasm_tick(&reasm, NET_REASM_TIMEOUT_MS + 1);
+    CHECK_EQ(net_reasm_expire(&reasm), 1);
+    CHECK_EQ(slabs[0].available, BUFFERS);
+    CHECK_EQ(reasm.stats.completed, 14);
+
+    return HOST_TEST_RESULT();
+}
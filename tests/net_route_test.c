@@ -0,0 +1,172 @@
+/**
+ * Host test and benchmark of net_route.h. Random IPv4 and IPv6 tables, with the
+ * prefix-length mix of real BGP/IGP tables, are checked against a linear
+ * longest-prefix scan before and after incremental deletes; lookups are timed
+ * at 1k and 10k IPv4 and 1k and 5k IPv6 routes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "net_route.h"
+
+#define QUERIES 4096 // Power of two
+
+typedef struct {
+    uint8_t prefix[16];
+    uint8_t len;
+    uint8_t hop;
+    uint8_t live;
+} route_t;
+
+static uint32_t next_random(void) {
+    static uint64_t s = 88172645463325252ull;
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return (uint32_t)s;
+}
+
+static int prefix_match(const uint8_t *addr, const uint8_t *prefix, int len) {
+    for (int i = 0; i < len; i++) {
+        int shift = 7 - (i & 7);
+        if (((addr[i >> 3] >> shift) & 1) != ((prefix[i >> 3] >> shift) & 1))
+            return 0;
+    }
+    return 1;
+}
+
+/** Linear longest-prefix match; a later duplicate replaced an earlier one, as in the table. */
+static uint8_t reference_lookup(const route_t *routes, int count, const uint8_t *addr) {
+    int best = -1;
+    uint8_t hop = NET_ROUTE_NONE;
+
+    for (int i = 0; i < count; i++) {
+        if (routes[i].live && routes[i].len >= best && prefix_match(addr, routes[i].prefix, routes[i].len)) {
+            best = routes[i].len;
+            hop = routes[i].hop;
+        }
+    }
+    return hop;
+}
+
+/** IPv4: mostly /24, then /16-/23, a few short aggregates. */
+static uint8_t ipv4_length(void) {
+    uint32_t x = next_random() % 100;
+    return (uint8_t)(x < 55 ? 24 : x < 65 ? 22 : x < 75 ? 23 : x < 85 ? 20 + next_random() % 2
+                     : x < 95 ? 16 + next_random() % 4 : 8 + next_random() % 8);
+}
+
+/** IPv6: mostly /48 and /32 under 2000::/14, some /29-/47 and longer. */
+static uint8_t ipv6_length(void) {
+    uint32_t x = next_random() % 100;
+    return (uint8_t)(x < 45 ? 48 : x < 70 ? 32 : x < 85 ? 40 + next_random() % 8
+                     : x < 95 ? 29 + next_random() % 3 : 56 + next_random() % 9);
+}
+
+static void check_queries(const net_route_table_t *table, const route_t *routes, int count,
+                          uint8_t queries[][16]) {
+    int mismatches = 0;
+    for (int q = 0; q < QUERIES; q++)
+        mismatches += net_route_lookup(table, queries[q]) != reference_lookup(routes, count, queries[q]);
+    CHECK_EQ(mismatches, 0);
+}
+
+static void run(uint8_t bits, int count, uint32_t node_count) {
+    static uint8_t queries[QUERIES][16];
+    net_route_node_t *nodes = malloc(sizeof(*nodes) * node_count);
+    route_t *routes = calloc((size_t)count, sizeof(*routes));
+    net_route_table_t table;
+
+    CHECK_EQ(net_route_init(&table, nodes, node_count, bits), NET_OK);
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < bits / 8; j++)
+            routes[i].prefix[j] = (uint8_t)next_random();
+        if (bits == 128) {
+            routes[i].prefix[0] = 0x20;
+            routes[i].prefix[1] = (uint8_t)(next_random() % 4);
+        }
+        routes[i].len = bits == 32 ? ipv4_length() : ipv6_length();
+        routes[i].hop = (uint8_t)(1 + next_random() % 255);
+        routes[i].live = 1;
+    }
+
+    uint64_t start = host_test_now_ns();
+    for (int i = 0; i < count; i++)
+        CHECK_EQ(net_route_add(&table, routes[i].prefix, routes[i].len, routes[i].hop), NET_OK);
+    double add = (double)(host_test_now_ns() - start) / count;
+
+    // Nine in ten queries fall inside some route.
+    for (int q = 0; q < QUERIES; q++) {
+        const route_t *r = &routes[next_random() % (uint32_t)count];
+        for (int j = 0; j < 16; j++)
+            queries[q][j] = (uint8_t)next_random();
+        if (next_random() % 10)
+            memcpy(queries[q], r->prefix, r->len / 8);
+    }
+    check_queries(&table, routes, count, queries);
+
+    const int lookups = 5000000;
+    volatile unsigned sink = 0;
+    start = host_test_now_ns();
+    for (int i = 0; i < lookups; i++)
+        sink += net_route_lookup(&table, queries[i & (QUERIES - 1)]);
+    double lookup = (double)(host_test_now_ns() - start) / lookups;
+
+    printf("IPv%d %5d routes: %5u nodes (%6.1f KB), add %4.0f ns, lookup %5.1f ns\n", bits == 32 ? 4 : 6, count,
+           (unsigned)table.nodes_used, table.nodes_used * sizeof(net_route_node_t) / 1024.0, add, lookup);
+
+    // Incremental update: delete every other route (and its duplicates), re-check.
+    for (int i = 0; i < count; i += 2) {
+        int rc = net_route_delete(&table, routes[i].prefix, routes[i].len);
+        CHECK(rc == NET_OK || (rc == NET_ERR_NOT_FOUND && !routes[i].live));
+        for (int k = 0; k < count; k++)
+            if (routes[k].len == routes[i].len && prefix_match(routes[k].prefix, routes[i].prefix, routes[i].len))
+                routes[k].live = 0;
+    }
+    check_queries(&table, routes, count, queries);
+
+    for (int i = 0; i < count; i++)
+        net_route_delete(&table, routes[i].prefix, routes[i].len);
+    CHECK_EQ(table.routes, 0);
+    CHECK_EQ(table.nodes_used, 1);
+
+    free(nodes);
+    free(routes);
+}
+
+static void test_exhaustion_and_default(void) {
+    net_route_node_t nodes[3];
+    net_route_table_t table;
+    uint8_t host[4] = { 10, 1, 2, 3 };
+
+    net_route_init(&table, nodes, 3, 32);
+
+    // A /32 needs more nodes than there are: refused, table unchanged.
+    CHECK_EQ(net_route_add(&table, host, 32, 1), NET_ERR_FULL);
+    CHECK_EQ(table.nodes_used, 1);
+    CHECK_EQ(net_route_lookup(&table, host), NET_ROUTE_NONE);
+
+    CHECK_EQ(net_route_add(&table, host, 0, 9), NET_OK);
+    CHECK_EQ(net_route_lookup(&table, host), 9);
+    CHECK_EQ(net_route_add_ipv4(&table, IPV4_ADDR(10, 0, 0, 0), 8, 4), NET_OK);
+    CHECK_EQ(net_route_lookup_ipv4(&table, IPV4_ADDR(10, 200, 0, 1)), 4);
+    CHECK_EQ(net_route_lookup_ipv4(&table, IPV4_ADDR(11, 0, 0, 1)), 9);
+    CHECK_EQ(net_route_delete_ipv4(&table, IPV4_ADDR(10, 0, 0, 0), 8), NET_OK);
+    CHECK_EQ(net_route_delete_ipv4(&table, IPV4_ADDR(10, 0, 0, 0), 8), NET_ERR_NOT_FOUND);
+    CHECK_EQ(net_route_lookup_ipv4(&table, IPV4_ADDR(10, 200, 0, 1)), 9);
+}
+
+int main(void) {
+    test_exhaustion_and_default();
+
+    run(32, 1000, 8192);
+    run(32, 10000, 65535);
+    run(128, 1000, 65535);
+    run(128, 5000, 65535);
+
+    return HOST_TEST_RESULT();
+}
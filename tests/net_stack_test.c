@@ -0,0 +1,234 @@
+/**
+ * Host test of net_stack.h: two stacks joined by a loopback link that queues
+ * frames in both directions, exercising ARP resolution and expiry, UDP delivery
+ * and port demux, and the drop paths for damaged or unwanted frames.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "net_stack.h"
+
+#define LINK_DEPTH 8
+
+/** One direction of the loopback link: frames wait here until pumped. */
+typedef struct {
+    uint8_t frames[LINK_DEPTH][NET_ETH_MTU + sizeof(eth_header_t)];
+    uint16_t lengths[LINK_DEPTH];
+    int count;
+    net_stack_t *to;
+} link_queue_t;
+
+NET_SLAB_DEFINE(small, 8, 256);
+static net_slab_t slabs[] = { NET_SLAB_INIT(small) };
+static net_pool_t pool = { slabs, 1 };
+
+static net_stack_t a, b;
+static net_arp_entry_t arp_a[4], arp_b[4];
+static net_udp_port_t ports_a[2], ports_b[2];
+static link_queue_t a_to_b, b_to_a;
+static int last_result;
+
+static int link_tx(void *ctx, const uint8_t *frame, uint16_t len) {
+    link_queue_t *q = (link_queue_t *)ctx;
+
+    if (q->count == LINK_DEPTH || len > sizeof(q->frames[0]))
+        return NET_ERR_LINK;
+
+    memcpy(q->frames[q->count], frame, len);
+    q->lengths[q->count++] = len;
+    return NET_OK;
+}
+
+/** Delivers queued frames (and any they provoke) until both directions are idle. */
+static int pump(void) {
+    int delivered = 0;
+
+    while (a_to_b.count || b_to_a.count) {
+        link_queue_t *q = a_to_b.count ? &a_to_b : &b_to_a;
+        uint8_t frame[sizeof(q->frames[0])];
+        uint16_t len = q->lengths[0];
+
+        memcpy(frame, q->frames[0], len);
+        q->count--;
+        memmove(q->frames[0], q->frames[1], sizeof(q->frames[0]) * q->count);
+        memmove(q->lengths, q->lengths + 1, sizeof(q->lengths[0]) * q->count);
+
+        last_result = net_stack_input(q->to, frame, len);
+        delivered++;
+    }
+
+    return delivered;
+}
+
+typedef struct {
+    int count;
+    ipv4_addr_t src;
+    uint16_t src_port;
+    uint16_t dest_port;
+    char data[64];
+    uint16_t len;
+} received_t;
+
+static void on_datagram(void *ctx, ipv4_addr_t src, uint16_t src_port, uint16_t dest_port, const uint8_t *data,
+                        uint16_t len) {
+    received_t *r = (received_t *)ctx;
+
+    r->count++;
+    r->src = src;
+    r->src_port = src_port;
+    r->dest_port = dest_port;
+    r->len = len < sizeof(r->data) ? len : sizeof(r->data);
+    memcpy(r->data, data, r->len);
+}
+
+static net_buf_t *datagram(const char *text) {
+    net_buf_t *buf = net_buf_alloc(&pool, 64);
+    memcpy(net_buf_put(buf, (uint16_t)strlen(text)), text, strlen(text));
+    return buf;
+}
+
+static void setup(void) {
+    static const uint8_t mac_a[6] = { 2, 0, 0, 0, 0, 1 }, mac_b[6] = { 2, 0, 0, 0, 0, 2 };
+
+    memset(&a_to_b, 0, sizeof(a_to_b));
+    memset(&b_to_a, 0, sizeof(b_to_a));
+    a_to_b.to = &b;
+    b_to_a.to = &a;
+
+    net_pool_init(&pool);
+    net_stack_init(&a, mac_a, IPV4_ADDR(10, 0, 0, 1), IPV4_ADDR(255, 255, 255, 0), IPV4_ADDR(10, 0, 0, 254), link_tx,
+                   &a_to_b, arp_a, 4, ports_a, 2);
+    net_stack_init(&b, mac_b, IPV4_ADDR(10, 0, 0, 2), IPV4_ADDR(255, 255, 255, 0), IPV4_ADDR(10, 0, 0, 254), link_tx,
+                   &b_to_a, arp_b, 4, ports_b, 2);
+}
+
+static void test_arp_then_delivery(void) {
+    received_t got;
+    memset(&got, 0, sizeof(got));
+    setup();
+
+    CHECK_EQ(net_udp_bind(&b, 5000, on_datagram, &got), NET_OK);
+
+    // Unknown next hop: an ARP request goes out, the reply teaches A the MAC.
+    net_buf_t *buf = datagram("hello");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1234, 5000, buf), NET_ERR_ARP_PENDING);
+    CHECK_EQ(buf->len, 5);
+    CHECK_EQ(pump(), 2);
+    CHECK_EQ(a.stats.arp_misses, 1);
+    CHECK(net_arp_find(&a, IPV4_ADDR(10, 0, 0, 2)) != NULL);
+    CHECK(net_arp_find(&b, IPV4_ADDR(10, 0, 0, 1)) != NULL);
+
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1234, 5000, buf), NET_OK);
+    CHECK_EQ(pump(), 1);
+    CHECK_EQ(last_result, NET_OK);
+    CHECK_EQ(got.count, 1);
+    CHECK(ipv4_equal(got.src, IPV4_ADDR(10, 0, 0, 1)));
+    CHECK_EQ(got.src_port, 1234);
+    CHECK_EQ(got.dest_port, 5000);
+    CHECK(got.len == 5 && memcmp(got.data, "hello", 5) == 0);
+    net_buf_unref(buf);
+
+    // B learnt A from the request, so its reply needs no ARP round trip.
+    received_t reply;
+    memset(&reply, 0, sizeof(reply));
+    CHECK_EQ(net_udp_bind(&a, 1234, on_datagram, &reply), NET_OK);
+    buf = datagram("ack");
+    CHECK_EQ(net_udp_send(&b, IPV4_ADDR(10, 0, 0, 1), 5000, 1234, buf), NET_OK);
+    net_buf_unref(buf);
+    CHECK_EQ(pump(), 1);
+    CHECK_EQ(reply.count, 1);
+
+    // Limited broadcast needs no ARP.
+    buf = datagram("all");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR_BROADCAST, 1, 5000, buf), NET_OK);
+    net_buf_unref(buf);
+    CHECK_EQ(pump(), 1);
+    CHECK_EQ(got.count, 2);
+
+    // Entries expire; the next send resolves again.
+    net_stack_tick(&a, NET_ARP_TIMEOUT_MS + 1);
+    buf = datagram("late");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1234, 5000, buf), NET_ERR_ARP_PENDING);
+    net_buf_unref(buf);
+    pump();
+    CHECK_EQ(a.stats.arp_misses, 2);
+}
+
+static void test_off_link_uses_gateway(void) {
+    setup();
+
+    net_buf_t *buf = datagram("far");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(192, 0, 2, 7), 1, 2, buf), NET_ERR_ARP_PENDING);
+    net_buf_unref(buf);
+
+    // The request asks for the gateway, which nobody on this link answers.
+    const arp_packet_t *arp = (const arp_packet_t *)(a_to_b.frames[0] + sizeof(eth_header_t));
+    CHECK(ipv4_equal(arp->tpa, IPV4_ADDR(10, 0, 0, 254)));
+    CHECK_EQ(pump(), 1);
+    CHECK_EQ(last_result, NET_ERR_NOT_FOR_US);
+    CHECK(net_arp_find(&b, IPV4_ADDR(10, 0, 0, 1)) == NULL);
+}
+
+static void test_drops(void) {
+    received_t got;
+    memset(&got, 0, sizeof(got));
+    setup();
+    net_udp_bind(&b, 5000, on_datagram, &got);
+
+    net_buf_t *buf = datagram("x");
+    net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1, 5000, buf);
+    pump();
+    net_buf_unref(buf);
+
+    // No handler on the port.
+    buf = datagram("nobody");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1, 6000, buf), NET_OK);
+    net_buf_unref(buf);
+    pump();
+    CHECK_EQ(last_result, NET_ERR_NO_PORT);
+
+    // A flipped payload bit fails the UDP checksum; a flipped header bit the IPv4 one.
+    buf = datagram("damaged");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1, 5000, buf), NET_OK);
+    net_buf_unref(buf);
+    a_to_b.frames[0][a_to_b.lengths[0] - 1] ^= 0x01;
+    pump();
+    CHECK_EQ(last_result, NET_ERR_CHECKSUM);
+
+    buf = datagram("damaged");
+    CHECK_EQ(net_udp_send(&a, IPV4_ADDR(10, 0, 0, 2), 1, 5000, buf), NET_OK);
+    net_buf_unref(buf);
+    a_to_b.frames[0][sizeof(eth_header_t) + 8] ^= 0x01; // TTL
+    pump();
+    CHECK_EQ(last_result, NET_ERR_CHECKSUM);
+
+    // Truncated frames.
+    uint8_t runt[10] = { 0 };
+    CHECK_EQ(net_stack_input(&b, runt, sizeof(runt)), NET_ERR_MALFORMED);
+
+    CHECK_EQ(got.count, 0);
+    CHECK_EQ(b.stats.rx_dropped, 4);
+}
+
+static void test_port_table(void) {
+    received_t got;
+    setup();
+
+    CHECK_EQ(net_udp_bind(&a, 0, on_datagram, &got), NET_ERR_MALFORMED);
+    CHECK_EQ(net_udp_bind(&a, 1, on_datagram, &got), NET_OK);
+    CHECK_EQ(net_udp_bind(&a, 1, on_datagram, &got), NET_ERR_MALFORMED);
+    CHECK_EQ(net_udp_bind(&a, 2, on_datagram, &got), NET_OK);
+    CHECK_EQ(net_udp_bind(&a, 3, on_datagram, &got), NET_ERR_FULL);
+    net_udp_unbind(&a, 1);
+    CHECK_EQ(net_udp_bind(&a, 3, on_datagram, &got), NET_OK);
+}
+
+int main(void) {
+    test_arp_then_delivery();
+    test_off_link_uses_gateway();
+    test_drops();
+    test_port_table();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,185 @@
+/**
+ * Host test and benchmark of the address helpers in network.h. Word-wise
+ * equality, prefix comparison and list search are checked against byte-wise
+ * references on addresses that share long prefixes, then timed against the
+ * byte loops they replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+#include "network.h"
+
+#define ADDRESSES 4096 // Power of two
+#define ROUNDS 5000000
+
+/** The original byte-at-a-time comparisons, as the baseline. */
+static int bytewise_ipv4_equal(ipv4_addr_t a, ipv4_addr_t b) {
+    return a.bytes[0] == b.bytes[0] && a.bytes[1] == b.bytes[1] && a.bytes[2] == b.bytes[2] &&
+           a.bytes[3] == b.bytes[3];
+}
+
+static int bytewise_ipv6_equal(ipv6_addr_t a, ipv6_addr_t b) {
+    for (int i = 0; i < 16; i++)
+        if (a.bytes[i] != b.bytes[i])
+            return 0;
+    return 1;
+}
+
+static int bitwise_prefix_equal(const uint8_t *a, const uint8_t *b, int len) {
+    for (int i = 0; i < len; i++) {
+        int shift = 7 - (i & 7);
+        if (((a[i >> 3] >> shift) & 1) != ((b[i >> 3] >> shift) & 1))
+            return 0;
+    }
+    return 1;
+}
+
+static ipv4_addr_t v4[ADDRESSES];
+static ipv6_addr_t v6[ADDRESSES];
+
+static void test_against_references(void) {
+    // Few distinct values per byte, so equal addresses and long shared prefixes are common.
+    for (int i = 0; i < ADDRESSES; i++) {
+        for (int j = 0; j < 4; j++)
+            v4[i].bytes[j] = (uint8_t)(rand() % 4);
+        for (int j = 0; j < 16; j++)
+            v6[i].bytes[j] = (uint8_t)(j < 14 ? 0x20 : rand() % 4);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < ADDRESSES; i++) {
+        for (int k = 0; k < 16; k++) {
+            int j = rand() % ADDRESSES;
+            failures += bytewise_ipv4_equal(v4[i], v4[j]) != ipv4_equal(v4[i], v4[j]);
+            failures += bytewise_ipv6_equal(v6[i], v6[j]) != ipv6_equal(v6[i], v6[j]);
+
+            int len = rand() % 33;
+            failures += bitwise_prefix_equal(v4[i].bytes, v4[j].bytes, len) != ipv4_prefix_equal(v4[i], v4[j], len);
+
+            ipv6_addr_t x, y;
+            for (int b = 0; b < 16; b++) {
+                x.bytes[b] = (uint8_t)rand();
+                y.bytes[b] = (uint8_t)(rand() % 3 ? x.bytes[b] : rand());
+            }
+            len = rand() % 129;
+            failures += bitwise_prefix_equal(x.bytes, y.bytes, len) != ipv6_prefix_equal(x, y, len);
+        }
+    }
+    CHECK_EQ(failures, 0);
+
+    failures = 0;
+    for (int count = 0; count < 40; count++) {
+        for (int t = 0; t < 200; t++) {
+            ipv4_addr_t key = v4[rand() % ADDRESSES];
+            int expected = -1;
+            for (int i = 0; i < count && expected < 0; i++)
+                expected = bytewise_ipv4_equal(key, v4[i]) ? i : -1;
+            failures += ipv4_find(key, v4, count) != expected;
+
+            ipv6_addr_t key6 = v6[rand() % ADDRESSES];
+            expected = -1;
+            for (int i = 0; i < count && expected < 0; i++)
+                expected = bytewise_ipv6_equal(key6, v6[i]) ? i : -1;
+            failures += ipv6_find(&key6, v6, count) != expected;
+        }
+    }
+    CHECK_EQ(failures, 0);
+}
+
+static void test_classes(void) {
+    CHECK(ipv4_is_multicast(IPV4_ADDR(239, 1, 1, 1)));
+    CHECK(!ipv4_is_multicast(IPV4_ADDR(240, 0, 0, 1)));
+    CHECK(ipv4_is_link_local(IPV4_ADDR(169, 254, 3, 4)));
+    CHECK(ipv4_is_loopback(IPV4_ADDR(127, 0, 0, 9)));
+    CHECK(ipv4_is_broadcast(IPV4_ADDR_BROADCAST));
+    CHECK(ipv4_is_any(IPV4_ADDR_ANY));
+    CHECK(ipv4_is_subnet_broadcast(IPV4_ADDR(192, 168, 1, 255), IPV4_ADDR(255, 255, 255, 0)));
+    CHECK(!ipv4_is_subnet_broadcast(IPV4_ADDR(192, 168, 1, 254), IPV4_ADDR(255, 255, 255, 0)));
+
+    CHECK(ipv6_is_multicast(IPV6_ADDR(0xFF, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1)));
+    CHECK(ipv6_is_link_local(IPV6_ADDR(0xFE, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1)));
+    CHECK(!ipv6_is_link_local(IPV6_ADDR(0xFE, 0xC0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1)));
+    CHECK(ipv6_is_loopback(IPV6_ADDR_LOOPBACK));
+    CHECK(ipv6_is_any(IPV6_ADDR_ANY));
+    CHECK(ipv6_is_v4_mapped(IPV6_ADDR(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 1, 2, 3, 4)));
+}
+
+static void bench(void) {
+    volatile int sink = 0;
+    uint64_t start;
+
+    // Realistic addresses: one /8 for IPv4, one /96 for IPv6, so IPv6 pairs differ only at the end.
+    for (int i = 0; i < ADDRESSES; i++) {
+        v4[i] = u32_to_ipv4(0x0A000000u + (uint32_t)rand() % 0x1000000u);
+        for (int j = 0; j < 16; j++)
+            v6[i].bytes[j] = (uint8_t)(j == 0 ? 0x20 : j < 12 ? 0 : rand());
+    }
+
+    double ns[4];
+    start = host_test_now_ns();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += bytewise_ipv4_equal(v4[i & (ADDRESSES - 1)], v4[(i * 7) & (ADDRESSES - 1)]);
+    ns[0] = (double)(host_test_now_ns() - start) / ROUNDS;
+    start = host_test_now_ns();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += ipv4_equal(v4[i & (ADDRESSES - 1)], v4[(i * 7) & (ADDRESSES - 1)]);
+    ns[1] = (double)(host_test_now_ns() - start) / ROUNDS;
+    start = host_test_now_ns();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += bytewise_ipv6_equal(v6[i & (ADDRESSES - 1)], v6[(i * 7) & (ADDRESSES - 1)]);
+    ns[2] = (double)(host_test_now_ns() - start) / ROUNDS;
+    start = host_test_now_ns();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += ipv6_equal(v6[i & (ADDRESSES - 1)], v6[(i * 7) & (ADDRESSES - 1)]);
+    ns[3] = (double)(host_test_now_ns() - start) / ROUNDS;
+
+    printf("equal: IPv4 bytewise %.2f ns, word %.2f ns | IPv6 bytewise %.2f ns, word %.2f ns\n", ns[0], ns[1], ns[2],
+           ns[3]);
+
+    static const int lengths[] = { 8, 64, 256 };
+    for (int l = 0; l < 3; l++) {
+        int count = lengths[l], queries = ROUNDS / count;
+
+        start = host_test_now_ns();
+        for (int q = 0; q < queries; q++) {
+            ipv4_addr_t key = v4[(q * 13) & (ADDRESSES - 1)];
+            int found = -1;
+            for (int i = 0; i < count && found < 0; i++)
+                found = bytewise_ipv4_equal(key, v4[i]) ? i : -1;
+            sink += found;
+        }
+        ns[0] = (double)(host_test_now_ns() - start) / queries;
+        start = host_test_now_ns();
+        for (int q = 0; q < queries; q++)
+            sink += ipv4_find(v4[(q * 13) & (ADDRESSES - 1)], v4, count);
+        ns[1] = (double)(host_test_now_ns() - start) / queries;
+        start = host_test_now_ns();
+        for (int q = 0; q < queries; q++) {
+            ipv6_addr_t key = v6[(q * 13) & (ADDRESSES - 1)];
+            int found = -1;
+            for (int i = 0; i < count && found < 0; i++)
+                found = bytewise_ipv6_equal(key, v6[i]) ? i : -1;
+            sink += found;
+        }
+        ns[2] = (double)(host_test_now_ns() - start) / queries;
+        start = host_test_now_ns();
+        for (int q = 0; q < queries; q++)
+            sink += ipv6_find(&v6[(q * 13) & (ADDRESSES - 1)], v6, count);
+        ns[3] = (double)(host_test_now_ns() - start) / queries;
+
+        printf("allow-list of %3d: IPv4 loop %6.1f ns, find %6.1f ns | IPv6 loop %6.1f ns, find %6.1f ns\n", count,
+               ns[0], ns[1], ns[2], ns[3]);
+    }
+}
+
+int main(void) {
+    srand(3);
+
+    test_against_references();
+    test_classes();
+    bench();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ErrorNo.h"
+
+// Host stand-in for codal-core's CodalComponent.h.
+
+namespace codal
+{
+    class CodalComponent
+    {
+    public:
+        uint16_t id;
+        uint16_t status;
+
+        CodalComponent() : id(0), status(0) {}
+        CodalComponent(uint16_t id, uint16_t status) : id(id), status(status) {}
+        virtual ~CodalComponent() {}
+    };
+} // namespace codal
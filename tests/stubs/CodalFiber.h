@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ErrorNo.h"
+
+// Host stand-in for codal-core's CodalFiber.h. Tests that use the scheduler
+// entry points define them, e.g. fiber_sleep() advancing a simulated clock.
+
+namespace codal
+{
+    struct Fiber
+    {
+        void *tcb;
+        uint32_t stack_bottom;
+        uint32_t stack_top;
+        uint32_t context;
+        uint32_t flags;
+        void *queue;
+        Fiber *qnext;
+        Fiber *qprev;
+        Fiber *next;
+        Fiber *prev;
+    };
+
+    extern Fiber *currentFiber;
+
+    void fiber_sleep(unsigned long t);
+    void release_fiber(void);
+    void release_fiber(void *param);
+    Fiber *get_fiber_list();
+} // namespace codal
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ErrorNo.h"
+
+// Host stand-in for codal-core's I2C.h. Tests derive from it to fake a device.
+
+namespace codal
+{
+    class I2C
+    {
+    public:
+        virtual int write(uint16_t, uint8_t *, int, bool = false)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        virtual int read(uint16_t, uint8_t *, int, bool = false)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        virtual int readRegister(uint16_t, uint8_t, uint8_t *, int, bool = false)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        virtual ~I2C() {}
+    };
+} // namespace codal
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ErrorNo.h"
+
+// Host stand-in for codal-core's SPI.h. Tests derive from it to fake a device.
+
+namespace codal
+{
+    class SPI
+    {
+    public:
+        virtual int write(int)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        virtual int read(uint8_t *, int)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        virtual ~SPI() {}
+    };
+} // namespace codal
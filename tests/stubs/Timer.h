@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for codal-core's Timer.h. Tests define the clock.
+
+#ifndef CODAL_TIMESTAMP
+#define CODAL_TIMESTAMP uint64_t
+#endif
+
+namespace codal
+{
+    CODAL_TIMESTAMP system_timer_current_time_us();
+} // namespace codal